@@ -6,7 +6,7 @@
 
 QT       += core gui sql network
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
 
 TARGET = Dota2_Replay_Manager_Gui
 TEMPLATE = app
@@ -16,16 +16,48 @@ SOURCES += main.cpp\
     edittitle.cpp \
     preferences.cpp \
     http.cpp \
+    httpcache.cpp \
+    jsonreader.cpp \
+    protoreader.cpp \
+    snappy.cpp \
+    demoheader.cpp \
+    demoreader.cpp \
+    bitreader.cpp \
+    replaytimeline.cpp \
     matchinfo.cpp \
-    thread.cpp \
+    matchcache.cpp \
+    matchstore.cpp \
+    replayindex.cpp \
+    replayscanner.cpp \
+    replayarchive.cpp \
+    replaydedup.cpp \
+    replaytablemodel.cpp \
+    replaysearch.cpp \
+    xxhash64.cpp \
     firstrun.cpp
 
 HEADERS  += mainwindow.h \
     edittitle.h \
     preferences.h \
     http.h \
+    httpcache.h \
+    jsonreader.h \
+    protoreader.h \
+    snappy.h \
+    demoheader.h \
+    demoreader.h \
+    bitreader.h \
+    replaytimeline.h \
     matchinfo.h \
-    thread.h \
+    matchcache.h \
+    matchstore.h \
+    replayindex.h \
+    replayscanner.h \
+    replayarchive.h \
+    replaydedup.h \
+    replaytablemodel.h \
+    replaysearch.h \
+    xxhash64.h \
     firstrun.h
 
 FORMS    += mainwindow.ui \
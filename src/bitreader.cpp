@@ -0,0 +1,116 @@
+#include "bitreader.h"
+
+#include <string.h>
+
+BitReader::BitReader(const uchar *data, qint64 size) :
+    data(data), totalBits(size * 8), position(0), failed(false)
+{
+}
+
+quint32 BitReader::readBits(int count)
+{
+    if(count <= 0)
+        return 0;
+
+    if(failed || count > 32 || bitsLeft() < count)
+    {
+        failed = true;
+        return 0;
+    }
+
+    //gather the (at most 5) bytes the bits span, then shift them into place
+    qint64 byte = position >> 3;
+    int shift = int(position & 7);
+    int needed = (shift + count + 7) >> 3;
+    quint64 value = 0;
+    for(int i = 0; i < needed; i++)
+        value |= quint64(data[byte + i]) << (8 * i);
+
+    position += count;
+    value >>= shift;
+    return count == 32 ? quint32(value) : quint32(value & ((quint64(1) << count) - 1));
+}
+
+quint32 BitReader::readUBitVar()
+{
+    quint32 value = readBits(6);
+    switch(value & 0x30)
+    {
+    case 16:
+        value = (value & 15) | (readBits(4) << 4);
+        break;
+    case 32:
+        value = (value & 15) | (readBits(8) << 4);
+        break;
+    case 48:
+        value = (value & 15) | (readBits(28) << 4);
+        break;
+    }
+
+    return value;
+}
+
+quint32 BitReader::readVarUInt32()
+{
+    quint32 value = 0;
+    for(int shift = 0; shift < 35; shift += 7)
+    {
+        quint32 byte = readBits(8);
+        value |= (byte & 0x7f) << shift;
+        if(!(byte & 0x80) || failed)
+            return value;
+    }
+
+    failed = true;
+    return 0;
+}
+
+bool BitReader::readBytes(qint64 count, QByteArray *out)
+{
+    if(failed || count < 0 || bitsLeft() < count * 8)
+    {
+        failed = true;
+        return false;
+    }
+
+    out->resize(int(count));
+    if((position & 7) == 0)
+    {
+        memcpy(out->data(), data + (position >> 3), size_t(count));
+        position += count * 8;
+        return true;
+    }
+
+    //not byte aligned, which is the usual case inside a packet
+    char *dest = out->data();
+    for(qint64 i = 0; i < count; i++)
+        dest[i] = char(readBits(8));
+
+    return !failed;
+}
+
+bool BitReader::skipBits(qint64 count)
+{
+    if(failed || count < 0 || bitsLeft() < count)
+    {
+        failed = true;
+        return false;
+    }
+
+    position += count;
+    return true;
+}
+
+QByteArray BitReader::readString()
+{
+    QByteArray string;
+    while(!failed)
+    {
+        char c = char(readBits(8));
+        if(c == 0)
+            break;
+        string.append(c);
+    }
+
+    return string;
+}
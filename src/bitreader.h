@@ -0,0 +1,33 @@
+#ifndef BITREADER_H
+#define BITREADER_H
+
+#include <QByteArray>
+
+/*
+ * Reads a buffer as a little endian bit stream, lowest bit first, which is how replay packets
+ * and string table updates are laid out. Reading past the end sets an error and returns zeros.
+ */
+class BitReader
+{
+public:
+    BitReader(const uchar *data, qint64 size);
+
+    quint32 readBits(int count);                                            //count <= 32
+    bool readBool() { return readBits(1) != 0; }
+    quint32 readUBitVar();                                                  //6 bits, extended by 4, 8 or 28 more
+    quint32 readVarUInt32();
+    bool readBytes(qint64 count, QByteArray *out);
+    bool skipBits(qint64 count);
+    QByteArray readString();                                                //up to the terminating 0
+
+    qint64 bitsLeft() const { return totalBits - position; }
+    bool hasError() const { return failed; }
+
+private:
+    const uchar *data;
+    qint64 totalBits;
+    qint64 position;
+    bool failed;
+};
+
+#endif // BITREADER_H
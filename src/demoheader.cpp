@@ -0,0 +1,213 @@
+#include "demoheader.h"
+#include "protoreader.h"
+#include "snappy.h"
+
+#include <QFile>
+#include <QFileInfo>
+
+#include <string.h>
+
+QString DemoInfo::gameModeName() const
+{
+    //DOTA_GameMode, in order
+    static const char *const names[] = {
+        "", "All Pick", "Captains Mode", "Random Draft", "Single Draft", "All Random", "Intro", "Diretide",
+        "Reverse Captains Mode", "Greeviling", "Tutorial", "Mid Only", "Least Played", "Limited Heroes",
+        "Compendium Matchmaking", "Custom", "Captains Draft", "Balanced Draft", "Ability Draft", "Event",
+        "All Random Death Match", "1v1 Mid", "All Draft", "Turbo", "Mutation"
+    };
+
+    if(gameMode < 0 || gameMode >= int(sizeof(names) / sizeof(names[0])))
+        return QString("Mode %1").arg(gameMode);
+
+    return QString(names[gameMode]);
+}
+
+QString DemoInfo::winnerName() const
+{
+    switch(winner)
+    {
+    case 2:
+        return "Radiant";
+    case 3:
+        return "Dire";
+    default:
+        return QString();
+    }
+}
+
+bool DemoHeader::read(const QString &fileName, DemoInfo *info)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    //8 byte magic and the offset of the file info block; source 2 adds a second offset we don't need
+    const qint64 fileSize = file.size();
+    if(fileSize < 12)
+        return false;
+
+    uchar *header = file.map(0, 12);
+    if(!header)
+        return false;
+
+    bool known = memcmp(header, "PBDEMS2\0", 8) == 0 || memcmp(header, "PBUFDEM\0", 8) == 0;
+    quint32 offset = header[8] | (header[9] << 8) | (header[10] << 16) | (quint32(header[11]) << 24);
+    file.unmap(header);
+
+    //a replay that is still being written has no file info yet
+    if(!known || offset < 12 || qint64(offset) >= fileSize)
+        return false;
+
+    qint64 length = qMin(fileSize - offset, qint64(MaxFileInfoSize));
+    uchar *block = file.map(offset, length);
+    if(!block)
+        return false;
+
+    bool ok = parseFileInfo(block, length, info);
+    file.unmap(block);
+
+    info->fileName = QFileInfo(fileName).fileName();
+    return ok;
+}
+
+/*
+ * A demo message is varint command, varint tick, varint size and the payload,
+ * which is snappy compressed if the command has DEM_IsCompressed set.
+ * The payload here is a CDemoFileInfo.
+ */
+bool DemoHeader::parseFileInfo(const uchar *data, qint64 size, DemoInfo *info)
+{
+    const uchar *p = data;
+    const uchar *end = data + size;
+    quint64 command, tick, length;
+    if(!ProtoReader::readVarint(&p, end, &command) || !ProtoReader::readVarint(&p, end, &tick)
+            || !ProtoReader::readVarint(&p, end, &length) || length > quint64(end - p))
+    {
+        return false;
+    }
+
+    if((command & ~quint64(DEM_IsCompressed)) != DEM_FileInfo)
+        return false;
+
+    QByteArray uncompressed;
+    if(command & DEM_IsCompressed)
+    {
+        if(!Snappy::uncompress(reinterpret_cast<const char *>(p), int(length), &uncompressed))
+            return false;
+
+        p = reinterpret_cast<const uchar *>(uncompressed.constData());
+        length = uncompressed.size();
+    }
+
+    ProtoReader reader(p, qint64(length));
+    while(reader.next())
+    {
+        qint64 fieldSize;
+        const uchar *field;
+
+        switch(reader.field())
+        {
+        case 1:     //playback_time
+            info->duration = int(reader.toFloat());
+            break;
+        case 4:     //game_info
+            field = reader.toBytes(&fieldSize);
+            if(field && !parseGameInfo(field, fieldSize, info))
+                return false;
+            break;
+        default:
+            reader.skip();
+        }
+    }
+
+    return !reader.hasError();
+}
+
+//CGameInfo, of which we only care for the dota part
+bool DemoHeader::parseGameInfo(const uchar *data, qint64 size, DemoInfo *info)
+{
+    ProtoReader reader(data, size);
+    while(reader.next())
+    {
+        if(reader.field() == 4)
+        {
+            qint64 fieldSize;
+            const uchar *field = reader.toBytes(&fieldSize);
+            if(field && !parseDotaGameInfo(field, fieldSize, info))
+                return false;
+        }
+        else
+        {
+            reader.skip();
+        }
+    }
+
+    return !reader.hasError();
+}
+
+//CGameInfo.CDotaGameInfo
+bool DemoHeader::parseDotaGameInfo(const uchar *data, qint64 size, DemoInfo *info)
+{
+    ProtoReader reader(data, size);
+    while(reader.next())
+    {
+        qint64 fieldSize;
+        const uchar *field;
+        DemoPlayer player;
+
+        switch(reader.field())
+        {
+        case 1:
+            info->matchID = reader.toVarint();
+            break;
+        case 2:
+            info->gameMode = int(reader.toVarint());
+            break;
+        case 3:
+            info->winner = int(reader.toVarint());
+            break;
+        case 4:     //player_info, one per player
+            field = reader.toBytes(&fieldSize);
+            if(!field || !parsePlayer(field, fieldSize, &player))
+                return false;
+            info->players.append(player);
+            break;
+        case 11:
+            info->endTime = quint32(reader.toVarint());
+            break;
+        default:
+            reader.skip();
+        }
+    }
+
+    return !reader.hasError();
+}
+
+//CGameInfo.CDotaGameInfo.CPlayerInfo
+bool DemoHeader::parsePlayer(const uchar *data, qint64 size, DemoPlayer *player)
+{
+    ProtoReader reader(data, size);
+    while(reader.next())
+    {
+        switch(reader.field())
+        {
+        case 1:
+            player->heroName = reader.toString();
+            break;
+        case 2:
+            player->playerName = reader.toString();
+            break;
+        case 4:
+            player->steamID = reader.toVarint();
+            break;
+        case 5:
+            player->team = int(reader.toVarint());
+            break;
+        default:
+            reader.skip();
+        }
+    }
+
+    return !reader.hasError();
+}
@@ -0,0 +1,59 @@
+#ifndef DEMOHEADER_H
+#define DEMOHEADER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMetaType>
+#include <QString>
+
+struct DemoPlayer
+{
+    DemoPlayer() : steamID(0), team(0) {}
+
+    QString playerName;
+    QString heroName;                                                       //npc_dota_hero_*
+    quint64 steamID;
+    int team;                                                               //2 = radiant, 3 = dire
+};
+
+//what a replay says about itself in its file info block
+struct DemoInfo
+{
+    DemoInfo() : matchID(0), gameMode(0), winner(0), endTime(0), duration(0) {}
+
+    QString fileName;
+    quint64 matchID;
+    int gameMode;
+    int winner;                                                             //2 = radiant, 3 = dire, 0 if unknown
+    quint32 endTime;                                                        //unix time
+    int duration;                                                           //seconds of playback
+    QList<DemoPlayer> players;
+
+    QString gameModeName() const;
+    QString winnerName() const;
+};
+
+Q_DECLARE_METATYPE(DemoInfo)
+
+/*
+ * Reads the file info block of a .dem replay without going through the rest of the file.
+ * The header at the start of the file holds the offset of the block, which sits near the end;
+ * both are read through a memory map, so only the few pages around them come off the disk.
+ * Handles Source 2 (PBDEMS2) and Source 1 (PBUFDEM) replays.
+ */
+class DemoHeader
+{
+public:
+    static bool read(const QString &fileName, DemoInfo *info);
+    static bool parseFileInfo(const uchar *data, qint64 size, DemoInfo *info);  //data starts at the file info message
+
+private:
+    enum { DEM_FileInfo = 2, DEM_IsCompressed = 64 };
+    enum { MaxFileInfoSize = 1024 * 1024 };
+
+    static bool parseGameInfo(const uchar *data, qint64 size, DemoInfo *info);
+    static bool parseDotaGameInfo(const uchar *data, qint64 size, DemoInfo *info);
+    static bool parsePlayer(const uchar *data, qint64 size, DemoPlayer *player);
+};
+
+#endif // DEMOHEADER_H
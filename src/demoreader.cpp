@@ -0,0 +1,122 @@
+#include "demoreader.h"
+#include "snappy.h"
+
+#include <string.h>
+
+DemoReader::DemoReader() :
+    source2(false), messageOffset(-1), payloadOffset(-1), payloadSize(0), payloadCompressed(false),
+    currentCommand(-1), currentTick(0), failed(false), stopped(false)
+{
+}
+
+bool DemoReader::open(const QString &fileName)
+{
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    //magic, file info offset, and on source 2 the spawn groups offset
+    char header[16];
+    if(file.read(header, 12) != 12)
+        return false;
+
+    if(memcmp(header, "PBDEMS2\0", 8) == 0)
+    {
+        source2 = true;
+        if(file.read(header + 12, 4) != 4)
+            return false;
+    }
+    else if(memcmp(header, "PBUFDEM\0", 8) != 0)
+    {
+        return false;
+    }
+
+    payloadOffset = file.pos();
+    return true;
+}
+
+bool DemoReader::readVarint(quint32 *value)
+{
+    quint32 result = 0;
+    for(int shift = 0; shift < 35; shift += 7)
+    {
+        char c;
+        if(!file.getChar(&c))
+            return false;
+
+        result |= quint32(uchar(c) & 0x7f) << shift;
+        if(!(uchar(c) & 0x80))
+        {
+            *value = result;
+            return true;
+        }
+    }
+
+    failed = true;
+    return false;
+}
+
+bool DemoReader::next()
+{
+    if(failed || stopped || payloadOffset < 0)
+        return false;
+
+    //skip whatever of the last payload wasn't read
+    qint64 nextOffset = messageOffset < 0 ? payloadOffset : payloadOffset + payloadSize;
+    if(file.pos() != nextOffset && !file.seek(nextOffset))
+    {
+        failed = true;
+        return false;
+    }
+
+    messageOffset = nextOffset;
+    quint32 command, tick;
+    //running out of file before DEM_Stop, here or in the payload, means the replay was cut off or is still being written
+    if(!readVarint(&command) || !readVarint(&tick) || !readVarint(&payloadSize))
+        return false;
+
+    payloadOffset = file.pos();
+    if(payloadOffset + payloadSize > file.size())
+        return false;
+
+    payloadCompressed = (command & DEM_IsCompressed) != 0;
+    currentCommand = int(command & ~quint32(DEM_IsCompressed));
+    currentTick = int(tick);                                                //signon messages have tick -1
+    stopped = currentCommand == DEM_Stop;
+    return !stopped;
+}
+
+bool DemoReader::readPayload(QByteArray *out)
+{
+    if(failed || messageOffset < 0 || file.pos() != payloadOffset)
+        return false;
+
+    QByteArray &raw = payloadCompressed ? compressed : *out;
+    raw.resize(int(payloadSize));
+    if(file.read(raw.data(), payloadSize) != qint64(payloadSize))
+    {
+        failed = true;
+        return false;
+    }
+
+    if(payloadCompressed && !Snappy::uncompress(compressed.constData(), compressed.size(), out))
+    {
+        failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+bool DemoReader::seek(qint64 offset)
+{
+    if(!file.seek(offset))
+        return false;
+
+    failed = false;
+    stopped = false;
+    messageOffset = -1;
+    payloadOffset = offset;
+    payloadSize = 0;
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef DEMOREADER_H
+#define DEMOREADER_H
+
+#include <QByteArray>
+#include <QFile>
+
+/*
+ * Walks the messages of a .dem replay one at a time, straight off the disk.
+ * Only the current message is ever in memory, and payloads nobody asks for are skipped with a seek,
+ * so a replay of any size is read in a small, fixed amount of memory.
+ */
+class DemoReader
+{
+public:
+    enum Command {
+        DEM_Stop = 0, DEM_FileHeader = 1, DEM_FileInfo = 2, DEM_SyncTick = 3, DEM_SendTables = 4,
+        DEM_ClassInfo = 5, DEM_StringTables = 6, DEM_Packet = 7, DEM_SignonPacket = 8, DEM_ConsoleCmd = 9,
+        DEM_UserCmd = 12, DEM_FullPacket = 13, DEM_SaveGame = 14, DEM_SpawnGroups = 15,
+        DEM_IsCompressed = 64
+    };
+
+    DemoReader();
+
+    bool open(const QString &fileName);
+    bool isSource2() const { return source2; }
+
+    bool next();                                                            //steps to the next message, false at the end or on error
+    int command() const { return currentCommand; }                          //without DEM_IsCompressed
+    int tick() const { return currentTick; }
+    qint64 offset() const { return messageOffset; }                         //where the current message starts
+    bool readPayload(QByteArray *out);                                      //the current message's payload, uncompressed
+    bool seek(qint64 offset);                                               //to a message start taken from offset()
+    bool hasError() const { return failed; }
+    bool reachedStop() const { return stopped; }                            //next() ended on DEM_Stop, not on a cut off file
+
+private:
+    bool readVarint(quint32 *value);
+
+    QFile file;
+    QByteArray compressed;                                                  //reused for every compressed payload
+    bool source2;
+    qint64 messageOffset;
+    qint64 payloadOffset;
+    quint32 payloadSize;
+    bool payloadCompressed;
+    int currentCommand;
+    int currentTick;
+    bool failed;
+    bool stopped;
+};
+
+#endif // DEMOREADER_H
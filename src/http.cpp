@@ -6,34 +6,127 @@
 #include <QString>
 #include <QStringList>
 #include <QTimer>
-#include "thread.h"
 
-Http::Http(QObject *parent) : QObject(parent), downloadCount(0), totalCount(0)
+#ifdef Q_OS_WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+static const char *apiHost = "computerfr33k-dota-2-replay-manager.p.mashape.com";
+
+Http::Http(QObject *parent) : QObject(parent), downloadCount(0), notModifiedCount(0), totalCount(0), coalesced(0), lastToken(0), maxConnections(8), maxConnectionsPerHost(6), nextDownloadScheduled(false), busy(false)
 {
     manager = new QNetworkAccessManager(this);
+    chunk.resize(ChunkSize);
     downloadsDir = QStandardPaths::standardLocations(QStandardPaths::DataLocation).at(0) + "/downloads";
+
+    //the api is rate limited, so keep it to a couple of connections. Images come from the steam cdn and can use more.
+    hostLimits.insert(apiHost, 2);
 }
 Http::~Http()
 {
+    foreach(Download download, activeDownloads)
+    {
+        download.reply->disconnect(this);
+        download.reply->abort();
+        interruptDownload(download.reply, download);
+    }
+    activeDownloads.clear();
+    HttpCache::instance()->save();
+
     delete manager;
 }
 
-void Http::append(const QUrl &url)
+void Http::append(const QUrl &url, Priority priority, int token)
 {
-    if(downloadQueue.isEmpty())
-        QTimer::singleShot(0, this, SLOT(startNextDownload()));
-
-    downloadQueue.enqueue(url);
     ++totalCount;
+
+    //the same icon is often asked for several times by one match, only fetch it once
+    if(pendingDownloads.contains(url))
+    {
+        Pending &pending = pendingDownloads[url];
+        pending.tokens.append(token);
+        ++coalesced;
+
+        //someone more urgent wants it, move it up if it hasn't started yet
+        if(priority < pending.priority)
+        {
+            if(downloadQueue[pending.priority].removeOne(url))
+                downloadQueue[priority].enqueue(url);
+            pending.priority = priority;
+            scheduleNextDownload();
+        }
+        return;
+    }
+
+    Pending pending;
+    pending.priority = priority;
+    pending.tokens.append(token);
+    pendingDownloads.insert(url, pending);
+    downloadQueue[priority].enqueue(url);
+    busy = true;
+
+    scheduleNextDownload();
 }
 
-void Http::append(const QStringList &urlList)
+void Http::append(const QStringList &urlList, Priority priority, int token)
 {
     foreach(QString url, urlList)
-        append(QUrl::fromEncoded(url.toLocal8Bit()));
+        append(QUrl::fromEncoded(url.toLocal8Bit()), priority, token);
+}
 
-    if(downloadQueue.isEmpty())
-        QTimer::singleShot(0, this, SIGNAL(finished()));
+int Http::createToken()
+{
+    return ++lastToken;
+}
+
+/*
+ * Drops every append tagged with token.
+ * Urls nobody else is waiting on are taken out of the queue, or aborted if they are already on the wire.
+ */
+void Http::cancel(int token)
+{
+    if(token == 0)
+        return;
+
+    QList<QUrl> cancelled;
+    for(QHash<QUrl, Pending>::iterator it = pendingDownloads.begin(); it != pendingDownloads.end(); ++it)
+    {
+        it.value().tokens.removeAll(token);
+        if(it.value().tokens.isEmpty())
+            cancelled.append(it.key());
+    }
+
+    //take everything off the queues before aborting anything.
+    //an abort finishes its reply right away, and that must not hand the freed connection to a url we are about to drop
+    QList<QNetworkReply*> aborted;
+    foreach(QUrl url, cancelled)
+    {
+        if(downloadQueue[pendingDownloads.value(url).priority].removeOne(url))
+        {
+            notifyWaiters(url, QString(), false);
+            continue;
+        }
+
+        foreach(const Download &download, activeDownloads)
+        {
+            if(download.url == url)
+            {
+                aborted.append(download.reply);
+                break;
+            }
+        }
+    }
+
+    //the waiters are notified as each reply finishes, the next download is only scheduled
+    foreach(QNetworkReply *reply, aborted)
+        reply->abort();
+
+    emit tokenFinished(token);
+    scheduleNextDownload();
 }
 
 void Http::setRawHeader(QByteArray headers, QByteArray headerValue)
@@ -42,6 +135,24 @@ void Http::setRawHeader(QByteArray headers, QByteArray headerValue)
     rawHeaderValue = headerValue;
 }
 
+void Http::setMaxConnections(int max)
+{
+    maxConnections = qMax(1, max);
+    scheduleNextDownload();
+}
+
+void Http::setMaxConnectionsPerHost(int max)
+{
+    maxConnectionsPerHost = qMax(1, max);
+    scheduleNextDownload();
+}
+
+void Http::setMaxConnectionsPerHost(const QString &host, int max)
+{
+    hostLimits.insert(host, qMax(1, max));
+    scheduleNextDownload();
+}
+
 QString Http::saveFileName(const QUrl &url)
 {
     QString path = url.path();
@@ -52,77 +163,375 @@ QString Http::saveFileName(const QUrl &url)
 
 bool Http::isFinished()
 {
-    return downloadQueue.isEmpty();
+    return pendingDownloads.isEmpty();
+}
+
+bool Http::isFinished(int token)
+{
+    foreach(const Pending &pending, pendingDownloads)
+        if(pending.tokens.contains(token))
+            return false;
+
+    return true;
+}
+
+int Http::requestCount() const
+{
+    return totalCount;
+}
+
+int Http::coalescedCount() const
+{
+    return coalesced;
+}
+
+void Http::notifyWaiters(const QUrl &url, const QString &fileName, bool ok)
+{
+    QList<int> tokens = pendingDownloads.take(url).tokens;
+    emit downloaded(url, fileName, ok);
+
+    //let anyone waiting on a group know once its last url is done
+    QSet<int> done;
+    foreach(int token, tokens)
+        if(token != 0 && !done.contains(token) && isFinished(token))
+            done.insert(token);
+
+    foreach(int token, done)
+        emit tokenFinished(token);
+}
+
+bool Http::hostAvailable(const QString &host)
+{
+    return hostConnections.value(host, 0) < hostLimits.value(host, maxConnectionsPerHost);
+}
+
+void Http::scheduleNextDownload()
+{
+    //batch up everything appended during this event loop iteration before we start handing out connections
+    if(nextDownloadScheduled)
+        return;
+
+    nextDownloadScheduled = true;
+    QTimer::singleShot(0, this, SLOT(startNextDownload()));
 }
 
 void Http::startNextDownload()
 {
-    if(downloadQueue.isEmpty())
+    nextDownloadScheduled = false;
+
+    //fill every free connection, most urgent queue first.
+    //urls whose host is already at its limit are skipped over so they don't hold up other hosts
+    for(int priority = 0; priority < PriorityCount && activeDownloads.size() < maxConnections; priority++)
     {
-        emit finished();
-        return;
+        QQueue<QUrl> &queue = downloadQueue[priority];
+        int i = 0;
+        while(i < queue.size() && activeDownloads.size() < maxConnections)
+        {
+            if(!hostAvailable(queue.at(i).host()))
+            {
+                i++;
+                continue;
+            }
+
+            QUrl url = queue.takeAt(i);
+            if(!startDownload(url))
+                notifyWaiters(url, QString(), false);
+        }
     }
 
-    QUrl url = downloadQueue.dequeue();
+    //only tell listeners once per batch, however many times we get here after the last url is done
+    if(busy && isFinished())
+    {
+        busy = false;
+        HttpCache::instance()->save();
+        emit finished();
+    }
+}
 
+bool Http::startDownload(const QUrl &url)
+{
     QString filename = saveFileName(url);
     //if filename is equal to the php script filename, then we know it is the match info in json. So add json as the file extension
 
     if(filename.compare("json-mashape.php") == 0)
         filename = QUrlQuery(url).queryItemValue("match_id") + QString(".json");
     else if(filename.compare("_sb.png") == 0)
+        return false;
+
+    QNetworkRequest request(url);
+
+    //only apply api key header to requests that are going to the API
+    if(url.host().compare(apiHost) == 0)
+        request.setRawHeader(rawHeaders, rawHeaderValue);
+
+    Download download;
+    download.url = url;
+    download.fileName = filename;
+    download.output = 0;
+    download.checksum = 0;
+    download.resumeOffset = 0;
+
+    //pick up where an interrupted transfer left off, as long as the server still has the same file
+    HttpCache::Entry cached;
+    if(HttpCache::instance()->lookupPartial(url, &cached) && cached.fileName == filename && cached.size > 0)
     {
-        startNextDownload();
-        return;
+        download.resumeOffset = cached.size;
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(cached.size) + "-");
+        request.setRawHeader("If-Range", cached.etag.isEmpty() ? cached.lastModified : cached.etag);
     }
-
-    output.setFileName(downloadsDir.path() + "/" + filename);
-    if(QFileInfo(output.fileName()).lastModified().addDays(14) > QDateTime::currentDateTime()) //file is not older than 2 weeks, do not bother updating it.
+    //if we already have a good copy, ask the server to only send the body if it changed
+    else if(HttpCache::instance()->lookup(url, &cached) && cached.fileName == filename)
     {
-        startNextDownload();
+        if(!cached.etag.isEmpty())
+            request.setRawHeader("If-None-Match", cached.etag);
+        if(!cached.lastModified.isEmpty())
+            request.setRawHeader("If-Modified-Since", cached.lastModified);
+    }
+
+    download.reply = manager->get(request);
+    download.reply->setReadBufferSize(ChunkSize * 16);                     //don't let a fast link buffer a whole replay in memory
+    connect(download.reply, SIGNAL(finished()), SLOT(downloadFinished()));
+    connect(download.reply, SIGNAL(readyRead()), SLOT(downloadReadyRead()));
+
+    activeDownloads.insert(download.reply, download);
+    hostConnections[url.host()]++;
+
+    //printf("Downloading %s...\n", url.toEncoded().constData());
+    return true;
+}
+
+void Http::downloadFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    if(!reply || !activeDownloads.contains(reply))
         return;
+
+    //drain whatever is still buffered before looking at the result
+    writeAvailable(reply);
+
+    Download download = activeDownloads.take(reply);
+    hostConnections[download.url.host()]--;
+
+    bool ok = false;
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if(reply->error())
+    {
+        interruptDownload(reply, download);
+    }
+    else if(status == 304)
+    {
+        //our copy is still current, nothing was transferred
+        ++notModifiedCount;
+        ok = finishDownload(download, Completed);
     }
+    else
+    {
+        //make sure we got the whole body before it goes into the cache
+        //(content-length is the encoded size when the body came gzipped, so it can only be checked on plain bodies)
+        QVariant length = reply->hasRawHeader("Content-Encoding") ? QVariant() : reply->header(QNetworkRequest::ContentLengthHeader);
+        qint64 offset = status == 206 ? download.resumeOffset : 0;
+        ok = download.output && (!length.isValid() || offset + length.toLongLong() == download.output->size());
+
+        HttpCache::Entry entry;
+        if(ok)
+        {
+            entry.fileName = download.fileName;
+            entry.etag = reply->rawHeader("ETag");
+            entry.lastModified = reply->rawHeader("Last-Modified");
+            entry.size = download.output->size();
+            entry.checksum = download.checksum->result().toHex();
+            entry.verified = true;
+        }
+
+        ok = finishDownload(download, ok ? Completed : Failed) && ok;
+        if(ok)
+        {
+            HttpCache::instance()->insert(download.url, entry);
+            ++downloadCount;
+        }
+    }
+
+    reply->close();
+    reply->deleteLater();
+    notifyWaiters(download.url, downloadsDir.path() + "/" + download.fileName, ok);
+    scheduleNextDownload();
+}
+
+/*
+ * Releases the output file and checksum of a transfer.
+ * The body is written to <name>.part and only moved over the real file once it is complete and on disk,
+ * so a partial file can never be mistaken for a cached one.
+ * Interrupted transfers keep their .part file so the next attempt can resume it.
+ * Returns false if a completed file could not be moved into place.
+ */
+bool Http::finishDownload(const Download &download, DownloadResult result)
+{
+    QString finalName = downloadsDir.path() + "/" + download.fileName;
+    QString partName = finalName + ".part";
+    bool ok = true;
 
-    if(!output.open(QIODevice::WriteOnly))
+    if(download.output)
     {
-        fprintf(stderr, "Problem Opening save file %s for download %s: %s\n", qPrintable(filename), url.toEncoded().constData(), qPrintable(output.errorString()));
+        if(result == Completed)
+        {
+            download.output->flush();
+            syncToDisk(download.output);
+        }
+        download.output->close();
+        delete download.output;
 
-        startNextDownload();
-        return;
+        if(result == Completed && !replaceFile(partName, finalName))
+        {
+            fprintf(stderr, "Problem moving %s into place\n", qPrintable(finalName));
+            HttpCache::instance()->remove(download.url);
+            ok = false;
+        }
     }
+    delete download.checksum;
 
-    QNetworkRequest request(url);
+    if(result == Failed || !ok)
+        QFile::remove(partName);
+    if(result != Interrupted)
+        HttpCache::instance()->removePartial(download.url);
 
-    //only apply api key header to requests that are going to the API
-    if(url.host().compare("computerfr33k-dota-2-replay-manager.p.mashape.com") == 0)
-        request.setRawHeader(rawHeaders, rawHeaderValue);
+    return ok;
+}
+
+/*
+ * Called when a transfer stops early.
+ * Keeps what we have so far if the server gave us a validator to resume against.
+ */
+void Http::interruptDownload(QNetworkReply *reply, const Download &download)
+{
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
 
-    currentDownload = manager->get(request);
-    connect(currentDownload, SIGNAL(finished()), SLOT(downloadFinished()));
-    connect(currentDownload, SIGNAL(readyRead()), SLOT(downloadReadyRead()));
+    //nothing was written this time, leave an earlier .part alone unless the server rejected the range
+    if(!download.output)
+    {
+        finishDownload(download, download.resumeOffset > 0 && status != 416 ? Interrupted : Failed);
+        return;
+    }
 
-    //printf("Downloading %s...\n", url.toEncoded().constData());
-    downloadTime.start();
+    HttpCache::Entry partial;
+    partial.fileName = download.fileName;
+    partial.etag = reply->rawHeader("ETag");
+    partial.lastModified = reply->rawHeader("Last-Modified");
+    bool resumable = download.output->size() > 0 && (!partial.etag.isEmpty() || !partial.lastModified.isEmpty());
+
+    finishDownload(download, resumable ? Interrupted : Failed);
+    if(resumable)
+        HttpCache::instance()->insertPartial(download.url, partial);
 }
 
-void Http::downloadFinished()
+/*
+ * Opens the .part file for a transfer once we know what the server is sending.
+ * A 206 is appended to what we already have, a 200 starts the file over.
+ */
+bool Http::openOutput(QNetworkReply *reply, Download &download)
 {
-    output.close();
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    //only resume if the server is continuing exactly where our file ends
+    bool resume = status == 206 && download.resumeOffset > 0 && reply->rawHeader("Content-Range").startsWith("bytes " + QByteArray::number(download.resumeOffset) + "-");
+
+    download.output = new QFile(downloadsDir.path() + "/" + download.fileName + ".part");
+    download.checksum = new QCryptographicHash(QCryptographicHash::Sha1);
 
-    if(currentDownload->error())
+    if(resume)
     {
+        //the checksum covers the whole body, so feed it what is already on disk
+        if(!download.output->open(QIODevice::ReadWrite) || !download.checksum->addData(download.output) || download.output->size() != download.resumeOffset)
+            resume = false;
     }
-    else
+
+    //a 206 only makes sense on top of the bytes we asked it to continue from
+    if(!resume && status == 206)
+    {
+        delete download.output;
+        delete download.checksum;
+        download.output = 0;
+        download.checksum = 0;
+        return false;
+    }
+
+    if(!resume)
+    {
+        download.output->close();
+        download.checksum->reset();
+        download.resumeOffset = 0;
+        if(!download.output->open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            fprintf(stderr, "Problem Opening save file %s for download %s: %s\n", qPrintable(download.fileName), download.url.toEncoded().constData(), qPrintable(download.output->errorString()));
+            delete download.output;
+            delete download.checksum;
+            download.output = 0;
+            download.checksum = 0;
+            return false;
+        }
+    }
+
+    download.output->seek(download.output->size());
+    return true;
+}
+
+/*
+ * Moves whatever the reply has buffered into the output file in fixed size chunks.
+ */
+void Http::writeAvailable(QNetworkReply *reply)
+{
+    //an aborted reply has nothing more for us
+    if(reply->error() != QNetworkReply::NoError)
+        return;
+
+    Download &download = activeDownloads[reply];
+
+    //a 304 has no body for us, and we don't want to touch the cached copy
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if(status != 200 && status != 206)
+        return;
+
+    if(!download.output && !openOutput(reply, download))
     {
-        ++downloadCount;
+        reply->abort();
+        return;
     }
 
-    currentDownload->close();
-    currentDownload->deleteLater();
-    startNextDownload();
+    qint64 read;
+    while(reply->bytesAvailable() > 0 && (read = reply->read(chunk.data(), ChunkSize)) > 0)
+    {
+        if(download.output->write(chunk.constData(), read) != read)
+        {
+            fprintf(stderr, "Problem writing download %s: %s\n", qPrintable(download.fileName), qPrintable(download.output->errorString()));
+            reply->abort();
+            return;
+        }
+        download.checksum->addData(chunk.constData(), read);
+    }
 }
 
 void Http::downloadReadyRead()
 {
-    output.write(currentDownload->readAll());
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    if(!reply || !activeDownloads.contains(reply))
+        return;
+
+    writeAvailable(reply);
+}
+
+bool Http::syncToDisk(QFile *file)
+{
+#ifdef Q_OS_WIN32
+    return _commit(file->handle()) == 0;
+#else
+    return fsync(file->handle()) == 0;
+#endif
+}
+
+bool Http::replaceFile(const QString &from, const QString &to)
+{
+#ifdef Q_OS_WIN32
+    return MoveFileExW((const wchar_t*)QDir::toNativeSeparators(from).utf16(), (const wchar_t*)QDir::toNativeSeparators(to).utf16(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#endif
 }
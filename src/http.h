@@ -1,7 +1,9 @@
 #ifndef HTTP_H
 #define HTTP_H
 
+#include <QCryptographicHash>
 #include <QFile>
+#include <QHash>
 #include <QObject>
 #include <QQueue>
 #include <QTime>
@@ -9,22 +11,42 @@
 #include <QtNetwork>
 #include <QProgressDialog>
 #include <QThread>
+#include "httpcache.h"
 
 class Http : public QObject
 {
     Q_OBJECT
 public:
+    //what a request is for, most urgent first
+    enum Priority
+    {
+        Interactive,            //something the user is waiting on, e.g. the match json
+        Visible,                //images for what is on screen
+        Background,             //prefetching
+        PriorityCount
+    };
+
     Http(QObject *parent = 0);
     ~Http();
 
-    void append(const QUrl &url);
-    void append(const QStringList &urlList);
+    void append(const QUrl &url, Priority priority = Visible, int token = 0);
+    void append(const QStringList &urlList, Priority priority = Visible, int token = 0);
+    int createToken();                                                      //tag appends with a token so they can be cancelled together
+    void cancel(int token);
     void setRawHeader(QByteArray header, QByteArray headerValue);
+    void setMaxConnections(int max);                                        //number of transfers allowed on the wire at once
+    void setMaxConnectionsPerHost(int max);                                 //default limit for hosts without their own limit
+    void setMaxConnectionsPerHost(const QString &host, int max);
     QString saveFileName(const QUrl &url);
     bool isFinished();                                                      //use for waiting for the queue to complete
+    bool isFinished(int token);
+    int requestCount() const;                                               //urls appended so far
+    int coalescedCount() const;                                             //appends that joined a transfer already queued or running
 
 signals:
     void finished();
+    void downloaded(const QUrl &url, const QString &fileName, bool ok);    //once per url, however many times it was appended
+    void tokenFinished(int token);                                          //everything tagged with token is done or cancelled
 
 private slots:
     void startNextDownload();
@@ -32,17 +54,58 @@ private slots:
     void downloadReadyRead();
 
 private:
+    //everything that belongs to a single transfer, so several can run side by side
+    struct Download
+    {
+        QUrl url;
+        QString fileName;
+        QNetworkReply *reply;
+        QFile *output;                                                      //<fileName>.part, only opened once the server sends a body
+        QCryptographicHash *checksum;
+        qint64 resumeOffset;                                                //bytes already on disk when the request was sent
+    };
+
+    //a url that is queued or running
+    struct Pending
+    {
+        Priority priority;
+        QList<int> tokens;                                                  //one per append, 0 for appends that can't be cancelled
+    };
+
+    enum DownloadResult { Completed, Interrupted, Failed };
+    enum { ChunkSize = 64 * 1024 };
+
+    bool startDownload(const QUrl &url);                                    //returns false if the url was skipped
+    void notifyWaiters(const QUrl &url, const QString &fileName, bool ok);
+    bool hostAvailable(const QString &host);
+    bool finishDownload(const Download &download, DownloadResult result);
+    void interruptDownload(QNetworkReply *reply, const Download &download);
+    bool openOutput(QNetworkReply *reply, Download &download);
+    void writeAvailable(QNetworkReply *reply);
+    static bool syncToDisk(QFile *file);
+    static bool replaceFile(const QString &from, const QString &to);
+    void scheduleNextDownload();
+
     QNetworkAccessManager *manager;
-    QQueue<QUrl> downloadQueue;
-    QNetworkReply *currentDownload;
+    QQueue<QUrl> downloadQueue[PriorityCount];
+    QHash<QNetworkReply*, Download> activeDownloads;
+    QHash<QUrl, Pending> pendingDownloads;                                  //every queued or running url, with the appends waiting on it
+    QHash<QString, int> hostConnections;                                    //running transfers per host
+    QHash<QString, int> hostLimits;
     QByteArray rawHeaders, rawHeaderValue;
-    QFile output;
-    QTime downloadTime;
     QProgressDialog progressDialog;
     QDir downloadsDir;
+    QByteArray chunk;                                                       //reused buffer for moving reply data to disk
 
     int downloadCount;
+    int notModifiedCount;                                                   //revalidated without a body transfer
     int totalCount;
+    int coalesced;
+    int lastToken;
+    int maxConnections;
+    int maxConnectionsPerHost;
+    bool nextDownloadScheduled;
+    bool busy;                                                              //something was appended since finished() was last emitted
 };
 
 #endif
@@ -0,0 +1,177 @@
+#include "httpcache.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+
+HttpCache::HttpCache() : dirty(false)
+{
+    downloadsDir = QStandardPaths::standardLocations(QStandardPaths::DataLocation).at(0) + "/downloads";
+    load();
+}
+
+HttpCache::~HttpCache()
+{
+    save();
+}
+
+HttpCache *HttpCache::instance()
+{
+    static HttpCache cache;
+    return &cache;
+}
+
+void HttpCache::load()
+{
+    QFile file(downloadsDir.path() + "/index.json");
+    if(!file.open(QIODevice::ReadOnly))
+        return;
+
+    QJsonObject index = QJsonDocument::fromJson(file.readAll()).object();
+    entries = readEntries(index.value("complete").toObject());
+    partials = readEntries(index.value("partial").toObject());
+}
+
+QHash<QString, HttpCache::Entry> HttpCache::readEntries(const QJsonObject &object)
+{
+    QHash<QString, Entry> result;
+    for(QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it)
+    {
+        QJsonObject value = it.value().toObject();
+
+        Entry entry;
+        entry.fileName = value.value("file").toString();
+        entry.etag = value.value("etag").toString().toLatin1();
+        entry.lastModified = value.value("lastModified").toString().toLatin1();
+        entry.size = (qint64)value.value("size").toDouble();
+        entry.checksum = value.value("sha1").toString().toLatin1();
+        result.insert(it.key(), entry);
+    }
+
+    return result;
+}
+
+QJsonObject HttpCache::writeEntries(const QHash<QString, Entry> &entries)
+{
+    QJsonObject result;
+    for(QHash<QString, Entry>::const_iterator it = entries.constBegin(); it != entries.constEnd(); ++it)
+    {
+        QJsonObject value;
+        value.insert("file", it.value().fileName);
+        value.insert("etag", QString::fromLatin1(it.value().etag));
+        value.insert("lastModified", QString::fromLatin1(it.value().lastModified));
+        value.insert("size", (double)it.value().size);
+        value.insert("sha1", QString::fromLatin1(it.value().checksum));
+        result.insert(it.key(), value);
+    }
+
+    return result;
+}
+
+void HttpCache::save()
+{
+    if(!dirty)
+        return;
+
+    QJsonObject index;
+    index.insert("complete", writeEntries(entries));
+    index.insert("partial", writeEntries(partials));
+
+    //the downloads dir may have been removed by "Clear Cache"
+    if(!downloadsDir.exists())
+        downloadsDir.mkpath(downloadsDir.path());
+
+    QFile file(downloadsDir.path() + "/index.json");
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        fprintf(stderr, "Problem saving download cache index: %s\n", qPrintable(file.errorString()));
+        return;
+    }
+
+    file.write(QJsonDocument(index).toJson(QJsonDocument::Compact));
+    dirty = false;
+}
+
+/*
+ * Returns true if we have a complete copy of url on disk.
+ * Missing, truncated or modified files are dropped from the index and count as a miss.
+ */
+bool HttpCache::lookup(const QUrl &url, Entry *entry)
+{
+    QString key = url.toString();
+    if(!entries.contains(key))
+        return false;
+
+    Entry &cached = entries[key];
+    QFile file(downloadsDir.path() + "/" + cached.fileName);
+
+    bool valid = cached.size >= 0 && !cached.checksum.isEmpty() && file.size() == cached.size;
+    if(valid && !cached.verified)
+    {
+        //only hash the file once per session, after that the size check is enough
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        valid = file.open(QIODevice::ReadOnly) && hash.addData(&file) && hash.result().toHex() == cached.checksum;
+        cached.verified = valid;
+    }
+
+    if(!valid)
+    {
+        remove(url);
+        return false;
+    }
+
+    if(entry)
+        *entry = cached;
+    return true;
+}
+
+void HttpCache::insert(const QUrl &url, const Entry &entry)
+{
+    entries.insert(url.toString(), entry);
+    dirty = true;
+}
+
+void HttpCache::remove(const QUrl &url)
+{
+    if(entries.remove(url.toString()))
+        dirty = true;
+}
+
+/*
+ * Returns true if an interrupted transfer of url left a .part file we can resume.
+ * entry->size is the number of bytes already on disk.
+ */
+bool HttpCache::lookupPartial(const QUrl &url, Entry *entry)
+{
+    QString key = url.toString();
+    if(!partials.contains(key))
+        return false;
+
+    Entry partial = partials.value(key);
+    QFileInfo info(downloadsDir.path() + "/" + partial.fileName + ".part");
+    if(!info.exists() || (partial.etag.isEmpty() && partial.lastModified.isEmpty()))
+    {
+        removePartial(url);
+        return false;
+    }
+
+    partial.size = info.size();
+    if(entry)
+        *entry = partial;
+    return true;
+}
+
+void HttpCache::insertPartial(const QUrl &url, const Entry &entry)
+{
+    partials.insert(url.toString(), entry);
+    dirty = true;
+}
+
+void HttpCache::removePartial(const QUrl &url)
+{
+    if(partials.remove(url.toString()))
+        dirty = true;
+}
@@ -0,0 +1,57 @@
+#ifndef HTTPCACHE_H
+#define HTTPCACHE_H
+
+#include <QByteArray>
+#include <QDir>
+#include <QHash>
+#include <QJsonObject>
+#include <QString>
+#include <QUrl>
+
+/*
+ * Index of everything Http has saved in the downloads dir.
+ * Keeps the validators the server sent (ETag / Last-Modified) along with the size and checksum of the body,
+ * so a cached file can be revalidated with a conditional request and a damaged file is never treated as a hit.
+ */
+class HttpCache
+{
+public:
+    struct Entry
+    {
+        Entry() : size(-1), verified(false) {}
+
+        QString fileName;           //relative to the downloads dir
+        QByteArray etag;
+        QByteArray lastModified;
+        qint64 size;
+        QByteArray checksum;        //sha1 of the body, hex encoded
+        bool verified;              //checksum has been compared against the file this session
+    };
+
+    static HttpCache *instance();   //shared by every Http object, so they don't overwrite each other's index
+
+    bool lookup(const QUrl &url, Entry *entry);
+    void insert(const QUrl &url, const Entry &entry);
+    void remove(const QUrl &url);
+
+    //validators of interrupted transfers, used to resume them with a range request
+    bool lookupPartial(const QUrl &url, Entry *entry);
+    void insertPartial(const QUrl &url, const Entry &entry);
+    void removePartial(const QUrl &url);
+
+    void save();
+
+private:
+    HttpCache();
+    ~HttpCache();
+    void load();
+    static QHash<QString, Entry> readEntries(const QJsonObject &object);
+    static QJsonObject writeEntries(const QHash<QString, Entry> &entries);
+
+    QDir downloadsDir;
+    QHash<QString, Entry> entries;
+    QHash<QString, Entry> partials;
+    bool dirty;
+};
+
+#endif // HTTPCACHE_H
@@ -0,0 +1,261 @@
+#include "jsonreader.h"
+
+#include <string.h>
+
+JsonReader::JsonReader(const char *data, qint64 size) :
+    pos(data), end(data + size), valueBegin(data), valueEnd(data), escaped(false), failed(false), current(Invalid)
+{
+}
+
+JsonReader::Token JsonReader::token() const
+{
+    return current;
+}
+
+bool JsonReader::hasError() const
+{
+    return failed;
+}
+
+JsonReader::Token JsonReader::fail()
+{
+    //stay stuck on the error, so loops waiting for an end token stop
+    failed = true;
+    current = Invalid;
+    return current;
+}
+
+JsonReader::Token JsonReader::next()
+{
+    if(failed)
+        return current;
+
+    //separators carry no information for us, the structure is all in the brackets
+    while(pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r' || *pos == ',' || *pos == ':'))
+        pos++;
+
+    if(pos == end)
+    {
+        current = End;
+        return current;
+    }
+
+    valueBegin = pos;
+    escaped = false;
+
+    switch(*pos)
+    {
+    case '{':
+        pos++;
+        current = BeginObject;
+        break;
+    case '}':
+        pos++;
+        current = EndObject;
+        break;
+    case '[':
+        pos++;
+        current = BeginArray;
+        break;
+    case ']':
+        pos++;
+        current = EndArray;
+        break;
+    case '"':
+    {
+        if(!readString())
+            return fail();
+
+        //a string followed by a colon is a key
+        const char *p = pos;
+        while(p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+        current = (p < end && *p == ':') ? Key : String;
+        return current;
+    }
+    case 't':
+    case 'f':
+    case 'n':
+    {
+        const char *word = *pos == 't' ? "true" : (*pos == 'f' ? "false" : "null");
+        size_t length = strlen(word);
+        if(end - pos < (qint64)length || memcmp(pos, word, length) != 0)
+            return fail();
+
+        pos += length;
+        current = *word == 'n' ? Null : Bool;
+        break;
+    }
+    default:
+        if(*pos != '-' && (*pos < '0' || *pos > '9'))
+            return fail();
+
+        while(pos < end && (*pos == '-' || *pos == '+' || *pos == '.' || *pos == 'e' || *pos == 'E' || (*pos >= '0' && *pos <= '9')))
+            pos++;
+        current = Number;
+        break;
+    }
+
+    valueEnd = pos;
+    return current;
+}
+
+bool JsonReader::readString()
+{
+    pos++;      //opening quote
+    valueBegin = pos;
+
+    while(pos < end && *pos != '"')
+    {
+        if(*pos == '\\')
+        {
+            escaped = true;
+            pos++;
+        }
+        pos++;
+    }
+
+    if(pos >= end)
+        return false;
+
+    valueEnd = pos;
+    pos++;      //closing quote
+    return true;
+}
+
+bool JsonReader::nextKey()
+{
+    return next() == Key;
+}
+
+bool JsonReader::nextElement()
+{
+    Token t = next();
+    return t != EndArray && t != End && t != Invalid;
+}
+
+bool JsonReader::readKey(const char *name)
+{
+    if(!isKey(name))
+        return false;
+
+    next();
+    return true;
+}
+
+bool JsonReader::isKey(const char *name) const
+{
+    size_t length = strlen(name);
+    return current == Key && !escaped && valueEnd - valueBegin == (qint64)length && memcmp(valueBegin, name, length) == 0;
+}
+
+void JsonReader::skip()
+{
+    if(current == Key)
+        next();
+
+    if(current != BeginObject && current != BeginArray)
+        return;
+
+    int depth = 1;
+    while(depth > 0)
+    {
+        switch(next())
+        {
+        case BeginObject:
+        case BeginArray:
+            depth++;
+            break;
+        case EndObject:
+        case EndArray:
+            depth--;
+            break;
+        case Invalid:
+        case End:
+            return;
+        default:
+            break;
+        }
+    }
+}
+
+QString JsonReader::toString() const
+{
+    if(current != String && current != Key && current != Number)
+        return QString();
+
+    if(!escaped)
+        return QString::fromUtf8(valueBegin, valueEnd - valueBegin);
+
+    //only strings with escapes need a copy made
+    QByteArray utf8;
+    utf8.reserve(valueEnd - valueBegin);
+    QString result;
+
+    for(const char *p = valueBegin; p < valueEnd; p++)
+    {
+        if(*p != '\\' || p + 1 >= valueEnd)
+        {
+            utf8.append(*p);
+            continue;
+        }
+
+        p++;
+        switch(*p)
+        {
+        case 'b': utf8.append('\b'); break;
+        case 'f': utf8.append('\f'); break;
+        case 'n': utf8.append('\n'); break;
+        case 'r': utf8.append('\r'); break;
+        case 't': utf8.append('\t'); break;
+        case 'u':
+        {
+            if(valueEnd - p < 5)
+                break;
+
+            //flush what we have, then add the code unit (surrogate pairs come through as two of these and QString joins them)
+            result += QString::fromUtf8(utf8);
+            utf8.clear();
+            result += QChar((ushort)QByteArray(p + 1, 4).toUShort(0, 16));
+            p += 4;
+            break;
+        }
+        default:
+            utf8.append(*p);    //  \" \\ \/
+            break;
+        }
+    }
+
+    return result + QString::fromUtf8(utf8);
+}
+
+qint64 JsonReader::toLongLong() const
+{
+    if(current != String && current != Number)
+        return 0;
+
+    //only the integer part, which is all we store
+    const char *p = valueBegin;
+    bool negative = p < valueEnd && *p == '-';
+    if(negative)
+        p++;
+
+    qint64 value = 0;
+    for(; p < valueEnd && *p >= '0' && *p <= '9'; p++)
+        value = value * 10 + (*p - '0');
+
+    return negative ? -value : value;
+}
+
+int JsonReader::toInt() const
+{
+    return (int)toLongLong();
+}
+
+bool JsonReader::toBool() const
+{
+    if(current == Bool)
+        return *valueBegin == 't';
+
+    return toLongLong() != 0;
+}
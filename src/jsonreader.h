@@ -0,0 +1,71 @@
+#ifndef JSONREADER_H
+#define JSONREADER_H
+
+#include <QByteArray>
+#include <QString>
+
+/*
+ * Pull parser for json that works straight on a buffer (e.g. a memory mapped file).
+ * Nothing is built up as it goes: the caller walks the tokens, picks the values it wants and skips the rest.
+ *
+ * After next() returns Key, the following next() moves onto that key's value.
+ * A typical object is walked like this:
+ *
+ *     while(reader.nextKey())
+ *     {
+ *         if(reader.readKey("name"))
+ *             name = reader.toString();
+ *         else
+ *             reader.skip();
+ *     }
+ */
+class JsonReader
+{
+public:
+    enum Token
+    {
+        Invalid,
+        BeginObject,
+        EndObject,
+        BeginArray,
+        EndArray,
+        Key,
+        String,
+        Number,
+        Bool,
+        Null,
+        End
+    };
+
+    JsonReader(const char *data, qint64 size);
+
+    Token next();
+    Token token() const;
+    bool hasError() const;
+
+    bool nextKey();                         //moves to the next key of the current object, false at its end
+    bool nextElement();                     //moves to the next value of the current array, false at its end
+    bool isKey(const char *name) const;     //compare the current key without allocating
+    bool readKey(const char *name);         //if the current key is name, moves onto its value
+    void skip();                            //skips the current value (or the value of the current key), along with everything inside it
+
+    //current value; numbers may also come as strings, since that is how the api sends them
+    QString toString() const;
+    qint64 toLongLong() const;
+    int toInt() const;
+    bool toBool() const;
+
+private:
+    Token fail();
+    bool readString();
+
+    const char *pos;
+    const char *end;
+    const char *valueBegin;                 //raw value, without quotes for strings
+    const char *valueEnd;
+    bool escaped;                           //current string has escape sequences
+    bool failed;
+    Token current;
+};
+
+#endif // JSONREADER_H
@@ -1,5 +1,4 @@
 #include "mainwindow.h"
-#include "thread.h"
 #include "http.h"
 #include "firstrun.h"
 #include <QApplication>
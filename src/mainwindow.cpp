@@ -3,10 +3,52 @@
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    MatchParser(0),
+    matchToken(0),
+    restoreRootId(0),
+    restoreProgress(0),
+    dedupProgress(0)
 {
     ui->setupUi(this);
 
+    //indexing a large folder for the first time takes a while, so show how far along it is
+    scanProgress = new QProgressBar(this);
+    scanProgress->setMaximumWidth(200);
+    scanProgress->hide();
+    cancelScanButton = new QPushButton(tr("Cancel"), this);
+    cancelScanButton->hide();
+    ui->statusBar->addPermanentWidget(scanProgress);
+    ui->statusBar->addPermanentWidget(cancelScanButton);
+    connect(cancelScanButton, SIGNAL(clicked()), SLOT(cancelScan()));
+
+    archiver = new ReplayArchiver(this);
+    connect(archiver, SIGNAL(archived(int,QString,qint64,qint64,qint64)), SLOT(replayArchived(int,QString,qint64,qint64,qint64)));
+    connect(&restoring, SIGNAL(finished()), SLOT(replayRestored()));
+    connect(&dedup, SIGNAL(finished()), SLOT(duplicatesLinked()));
+    connect(&http, SIGNAL(downloaded(QUrl,QString,bool)), SLOT(matchDownloaded(QUrl,QString,bool)));
+
+    //pick up replays as dota writes them, instead of waiting for a refresh
+    watcher = new QFileSystemWatcher(this);
+    changeTimer = new QTimer(this);
+    changeTimer->setSingleShot(true);
+    changeTimer->setInterval(250);      //a new replay fires several events, let them settle first
+    retryTimer = new QTimer(this);
+    retryTimer->setSingleShot(true);
+    retryTimer->setInterval(2000);
+    consistencyTimer = new QTimer(this);
+    consistencyTimer->setInterval(5 * 60 * 1000);
+    connect(watcher, SIGNAL(directoryChanged(QString)), SLOT(folderChanged(QString)));
+    connect(changeTimer, SIGNAL(timeout()), SLOT(applyFolderChanges()));
+    connect(retryTimer, SIGNAL(timeout()), SLOT(retryUnreadable()));
+    connect(consistencyTimer, SIGNAL(timeout()), SLOT(checkAllFolders()));     //in case the watcher missed something
+
+    //search as the user types, once they pause
+    searchTimer = new QTimer(this);
+    searchTimer->setSingleShot(true);
+    searchTimer->setInterval(150);
+    connect(searchTimer, SIGNAL(timeout()), SLOT(applySearch()));
+
     //create blank image for empty item slots
     image = QPixmap(QSize(32,24));
     image.fill(Qt::black);
@@ -19,6 +61,21 @@ MainWindow::MainWindow(QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+    foreach(ReplayRoot *root, roots)
+        root->scanner->stop();
+    archiver->stop();
+    stopBackfill.store(1);
+    matchBackfill.waitForFinished();
+    restoring.waitForFinished();
+    dedup.cancel();
+    dedup.waitForFinished();
+    foreach(ReplayRoot *root, roots)
+    {
+        root->scanner->wait();
+        delete root;
+    }
+    archiver->wait();
+
     settings->setValue("windowGeometry", saveGeometry());
     settings->setValue("windowState", saveState());
     settings->sync();
@@ -34,6 +91,7 @@ void MainWindow::start()
 {
     userDir = QStandardPaths::standardLocations(QStandardPaths::DataLocation).at(0);
     downloadsDir = userDir.path() + "/downloads";
+    archiveDir = userDir.path() + "/archive";
 
     //create the folder if it doesn't already exist
     if(!QDir(userDir).exists())
@@ -47,6 +105,18 @@ void MainWindow::start()
         downloadsDir.mkpath(downloadsDir.path());
     }
 
+    if(!archiveDir.exists())
+    {
+        archiveDir.mkpath(archiveDir.path());
+    }
+
+    //each root has its own archive folder; what was archived before there were several belongs to the first
+    QStringList oldArchives = archiveDir.entryList(QStringList("*" + ReplayArchive::archiveFileName("")), QDir::Files);
+    if(!oldArchives.isEmpty())
+        archiveDir.mkpath("1");
+    foreach(QString name, oldArchives)
+        archiveDir.rename(name, "1/" + name);
+
     settings = new QSettings(userDir.absolutePath() + "/settings.ini", QSettings::IniFormat);
 
     apiKey = settings->value("apiKey").toString();
@@ -68,44 +138,117 @@ void MainWindow::start()
     db = QSqlDatabase::addDatabase("QSQLITE");
     db.setDatabaseName(userDir.absolutePath() + "/matches.db");
     db.open();
-    db.exec( "create table if not exists replays (title TEXT, filename TEXT PRIMARY KEY, fileExists BLOB)" );
-    model = new QSqlTableModel(this, db);
+    ReplayIndex(db).createTables();
+    setupRoots();
+    model = new ReplayTableModel(db, this);
     ui->tableView->setModel(model);
-    model->setTable("replays");
-    model->select();
-    ui->tableView->hideColumn(2);
-}
-
-void MainWindow::checkDb() //check and remove files from db that are no longer locally saved
-{
-    db.transaction();
-    QSqlQuery query;
-    QSqlQuery updateRow;
-    query.exec("update replays set fileExists = 0");
-    updateRow.prepare("update replays set fileExists = 1 where filename = :filename");
-    query.prepare("select * from replays where filename = :id");
-    int i=0;
-    for(QStringList::Iterator it = list.begin(); it != list.end(); it++)
-    {
-        QString param = QString(list.at(i));
-        //qDebug() << param;
-        query.bindValue(":id", param);
-        if(query.exec())
+
+    //the model sorts in SQL; until a header is clicked the table stays in match id order
+    ui->tableView->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder);
+    ui->tableView->setSortingEnabled(true);
+
+    ui->fromDateEdit->setDate(QDate::currentDate().addMonths(-1));
+    ui->toDateEdit->setDate(QDate::currentDate());
+    ui->winnerFilter->addItem("Either side won", QString());
+    ui->winnerFilter->addItem("Radiant won", QString("Radiant"));
+    ui->winnerFilter->addItem("Dire won", QString("Dire"));
+    fillFilters();
+    connect(ui->dateFilterCheck, SIGNAL(toggled(bool)), SLOT(applyFilter()));
+    connect(ui->fromDateEdit, SIGNAL(dateChanged(QDate)), SLOT(applyFilter()));
+    connect(ui->toDateEdit, SIGNAL(dateChanged(QDate)), SLOT(applyFilter()));
+    connect(ui->gameModeFilter, SIGNAL(currentIndexChanged(int)), SLOT(applyFilter()));
+    connect(ui->heroFilter, SIGNAL(currentIndexChanged(int)), SLOT(applyFilter()));
+    connect(ui->winnerFilter, SIGNAL(currentIndexChanged(int)), SLOT(applyFilter()));
+
+    //pick up any matches that were viewed before the stats tables existed; the search index follows them through its triggers.
+    //matches viewed since are stored as they are shown, so once this has gone through every json it never runs again
+    bool stored = MatchStore(db).createTables();
+    ReplaySearch(db).createTables();
+    if(stored && !settings->value("matchesBackfilled", false).toBool())
+    {
+        connect(&matchBackfill, SIGNAL(finished()), SLOT(matchesBackfilled()));
+        matchBackfill.setFuture(QtConcurrent::run(&MatchStore::backfill, db.databaseName(), downloadsDir.path(), &stopBackfill));
+    }
+}
+
+void MainWindow::matchesBackfilled()
+{
+    if(!matchBackfill.result())
+        return;
+
+    settings->setValue("matchesBackfilled", true);
+    model->refresh();
+    fillFilters();
+}
+
+/*
+ * Makes the roots match the settings: the game's replay folder, then the other folders.
+ * Each gets its own scanner, so they are listed side by side and one can be rescanned without the others.
+ * Replays of folders that were dropped leave the index, other than archived ones.
+ */
+QList<int> MainWindow::setupRoots()
+{
+    QStringList paths(dir.absolutePath());
+    foreach(QString path, settings->value("otherReplayFolders").toStringList())
+    {
+        path = QDir(path).absolutePath();
+        if(!paths.contains(path))
+            paths.append(path);
+    }
+
+    ReplayIndex index(db);
+    QList<ReplayRoot*> previous = roots;
+    QList<int> added;
+    QList<int> ids;
+    roots.clear();
+    foreach(QString path, paths)
+    {
+        int id = index.rootId(path);
+        if(id == 0 || ids.contains(id))
+            continue;
+        ids.append(id);
+
+        ReplayRoot *root = 0;
+        for(int i = 0; i < previous.size() && !root; i++)
         {
-            while(query.next())
-            {
-                updateRow.bindValue(0, param);
-                updateRow.exec();
-            }
+            if(previous.at(i)->id == id)
+                root = previous.takeAt(i);
         }
-        else
+
+        if(!root)
         {
-            qDebug() << "query did not exec;";
+            root = new ReplayRoot;
+            root->id = id;
+            root->dir = path;
+            root->scanner = new ReplayScanner(this);
+            connect(root->scanner, SIGNAL(filesFound(QStringList)), SLOT(replaysFound(QStringList)));
+            connect(root->scanner, SIGNAL(filesChanged(QList<ReplayFile>)), SLOT(replaysChanged(QList<ReplayFile>)));
+            connect(root->scanner, SIGNAL(filesRead(QList<DemoInfo>)), SLOT(replaysRead(QList<DemoInfo>)));
+            connect(root->scanner, SIGNAL(filesUnreadable(QList<ReplayFile>)), SLOT(replaysUnreadable(QList<ReplayFile>)));
+            connect(root->scanner, SIGNAL(filesHashed(QList<ReplayFile>)), SLOT(replaysHashed(QList<ReplayFile>)));
+            connect(root->scanner, SIGNAL(timelinesRead(QList<ReplayTimeline>)), SLOT(replayTimelinesRead(QList<ReplayTimeline>)));
+            connect(root->scanner, SIGNAL(filesListed(QStringList)), SLOT(replaysListed(QStringList)));
+            connect(root->scanner, SIGNAL(progress(int,int)), SLOT(scanProgressed(int,int)));
+            connect(root->scanner, SIGNAL(scanFinished(bool)), SLOT(scanFinished(bool)));
+            added.append(id);
         }
-        i++;
+        roots.append(root);
     }
-    query.exec("delete from replays where fileExists = 0");
-    db.commit();
+
+    //whatever they still have queued for the GUI finds no root and is dropped
+    foreach(ReplayRoot *root, previous)
+    {
+        root->scanner->stop();
+        root->scanner->wait();
+        root->scanner->deleteLater();
+        delete root;
+    }
+
+    index.removeRootsExcept(ids);
+    if(!previous.isEmpty())
+        watchReplayFolders();
+
+    return added;
 }
 
 void MainWindow::addFilesToDb()
@@ -116,44 +259,531 @@ void MainWindow::addFilesToDb()
     ui->viewMatchButton->setEnabled(false);
     ui->deleteReplayButton->setEnabled(false);
 
-    list.clear();
-    QSqlQuery query;
-    db.transaction();
-    query.prepare("insert into replays (fileExists, filename) VALUES (1, :filename)");
-    bool ok = dir.exists();  //check if directory exist
-        if ( ok )
+    foreach(ReplayRoot *root, roots)
+        scanRoot(root);
+}
+
+void MainWindow::scanRoot(ReplayRoot *root, const QStringList &fileNames)
+{
+    //already scanning, go again once it is done so changes made meanwhile are seen
+    if(root->scanner->isRunning())
+    {
+        root->rescanPending = true;
+        return;
+    }
+
+    root->list.clear();
+    root->done = 0;
+    root->total = 0;
+    root->scanner->setRoot(root->id, root->dir.absolutePath());
+    root->scanner->setKnownFiles(ReplayIndex(db, root->id).files());
+    root->scanner->setFileNames(fileNames);
+    root->scanner->start();
+    ui->statusBar->showMessage("Scanning replays...");
+}
+
+MainWindow::ReplayRoot *MainWindow::rootForId(int id)
+{
+    foreach(ReplayRoot *root, roots)
+    {
+        if(root->id == id)
+            return root;
+    }
+    return 0;
+}
+
+MainWindow::ReplayRoot *MainWindow::rootForScanner(QObject *scanner)
+{
+    foreach(ReplayRoot *root, roots)
+    {
+        if(root->scanner == scanner)
+            return root;
+    }
+    return 0;
+}
+
+//the root a folder is in; roots inside other roots are matched to the innermost one
+MainWindow::ReplayRoot *MainWindow::rootForPath(const QString &path)
+{
+    ReplayRoot *found = 0;
+    foreach(ReplayRoot *root, roots)
+    {
+        QString rootPath = root->dir.absolutePath();
+        if((path == rootPath || path.startsWith(rootPath + "/")) && (!found || rootPath.size() > found->dir.absolutePath().size()))
+            found = root;
+    }
+    return found;
+}
+
+/*
+ * Column widths from the header and the rows at the top of the view, instead of resizeColumnsToContents(),
+ * which goes over every row while the window isn't shown yet.
+ */
+void MainWindow::resizeColumns()
+{
+    const int sampleRows = 64;
+    int first = qMax(0, ui->tableView->rowAt(0));
+    int last = qMin(model->rowCount(), first + sampleRows);
+
+    for(int column = 0; column < model->columnCount(); column++)
+    {
+        int width = ui->tableView->horizontalHeader()->sectionSizeHint(column);
+        for(int row = first; row < last; row++)
+            width = qMax(width, ui->tableView->sizeHintForIndex(model->index(row, column)).width());
+        ui->tableView->setColumnWidth(column, width);
+    }
+}
+
+/*
+ * Refilled as replays are read, keeping what was picked. Both lists come straight off an index.
+ * If the picked one is gone, the filter is applied again without it.
+ */
+void MainWindow::fillFilters()
+{
+    QString gameMode = ui->gameModeFilter->itemData(ui->gameModeFilter->currentIndex()).toString();
+    QString hero = ui->heroFilter->itemData(ui->heroFilter->currentIndex()).toString();
+
+    ui->gameModeFilter->blockSignals(true);
+    ui->gameModeFilter->clear();
+    ui->gameModeFilter->addItem("All game modes", QString());
+    QSqlQuery query(db);
+    query.exec("select distinct game_mode from replays where game_mode is not null order by game_mode");
+    while(query.next())
+        ui->gameModeFilter->addItem(query.value(0).toString(), query.value(0).toString());
+    ui->gameModeFilter->setCurrentIndex(gameMode.isEmpty() ? 0 : qMax(0, ui->gameModeFilter->findData(gameMode)));
+    ui->gameModeFilter->blockSignals(false);
+
+    //npc_dota_hero_anti_mage is shown as anti mage
+    ui->heroFilter->blockSignals(true);
+    ui->heroFilter->clear();
+    ui->heroFilter->addItem("All heroes", QString());
+    query.exec("select distinct hero from replay_players where hero is not null order by hero");
+    while(query.next())
+    {
+        QString name = query.value(0).toString();
+        ui->heroFilter->addItem(QString(name).remove("npc_dota_hero_").replace('_', ' '), name);
+    }
+    ui->heroFilter->setCurrentIndex(hero.isEmpty() ? 0 : qMax(0, ui->heroFilter->findData(hero)));
+    ui->heroFilter->blockSignals(false);
+
+    if((!gameMode.isEmpty() && ui->gameModeFilter->currentIndex() == 0) || (!hero.isEmpty() && ui->heroFilter->currentIndex() == 0))
+        applyFilter();
+}
+
+int MainWindow::replayCount() const
+{
+    int count = 0;
+    foreach(const ReplayRoot *root, roots)
+        count += root->knownReplays.size();
+    return count;
+}
+
+//a batch of replay file names from a scanner thread
+void MainWindow::replaysFound(const QStringList &fileNames)
+{
+    ReplayRoot *root = rootForScanner(sender());
+    if(root)
+        root->list.append(fileNames);
+}
+
+//replays that are new or changed since the last scan, the rest are already in the table as they are
+void MainWindow::replaysChanged(const QList<ReplayFile> &files)
+{
+    ReplayRoot *root = rootForScanner(sender());
+
+    //only reload the table if something new showed up, so the selection survives a rescan
+    if(root && ReplayIndex(db, root->id).update(files) > 0)
+        model->reload();
+}
+
+//what the replays themselves say: duration, mode, winner and players, no network needed
+void MainWindow::replaysRead(const QList<DemoInfo> &infos)
+{
+    ReplayRoot *root = rootForScanner(sender());
+
+    //no rows come or go here, so the view keeps its place
+    if(root && ReplayIndex(db, root->id).setInfo(infos))
+    {
+        model->refresh();
+        fillFilters();
+    }
+}
+
+//most likely still being written; looked at again once it stops changing
+void MainWindow::replaysUnreadable(const QList<ReplayFile> &files)
+{
+    ReplayRoot *root = rootForScanner(sender());
+    if(!root)
+        return;
+
+    ReplayIndex(db, root->id).setUnreadable(files);
+    foreach(const ReplayFile &file, files)
+        root->unreadable.insert(file.fileName, file);
+    retryTimer->start();
+}
+
+/*
+ * Replays whose stat data moved on since they couldn't be read get the scanner again, just them.
+ * One that stayed the same is as finished as it's going to get, it's left for the next scan.
+ */
+void MainWindow::retryUnreadable()
+{
+    bool waiting = false;
+    foreach(ReplayRoot *root, roots)
+    {
+        if(root->unreadable.isEmpty())
+            continue;
+
+        if(root->scanner->isRunning())
         {
-            //set fileinfo filter
-            QFileInfoList entries = dir.entryInfoList( QDir::NoDotAndDotDot |
-                    QDir::Dirs | QDir::Files );
-                    //loop over entries filter selected
-            foreach ( QFileInfo entryInfo, entries )
-            {
-                //QString path = entryInfo.absoluteFilePath();
-                QString fileName = entryInfo.fileName();
+            waiting = true;
+            continue;
+        }
+
+        QStringList fileNames;
+        foreach(const ReplayFile &file, root->unreadable)
+        {
+            QFileInfo info(root->dir.absoluteFilePath(file.fileName));
+            if(info.isFile() && !ReplayFile::fromFileInfo(info).sameFile(file))
+                fileNames.append(file.fileName);
+        }
+        root->unreadable.clear();
+
+        if(!fileNames.isEmpty())
+            scanRoot(root, fileNames);
+    }
+
+    if(waiting)
+        retryTimer->start();
+}
+
+void MainWindow::replaysHashed(const QList<ReplayFile> &files)
+{
+    ReplayRoot *root = rootForScanner(sender());
+    if(root)
+        ReplayIndex(db, root->id).setHashes(files);
+}
+
+//the whole root has been listed; reading and hashing changed replays may still be going on
+void MainWindow::replaysListed(const QStringList &folders)
+{
+    ReplayRoot *root = rootForScanner(sender());
+    if(!root)
+        return;
+
+    root->knownReplays = root->list.toSet();
+    root->folders = folders;
+    watchReplayFolders();
+    ReplayIndex(db, root->id).removeMissing(root->list);
+    model->reload();
+    resizeColumns();
+    ui->statusBar->showMessage(QString("%1 replays").arg(replayCount()), 5000);
+}
+
+//each root reports its own progress, the bar shows all of them together
+void MainWindow::scanProgressed(int done, int total)
+{
+    ReplayRoot *root = rootForScanner(sender());
+    if(!root)
+        return;
+
+    root->done = done;
+    root->total = total;
+
+    done = 0;
+    total = 0;
+    foreach(ReplayRoot *other, roots)
+    {
+        done += other->done;
+        total += other->total;
+    }
+    if(done >= total)
+        return;
+
+    scanProgress->setRange(0, total);
+    scanProgress->setValue(done);
+    scanProgress->show();
+    cancelScanButton->show();
+    ui->statusBar->showMessage(QString("Indexing replays... %1 of %2").arg(done).arg(total));
+}
+
+void MainWindow::cancelScan()
+{
+    foreach(ReplayRoot *root, roots)
+    {
+        root->rescanPending = false;
+        root->scanner->stop();
+    }
+}
+
+void MainWindow::replayTimelinesRead(const QList<ReplayTimeline> &timelines)
+{
+    ReplayRoot *root = rootForScanner(sender());
+    if(root)
+        ReplayIndex(db, root->id).setTimelines(timelines);
+}
+
+void MainWindow::scanFinished(bool completed)
+{
+    ReplayRoot *root = rootForScanner(sender());
+    if(!root)
+        return;
+
+    root->done = 0;
+    root->total = 0;
+
+    //the others may still be going
+    bool scanning = false;
+    foreach(ReplayRoot *other, roots)
+        scanning = scanning || (other != root && other->scanner->isRunning());
+
+    if(!scanning)
+    {
+        scanProgress->hide();
+        cancelScanButton->hide();
+        ui->statusBar->showMessage(completed ? QString("%1 replays").arg(replayCount()) : QString("Indexing cancelled"), 5000);
+
+        //only once the scanners are done with the files
+        if(completed)
+            archiveOldReplays();
+    }
 
-                if ( entryInfo.isDir() )    //check if entryInfo is dir
-                {
-                }
+    if(root->rescanPending)
+    {
+        root->rescanPending = false;
+        scanRoot(root);
+    }
+}
+
+void MainWindow::archiveOldReplays()
+{
+    int days = settings->value("archiveAfterDays", 0).toInt();
+    if(days <= 0 || archiver->isRunning())
+        return;
+
+    qint64 modifiedBefore = QDateTime::currentDateTime().addDays(-days).toMSecsSinceEpoch();
+    bool queued = false;
+    foreach(ReplayRoot *root, roots)
+    {
+        QStringList fileNames = ReplayIndex(db, root->id).archiveCandidates(modifiedBefore);
+        if(fileNames.isEmpty())
+            continue;
+
+        archiver->addFiles(root->id, root->dir.absolutePath(), archiveDir.absoluteFilePath(QString::number(root->id)), fileNames);
+        queued = true;
+    }
+
+    if(queued)
+        archiver->start(QThread::LowPriority);
+}
+
+void MainWindow::replayArchived(int rootId, const QString &fileName, qint64 originalSize, qint64 archivedSize, qint64 msecs)
+{
+    ReplayIndex index(db, rootId);
+    index.setArchived(fileName, archivedSize);
+    model->refreshReplay(index.matchId(fileName));
+    ui->statusBar->showMessage(QString("Archived %1: %2 MB to %3 MB (%4x) at %5 MB/s")
+                               .arg(fileName)
+                               .arg(originalSize / (1024.0 * 1024.0), 0, 'f', 1)
+                               .arg(archivedSize / (1024.0 * 1024.0), 0, 'f', 1)
+                               .arg(archivedSize > 0 ? double(originalSize) / archivedSize : 0.0, 0, 'f', 2)
+                               .arg(originalSize / (1024.0 * 1024.0) / qMax(msecs, qint64(1)) * 1000, 0, 'f', 0), 5000);
+}
+
+//also works for archived replays of folders that are no longer roots
+QString MainWindow::replayPath(int rootId, const QString &fileName)
+{
+    return ReplayIndex(db).rootPaths().value(rootId) + "/" + fileName;
+}
+
+QString MainWindow::archivePath(int rootId, const QString &fileName)
+{
+    return archiveDir.absolutePath() + "/" + QString::number(rootId) + "/" + ReplayArchive::archiveFileName(fileName);
+}
+
+/*
+ * Puts an archived replay back in its folder, decompressing it in the background while a dialog is up.
+ * replayRestored() takes it from there.
+ */
+void MainWindow::restoreReplay(int rootId, const QString &fileName)
+{
+    if(restoring.isRunning())
+        return;
+
+    restoreRootId = rootId;
+    restoreFileName = fileName;
+    QString source = archivePath(rootId, fileName);
+    QString destination = replayPath(rootId, fileName);
+    QDir().mkpath(QFileInfo(destination).absolutePath());
+
+    restoreProgress = new QProgressDialog(tr("Restoring %1 from the archive...").arg(fileName), QString(), 0, 0, this);
+    restoreProgress->setWindowModality(Qt::WindowModal);
+    restoreProgress->setMinimumDuration(0);
+    restoreProgress->show();
+
+    restoreTimer.start();
+    restoring.setFuture(QtConcurrent::run(&ReplayArchive::extract, source, destination));
+}
+
+void MainWindow::replayRestored()
+{
+    restoreProgress->deleteLater();
+    restoreProgress = 0;
+
+    if(!restoring.result())
+    {
+        QMessageBox::warning(this, tr("Watch Replay"), tr("Could not restore %1 from the archive").arg(restoreFileName));
+        return;
+    }
+
+    QString destination = replayPath(restoreRootId, restoreFileName);
+    QFile::remove(archivePath(restoreRootId, restoreFileName));
+    ReplayFile file = ReplayFile::fromFileInfo(QFileInfo(destination));
+    file.fileName = restoreFileName;
+    ReplayIndex index(db, restoreRootId);
+    index.setRestored(file);
+    model->refreshReplay(index.matchId(restoreFileName));
+    ui->statusBar->showMessage(QString("Restored %1 at %2 MB/s")
+                               .arg(restoreFileName)
+                               .arg(file.size / (1024.0 * 1024.0) / qMax(restoreTimer.elapsed(), qint64(1)) * 1000, 0, 'f', 0), 5000);
+
+    showPlayDemo(restoreRootId, restoreFileName);
+}
+
+/*
+ * Every folder of every root is watched, as the watcher only sees changes directly inside a folder.
+ * On Linux each one takes an inotify watch, so very large trees can run into the system's limit;
+ * what isn't watched is still picked up by checkAllFolders().
+ */
+void MainWindow::watchReplayFolders()
+{
+    if(!watcher->directories().isEmpty())
+        watcher->removePaths(watcher->directories());
+
+    QStringList folders;
+    foreach(ReplayRoot *root, roots)
+    {
+        if(root->dir.exists())
+            folders.append(root->folders.isEmpty() ? QStringList(root->dir.absolutePath()) : root->folders);
+    }
+    if(!folders.isEmpty())
+        watcher->addPaths(folders);
+
+    consistencyTimer->start();
+}
+
+void MainWindow::folderChanged(const QString &path)
+{
+    changedFolders.insert(path);
+    changeTimer->start();
+}
+
+void MainWindow::checkAllFolders()
+{
+    foreach(ReplayRoot *root, roots)
+        changedFolders += root->folders.toSet();
+    applyFolderChanges();
+}
+
+/*
+ * Applies what changed in the folders we were told about since we last looked, one row at a time.
+ * Only the file names in those folders are listed, which is cheap next to a scan.
+ * A folder that appeared or went away means the tree changed shape; only its root is scanned again.
+ */
+void MainWindow::applyFolderChanges()
+{
+    QSet<QString> folders = changedFolders;
+    changedFolders.clear();
+
+    bool changed = false;
+    bool reload = false;
+    QHash<ReplayRoot*, QStringList> toScan;
+    foreach(QString folder, folders)
+    {
+        ReplayRoot *root = rootForPath(folder);
+        if(!root)
+            continue;
+
+        //a running scan may or may not see the change, so go over it again once it is done
+        if(root->scanner->isRunning())
+        {
+            root->rescanPending = true;
+            continue;
+        }
+
+        QDir current(folder);
+        bool reshaped = !current.exists();
+        foreach(QString subfolder, current.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+            reshaped = reshaped || !root->folders.contains(current.absoluteFilePath(subfolder));
+        if(reshaped)
+        {
+            scanRoot(root);
+            continue;
+        }
+
+        //names in the index are relative to the root
+        QString prefix = root->dir.relativeFilePath(folder);
+        prefix = prefix == "." ? QString() : prefix + "/";
+
+        QSet<QString> present;
+        foreach(QString name, current.entryList(QStringList("*.dem"), QDir::Files))
+            present.insert(prefix + name);
+
+        QSet<QString> known;
+        foreach(QString name, root->knownReplays)
+        {
+            if(name.startsWith(prefix) && name.indexOf('/', prefix.size()) < 0)
+                known.insert(name);
+        }
+
+        QSet<QString> added = present - known;
+        QSet<QString> removed = known - present;
+        if(added.isEmpty() && removed.isEmpty())
+            continue;
+
+        ReplayIndex index(db, root->id);
+        if(added.size() == 1 && removed.size() == 1 && index.rename(*removed.begin(), *added.begin()))
+        {
+            //one file went away as another appeared, that's a rename; it keeps its title and only its row changes
+            model->refreshReplay(index.matchId(*added.begin()));
+        }
+        else if(added.isEmpty() && removed.size() == 1)
+        {
+            //a single delete only takes out its row, and an archived replay keeps it
+            if(!index.isArchived(*removed.begin()))
+            {
+                int row = model->rowOf(index.matchId(*removed.begin()));
+                index.remove(removed.toList());
+                if(row >= 0)
+                    model->replayRemoved(row);
                 else
-                {
-                    if(fileName.endsWith(".dem"))
-                    {
-                        list.append(fileName);
-                        query.bindValue(":filename", fileName);
-                        query.exec();
-                    }
-                }
+                    reload = true;                                          //not on screen, so where it was isn't known
             }
         }
+        else
+        {
+            //new ones show up as bare rows right away, then are read, hashed and gone through like in a scan
+            index.insert(added.toList());
+            index.remove(removed.toList());
+            toScan[root] += added.toList();
+            reload = true;
+        }
+        root->knownReplays -= removed;
+        root->knownReplays += added;
+        changed = true;
+    }
 
-        if (ok && !dir.exists(dir.absolutePath()))
-            ok = false;
+    if(!changed)
+        return;
 
-        db.commit();
-        checkDb();
-        model->select();
-        ui->tableView->resizeColumnsToContents();
+    if(reload)
+    {
+        model->reload();
+        resizeColumns();
+    }
+    for(QHash<ReplayRoot*, QStringList>::const_iterator it = toScan.constBegin(); it != toScan.constEnd(); ++it)
+        scanRoot(it.key(), it.value());
+    ui->statusBar->showMessage(QString("%1 replays").arg(replayCount()), 5000);
 }
 
 /*
@@ -187,13 +817,44 @@ QPixmap MainWindow::getImage(QString type, QString name)
 
 void MainWindow::on_watchReplay_clicked()
 {
-    queryModel.setQuery("SELECT * FROM replays");
+    //archived replays have to be back in the folder for dota to play them
+    ReplayRow replay = model->replay(ui->tableView->selectionModel()->currentIndex().row());
+    if(!QFile::exists(replayPath(replay.rootId, replay.fileName)) && ReplayIndex(db, replay.rootId).isArchived(replay.fileName))
+        restoreReplay(replay.rootId, replay.fileName);
+    else
+        showPlayDemo(replay.rootId, replay.fileName);
+}
+
+/*
+ * playdemo takes a path below the game's replay folder, which is where its replays/ prefix points.
+ * Replays in the other folders can't be played from where they are, so the dialog says to copy them there first.
+ */
+void MainWindow::showPlayDemo(int rootId, const QString &fileName)
+{
+    QString path = QFileInfo(replayPath(rootId, fileName)).absoluteFilePath();
+    QString relative = dir.relativeFilePath(path);
+    bool inReplayFolder = !QDir::isAbsolutePath(relative) && !relative.startsWith("../");
+
+    QString text;
+    if(inReplayFolder)
+    {
+        text = QString("Type This Into Dota 2 Console: <p> <pre>playdemo replays/%1</pre>").arg(relative.toHtmlEscaped());
+    }
+    else
+    {
+        text = QString("This replay is in <pre>%1</pre> which is not your Dota 2 replay folder. "
+                       "Copy it to <pre>%2</pre> first, then type this into the Dota 2 console: <p> <pre>playdemo replays/%3</pre>")
+                .arg(QDir::toNativeSeparators(QFileInfo(path).absolutePath()).toHtmlEscaped())
+                .arg(QDir::toNativeSeparators(dir.absolutePath()).toHtmlEscaped())
+                .arg(QFileInfo(path).fileName().toHtmlEscaped());
+    }
+
     QDialog dialog(this);
     QVBoxLayout *layout = new QVBoxLayout;
     QTextEdit *textEdit = new QTextEdit;
     textEdit->setReadOnly(true);
     layout->addWidget(textEdit);
-    textEdit->setHtml(QString("Type This Into Dota 2 Console: <p> <pre>playdemo replays/%1</pre><p><em>make sure the replay is in your default dota 2 replay directory</em>").arg(queryModel.record(ui->tableView->selectionModel()->currentIndex().row()).value("filename").toString()));
+    textEdit->setHtml(text);
     QDialogButtonBox *buttonBox = new QDialogButtonBox;
     QPushButton *acceptButton = new QPushButton(tr("Ok"));
     buttonBox->addButton(acceptButton, QDialogButtonBox::AcceptRole);
@@ -208,46 +869,64 @@ void MainWindow::on_watchReplay_clicked()
     layout->deleteLater();
 }
 
-void MainWindow::setMatchInfo()
+void MainWindow::matchDownloaded(const QUrl &url, const QString &fileName, bool ok)
 {
-    //we need to make sure we don't use this slot anymore since this is in the slot.
-    //if we kept this slot enabled we would keep calling this everytime a download is finished and continous loop.
-    http.disconnect();
+    Q_UNUSED(fileName);
+
+    //every image download lands here as well, we only care about the match json
+    if(url != matchUrl)
+        return;
+
+    matchUrl = QUrl();
+    if(!ok)
+    {
+        ui->statusBar->showMessage("Could not download the match info", 30000);
+        return;
+    }
 
+    //the selection may have moved on while the json was loading, so go by the match the request was for
+    setMatchInfo(QUrlQuery(url).queryItemValue("match_id"));
+}
+
+void MainWindow::setMatchInfo(const QString &matchID)
+{
     ui->tabWidget->setCurrentIndex(0);
 
-    QString matchID = queryModel.record(ui->tableView->selectionModel()->currentIndex().row()).value("filename").toString().remove(".dem");
+    //the previous match may still be fetching images, it reports nothing once it is gone
+    delete MatchParser;
+    MatchParser = new matchInfo(this);
+    MatchParser->parse(downloadsDir.path() + "/" + matchID + ".json");
+    pendingImages.clear();
 
-    //test matchInfo parse class
-    matchInfo MatchParser;
-    MatchParser.parse(downloadsDir.path() + "/" + matchID + ".json");
+    const MatchRecord &match = MatchParser->record();
+    MatchStore(db).ingest(match);
 
     //display basic match info
-    ui->winner->setText( MatchParser.getMatchWinner() );
-    ui->matchID->setText( MatchParser.getMatchID() );
-    ui->gameMode->setText( MatchParser.getGameMode() );
-    ui->startTime->setText( MatchParser.getStartTime() );
-    ui->lobbyType->setText( MatchParser.getLobbyType() );
-    ui->duration->setText( MatchParser.getDuration() );
-    ui->fbTime->setText( MatchParser.getFirstBloodTime() );
+    ui->winner->setText( MatchParser->getMatchWinner() );
+    ui->matchID->setText( QString::number(match.matchID) );
+    ui->gameMode->setText( match.gameMode );
+    ui->startTime->setText( matchInfo::startTimeText(match.startTime) );
+    ui->lobbyType->setText( match.lobbyType );
+    ui->duration->setText( matchInfo::durationText(match.duration) );
+    ui->fbTime->setText( matchInfo::durationText(match.firstBloodTime) );
 
     //if CM, then display picks & bans
-    if(MatchParser.getGameMode().compare("Captains Mode") == 0)
+    if(match.gameMode.compare("Captains Mode") == 0)
     {
         for(int i=0; i < 5; i++)
         {
-            radiantBansUI[i]->setText("<img src=\"" + downloadsDir.path() + "/" + MatchParser.getBans()[0][i] + "_sb.png\" width=\"45\" />");
-            radiantPicksUI[i]->setText("<img src=\"" + downloadsDir.path() + "/" + MatchParser.getPicks()[0][i] + "_sb.png\" width=\"45\" />");
+            setImage(radiantBansUI[i], match.bans[0][i] + "_sb.png");
+            setImage(radiantPicksUI[i], match.picks[0][i] + "_sb.png");
         }
 
         for(int i=0; i<5; i++)
         {
             //Pixmap display higher quality, but using html <img> is easier but does not display as good of quality
             //QPixmap pic;
-            //pic.load("downloads/" + MatchParser.getBans()[1][i] + "_sb.png");
+            //pic.load("downloads/" + match.bans[1][i] + "_sb.png");
 
-            direBansUI[i]->setText("<img src=\"" + downloadsDir.path() + "/" + MatchParser.getBans()[1][i] + "_sb.png\" width=\"45\" />");
-            direPicksUI[i]->setText("<img src=\"" + downloadsDir.path() + "/" + MatchParser.getPicks()[1][i] + "_sb.png\" width=\"45\" />");
+            setImage(direBansUI[i], match.bans[1][i] + "_sb.png");
+            setImage(direPicksUI[i], match.picks[1][i] + "_sb.png");
         }
     }
     else //match was not CM, clear images
@@ -264,29 +943,69 @@ void MainWindow::setMatchInfo()
     for(int i=0; i<2; i++)
         for(int j=0; j<5; j++)
         {
-            //qDebug() << "<img src=\"file:///" + downloadsDir.path() + "/" + MatchParser.getPlayerHeroName()[i][j].value("name").toString() + "_sb.png\" width=\"45\" />";
-            playerNameUI[i][j]->setText( MatchParser.getPlayerNames()[i][j] );
-            playerLevelUI[i][j]->setText( MatchParser.getPlayerLevel()[i][j] );
-            playerHeroPicUI[i][j]->setText( "<img src=\"" + downloadsDir.path() + "/" + MatchParser.getPlayerHeroName()[i][j].value("name").toString() + "_sb.png\" width=\"45\" />" );
-            playerHeroNameUI[i][j]->setText( MatchParser.getPlayerHeroName()[i][j].value("localized_name").toString() );
-            playerKillsUI[i][j]->setText( MatchParser.getPlayerKills()[i][j] );
-            playerDeathsUI[i][j]->setText( MatchParser.getPlayerDeaths()[i][j] );
-            playerAssistsUI[i][j]->setText( MatchParser.getPlayerAssists()[i][j] );
-            playerGoldUI[i][j]->setText( MatchParser.getPlayerGold()[i][j] );
-            playerLastHitsUI[i][j]->setText( MatchParser.getPlayerLH()[i][j] );
-            playerDeniesUI[i][j]->setText( MatchParser.getPlayerDN()[i][j] );
-            playerGPMUI[i][j]->setText( MatchParser.getPlayerGPM()[i][j] );
-            playerXPMUI[i][j]->setText( MatchParser.getPlayerXPM()[i][j] );
+            const PlayerSlot &player = match.players[i][j];
+
+            playerNameUI[i][j]->setText( player.accountName );
+            playerLevelUI[i][j]->setText( QString::number(player.level) );
+            setImage(playerHeroPicUI[i][j], player.heroName + "_sb.png");
+            playerHeroNameUI[i][j]->setText( player.heroLocalizedName );
+            playerKillsUI[i][j]->setText( QString::number(player.kills) );
+            playerDeathsUI[i][j]->setText( QString::number(player.deaths) );
+            playerAssistsUI[i][j]->setText( QString::number(player.assists) );
+            playerGoldUI[i][j]->setText( QString::number(player.goldSpent) );
+            playerLastHitsUI[i][j]->setText( QString::number(player.lastHits) );
+            playerDeniesUI[i][j]->setText( QString::number(player.denies) );
+            playerGPMUI[i][j]->setText( QString::number(player.gpm) );
+            playerXPMUI[i][j]->setText( QString::number(player.xpm) );
 
             //display items
             for(int k=0; k<6; k++)
             {
                 //only display image if it is not empty
-                if(MatchParser.getPlayerItems()[i][j][k] != "empty")
-                    playerItemsUI[i][j][k]->setText( "<img src=\"" + downloadsDir.path() + "/" + MatchParser.getPlayerItems()[i][j][k] + "_lg.png\" width=\"32\"/>" );
+                if(player.items[k] != "empty")
+                    setImage(playerItemsUI[i][j][k], player.items[k] + "_lg.png");
+                else
+                    playerItemsUI[i][j][k]->clear();
             }
         }
 
+    //the scoreboard is up, icons drop in as they arrive
+    ui->statusBar->showMessage("Loading Images...");
+    connect(MatchParser, SIGNAL(imageReady(QString)), SLOT(showImage(QString)));
+    connect(MatchParser, SIGNAL(imagesFinished()), SLOT(matchImagesFinished()));
+    MatchParser->downloadImages(&http, matchToken);
+}
+
+/*
+ * Points label at an image in the downloads dir.
+ * If it hasn't been downloaded yet, the label stays empty until showImage() is called for it.
+ */
+void MainWindow::setImage(QLabel *label, const QString &fileName)
+{
+    pendingImages.insert(fileName, label);
+
+    if(QFile::exists(downloadsDir.path() + "/" + fileName))
+        label->setText(imageHtml(fileName));
+    else
+        label->clear();
+}
+
+QString MainWindow::imageHtml(const QString &fileName)
+{
+    //hero portraits are the small "_sb" images, everything else is an item
+    int width = fileName.endsWith("_sb.png") ? 45 : 32;
+    return QString("<img src=\"%1/%2\" width=\"%3\" />").arg(downloadsDir.path(), fileName).arg(width);
+}
+
+void MainWindow::showImage(const QString &fileName)
+{
+    foreach(QLabel *label, pendingImages.values(fileName))
+        label->setText(imageHtml(fileName));
+}
+
+void MainWindow::matchImagesFinished()
+{
+    pendingImages.clear();
     ui->statusBar->showMessage("Loading Complete!", 30000);     //display message in status bar for 30 sec.
 }
 
@@ -300,24 +1019,23 @@ void MainWindow::on_viewMatchButton_clicked()
     }
     ui->statusBar->showMessage("Loading...");
 
-    queryModel.setQuery("SELECT * FROM replays");
-    QString matchID = queryModel.record(ui->tableView->selectionModel()->currentIndex().row()).value("filename").toString().remove(".dem");
+    QString matchID = QFileInfo(model->replay(ui->tableView->selectionModel()->currentIndex().row()).fileName).completeBaseName();
     downloadMatch(matchID);
 }
 
 void MainWindow::on_editTitle_clicked()
 {
-    queryModel.setQuery("SELECT * FROM replays");
+    //go by the key afterwards, not the row: a scan can reload the table while the dialog is up
+    ReplayRow replay = model->replay(ui->tableView->selectionModel()->currentIndex().row());
     EditTitle title;
-    title.setTitle(queryModel.record(ui->tableView->selectionModel()->currentIndex().row()).value("title").toString());
+    title.setTitle(replay.title);
     if(title.exec())
     {
-        QSqlQuery query("update replays set title = :title WHERE filename = :filename");
+        QSqlQuery query("update replays set title = :title WHERE match_id = :match_id");
         query.bindValue(0, title.getTitle());
-        query.bindValue(1, queryModel.record(ui->tableView->selectionModel()->currentIndex().row()).value("filename").toString());
+        query.bindValue(1, replay.matchID);
         query.exec();
-        model->select();
-        ui->tableView->resizeColumnsToContents();
+        model->refreshReplay(replay.matchID);
     }
 }
 
@@ -325,15 +1043,27 @@ void MainWindow::on_actionPreferences_triggered()
 {
     Preferences pref;
     pref.setDir(settings->value("replayFolder").toString());
+    pref.setOtherDirs(settings->value("otherReplayFolders").toStringList());
     pref.setApiKey(apiKey);
+    pref.setArchiveDays(settings->value("archiveAfterDays", 0).toInt());
     if(pref.exec())
     {
+        settings->setValue("archiveAfterDays", pref.getArchiveDays());
         dir = pref.getDir();
         apiKey = pref.getApiKey();
         settings->setValue("replayFolder", pref.getDir());
+        settings->setValue("otherReplayFolders", pref.getOtherDirs());
         settings->setValue("apiKey", apiKey);
         settings->sync();
-        addFilesToDb();
+
+        //folders that were there before are left alone, the watcher keeps them up to date
+        foreach(int id, setupRoots())
+        {
+            ReplayRoot *root = rootForId(id);
+            if(root)
+                scanRoot(root);
+        }
+        model->reload();
     }
 }
 
@@ -344,20 +1074,105 @@ void MainWindow::on_actionClear_Cache_triggered()
     cache.mkdir(downloadsDir.path());
 }
 
-void MainWindow::on_deleteReplayButton_clicked()
+/*
+ * Replays with the same content, by hash, can be swapped for links to one copy.
+ * Each one is compared byte for byte before it is replaced.
+ */
+void MainWindow::on_actionFind_Duplicates_triggered()
+{
+    if(dedup.isRunning())
+        return;
+
+    QList<QList<ReplayFile> > groups = ReplayIndex(db).duplicates();
+
+    int copies = 0;
+    qint64 wasted = 0;
+    foreach(const QList<ReplayFile> &group, groups)
+    {
+        copies += group.size() - 1;
+        wasted += (group.size() - 1) * group.first().size;
+    }
+
+    if(copies == 0)
+    {
+        QMessageBox::information(this, tr("Find Duplicates"), tr("No duplicate replays found"));
+        return;
+    }
+
+    if(QMessageBox::question(this, tr("Find Duplicates"),
+                             tr("%1 replays are copies of another one, taking up %2 MB.\nReplace the copies with links to a single file? Titles are kept.")
+                             .arg(copies).arg(wasted / (1024 * 1024)),
+                             QMessageBox::Yes | QMessageBox::No) != QMessageBox::Yes)
+    {
+        return;
+    }
+
+    //already the same file as the one we keep, nothing to read
+    QList<QPair<QString, QString> > links;
+    foreach(const QList<ReplayFile> &group, groups)
+    {
+        const ReplayFile &original = group.first();
+        QString originalPath = replayPath(original.rootId, original.fileName);
+        for(int i = 1; i < group.size(); i++)
+        {
+            if(original.inode == 0 || group.at(i).inode != original.inode)
+                links.append(qMakePair(originalPath, replayPath(group.at(i).rootId, group.at(i).fileName)));
+        }
+    }
+
+    //each copy is compared byte for byte before it is linked, which reads both files; off the GUI thread
+    dedupProgress = new QProgressDialog(tr("Linking duplicates..."), tr("Cancel"), 0, links.size(), this);
+    dedupProgress->setWindowModality(Qt::WindowModal);
+    dedupProgress->setMinimumDuration(0);
+    connect(&dedup, SIGNAL(progressRangeChanged(int,int)), dedupProgress, SLOT(setRange(int,int)));
+    connect(&dedup, SIGNAL(progressValueChanged(int)), dedupProgress, SLOT(setValue(int)));
+    connect(dedupProgress, SIGNAL(canceled()), &dedup, SLOT(cancel()));
+    dedup.setFuture(QtConcurrent::mapped(links, &ReplayDedup::linkCopy));
+}
+
+void MainWindow::duplicatesLinked()
 {
-    queryModel.setQuery("SELECT * FROM replays");
-    QString filename = queryModel.record(ui->tableView->selectionModel()->currentIndex().row()).value("filename").toString();
-    QFile::remove(dir.absolutePath() + "/" + filename);
+    dedupProgress->deleteLater();
+    dedupProgress = 0;
+
+    //only the copies done before a cancel have results
+    int linked = dedup.future().results().count(true);
+    ui->statusBar->showMessage(tr("Linked %1 duplicate replays").arg(linked), 5000);
     addFilesToDb();
+}
+
+void MainWindow::on_deleteReplayButton_clicked()
+{
+    int row = ui->tableView->selectionModel()->currentIndex().row();
+    ReplayRow replay = model->replay(row);
+    if(replay.fileName.isEmpty())
+        return;
+
+    QFile::remove(replayPath(replay.rootId, replay.fileName));
+
+    //an archived one only has its compressed copy
+    if(QFile::remove(archivePath(replay.rootId, replay.fileName)))
+        ReplayIndex(db, replay.rootId).setArchived(replay.fileName, -1);
+
+    //out of the index and the table right away, so when the watcher reports the file gone there is nothing left to do
+    ReplayIndex(db, replay.rootId).remove(QStringList(replay.fileName));
+    ReplayRoot *root = rootForId(replay.rootId);
+    if(root)
+        root->knownReplays.remove(replay.fileName);
+    model->replayRemoved(row);
     ui->deleteReplayButton->setEnabled(false);
 }
 
 void MainWindow::downloadMatch(QString id)
 {
-    http.append("https://computerfr33k-dota-2-replay-manager.p.mashape.com/json-mashape.php?match_id=" + id);
+    //drop whatever is still loading for the previous match, so this one is next on the wire
+    matchUrl = QUrl();
+    http.cancel(matchToken);
+    matchToken = http.createToken();
+
+    matchUrl = QUrl("https://computerfr33k-dota-2-replay-manager.p.mashape.com/json-mashape.php?match_id=" + id);
     http.setRawHeader(QByteArray("X-Mashape-Authorization"), apiKey.toLatin1());
-    connect(&http, SIGNAL(finished()), SLOT(setMatchInfo()));
+    http.append(matchUrl, Http::Interactive, matchToken);
 }
 
 void MainWindow::on_actionAbout_Qt_triggered()
@@ -393,6 +1208,53 @@ void MainWindow::on_tableView_clicked(const QModelIndex &index)
     }
 }
 
+void MainWindow::on_searchEdit_textChanged(const QString &text)
+{
+    Q_UNUSED(text);
+    searchTimer->start();
+}
+
+void MainWindow::applySearch()
+{
+    QString text = ui->searchEdit->text().trimmed();
+    model->setSearchText(text);
+    resizeColumns();
+
+    ui->watchReplay->setEnabled(false);
+    ui->editTitle->setEnabled(false);
+    ui->viewMatchButton->setEnabled(false);
+    ui->deleteReplayButton->setEnabled(false);
+
+    if(!text.isEmpty())
+        ui->statusBar->showMessage(QString("%1 replays found in %2 ms").arg(model->rowCount()).arg(model->searchMsecs()), 5000);
+}
+
+void MainWindow::applyFilter()
+{
+    ReplayFilter filter;
+    bool dates = ui->dateFilterCheck->isChecked();
+    ui->fromDateEdit->setEnabled(dates);
+    ui->toDateEdit->setEnabled(dates);
+    if(dates)
+    {
+        filter.from = ui->fromDateEdit->date();
+        filter.to = ui->toDateEdit->date();
+    }
+    filter.gameMode = ui->gameModeFilter->itemData(ui->gameModeFilter->currentIndex()).toString();
+    filter.hero = ui->heroFilter->itemData(ui->heroFilter->currentIndex()).toString();
+    filter.winner = ui->winnerFilter->itemData(ui->winnerFilter->currentIndex()).toString();
+
+    model->setFilter(filter);
+    resizeColumns();
+
+    ui->watchReplay->setEnabled(false);
+    ui->editTitle->setEnabled(false);
+    ui->viewMatchButton->setEnabled(false);
+    ui->deleteReplayButton->setEnabled(false);
+
+    ui->statusBar->showMessage(QString("%1 replays shown").arg(model->rowCount()), 5000);
+}
+
 void MainWindow::on_refreshButton_clicked()
 {
     addFilesToDb();
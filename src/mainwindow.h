@@ -12,18 +12,30 @@
 #include <QPixmap>
 #include <QMessageBox>
 #include <QSqlRecord>
+#include <QSqlError>
 #include <QTextEdit>
 #include <QDialog>
 #include <QDialogButtonBox>
 #include <QProgressDialog>
+#include <QProgressBar>
+#include <QPushButton>
 #include <QSslError>
 #include <QDebug>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QtConcurrent>
 
 #include "edittitle.h"
 #include "preferences.h"
 #include "http.h"
-#include "thread.h"
+#include "replayscanner.h"
 #include "matchinfo.h"
+#include "matchstore.h"
+#include "replayindex.h"
+#include "replayarchive.h"
+#include "replaydedup.h"
+#include "replaytablemodel.h"
+#include "replaysearch.h"
 #include "firstrun.h"
 
 namespace Ui {
@@ -42,7 +54,6 @@ public:
 
 protected:
     void start();
-    void checkDb();
     void addFilesToDb();
 
     void downloadMatch(QString);
@@ -55,22 +66,79 @@ private slots:
     void on_editTitle_clicked();
     void on_actionPreferences_triggered();
     void on_actionClear_Cache_triggered();
+    void on_actionFind_Duplicates_triggered();
     void on_actionAbout_Qt_triggered();
     void on_actionAbout_triggered();
     void on_actionWebsite_triggered();
     void on_tableView_clicked(const QModelIndex &index);
     void on_refreshButton_clicked();
+    void on_searchEdit_textChanged(const QString &text);
+    void applySearch();
+    void applyFilter();
     void on_deleteReplayButton_clicked();
     void on_actionCheck_For_Updates_triggered();
     void networkError();
     void sslError();
-    void setMatchInfo();
+    void setMatchInfo(const QString &matchID);
+    void matchDownloaded(const QUrl &url, const QString &fileName, bool ok);
+    void showImage(const QString &fileName);
+    void matchImagesFinished();
+    void matchesBackfilled();
+    void replaysFound(const QStringList &fileNames);
+    void replaysChanged(const QList<ReplayFile> &files);
+    void replaysRead(const QList<DemoInfo> &infos);
+    void replaysUnreadable(const QList<ReplayFile> &files);
+    void replaysHashed(const QList<ReplayFile> &files);
+    void replayTimelinesRead(const QList<ReplayTimeline> &timelines);
+    void replayArchived(int rootId, const QString &fileName, qint64 originalSize, qint64 archivedSize, qint64 msecs);
+    void replayRestored();
+    void duplicatesLinked();
+    void replaysListed(const QStringList &folders);
+    void scanProgressed(int done, int total);
+    void cancelScan();
+    void scanFinished(bool completed);
+    void folderChanged(const QString &path);
+    void checkAllFolders();
+    void applyFolderChanges();
+    void retryUnreadable();
 
     void on_actionTutorial_triggered();
 
 private:
+    //a folder replays are taken from, with its subfolders
+    struct ReplayRoot
+    {
+        ReplayRoot() : id(0), scanner(0), rescanPending(false), done(0), total(0) {}
+
+        int id;                             //root_id in the index
+        QDir dir;
+        ReplayScanner *scanner;             //lists this folder off the GUI thread
+        bool rescanPending;                 //a rescan was asked for while a scan was running
+        QStringList list;                   //replay files found by the scan going on
+        QSet<QString> knownReplays;         //replay files as of the last scan or change we applied, relative to dir
+        QStringList folders;                //dir and every folder below it, as of the last scan
+        QHash<QString, ReplayFile> unreadable;  //no file info yet, with the stat data it was read at; tried again while it changes
+        int done;                           //progress of the scan going on
+        int total;
+    };
+
     void initializeUIPointers();
-    //Thread *thread;
+    QList<int> setupRoots();            //returns the ids of roots that weren't there before
+    void scanRoot(ReplayRoot *root, const QStringList &fileNames = QStringList());    //just those files, if any are given
+    ReplayRoot *rootForId(int id);
+    ReplayRoot *rootForScanner(QObject *scanner);
+    ReplayRoot *rootForPath(const QString &path);
+    void resizeColumns();
+    void fillFilters();                 //game modes and heroes there are replays of
+    int replayCount() const;
+    void watchReplayFolders();
+    void archiveOldReplays();
+    QString replayPath(int rootId, const QString &fileName);
+    QString archivePath(int rootId, const QString &fileName);
+    void restoreReplay(int rootId, const QString &fileName);
+    void showPlayDemo(int rootId, const QString &fileName);    //the playdemo command, or where to copy the replay first
+    void setImage(QLabel *label, const QString &fileName);
+    QString imageHtml(const QString &fileName);
 
     //array of labels for UI
     //use array because it will be less code and allow us to iterate through them with for loops.
@@ -95,20 +163,42 @@ private:
     //
 
     QSettings *settings;
-    QDir dir;                           //replay Dir
+    QDir dir;                           //replay Dir of the game, the first root
     QDir userDir;                       //AppData Location for storing program settings
     QDir downloadsDir;
+    QDir archiveDir;                    //compressed copies of old replays
     QFont font;
     Ui::MainWindow *ui;
+    matchInfo *MatchParser;             //match being viewed, kept around while its images download
+    QMultiHash<QString, QLabel*> pendingImages;     //image file name -> labels waiting to show it
     QSqlDatabase db;                    //for the database of files and names
-    QSqlTableModel *model;
-    QSqlQueryModel queryModel;          //for querying the sqlite3 db
-    QStringList list;                   //list of replay files
+    ReplayTableModel *model;
     QString picDir;                     //dir where images are located. (./thumbnails)
     QString apiKey;
     QPixmap image;                      //QPixmap object that is empty, useful so we only need one object for empty images instead of multiple.
     bool block;                         //if true, block all network requests
     Http http;
+    QUrl matchUrl;                      //match json we are waiting on
+    int matchToken;                     //tags every download for the match being viewed, so it can be cancelled
+    QList<ReplayRoot*> roots;           //the game's replay folder first, then the others from the preferences
+    QFileSystemWatcher *watcher;        //watches every folder of every root for new, deleted and renamed replays
+    QSet<QString> changedFolders;       //reported by the watcher, waiting for changeTimer
+    QTimer *changeTimer;
+    QTimer *retryTimer;                 //goes back to replays that couldn't be read, in case they were still being written
+    QTimer *consistencyTimer;
+    QTimer *searchTimer;
+    QProgressBar *scanProgress;         //in the status bar while changed replays are read and hashed
+    QPushButton *cancelScanButton;
+    ReplayArchiver *archiver;           //moves old replays into the archive
+    QFutureWatcher<bool> matchBackfill; //stores the match json downloaded before matches.db had the stats tables
+    QAtomicInt stopBackfill;
+    QFutureWatcher<bool> restoring;     //an archived replay being put back to be watched
+    int restoreRootId;                  //which one, by name rather than row, the table may change under it
+    QString restoreFileName;
+    QElapsedTimer restoreTimer;
+    QProgressDialog *restoreProgress;
+    QFutureWatcher<bool> dedup;         //duplicate replays being checked and linked, one result per copy
+    QProgressDialog *dedupProgress;
 };
 
 #endif // MAINWINDOW_H
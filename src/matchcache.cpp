@@ -0,0 +1,218 @@
+#include "matchcache.h"
+
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <string.h>
+
+namespace
+{
+    //on disk layout, all in native byte order since the file never leaves this machine
+
+    struct Header
+    {
+        char magic[4];                  //"D2MC"
+        quint32 version;
+        qint64 jsonSize;                //the json this was made from, so a re-downloaded match is noticed
+        qint64 jsonModified;
+        quint32 stringsOffset;
+        quint32 stringsSize;
+    };
+
+    //strings are offsets into the pool, each stored as a quint32 length followed by utf-8
+    struct StoredPlayer
+    {
+        quint32 accountName;
+        quint32 heroName;
+        quint32 heroLocalizedName;
+        quint32 items[6];
+        qint32 level;
+        qint32 kills;
+        qint32 deaths;
+        qint32 assists;
+        qint32 goldSpent;
+        qint32 lastHits;
+        qint32 denies;
+        qint32 gpm;
+        qint32 xpm;
+    };
+
+    struct StoredMatch
+    {
+        qint64 matchID;
+        qint64 startTime;
+        quint32 gameMode;
+        quint32 lobbyType;
+        qint32 duration;
+        qint32 firstBloodTime;
+        quint32 radiantWin;
+        quint32 picks[2][5];
+        quint32 bans[2][5];
+        StoredPlayer players[2][5];
+    };
+
+    //builds the string pool, storing every distinct string once
+    class StringPool
+    {
+    public:
+        quint32 add(const QString &string)
+        {
+            if(offsets.contains(string))
+                return offsets.value(string);
+
+            QByteArray utf8 = string.toUtf8();
+            quint32 offset = data.size();
+            quint32 length = utf8.size();
+            data.append((const char*)&length, sizeof(length));
+            data.append(utf8);
+            offsets.insert(string, offset);
+            return offset;
+        }
+
+        QByteArray data;
+
+    private:
+        QHash<QString, quint32> offsets;
+    };
+
+    QString poolString(const uchar *pool, quint32 poolSize, quint32 offset)
+    {
+        quint32 length;
+        if(offset > poolSize || poolSize - offset < sizeof(length))
+            return QString();
+
+        memcpy(&length, pool + offset, sizeof(length));
+        if(poolSize - offset - sizeof(length) < length)
+            return QString();
+
+        return QString::fromUtf8((const char*)pool + offset + sizeof(length), length);
+    }
+}
+
+QString MatchCache::cacheFileName(const QString &jsonFile)
+{
+    QFileInfo info(jsonFile);
+    return info.path() + "/" + info.completeBaseName() + ".bin";
+}
+
+bool MatchCache::load(const QString &jsonFile, MatchRecord *match)
+{
+    QFileInfo json(jsonFile);
+    QFile file(cacheFileName(jsonFile));
+    if(!json.exists() || !file.open(QIODevice::ReadOnly) || file.size() < (qint64)(sizeof(Header) + sizeof(StoredMatch)))
+        return false;
+
+    uchar *data = file.map(0, file.size());
+    if(!data)
+        return false;
+
+    Header header;
+    memcpy(&header, data, sizeof(header));
+
+    //anything written by another schema, or for an older copy of the json, gets rebuilt
+    bool ok = memcmp(header.magic, "D2MC", 4) == 0 && header.version == Version
+            && header.jsonSize == json.size() && header.jsonModified == json.lastModified().toMSecsSinceEpoch()
+            && header.stringsOffset >= sizeof(Header) + sizeof(StoredMatch) && header.stringsOffset <= file.size()
+            && header.stringsSize <= file.size() - header.stringsOffset;
+
+    if(ok)
+    {
+        StoredMatch stored;
+        memcpy(&stored, data + sizeof(Header), sizeof(stored));
+        const uchar *pool = data + header.stringsOffset;
+        quint32 poolSize = header.stringsSize;
+
+        match->matchID = stored.matchID;
+        match->gameMode = poolString(pool, poolSize, stored.gameMode);
+        match->startTime = stored.startTime;
+        match->lobbyType = poolString(pool, poolSize, stored.lobbyType);
+        match->duration = stored.duration;
+        match->firstBloodTime = stored.firstBloodTime;
+        match->radiantWin = stored.radiantWin != 0;
+
+        for(int i=0; i<2; i++)
+            for(int j=0; j<5; j++)
+            {
+                match->picks[i][j] = poolString(pool, poolSize, stored.picks[i][j]);
+                match->bans[i][j] = poolString(pool, poolSize, stored.bans[i][j]);
+
+                const StoredPlayer &from = stored.players[i][j];
+                PlayerSlot &to = match->players[i][j];
+                to.accountName = poolString(pool, poolSize, from.accountName);
+                to.heroName = poolString(pool, poolSize, from.heroName);
+                to.heroLocalizedName = poolString(pool, poolSize, from.heroLocalizedName);
+                for(int k=0; k<6; k++)
+                    to.items[k] = poolString(pool, poolSize, from.items[k]);
+                to.level = from.level;
+                to.kills = from.kills;
+                to.deaths = from.deaths;
+                to.assists = from.assists;
+                to.goldSpent = from.goldSpent;
+                to.lastHits = from.lastHits;
+                to.denies = from.denies;
+                to.gpm = from.gpm;
+                to.xpm = from.xpm;
+            }
+    }
+
+    file.unmap(data);
+    return ok;
+}
+
+bool MatchCache::save(const QString &jsonFile, const MatchRecord &match)
+{
+    QFileInfo json(jsonFile);
+    StringPool pool;
+
+    StoredMatch stored;
+    memset(&stored, 0, sizeof(stored));
+    stored.matchID = match.matchID;
+    stored.gameMode = pool.add(match.gameMode);
+    stored.startTime = match.startTime;
+    stored.lobbyType = pool.add(match.lobbyType);
+    stored.duration = match.duration;
+    stored.firstBloodTime = match.firstBloodTime;
+    stored.radiantWin = match.radiantWin ? 1 : 0;
+
+    for(int i=0; i<2; i++)
+        for(int j=0; j<5; j++)
+        {
+            stored.picks[i][j] = pool.add(match.picks[i][j]);
+            stored.bans[i][j] = pool.add(match.bans[i][j]);
+
+            const PlayerSlot &from = match.players[i][j];
+            StoredPlayer &to = stored.players[i][j];
+            to.accountName = pool.add(from.accountName);
+            to.heroName = pool.add(from.heroName);
+            to.heroLocalizedName = pool.add(from.heroLocalizedName);
+            for(int k=0; k<6; k++)
+                to.items[k] = pool.add(from.items[k]);
+            to.level = from.level;
+            to.kills = from.kills;
+            to.deaths = from.deaths;
+            to.assists = from.assists;
+            to.goldSpent = from.goldSpent;
+            to.lastHits = from.lastHits;
+            to.denies = from.denies;
+            to.gpm = from.gpm;
+            to.xpm = from.xpm;
+        }
+
+    Header header;
+    memcpy(header.magic, "D2MC", 4);
+    header.version = Version;
+    header.jsonSize = json.size();
+    header.jsonModified = json.lastModified().toMSecsSinceEpoch();
+    header.stringsOffset = sizeof(Header) + sizeof(StoredMatch);
+    header.stringsSize = pool.data.size();
+
+    //written to a temporary file and renamed, so a crash never leaves a half written copy behind
+    QSaveFile file(cacheFileName(jsonFile));
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)&stored, sizeof(stored));
+    file.write(pool.data);
+    return file.commit();
+}
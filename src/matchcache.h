@@ -0,0 +1,23 @@
+#ifndef MATCHCACHE_H
+#define MATCHCACHE_H
+
+#include <QString>
+#include "matchinfo.h"
+
+/*
+ * Binary copy of a parsed match, kept next to its json as <matchid>.bin.
+ * The layout is fixed: a header, the integer fields of the match and its players,
+ * and a pool of interned strings the fields point into. Loading it is a map and a copy, no parsing.
+ */
+class MatchCache
+{
+public:
+    static bool load(const QString &jsonFile, MatchRecord *match);         //false if there is no usable copy for this json
+    static bool save(const QString &jsonFile, const MatchRecord &match);
+    static QString cacheFileName(const QString &jsonFile);
+
+private:
+    enum { Version = 2 };                                                   //2: times as numbers
+};
+
+#endif // MATCHCACHE_H
@@ -1,262 +1,362 @@
 #include "matchinfo.h"
+#include "jsonreader.h"
+#include "matchcache.h"
+
+#include <QDateTime>
+#include <QFileInfo>
 
 matchInfo::matchInfo(QObject *parent) :
-    QObject(parent)
+    QObject(parent), http(0), token(0)
 {
-    //size our array accordingly
-    bans.resize(2);
-    picks.resize(2);
-    playerNames.resize(2);
-    playerLevel.resize(2);
-    playerHeroName.resize(2);
-    playerKills.resize(2);
-    playerDeaths.resize(2);
-    playerAssists.resize(2);
-    playerItems.resize(2);
-    playerGold.resize(2);
-    playerLH.resize(2);
-    playerDN.resize(2);
-    playerGPM.resize(2);
-    playerXPM.resize(2);
+    baseUrl = "http://media.steampowered.com/apps/dota2/images/";
+}
 
-    for(int i=0; i<2; i++)
-    {
-        bans[i].resize(5);
-        picks[i].resize(5);
-        playerNames[i].resize(5);
-        playerLevel[i].resize(5);
-        playerHeroName[i].resize(5);
-        playerKills[i].resize(5);
-        playerDeaths[i].resize(5);
-        playerAssists[i].resize(5);
-        playerItems[i].resize(5);
-        for(int j=0; j<5; j++)
-            playerItems[i][j].resize(6);
+void matchInfo::parse(const QString &filename)
+{
+    match = MatchRecord();
 
-        playerGold[i].resize(5);
-        playerLH[i].resize(5);
-        playerDN[i].resize(5);
-        playerGPM[i].resize(5);
-        playerXPM[i].resize(5);
-    }
+    //a match we have seen before comes straight from its binary copy, the json is only read the first time
+    if(MatchCache::load(filename, &match))
+        return;
 
-    baseUrl = "http://media.steampowered.com/apps/dota2/images/";
+    match = MatchRecord();
+    if(readMatch(filename, &match))
+        MatchCache::save(filename, match);
 }
 
-void matchInfo::parse(const QString &filename)
+/*
+ * Reads the fields we show straight out of the json file into match.
+ * The file is memory mapped and walked once with a JsonReader, nothing else is kept around.
+ */
+bool matchInfo::readMatch(const QString &filename, MatchRecord *match)
 {
     QFile file(filename);
-    if(!file.open(QIODevice::ReadOnly))
+    if(!file.open(QIODevice::ReadOnly) || file.size() == 0)
     {
         //qDebug() << "Could Not Open file: " << filename;
-        return;
+        return false;
     }
 
-    json = QJsonDocument::fromJson(file.readAll());
+    uchar *data = file.map(0, file.size());
+    if(!data)
+        return false;
 
-    //parse basic match info
-    matchID = json.object().value("match_id").toString();
-    gameMode = json.object().value("game_mode").toString();
-    startTime = json.object().value("start_time").toString();
-    lobbyType = json.object().value("lobby_type").toString();
-    duration = json.object().value("duration").toString();
-    firstBloodTime = json.object().value("first_blood_time").toString();
+    JsonReader reader((const char*)data, file.size());
+    bool ok = reader.next() == JsonReader::BeginObject;
 
-    //parse picks & bans if CM
-    if(gameMode.compare("Captains Mode") == 0)
+    while(ok && reader.nextKey())
     {
-        for(int i=0; i < 2; i++)
+        //basic match info
+        if(reader.readKey("match_id"))
+            match->matchID = reader.toLongLong();
+        else if(reader.readKey("game_mode"))
+            match->gameMode = reader.toString();
+        else if(reader.readKey("start_time"))
+            match->startTime = parseStartTime(reader.toString());
+        else if(reader.readKey("lobby_type"))
+            match->lobbyType = reader.toString();
+        else if(reader.readKey("duration"))
+            match->duration = parseDuration(reader.toString());
+        else if(reader.readKey("first_blood_time"))
+            match->firstBloodTime = parseDuration(reader.toString());
+        else if(reader.readKey("radiant_win"))
+            match->radiantWin = reader.toBool();
+        else if(reader.readKey("picks_bans"))
+            readPicksBans(reader, match);
+        else if(reader.readKey("slots"))
+            readSlots(reader, match);
+        else
+            reader.skip();
+    }
+
+    ok = ok && !reader.hasError();
+    file.unmap(data);
+    return ok;
+}
+
+//picks_bans: { radiant: { bans: [ {name}, ... ], picks: [ ... ] }, dire: { ... } }, only there for CM/CD games
+void matchInfo::readPicksBans(JsonReader &reader, MatchRecord *match)
+{
+    if(reader.token() != JsonReader::BeginObject)
+    {
+        reader.skip();
+        return;
+    }
+
+    while(reader.nextKey())
+    {
+        int team = reader.isKey("radiant") ? 0 : (reader.isKey("dire") ? 1 : -1);
+        reader.next();
+        if(team < 0 || reader.token() != JsonReader::BeginObject)
         {
-            for(int j=0; j < 5; j++)
+            reader.skip();
+            continue;
+        }
+
+        while(reader.nextKey())
+        {
+            QString *list = reader.isKey("bans") ? match->bans[team] : (reader.isKey("picks") ? match->picks[team] : 0);
+            reader.next();
+            if(!list || reader.token() != JsonReader::BeginArray)
             {
-                if(i == 0)
+                reader.skip();
+                continue;
+            }
+
+            for(int j=0; reader.nextElement(); j++)
+            {
+                if(reader.token() != JsonReader::BeginObject)
                 {
-                    bans[i][j] = json.object().value("picks_bans").toObject().value("radiant").toObject().value("bans").toArray().at(j).toObject().value("name").toString();
-                    picks[i][j] = json.object().value("picks_bans").toObject().value("radiant").toObject().value("picks").toArray().at(j).toObject().value("name").toString();
+                    reader.skip();
+                    continue;
                 }
-                else
+
+                while(reader.nextKey())
                 {
-                    bans[i][j] = json.object().value("picks_bans").toObject().value("dire").toObject().value("bans").toArray().at(j).toObject().value("name").toString();
-                    picks[i][j] = json.object().value("picks_bans").toObject().value("dire").toObject().value("picks").toArray().at(j).toObject().value("name").toString();
+                    if(reader.readKey("name") && j < 5)
+                        list[j] = reader.toString();
+                    else
+                        reader.skip();
                 }
             }
         }
     }
-
-    //used for holding either 'dire' or 'radiant' depending on which part of the for loop we are in.
-    QString team;
-    for(int i=0; i<2; i++)
-        for(int j=0; j<5; j++)
-        {
-            team = (i == 0) ? "radiant" : "dire";       //if else statement, just in a single line.
-            playerNames[i][j] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("account_name").toString();
-            playerLevel[i][j] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("level").toString();
-            playerHeroName[i][j] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("hero").toObject();
-            playerKills[i][j] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("kills").toString();
-            playerDeaths[i][j] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("deaths").toString();
-            playerAssists[i][j] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("assists").toString();
-            playerGold[i][j] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("gold_spent").toString();
-            playerLH[i][j] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("last_hits").toString();
-            playerDN[i][j] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("denies").toString();
-            playerGPM[i][j] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("gold_per_min").toString();
-            playerXPM[i][j] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("xp_per_min").toString();
-
-            //parse items into the array (QVector)
-            for(int k=0; k<6; k++)
-            {
-                playerItems[i][j][k] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("item_" + QString::number(k) ).toString();
-            }
-        }
-
-    //Now Download Images since we are done parsing
-    downloadImages();
-}
-
-QString matchInfo::getMatchID()
-{
-    return matchID;
 }
 
-QString matchInfo::getGameMode()
+//slots: { radiant: [ player, ... ], dire: [ ... ] }
+void matchInfo::readSlots(JsonReader &reader, MatchRecord *match)
 {
-    return gameMode;
-}
-
-QString matchInfo::getStartTime()
-{
-    return startTime;
-}
-
-QString matchInfo::getLobbyType()
-{
-    return lobbyType;
-}
-
-QString matchInfo::getDuration()
-{
-    return duration;
-}
+    if(reader.token() != JsonReader::BeginObject)
+    {
+        reader.skip();
+        return;
+    }
 
-QString matchInfo::getFirstBloodTime()
-{
-    return firstBloodTime;
-}
+    while(reader.nextKey())
+    {
+        int team = reader.isKey("radiant") ? 0 : (reader.isKey("dire") ? 1 : -1);
+        reader.next();
+        if(team < 0 || reader.token() != JsonReader::BeginArray)
+        {
+            reader.skip();
+            continue;
+        }
 
-QString matchInfo::getMatchWinner()
-{
-    if(json.object().value("radiant_win").toString().compare("1") == 0)
-        return "<font color=\"green\">Radiant Victory</font>";
-    else
-        return "<font color=\"red\">Dire Victory</font>";
+        for(int j=0; reader.nextElement(); j++)
+        {
+            if(j < 5 && reader.token() == JsonReader::BeginObject)
+                readPlayer(reader, &match->players[team][j]);
+            else
+                reader.skip();
+        }
+    }
 }
 
-QVector<QVector<QString> > matchInfo::getPicks()
+void matchInfo::readPlayer(JsonReader &reader, PlayerSlot *slot)
 {
-    return picks;
-}
+    while(reader.nextKey())
+    {
+        if(reader.readKey("account_name"))
+            slot->accountName = reader.toString();
+        else if(reader.readKey("level"))
+            slot->level = reader.toInt();
+        else if(reader.readKey("kills"))
+            slot->kills = reader.toInt();
+        else if(reader.readKey("deaths"))
+            slot->deaths = reader.toInt();
+        else if(reader.readKey("assists"))
+            slot->assists = reader.toInt();
+        else if(reader.readKey("gold_spent"))
+            slot->goldSpent = reader.toInt();
+        else if(reader.readKey("last_hits"))
+            slot->lastHits = reader.toInt();
+        else if(reader.readKey("denies"))
+            slot->denies = reader.toInt();
+        else if(reader.readKey("gold_per_min"))
+            slot->gpm = reader.toInt();
+        else if(reader.readKey("xp_per_min"))
+            slot->xpm = reader.toInt();
+        else if(reader.readKey("hero"))
+        {
+            //hero: { name, localized_name, ... }
+            if(reader.token() != JsonReader::BeginObject)
+            {
+                reader.skip();
+                continue;
+            }
 
-QVector<QVector<QString> > matchInfo::getBans()
-{
-    return bans;
-}
+            while(reader.nextKey())
+            {
+                if(reader.readKey("name"))
+                    slot->heroName = reader.toString();
+                else if(reader.readKey("localized_name"))
+                    slot->heroLocalizedName = reader.toString();
+                else
+                    reader.skip();
+            }
+        }
+        else
+        {
+            //item_0 .. item_5
+            bool item = false;
+            for(int k=0; k<6 && !item; k++)
+            {
+                char key[] = "item_0";
+                key[5] = '0' + k;
+                if(reader.readKey(key))
+                {
+                    slot->items[k] = reader.toString();
+                    item = true;
+                }
+            }
 
-QVector<QVector<QString> > matchInfo::getPlayerNames()
-{
-    return playerNames;
+            if(!item)
+                reader.skip();
+        }
+    }
 }
 
-QVector<QVector<QString> > matchInfo::getPlayerLevel()
+const MatchRecord &matchInfo::record() const
 {
-    return playerLevel;
+    return match;
 }
 
-QVector<QVector<QJsonObject> > matchInfo::getPlayerHeroName()
+/*
+ * The api formats times for display; they are kept as numbers so matches.db can sort, range and average over them.
+ */
+qint64 matchInfo::parseStartTime(const QString &text)
 {
-    return playerHeroName;
-}
+    bool isNumber = false;
+    qint64 seconds = text.toLongLong(&isNumber);
+    if(isNumber)
+        return seconds;
 
-QVector<QVector<QString> > matchInfo::getPlayerKills()
-{
-    return playerKills;
-}
+    QDateTime time = QDateTime::fromString(text, "yyyy-MM-dd HH:mm:ss");
+    if(!time.isValid())
+        return 0;
 
-QVector<QVector<QString> > matchInfo::getPlayerDeaths()
-{
-    return playerDeaths;
+    time.setTimeSpec(Qt::UTC);
+    return time.toMSecsSinceEpoch() / 1000;
 }
 
-QVector<QVector<QString> > matchInfo::getPlayerAssists()
+int matchInfo::parseDuration(const QString &text)
 {
-    return playerAssists;
-}
+    int seconds = 0;
+    foreach(QString part, text.split(':'))
+    {
+        bool ok = false;
+        int value = part.trimmed().toInt(&ok);
+        if(!ok || value < 0)
+            return 0;
+        seconds = seconds * 60 + value;
+    }
 
-QVector<QVector<QVector<QString> > > matchInfo::getPlayerItems()
-{
-    return playerItems;
+    return seconds;
 }
 
-QVector<QVector<QString> > matchInfo::getPlayerGold()
+QString matchInfo::startTimeText(qint64 startTime)
 {
-    return playerGold;
-}
+    if(startTime <= 0)
+        return QString();
 
-QVector<QVector<QString> > matchInfo::getPlayerLH()
-{
-    return playerLH;
+    return QDateTime::fromMSecsSinceEpoch(startTime * 1000).toUTC().toString("yyyy-MM-dd HH:mm:ss");
 }
 
-QVector<QVector<QString> > matchInfo::getPlayerDN()
+QString matchInfo::durationText(int seconds)
 {
-    return playerDN;
-}
+    if(seconds >= 3600)
+        return QString("%1:%2:%3").arg(seconds / 3600).arg(seconds / 60 % 60, 2, 10, QChar('0')).arg(seconds % 60, 2, 10, QChar('0'));
 
-QVector<QVector<QString> > matchInfo::getPlayerGPM()
-{
-    return playerGPM;
+    return QString("%1:%2").arg(seconds / 60).arg(seconds % 60, 2, 10, QChar('0'));
 }
 
-QVector<QVector<QString> > matchInfo::getPlayerXPM()
+QString matchInfo::getMatchWinner()
 {
-    return playerXPM;
+    if(match.radiantWin)
+        return "<font color=\"green\">Radiant Victory</font>";
+    else
+        return "<font color=\"red\">Dire Victory</font>";
 }
 
-void matchInfo::downloadImages()
+/*
+ * Queues every hero and item image this match needs and returns right away.
+ * imageReady() is emitted as each one lands, and imagesFinished() once they all have (or the token was cancelled).
+ */
+void matchInfo::downloadImages(Http *http, int token)
 {
-    Http http;
-    QEventLoop loop;
+    this->http = http;
+    this->token = token;
+    connect(http, SIGNAL(downloaded(QUrl,QString,bool)), this, SLOT(imageDownloaded(QUrl,QString,bool)));
+    connect(http, SIGNAL(tokenFinished(int)), this, SLOT(tokenFinished(int)));
 
     //get picks for picks & bans
-    if(gameMode.compare("Captains Mode") == 0)
+    if(match.gameMode.compare("Captains Mode") == 0)
     {
         for(int i=0; i<2; i++)
             for(int j=0; j<5; j++)
             {
-                //qDebug() << "Downloading... " + baseUrl + "heroes/" + getBans()[i][j] + "_sb.png";
-                http.append(QUrl(baseUrl + "heroes/" + getBans()[i][j] + "_sb.png" ));
-                http.append(QUrl(baseUrl + "heroes/" + getPicks()[i][j] + "_sb.png" ));
+                //qDebug() << "Downloading... " + baseUrl + "heroes/" + match.bans[i][j] + "_sb.png";
+                appendImage(QUrl(baseUrl + "heroes/" + match.bans[i][j] + "_sb.png" ));
+                appendImage(QUrl(baseUrl + "heroes/" + match.picks[i][j] + "_sb.png" ));
             }
     }
-    else if(gameMode.compare("Captains Draft") == 0)
+    else if(match.gameMode.compare("Captains Draft") == 0)
     {
         for(int i=0; i<2; i++)
             for(int j=0; j<2; j++)
-                http.append(QUrl(baseUrl + "heroes/" + getPicks()[i][j] + "_sb.png" ));
+                appendImage(QUrl(baseUrl + "heroes/" + match.picks[i][j] + "_sb.png" ));
     }
 
     for(int i=0; i<2; i++)
         for(int j=0; j<5; j++)
         {
             //download hero pic(s)
-            http.append(QUrl(baseUrl + "heroes/" + getPlayerHeroName()[i][j].value("name").toString() + "_sb.png"));
+            appendImage(QUrl(baseUrl + "heroes/" + match.players[i][j].heroName + "_sb.png"));
             //download item(s)
             for(int k=0; k<6; k++)
             {
-                http.append(QUrl(baseUrl + "items/" + getPlayerItems()[i][j][k] + "_lg.png"));
+                appendImage(QUrl(baseUrl + "items/" + match.players[i][j].items[k] + "_lg.png"));
             }
         }
 
-    //Need an event loop so that networking can do its thing and download the files.
-    //once all images are downloaded, the loop exits.
-    connect(&http, SIGNAL(finished()), &loop, SLOT(quit()));
-    loop.exec();
+    if(pendingImages.isEmpty())
+        finishImages();
+}
+
+void matchInfo::appendImage(const QUrl &url)
+{
+    pendingImages.insert(url);
+    http->append(url, Http::Visible, token);
+}
+
+void matchInfo::imageDownloaded(const QUrl &url, const QString &fileName, bool ok)
+{
+    //the window's Http is shared, so skip anything that isn't ours
+    if(!pendingImages.remove(url))
+        return;
+
+    if(ok)
+        emit imageReady(QFileInfo(fileName).fileName());
+
+    if(pendingImages.isEmpty())
+        finishImages();
+}
+
+void matchInfo::tokenFinished(int token)
+{
+    if(token != this->token)
+        return;
+
+    pendingImages.clear();
+    finishImages();
+}
+
+void matchInfo::finishImages()
+{
+    if(!http)
+        return;
+
+    disconnect(http, 0, this, 0);
+    http = 0;
+    emit imagesFinished();
 }
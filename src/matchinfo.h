@@ -3,84 +3,96 @@
 
 #include <QApplication>
 #include <QObject>
-#include <QJsonDocument>
-#include <QJsonArray>
-#include <QJsonObject>
 #include <QFile>
 #include <QDebug>
+#include <QSet>
 #include "http.h"
 
+class JsonReader;
+
+//one line of the scoreboard
+struct PlayerSlot
+{
+    PlayerSlot() : level(0), kills(0), deaths(0), assists(0), goldSpent(0), lastHits(0), denies(0), gpm(0), xpm(0) {}
+
+    QString accountName;
+    QString heroName;               //internal name, used for the hero image
+    QString heroLocalizedName;
+    QString items[6];               //internal item names, "empty" for an empty slot
+    int level;
+    int kills;
+    int deaths;
+    int assists;
+    int goldSpent;
+    int lastHits;
+    int denies;
+    int gpm;
+    int xpm;
+};
+
+//everything we show for a match, parsed once from the api json
+struct MatchRecord
+{
+    MatchRecord() : matchID(0), startTime(0), duration(0), firstBloodTime(0), radiantWin(false) {}
+
+    qint64 matchID;
+    QString gameMode;
+    qint64 startTime;               //unix time, 0 if unknown
+    QString lobbyType;
+    int duration;                   //seconds
+    int firstBloodTime;             //seconds into the game
+    bool radiantWin;
+
+    //picks & bans, 1st index is the team; 0 = radiant, 1 = dire
+    QString picks[2][5];
+    QString bans[2][5];
+
+    PlayerSlot players[2][5];       //[team][player_slot]
+};
+
 class matchInfo : public QObject
 {
     Q_OBJECT
 public:
     explicit matchInfo(QObject *parent = 0);
     void parse(const QString& filename);
+    static bool readMatch(const QString &filename, MatchRecord *match);    //usable without a matchInfo, e.g. for bulk loading
+    void downloadImages(Http *http, int token = 0);                         //returns right away, see imageReady() and imagesFinished()
 
-    //get basic match info
-    QString getMatchID();
-    QString getGameMode();
-    QString getStartTime();
-    QString getLobbyType();
-    QString getDuration();
-    QString getFirstBloodTime();
+    const MatchRecord &record() const;
     QString getMatchWinner();
 
-    //get picks & bans
-    QVector<QVector<QString> > getPicks();
-    QVector<QVector<QString> > getBans();
-
-    //get player names
-    QVector<QVector<QString> > getPlayerNames();
-    QVector<QVector<QString> > getPlayerLevel();
-    QVector<QVector<QJsonObject> > getPlayerHeroName();
-    QVector<QVector<QString> > getPlayerKills();
-    QVector<QVector<QString> > getPlayerDeaths();
-    QVector<QVector<QString> > getPlayerAssists();
-    QVector<QVector<QVector<QString> > > getPlayerItems();
-    QVector<QVector<QString> > getPlayerGold();
-    QVector<QVector<QString> > getPlayerLH();
-    QVector<QVector<QString> > getPlayerDN();
-    QVector<QVector<QString> > getPlayerGPM();
-    QVector<QVector<QString> > getPlayerXPM();
+    static qint64 parseStartTime(const QString &text);                     //"2014-01-18 19:32:05" (UTC) or unix time
+    static int parseDuration(const QString &text);                          //"47:12", "1:02:03" or seconds
+    static QString startTimeText(qint64 startTime);
+    static QString durationText(int seconds);
 
 signals:
+    void imageReady(const QString &fileName);                               //an image for this match has landed in the downloads dir
+    void imagesFinished();
 
 public slots:
 
+private slots:
+    void imageDownloaded(const QUrl &url, const QString &fileName, bool ok);
+    void tokenFinished(int token);
+
 private:
-    QJsonDocument json;
     //url used for the base of image downloads
     QString baseUrl;
 
-    //basic match Info variables
-    QString matchID;
-    QString gameMode;
-    QString startTime;
-    QString lobbyType;
-    QString duration;
-    QString firstBloodTime;
-
-    //Picks & Bans
-    //2-D array, 1st for team; 0 = radiant, 1 = dire; 2nd for which pick/ban
-    QVector<QVector<QString> > picks;
-    QVector<QVector<QString> > bans;
-
-    QVector<QVector<QString> > playerNames;
-    QVector<QVector<QString> > playerLevel;
-    QVector<QVector<QJsonObject> > playerHeroName;          //use JsonObject because then we can get name and localized name
-    QVector<QVector<QString> > playerKills;
-    QVector<QVector<QString> > playerDeaths;
-    QVector<QVector<QString> > playerAssists;
-    QVector<QVector<QVector<QString> > > playerItems;       //3-D Array; [team][player_slot][item_id]
-    QVector<QVector<QString> > playerGold;
-    QVector<QVector<QString> > playerLH;
-    QVector<QVector<QString> > playerDN;
-    QVector<QVector<QString> > playerGPM;
-    QVector<QVector<QString> > playerXPM;
+    MatchRecord match;
+
+    Http *http;
+    int token;
+    QSet<QUrl> pendingImages;
 
     //internal funcion(s)
-    void downloadImages();
+    static void readPicksBans(JsonReader &reader, MatchRecord *match);
+    static void readSlots(JsonReader &reader, MatchRecord *match);
+    static void readPlayer(JsonReader &reader, PlayerSlot *slot);
+    void appendImage(const QUrl &url);
+    void finishImages();
 };
 
 #endif // MATCHINFO_H
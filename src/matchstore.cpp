@@ -0,0 +1,298 @@
+#include "matchstore.h"
+#include "matchcache.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <QDebug>
+
+MatchStore::MatchStore(const QSqlDatabase &db) : db(db)
+{
+}
+
+bool MatchStore::createTables()
+{
+    QStringList statements;
+    //start_time is unix time, duration and first_blood_time are seconds
+    statements << "create table if not exists matches (match_id INTEGER PRIMARY KEY, game_mode TEXT, lobby_type TEXT, start_time INTEGER, duration INTEGER, first_blood_time INTEGER, radiant_win INTEGER)"
+               << "create table if not exists match_players (match_id INTEGER, team INTEGER, slot INTEGER, account_name TEXT, hero TEXT, hero_localized_name TEXT, level INTEGER, kills INTEGER, deaths INTEGER, assists INTEGER, gold_spent INTEGER, last_hits INTEGER, denies INTEGER, gpm INTEGER, xpm INTEGER, PRIMARY KEY (match_id, team, slot))"
+               << "create table if not exists match_items (match_id INTEGER, team INTEGER, slot INTEGER, item_slot INTEGER, item TEXT, PRIMARY KEY (match_id, team, slot, item_slot))"
+               << "create table if not exists picks_bans (match_id INTEGER, team INTEGER, is_pick INTEGER, pick_order INTEGER, hero TEXT, PRIMARY KEY (match_id, team, is_pick, pick_order))"
+               //json files that could not be read, so they are only tried again once they change
+               << "create table if not exists match_ingest_failures (file_name TEXT PRIMARY KEY, size INTEGER, mtime INTEGER)"
+               //the lookups we expect: by hero, by player and by item
+               << "create index if not exists match_players_by_hero on match_players (hero, match_id)"
+               << "create index if not exists match_players_by_account on match_players (account_name, match_id)"
+               << "create index if not exists match_items_by_item on match_items (item, match_id)"
+               << "create index if not exists picks_bans_by_hero on picks_bans (hero, match_id)";
+
+    QSqlQuery query(db);
+    foreach(QString statement, statements)
+    {
+        if(!query.exec(statement))
+        {
+            qDebug() << "Could not create match tables:" << query.lastError().text();
+            return false;
+        }
+    }
+
+    return migrateTimesToIntegers();
+}
+
+/*
+ * The times used to be the api's display strings in TEXT columns, which sort and compare as text ("9:00" > "10:00").
+ * The table is rebuilt with INTEGER columns and every row parsed the way readMatch does it now.
+ * Triggers on matches go with the old table; ReplaySearch makes them again on start.
+ */
+bool MatchStore::migrateTimesToIntegers()
+{
+    QSqlQuery query(db);
+    bool text = false;
+    query.exec("pragma table_info(matches)");
+    while(query.next())
+    {
+        if(query.value(1).toString() == "start_time")
+            text = query.value(2).toString().compare("TEXT", Qt::CaseInsensitive) == 0;
+    }
+    if(!text)
+        return true;
+
+    if(!db.transaction())
+        return false;
+
+    //copied aside rather than renamed, an alter table rename would rewrite the search triggers on replays that read matches
+    QSqlQuery insert(db);
+    bool ok = query.exec("create temp table matches_text as select * from matches")
+            && query.exec("drop table matches")
+            && query.exec("create table matches (match_id INTEGER PRIMARY KEY, game_mode TEXT, lobby_type TEXT, start_time INTEGER, duration INTEGER, first_blood_time INTEGER, radiant_win INTEGER)")
+            && insert.prepare("insert into matches (match_id, game_mode, lobby_type, start_time, duration, first_blood_time, radiant_win) VALUES (?, ?, ?, ?, ?, ?, ?)")
+            && query.exec("select match_id, game_mode, lobby_type, start_time, duration, first_blood_time, radiant_win from matches_text");
+
+    while(ok && query.next())
+    {
+        insert.addBindValue(query.value(0));
+        insert.addBindValue(query.value(1));
+        insert.addBindValue(query.value(2));
+        insert.addBindValue(matchInfo::parseStartTime(query.value(3).toString()));
+        insert.addBindValue(matchInfo::parseDuration(query.value(4).toString()));
+        insert.addBindValue(matchInfo::parseDuration(query.value(5).toString()));
+        insert.addBindValue(query.value(6));
+        ok = insert.exec();
+    }
+
+    ok = ok && query.exec("drop table matches_text");
+    if(!ok)
+    {
+        qDebug() << "Could not migrate the matches table:" << query.lastError().text() << insert.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    return db.commit();
+}
+
+bool MatchStore::ingest(const MatchRecord &match)
+{
+    QList<MatchRecord> matches;
+    matches.append(match);
+    return ingest(matches);
+}
+
+bool MatchStore::ingest(const QList<MatchRecord> &matches)
+{
+    if(!db.transaction())
+        return false;
+
+    QSqlQuery matchQuery(db);
+    QSqlQuery playerQuery(db);
+    QSqlQuery itemQuery(db);
+    QSqlQuery pickBanQuery(db);
+    QSqlQuery clearPicksBans(db);
+    matchQuery.prepare("insert or replace into matches (match_id, game_mode, lobby_type, start_time, duration, first_blood_time, radiant_win) VALUES (?, ?, ?, ?, ?, ?, ?)");
+    playerQuery.prepare("insert or replace into match_players (match_id, team, slot, account_name, hero, hero_localized_name, level, kills, deaths, assists, gold_spent, last_hits, denies, gpm, xpm) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+    itemQuery.prepare("insert or replace into match_items (match_id, team, slot, item_slot, item) VALUES (?, ?, ?, ?, ?)");
+    pickBanQuery.prepare("insert or replace into picks_bans (match_id, team, is_pick, pick_order, hero) VALUES (?, ?, ?, ?, ?)");
+    clearPicksBans.prepare("delete from picks_bans where match_id = ?");
+
+    bool ok = true;
+    foreach(const MatchRecord &match, matches)
+    {
+        if(match.matchID == 0)
+            continue;
+
+        clearPicksBans.addBindValue(match.matchID);
+        ok = ok && clearPicksBans.exec();
+
+        for(int team=0; team<2; team++)
+            for(int j=0; j<5; j++)
+            {
+                const PlayerSlot &player = match.players[team][j];
+                playerQuery.addBindValue(match.matchID);
+                playerQuery.addBindValue(team);
+                playerQuery.addBindValue(j);
+                playerQuery.addBindValue(player.accountName);
+                playerQuery.addBindValue(player.heroName);
+                playerQuery.addBindValue(player.heroLocalizedName);
+                playerQuery.addBindValue(player.level);
+                playerQuery.addBindValue(player.kills);
+                playerQuery.addBindValue(player.deaths);
+                playerQuery.addBindValue(player.assists);
+                playerQuery.addBindValue(player.goldSpent);
+                playerQuery.addBindValue(player.lastHits);
+                playerQuery.addBindValue(player.denies);
+                playerQuery.addBindValue(player.gpm);
+                playerQuery.addBindValue(player.xpm);
+                ok = ok && playerQuery.exec();
+
+                for(int k=0; k<6; k++)
+                {
+                    itemQuery.addBindValue(match.matchID);
+                    itemQuery.addBindValue(team);
+                    itemQuery.addBindValue(j);
+                    itemQuery.addBindValue(k);
+                    itemQuery.addBindValue(player.items[k]);
+                    ok = ok && itemQuery.exec();
+                }
+
+                //only CM/CD games have picks & bans
+                for(int isPick=0; isPick<2; isPick++)
+                {
+                    const QString &hero = isPick ? match.picks[team][j] : match.bans[team][j];
+                    if(hero.isEmpty())
+                        continue;
+
+                    pickBanQuery.addBindValue(match.matchID);
+                    pickBanQuery.addBindValue(team);
+                    pickBanQuery.addBindValue(isPick);
+                    pickBanQuery.addBindValue(j);
+                    pickBanQuery.addBindValue(hero);
+                    ok = ok && pickBanQuery.exec();
+                }
+            }
+
+        //after the players, the matches row has the replay's search document rebuilt
+        matchQuery.addBindValue(match.matchID);
+        matchQuery.addBindValue(match.gameMode);
+        matchQuery.addBindValue(match.lobbyType);
+        matchQuery.addBindValue(match.startTime);
+        matchQuery.addBindValue(match.duration);
+        matchQuery.addBindValue(match.firstBloodTime);
+        matchQuery.addBindValue(match.radiantWin ? 1 : 0);
+        ok = ok && matchQuery.exec();
+
+        if(!ok)
+            break;
+    }
+
+    if(!ok)
+    {
+        qDebug() << "Could not store matches:" << db.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    return db.commit();
+}
+
+int MatchStore::ingestDirectory(const QDir &dir, const QAtomicInt *stopRequested)
+{
+    //skip whatever is already stored, so this is cheap after the first run
+    QSet<qint64> stored;
+    QSqlQuery query("select match_id from matches", db);
+    while(query.next())
+        stored.insert(query.value(0).toLongLong());
+
+    //and whatever failed before, unless it has been downloaded again since
+    QHash<QString, QPair<qint64, qint64> > failures;
+    query.exec("select file_name, size, mtime from match_ingest_failures");
+    while(query.next())
+        failures.insert(query.value(0).toString(), qMakePair(query.value(1).toLongLong(), query.value(2).toLongLong()));
+    query.finish();
+
+    int count = 0;
+    QList<MatchRecord> batch;
+    QList<QFileInfo> failed;
+    foreach(QFileInfo info, dir.entryInfoList(QStringList("*.json"), QDir::Files))
+    {
+        if(stopRequested && stopRequested->load())
+            break;
+
+        bool isMatch;
+        qint64 matchID = info.completeBaseName().toLongLong(&isMatch);
+        if(!isMatch || stored.contains(matchID))
+            continue;
+
+        QPair<qint64, qint64> stat(info.size(), info.lastModified().toMSecsSinceEpoch());
+        if(failures.value(info.fileName(), qMakePair(qint64(-1), qint64(-1))) == stat)
+            continue;
+
+        MatchRecord match;
+        QString path = info.filePath();
+        if(!MatchCache::load(path, &match))
+        {
+            match = MatchRecord();
+            if(!matchInfo::readMatch(path, &match))
+                match.matchID = 0;
+        }
+
+        //an error reply from the api parses fine but has no match in it
+        if(match.matchID == 0)
+        {
+            failed.append(info);
+            continue;
+        }
+
+        batch.append(match);
+        if(batch.size() == BatchSize)
+        {
+            count += ingest(batch) ? batch.size() : 0;
+            batch.clear();
+        }
+    }
+
+    if(!batch.isEmpty())
+        count += ingest(batch) ? batch.size() : 0;
+
+    if(!failed.isEmpty() && db.transaction())
+    {
+        query.prepare("insert or replace into match_ingest_failures (file_name, size, mtime) VALUES (?, ?, ?)");
+        foreach(const QFileInfo &info, failed)
+        {
+            query.addBindValue(info.fileName());
+            query.addBindValue(info.size());
+            query.addBindValue(info.lastModified().toMSecsSinceEpoch());
+            query.exec();
+        }
+        db.commit();
+    }
+
+    return count;
+}
+
+/*
+ * Runs ingestDirectory on a connection of its own, since a connection can only be used by the thread that opened it.
+ * Returns true once every file in dir has been either stored or recorded as failed.
+ */
+bool MatchStore::backfill(const QString &databaseName, const QString &dir, const QAtomicInt *stopRequested)
+{
+    const QString connection = "matchBackfill";
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+        db.setDatabaseName(databaseName);
+        if(db.open())
+        {
+            MatchStore(db).ingestDirectory(QDir(dir), stopRequested);
+            ok = !(stopRequested && stopRequested->load());
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connection);
+
+    return ok;
+}
@@ -0,0 +1,33 @@
+#ifndef MATCHSTORE_H
+#define MATCHSTORE_H
+
+#include <QAtomicInt>
+#include <QDir>
+#include <QList>
+#include <QSqlDatabase>
+#include "matchinfo.h"
+
+/*
+ * Parsed matches in matches.db, one row per match / player / item / pick or ban,
+ * so stats across many matches can be answered with indexed queries instead of opening every json.
+ */
+class MatchStore
+{
+public:
+    explicit MatchStore(const QSqlDatabase &db);
+
+    bool createTables();
+    bool ingest(const MatchRecord &match);
+    bool ingest(const QList<MatchRecord> &matches);                         //all in one transaction
+    int ingestDirectory(const QDir &dir, const QAtomicInt *stopRequested = 0);  //every <matchid>.json in dir that isn't stored or known to fail yet
+    static bool backfill(const QString &databaseName, const QString &dir, const QAtomicInt *stopRequested);   //ingestDirectory on its own connection, for a worker thread; false if stopped
+
+private:
+    enum { BatchSize = 500 };
+
+    bool migrateTimesToIntegers();                                          //matches made before the times were stored as numbers
+
+    QSqlDatabase db;
+};
+
+#endif // MATCHSTORE_H
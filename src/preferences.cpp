@@ -29,6 +29,32 @@ void Preferences::on_pushButton_clicked()
     ui->lineEdit->setText(fd.getExistingDirectory(this, "", "C:/Program Files (x86)/Steam/SteamApps/common/dota 2 beta/dota/replays"));
 }
 
+QStringList Preferences::getOtherDirs()
+{
+    QStringList dirs;
+    for(int i = 0; i < ui->otherFoldersList->count(); i++)
+        dirs.append(ui->otherFoldersList->item(i)->text());
+    return dirs;
+}
+
+void Preferences::setOtherDirs(const QStringList &dirs)
+{
+    ui->otherFoldersList->clear();
+    ui->otherFoldersList->addItems(dirs);
+}
+
+void Preferences::on_addFolderButton_clicked()
+{
+    QString dir = QFileDialog::getExistingDirectory(this, tr("Add Replay Folder"));
+    if(!dir.isEmpty() && ui->otherFoldersList->findItems(dir, Qt::MatchExactly).isEmpty())
+        ui->otherFoldersList->addItem(dir);
+}
+
+void Preferences::on_removeFolderButton_clicked()
+{
+    delete ui->otherFoldersList->currentItem();
+}
+
 QString Preferences::getApiKey()
 {
     return ui->apiKeyTextEdit->text();
@@ -38,3 +64,13 @@ void Preferences::setApiKey(QString& key)
 {
     ui->apiKeyTextEdit->setText(key);
 }
+
+int Preferences::getArchiveDays()
+{
+    return ui->archiveDaysSpinBox->value();
+}
+
+void Preferences::setArchiveDays(int days)
+{
+    ui->archiveDaysSpinBox->setValue(days);
+}
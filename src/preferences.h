@@ -16,14 +16,20 @@ public:
     explicit Preferences(QWidget *parent = 0);
     QString getDir();
     void setDir(QString);
+    QStringList getOtherDirs();
+    void setOtherDirs(const QStringList &dirs);
     QFont getFont();
     void setFont(QFont);
     QString getApiKey();
     void setApiKey(QString&);
+    int getArchiveDays();
+    void setArchiveDays(int days);
     ~Preferences();
     
 private slots:
     void on_pushButton_clicked();
+    void on_addFolderButton_clicked();
+    void on_removeFolderButton_clicked();
 
 private:
     Ui::Preferences *ui;
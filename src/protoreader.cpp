@@ -0,0 +1,130 @@
+#include "protoreader.h"
+
+#include <string.h>
+
+ProtoReader::ProtoReader(const uchar *data, qint64 size) :
+    p(data), end(data + size), currentField(0), currentWireType(0), valueRead(true), failed(false)
+{
+}
+
+bool ProtoReader::readVarint(const uchar **p, const uchar *end, quint64 *value)
+{
+    quint64 result = 0;
+    for(int shift = 0; shift < 64 && *p < end; shift += 7)
+    {
+        uchar byte = *(*p)++;
+        result |= quint64(byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+        {
+            *value = result;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ProtoReader::next()
+{
+    //the caller didn't want the last value
+    if(!valueRead)
+        skip();
+
+    if(failed || p >= end)
+        return false;
+
+    quint64 key;
+    if(!readVarint(&p, end, &key))
+    {
+        failed = true;
+        return false;
+    }
+
+    currentField = int(key >> 3);
+    currentWireType = int(key & 7);
+    valueRead = false;
+    return true;
+}
+
+quint64 ProtoReader::toVarint()
+{
+    valueRead = true;
+    quint64 value = 0;
+    if(currentWireType != Varint || !readVarint(&p, end, &value))
+        failed = true;
+
+    return value;
+}
+
+float ProtoReader::toFloat()
+{
+    valueRead = true;
+    float value = 0;
+    if(currentWireType != Fixed32 || end - p < 4)
+    {
+        failed = true;
+        return value;
+    }
+
+    //the wire is little endian, as is everything we build for
+    memcpy(&value, p, 4);
+    p += 4;
+    return value;
+}
+
+const uchar *ProtoReader::toBytes(qint64 *size)
+{
+    valueRead = true;
+    quint64 length;
+    if(currentWireType != LengthDelimited || !readVarint(&p, end, &length) || length > quint64(end - p))
+    {
+        failed = true;
+        *size = 0;
+        return 0;
+    }
+
+    const uchar *bytes = p;
+    p += length;
+    *size = qint64(length);
+    return bytes;
+}
+
+QString ProtoReader::toString()
+{
+    qint64 size;
+    const uchar *bytes = toBytes(&size);
+    return bytes ? QString::fromUtf8(reinterpret_cast<const char *>(bytes), int(size)) : QString();
+}
+
+void ProtoReader::skip()
+{
+    valueRead = true;
+    quint64 value;
+    qint64 size;
+
+    switch(currentWireType)
+    {
+    case Varint:
+        if(!readVarint(&p, end, &value))
+            failed = true;
+        break;
+    case Fixed64:
+        if(end - p < 8)
+            failed = true;
+        else
+            p += 8;
+        break;
+    case LengthDelimited:
+        toBytes(&size);
+        break;
+    case Fixed32:
+        if(end - p < 4)
+            failed = true;
+        else
+            p += 4;
+        break;
+    default:
+        //groups are long gone from the replay protos
+        failed = true;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef PROTOREADER_H
+#define PROTOREADER_H
+
+#include <QByteArray>
+#include <QString>
+
+/*
+ * Walks the fields of a protobuf message in a buffer, for the handful of replay messages we read.
+ * No generated code and no copies: fields are read in place and anything we don't know is skipped.
+ */
+class ProtoReader
+{
+public:
+    enum WireType { Varint = 0, Fixed64 = 1, LengthDelimited = 2, Fixed32 = 5 };
+
+    ProtoReader(const uchar *data, qint64 size);
+
+    bool next();                                                            //steps to the next field, false at the end or on error
+    int field() const { return currentField; }
+    int wireType() const { return currentWireType; }
+    bool hasError() const { return failed; }
+
+    //read the value of the current field; each may only be called once per field
+    quint64 toVarint();
+    float toFloat();
+    const uchar *toBytes(qint64 *size);
+    QString toString();
+    void skip();
+
+    static bool readVarint(const uchar **p, const uchar *end, quint64 *value);
+
+private:
+    const uchar *p;
+    const uchar *end;
+    int currentField;
+    int currentWireType;
+    bool valueRead;
+    bool failed;
+};
+
+#endif // PROTOREADER_H
@@ -0,0 +1,284 @@
+#include "replayarchive.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtConcurrent>
+#include <QtEndian>
+
+#include "xxhash64.h"
+
+#include <string.h>
+#ifdef Q_OS_WIN
+#include <sys/types.h>
+#include <sys/utime.h>
+#else
+#include <sys/time.h>
+#endif
+
+struct CompressChunk
+{
+    typedef QByteArray result_type;
+
+    QByteArray operator()(const QByteArray &chunk) const
+    {
+        return qCompress(chunk);
+    }
+};
+
+struct UncompressChunk
+{
+    typedef QByteArray result_type;
+
+    QByteArray operator()(const QByteArray &chunk) const
+    {
+        return qUncompress(chunk);
+    }
+};
+
+//how many chunks are in flight at once; enough to keep every core busy
+static int chunksPerGroup()
+{
+    return qMax(QThread::idealThreadCount(), 1);
+}
+
+//QFileDevice::setFileTime() is Qt 5.10 and up
+static bool setModified(const QString &fileName, qint64 msecs)
+{
+#ifdef Q_OS_WIN
+    struct _utimbuf times;
+    times.actime = times.modtime = msecs / 1000;
+    return _wutime(reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(fileName).utf16()), &times) == 0;
+#else
+    struct timeval times[2];
+    times[0].tv_sec = times[1].tv_sec = msecs / 1000;
+    times[0].tv_usec = times[1].tv_usec = (msecs % 1000) * 1000;
+    return utimes(QFile::encodeName(fileName).constData(), times) == 0;
+#endif
+}
+
+QString ReplayArchive::archiveFileName(const QString &fileName)
+{
+    return fileName + ".d2ra";
+}
+
+bool ReplayArchive::compress(const QString &source, const QString &destination, const QAtomicInt *stopRequested, quint64 *sourceHash)
+{
+    QFile in(source);
+    if(!in.open(QIODevice::ReadOnly))
+        return false;
+
+    QSaveFile out(destination);
+    if(!out.open(QIODevice::WriteOnly))
+        return false;
+
+    uchar header[HeaderSize];
+    memcpy(header, "D2RA", 4);
+    qToLittleEndian<quint32>(Version, header + 4);
+    qToLittleEndian<qint64>(in.size(), header + 8);
+    qToLittleEndian<quint32>(ChunkSize, header + 16);
+    qToLittleEndian<qint64>(QFileInfo(in).lastModified().toMSecsSinceEpoch(), header + 20);
+    out.write(reinterpret_cast<const char *>(header), HeaderSize);
+
+    XxHash64 hash;
+    while(!in.atEnd())
+    {
+        if(stopRequested && stopRequested->load())
+        {
+            out.cancelWriting();
+            return false;
+        }
+
+        QList<QByteArray> group;
+        for(int i = 0; i < chunksPerGroup() && !in.atEnd(); i++)
+        {
+            QByteArray chunk = in.read(ChunkSize);
+            if(chunk.isEmpty())
+            {
+                out.cancelWriting();
+                return false;
+            }
+            hash.addData(chunk.constData(), chunk.size());
+            group.append(chunk);
+        }
+
+        QList<QByteArray> packed = QtConcurrent::blockingMapped<QList<QByteArray> >(group, CompressChunk());
+        foreach(const QByteArray &chunk, packed)
+        {
+            uchar length[4];
+            qToLittleEndian<quint32>(quint32(chunk.size()), length);
+            out.write(reinterpret_cast<const char *>(length), 4);
+            out.write(chunk);
+        }
+    }
+
+    if(sourceHash)
+        *sourceHash = hash.result();
+    return out.commit();
+}
+
+/*
+ * Reads the header and every chunk of in, checking the sizes on the way.
+ * The replay goes to out if there is one, and its xxh64 to hash if asked for.
+ * modified is 0 for version 1 archives, which did not keep it.
+ */
+bool ReplayArchive::unpack(QFile &in, QSaveFile *out, quint64 *hash, qint64 *modified)
+{
+    uchar header[HeaderSize];
+    if(in.read(reinterpret_cast<char *>(header), HeaderSizeV1) != HeaderSizeV1 || memcmp(header, "D2RA", 4) != 0)
+        return false;
+
+    const quint32 version = qFromLittleEndian<quint32>(header + 4);
+    if(version == 1)
+        *modified = 0;
+    else if(version == Version && in.read(reinterpret_cast<char *>(header) + HeaderSizeV1, HeaderSize - HeaderSizeV1) == HeaderSize - HeaderSizeV1)
+        *modified = qFromLittleEndian<qint64>(header + 20);
+    else
+        return false;
+
+    const qint64 originalSize = qFromLittleEndian<qint64>(header + 8);
+    const quint32 chunkSize = qFromLittleEndian<quint32>(header + 16);
+
+    XxHash64 xxh64;
+    qint64 written = 0;
+    while(!in.atEnd())
+    {
+        QList<QByteArray> group;
+        for(int i = 0; i < chunksPerGroup() && !in.atEnd(); i++)
+        {
+            uchar length[4];
+            if(in.read(reinterpret_cast<char *>(length), 4) != 4)
+                return false;
+
+            //qCompress output is at most a little bigger than its input
+            quint32 size = qFromLittleEndian<quint32>(length);
+            if(size > chunkSize + chunkSize / 100 + 1024)
+                return false;
+
+            QByteArray chunk = in.read(size);
+            if(chunk.size() != int(size))
+                return false;
+            group.append(chunk);
+        }
+
+        QList<QByteArray> unpacked = QtConcurrent::blockingMapped<QList<QByteArray> >(group, UncompressChunk());
+        foreach(const QByteArray &chunk, unpacked)
+        {
+            if(chunk.isEmpty() || (out && out->write(chunk) != chunk.size()))
+                return false;
+            if(hash)
+                xxh64.addData(chunk.constData(), chunk.size());
+            written += chunk.size();
+        }
+    }
+
+    if(hash)
+        *hash = xxh64.result();
+    return written == originalSize;
+}
+
+bool ReplayArchive::extract(const QString &source, const QString &destination)
+{
+    QFile in(source);
+    if(!in.open(QIODevice::ReadOnly))
+        return false;
+
+    QSaveFile out(destination);
+    if(!out.open(QIODevice::WriteOnly))
+        return false;
+
+    qint64 modified = 0;
+    if(!unpack(in, &out, 0, &modified))
+    {
+        out.cancelWriting();
+        return false;
+    }
+
+    if(!out.commit())
+        return false;
+
+    //not worth failing the restore over, the replay is only read again
+    if(modified > 0)
+        setModified(destination, modified);
+    return true;
+}
+
+bool ReplayArchive::verify(const QString &archive, quint64 sourceHash)
+{
+    QFile in(archive);
+    if(!in.open(QIODevice::ReadOnly))
+        return false;
+
+    quint64 hash = 0;
+    qint64 modified = 0;
+    return unpack(in, 0, &hash, &modified) && hash == sourceHash;
+}
+
+ReplayArchiver::ReplayArchiver(QObject *parent) :
+    QThread(parent), stopRequested(0)
+{
+}
+
+void ReplayArchiver::addFiles(int rootId, const QString &replayDir, const QString &archiveDir, const QStringList &fileNames)
+{
+    Folder folder;
+    folder.rootId = rootId;
+    folder.replayDir = replayDir;
+    folder.archiveDir = archiveDir;
+    folder.fileNames = fileNames;
+    folders.append(folder);
+}
+
+void ReplayArchiver::stop()
+{
+    stopRequested.store(1);
+}
+
+void ReplayArchiver::run()
+{
+    stopRequested.store(0);
+    QList<Folder> queued = folders;
+    folders.clear();
+
+    foreach(const Folder &folder, queued)
+    {
+        foreach(QString fileName, folder.fileNames)
+        {
+            if(stopRequested.load())
+                return;
+
+            QString source = folder.replayDir + "/" + fileName;
+            QString destination = folder.archiveDir + "/" + ReplayArchive::archiveFileName(fileName);
+
+            //replays in subfolders keep the same layout in the archive
+            QDir().mkpath(QFileInfo(destination).absolutePath());
+
+            QElapsedTimer timer;
+            timer.start();
+            qint64 originalSize = QFileInfo(source).size();
+            quint64 hash = 0;
+            if(!ReplayArchive::compress(source, destination, &stopRequested, &hash))
+                continue;
+
+            //the archive is the only copy once the original is gone, so it has to read back to the same bytes
+            if(!ReplayArchive::verify(destination, hash))
+            {
+                qDebug() << "Archive of" << source << "did not verify, keeping the original";
+                QFile::remove(destination);
+                continue;
+            }
+
+            //dota may have the replay open; then it stays where it is and we try again another time
+            if(!QFile::remove(source))
+            {
+                QFile::remove(destination);
+                continue;
+            }
+
+            emit archived(folder.rootId, fileName, originalSize, QFileInfo(destination).size(), timer.elapsed());
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef REPLAYARCHIVE_H
+#define REPLAYARCHIVE_H
+
+#include <QAtomicInt>
+#include <QFile>
+#include <QSaveFile>
+#include <QStringList>
+#include <QThread>
+
+/*
+ * Compressed copies of replays, for keeping old ones around at a fraction of the size.
+ * A file is cut into fixed size chunks that are deflated independently, so both directions stream through
+ * a few chunks at a time and spread them over the thread pool.
+ *
+ * Layout: "D2RA", quint32 version, qint64 original size, quint32 chunk size, qint64 modified time
+ * (ms since epoch, from version 2 on), then per chunk a quint32 length and the qCompress()ed bytes.
+ * Integers are little endian.
+ */
+class ReplayArchive
+{
+public:
+    static bool compress(const QString &source, const QString &destination, const QAtomicInt *stopRequested = 0, quint64 *sourceHash = 0);
+    static bool extract(const QString &source, const QString &destination);   //the replay gets its mtime back, so a rescan sees it unchanged
+    static bool verify(const QString &archive, quint64 sourceHash);         //decompresses it all and compares size and xxh64
+
+    static QString archiveFileName(const QString &fileName);                //name of a replay's archive copy
+
+private:
+    enum { Version = 2, ChunkSize = 4 * 1024 * 1024, HeaderSizeV1 = 20, HeaderSize = 28 };
+
+    static bool unpack(QFile &in, QSaveFile *out, quint64 *hash, qint64 *modified);
+};
+
+/*
+ * Moves replays into the archive on a worker thread: compress, read the archive back, then remove the original.
+ * Files can be queued from several replay folders, each with its own archive folder.
+ */
+class ReplayArchiver : public QThread
+{
+    Q_OBJECT
+public:
+    explicit ReplayArchiver(QObject *parent = 0);
+
+    void addFiles(int rootId, const QString &replayDir, const QString &archiveDir, const QStringList &fileNames);   //not while running; start() takes them all
+    void stop();
+
+signals:
+    void archived(int rootId, const QString &fileName, qint64 originalSize, qint64 archivedSize, qint64 msecs);
+
+private:
+    struct Folder
+    {
+        int rootId;
+        QString replayDir;
+        QString archiveDir;
+        QStringList fileNames;                                              //relative to both folders
+    };
+
+    void run();
+
+    QList<Folder> folders;
+    QAtomicInt stopRequested;
+};
+
+#endif // REPLAYARCHIVE_H
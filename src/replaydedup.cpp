@@ -0,0 +1,111 @@
+#include "replaydedup.h"
+
+#include <QDir>
+#include <QFile>
+
+#include <string.h>
+
+#ifdef Q_OS_WIN32
+#include <windows.h>
+#else
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <linux/fs.h>
+#endif
+
+bool ReplayDedup::sameContent(const QString &first, const QString &second)
+{
+    QFile a(first);
+    QFile b(second);
+    if(!a.open(QIODevice::ReadOnly) || !b.open(QIODevice::ReadOnly) || a.size() != b.size())
+        return false;
+
+    QByteArray bufferA(1024 * 1024, Qt::Uninitialized);
+    QByteArray bufferB(1024 * 1024, Qt::Uninitialized);
+    while(!a.atEnd())
+    {
+        qint64 sizeA = a.read(bufferA.data(), bufferA.size());
+        qint64 sizeB = b.read(bufferB.data(), bufferB.size());
+        if(sizeA <= 0 || sizeA != sizeB || memcmp(bufferA.constData(), bufferB.constData(), size_t(sizeA)) != 0)
+            return false;
+    }
+
+    return b.atEnd();
+}
+
+/*
+ * The link is made next to the duplicate and then renamed over it,
+ * so at no point is the duplicate's name missing or half written.
+ */
+bool ReplayDedup::replaceWithLink(const QString &original, const QString &duplicate)
+{
+    QString link = duplicate + ".link";
+    QFile::remove(link);
+
+    if(!reflink(original, link) && !hardlink(original, link))
+        return false;
+
+    if(!replaceFile(link, duplicate))
+    {
+        QFile::remove(link);
+        return false;
+    }
+
+    return true;
+}
+
+bool ReplayDedup::linkCopy(const QPair<QString, QString> &copy)
+{
+    return sameContent(copy.first, copy.second) && replaceWithLink(copy.first, copy.second);
+}
+
+bool ReplayDedup::reflink(const QString &original, const QString &link)
+{
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+    int source = ::open(QFile::encodeName(original).constData(), O_RDONLY);
+    if(source < 0)
+        return false;
+
+    int destination = ::open(QFile::encodeName(link).constData(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if(destination < 0)
+    {
+        ::close(source);
+        return false;
+    }
+
+    //fails on file systems without shared extents (ext4, ntfs), which is what the hard link is for
+    bool ok = ::ioctl(destination, FICLONE, source) == 0;
+    ::close(destination);
+    ::close(source);
+    if(!ok)
+        QFile::remove(link);
+
+    return ok;
+#else
+    Q_UNUSED(original);
+    Q_UNUSED(link);
+    return false;
+#endif
+}
+
+bool ReplayDedup::hardlink(const QString &original, const QString &link)
+{
+#ifdef Q_OS_WIN32
+    return CreateHardLinkW((const wchar_t*)QDir::toNativeSeparators(link).utf16(), (const wchar_t*)QDir::toNativeSeparators(original).utf16(), 0) != 0;
+#else
+    return ::link(QFile::encodeName(original).constData(), QFile::encodeName(link).constData()) == 0;
+#endif
+}
+
+bool ReplayDedup::replaceFile(const QString &from, const QString &to)
+{
+#ifdef Q_OS_WIN32
+    return MoveFileExW((const wchar_t*)QDir::toNativeSeparators(from).utf16(), (const wchar_t*)QDir::toNativeSeparators(to).utf16(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+#endif
+}
@@ -0,0 +1,25 @@
+#ifndef REPLAYDEDUP_H
+#define REPLAYDEDUP_H
+
+#include <QPair>
+#include <QString>
+
+/*
+ * Turns identical replay files into one copy on disk.
+ * A duplicate is swapped for a reflink of the original where the file system can share extents
+ * (a copy that costs nothing until one side is written to), and a hard link everywhere else.
+ */
+class ReplayDedup
+{
+public:
+    static bool sameContent(const QString &first, const QString &second);   //byte for byte, a hash match is not proof
+    static bool replaceWithLink(const QString &original, const QString &duplicate);
+    static bool linkCopy(const QPair<QString, QString> &copy);              //original and duplicate path; both of the above, for QtConcurrent::mapped
+
+private:
+    static bool reflink(const QString &original, const QString &link);
+    static bool hardlink(const QString &original, const QString &link);
+    static bool replaceFile(const QString &from, const QString &to);
+};
+
+#endif // REPLAYDEDUP_H
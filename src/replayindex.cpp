@@ -0,0 +1,924 @@
+#include "replayindex.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <QDebug>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+bool ReplayFile::sameFile(const ReplayFile &other) const
+{
+    return size == other.size && modified == other.modified && inode == other.inode;
+}
+
+ReplayFile ReplayFile::fromFileInfo(const QFileInfo &info)
+{
+    ReplayFile file;
+    file.fileName = info.fileName();
+    file.size = info.size();
+    file.modified = info.lastModified().toMSecsSinceEpoch();
+
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if(::stat(QFile::encodeName(info.absoluteFilePath()).constData(), &st) == 0)
+        file.inode = st.st_ino;
+#endif
+    //windows has file ids too, but only through an open handle, which is more than a stat should cost
+
+    return file;
+}
+
+//an empty hash goes in as NULL
+static QVariant hashValue(const QByteArray &hash)
+{
+    return hash.isEmpty() ? QVariant(QVariant::String) : QVariant(QString::fromLatin1(hash));
+}
+
+ReplayIndex::ReplayIndex(const QSqlDatabase &db, int rootId) : db(db), root(rootId), nextLocalId(0)
+{
+}
+
+bool ReplayIndex::createTables()
+{
+    QSqlQuery query(db);
+    query.exec("PRAGMA user_version");
+    int version = query.next() ? query.value(0).toInt() : 0;
+    if(version >= SchemaVersion)
+        return true;
+
+    if(!db.transaction())
+        return false;
+
+    bool ok = true;
+    if(version < 2)
+    {
+        if(db.tables().contains("replays"))
+            ok = migrateFromVersion1();
+        else
+            ok = query.exec("create table replays (title TEXT, filename TEXT NOT NULL UNIQUE, match_id INTEGER PRIMARY KEY, size INTEGER, modified INTEGER, inode INTEGER, hash TEXT)");
+    }
+
+    if(ok && version < 3)
+        ok = migrateToVersion3();
+
+    if(ok && version < 4)
+        ok = migrateToVersion4();
+
+    if(ok && version < 5)
+        ok = migrateToVersion5();
+
+    if(ok && version < 6)
+        ok = migrateToVersion6();
+
+    if(ok && version < 7)
+        ok = migrateToVersion7();
+
+    if(ok && version < 8)
+        ok = migrateToVersion8();
+
+    if(ok && version < 9)
+        ok = migrateToVersion9();
+
+    if(ok && version < 10)
+        ok = migrateToVersion10();
+
+    if(ok && version < 11)
+        ok = migrateToVersion11();
+
+    ok = ok && query.exec(QString("PRAGMA user_version = %1").arg(int(SchemaVersion)));
+
+    if(!ok)
+    {
+        qDebug() << "Could not create replays table:" << query.lastError().text() << db.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    return db.commit();
+}
+
+/*
+ * Version 1 was (title, filename, fileExists) keyed by the file name.
+ * Titles carry over; stat data starts out empty so the next scan looks at every file once.
+ */
+bool ReplayIndex::migrateFromVersion1()
+{
+    QSqlQuery query(db);
+    if(!query.exec("alter table replays rename to replays_v1")
+            || !query.exec("create table replays (title TEXT, filename TEXT NOT NULL UNIQUE, match_id INTEGER PRIMARY KEY, size INTEGER, modified INTEGER, inode INTEGER, hash TEXT)")
+            || !query.exec("select title, filename from replays_v1"))
+    {
+        return false;
+    }
+
+    QSqlQuery insert(db);
+    insert.prepare("insert or ignore into replays (title, filename, match_id) VALUES (?, ?, ?)");
+    while(query.next())
+    {
+        QString fileName = query.value(1).toString();
+        insert.addBindValue(query.value(0));
+        insert.addBindValue(fileName);
+        insert.addBindValue(freeMatchId(matchIdFromFileName(fileName)));
+        if(!insert.exec())
+            return false;
+    }
+
+    return query.exec("drop table replays_v1");
+}
+
+/*
+ * Version 3 adds what a replay says about itself in its file info block, and who played in it.
+ * info_read is NULL until the block has been read, so existing rows are picked up by the next scan.
+ */
+bool ReplayIndex::migrateToVersion3()
+{
+    QStringList statements;
+    statements << "alter table replays add column duration INTEGER"
+               << "alter table replays add column game_mode TEXT"
+               << "alter table replays add column winner TEXT"
+               << "alter table replays add column end_time INTEGER"
+               << "alter table replays add column info_read INTEGER"
+               << "create table if not exists replay_players (match_id INTEGER, slot INTEGER, team INTEGER, player_name TEXT, hero TEXT, steam_id INTEGER, PRIMARY KEY (match_id, slot))"
+               << "create index if not exists replay_players_by_hero on replay_players (hero, match_id)"
+               << "create index if not exists replay_players_by_steam_id on replay_players (steam_id, match_id)";
+
+    QSqlQuery query(db);
+    foreach(QString statement, statements)
+    {
+        if(!query.exec(statement))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Version 4 adds per player curves sampled from the packet stream, one delta encoded blob per series.
+ * timeline_read is NULL until a replay has been gone through, 0 if that failed, and 2 if the replay was cut off
+ * before its end, so the full read is not repeated until the file changes.
+ */
+bool ReplayIndex::migrateToVersion4()
+{
+    QSqlQuery query(db);
+    return query.exec("alter table replays add column timeline_read INTEGER")
+            && query.exec("create table if not exists replay_timeline (match_id INTEGER, slot INTEGER, series TEXT, sample_ticks INTEGER, data BLOB, PRIMARY KEY (match_id, slot, series))");
+}
+
+/*
+ * Version 5 adds a seek index: tick and file offset of every full packet, so reading can start near any point
+ * of a replay. It is built in the same pass as the timeline, so clearing timeline_read rebuilds it.
+ */
+bool ReplayIndex::migrateToVersion5()
+{
+    QSqlQuery query(db);
+    if(!query.exec("create table if not exists replay_seek (match_id INTEGER, tick INTEGER, file_offset INTEGER, PRIMARY KEY (match_id, tick))"))
+        return false;
+
+    //replays gone through before have no seek points yet
+    return query.exec("update replays set timeline_read = NULL");
+}
+
+//version 6 marks replays moved to the compressed archive, which stay in the table while not in the folder
+bool ReplayIndex::migrateToVersion6()
+{
+    QSqlQuery query(db);
+    return query.exec("alter table replays add column archived INTEGER")
+            && query.exec("alter table replays add column archived_size INTEGER");
+}
+
+/*
+ * Version 7 hashes with xxh64 instead of sha1, so duplicates can be found by hash.
+ * Old hashes are dropped and the next scan rehashes just those files, nothing else about them is redone.
+ */
+bool ReplayIndex::migrateToVersion7()
+{
+    QSqlQuery query(db);
+    return query.exec("update replays set hash = NULL")
+            && query.exec("create index if not exists replays_by_hash on replays (hash, size)");
+}
+
+/*
+ * Version 8 adds the roots table and records which one each replay is in; file names only have to be unique within a root.
+ * SQLite can't drop the old UNIQUE constraint, so the table is rebuilt with the same columns plus root_id.
+ * Everything indexed so far came from the one replay folder there was, which becomes root 1;
+ * its path is filled in by the first rootId() call, see there.
+ */
+bool ReplayIndex::migrateToVersion8()
+{
+    QString columns = "title, filename, match_id, size, modified, inode, hash, duration, game_mode, winner, end_time, info_read, timeline_read, archived, archived_size";
+
+    QSqlQuery query(db);
+    return query.exec("create table if not exists roots (root_id INTEGER PRIMARY KEY, path TEXT UNIQUE)")
+            && query.exec("insert or ignore into roots (root_id, path) VALUES (1, NULL)")
+            && query.exec("alter table replays rename to replays_v7")
+            && query.exec("create table replays (title TEXT, filename TEXT NOT NULL, match_id INTEGER PRIMARY KEY, size INTEGER, modified INTEGER, inode INTEGER, hash TEXT, "
+                          "duration INTEGER, game_mode TEXT, winner TEXT, end_time INTEGER, info_read INTEGER, timeline_read INTEGER, archived INTEGER, archived_size INTEGER, "
+                          "root_id INTEGER NOT NULL DEFAULT 1, UNIQUE (root_id, filename))")
+            && query.exec(QString("insert into replays (%1, root_id) select %1, 1 from replays_v7").arg(columns))
+            && query.exec("drop table replays_v7")
+            && query.exec("create index if not exists replays_by_hash on replays (hash, size)");
+}
+
+/*
+ * Version 9 indexes every column the replay table can be sorted by, each followed by the match id that breaks ties.
+ * ReplayTableModel pages through them from one (value, match id) to the next, and skips ahead by counting index entries,
+ * so neither has to touch the rows themselves.
+ */
+bool ReplayIndex::migrateToVersion9()
+{
+    QStringList statements;
+    statements << "create index if not exists replays_by_title on replays (title, match_id)"
+               << "create index if not exists replays_by_end_time on replays (end_time, match_id)"
+               << "create index if not exists replays_by_duration on replays (duration, match_id)"
+               << "create index if not exists replays_by_game_mode on replays (game_mode, match_id)"
+               << "create index if not exists replays_by_winner on replays (winner, match_id)"
+               << "create index if not exists replays_by_archived on replays (archived, match_id)";
+
+    QSqlQuery query(db);
+    foreach(QString statement, statements)
+    {
+        if(!query.exec(statement))
+            return false;
+    }
+
+    return true;
+}
+
+//version 10 dropped the seek index of version 5, when nothing read from it yet
+bool ReplayIndex::migrateToVersion10()
+{
+    QSqlQuery query(db);
+    return query.exec("drop table if exists replay_seek");
+}
+
+/*
+ * Version 11 brings the seek index back, now that TimelineReader::readRange() starts from it.
+ * Replays are gone through again to fill it, the same as for version 5.
+ */
+bool ReplayIndex::migrateToVersion11()
+{
+    QSqlQuery query(db);
+    return query.exec("create table if not exists replay_seek (match_id INTEGER, tick INTEGER, file_offset INTEGER, PRIMARY KEY (match_id, tick))")
+            && query.exec("update replays set timeline_read = NULL");
+}
+
+int ReplayIndex::rootId(const QString &path)
+{
+    QSqlQuery query(db);
+    query.prepare("select root_id from roots where path = ?");
+    query.addBindValue(path);
+    if(query.exec() && query.next())
+        return query.value(0).toInt();
+
+    //replays indexed before there were roots belong to the first folder asked for, which is the game's replay folder
+    query.prepare("update roots set path = ? where path is NULL");
+    query.addBindValue(path);
+    if(!query.exec() || query.numRowsAffected() == 0)
+    {
+        query.prepare("insert into roots (path) VALUES (?)");
+        query.addBindValue(path);
+        if(!query.exec())
+        {
+            qDebug() << "Could not add replay folder" << path << query.lastError().text();
+            return 0;
+        }
+    }
+
+    query.prepare("select root_id from roots where path = ?");
+    query.addBindValue(path);
+    return query.exec() && query.next() ? query.value(0).toInt() : 0;
+}
+
+QHash<int, QString> ReplayIndex::rootPaths()
+{
+    QHash<int, QString> paths;
+
+    QSqlQuery query(db);
+    query.exec("select root_id, path from roots where path is not NULL");
+    while(query.next())
+        paths.insert(query.value(0).toInt(), query.value(1).toString());
+
+    return paths;
+}
+
+bool ReplayIndex::removeRootsExcept(const QList<int> &rootIds)
+{
+    QStringList ids;
+    foreach(int id, rootIds)
+        ids.append(QString::number(id));
+
+    if(!db.transaction())
+        return false;
+
+    QSqlQuery query(db);
+    query.exec(QString("delete from replays where root_id not in (%1) and archived is NULL").arg(ids.join(",")));
+    query.exec("delete from replay_players where match_id not in (select match_id from replays)");
+    query.exec("delete from replay_timeline where match_id not in (select match_id from replays)");
+    query.exec("delete from replay_seek where match_id not in (select match_id from replays)");
+
+    return db.commit();
+}
+
+QHash<QString, ReplayFile> ReplayIndex::files()
+{
+    QHash<QString, ReplayFile> files;
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("select filename, size, modified, inode, hash, info_read, timeline_read from replays where root_id = ?");
+    query.addBindValue(root);
+    query.exec();
+    while(query.next())
+    {
+        ReplayFile file;
+        file.rootId = root;
+        file.fileName = query.value(0).toString();
+        if(!query.value(1).isNull())
+        {
+            file.size = query.value(1).toLongLong();
+            file.modified = query.value(2).toLongLong();
+            file.inode = query.value(3).toLongLong();
+        }
+        file.hash = query.value(4).toString().toLatin1();
+        file.infoRead = query.value(5).toInt() == 1;
+        file.infoUnreadable = !query.value(5).isNull() && query.value(5).toInt() == 0;
+        file.timelineRead = !query.value(6).isNull();
+        files.insert(file.fileName, file);
+    }
+
+    return files;
+}
+
+/*
+ * The files are loaded into a temporary table and reconciled with a few set based statements,
+ * instead of an update, and on a miss an insert, per file.
+ * Only new files that aren't named after a free match id need an id handed out one at a time.
+ */
+int ReplayIndex::update(const QList<ReplayFile> &files)
+{
+    if(files.isEmpty())
+        return 0;
+
+    QVariantList names, sizes, modified, inodes, hashes, matchIds;
+    foreach(const ReplayFile &file, files)
+    {
+        names.append(file.fileName);
+        sizes.append(file.size);
+        modified.append(file.modified);
+        inodes.append(file.inode);
+        hashes.append(hashValue(file.hash));
+        matchIds.append(matchIdFromFileName(file.fileName));
+    }
+
+    if(!db.transaction())
+        return 0;
+
+    QSqlQuery query(db);
+    query.exec("create temp table if not exists scanned_files (filename TEXT PRIMARY KEY, size INTEGER, modified INTEGER, inode INTEGER, hash TEXT, match_id INTEGER)");
+    query.exec("delete from scanned_files");
+
+    query.prepare("insert or replace into scanned_files (filename, size, modified, inode, hash, match_id) VALUES (?, ?, ?, ?, ?, ?)");
+    query.addBindValue(names);
+    query.addBindValue(sizes);
+    query.addBindValue(modified);
+    query.addBindValue(inodes);
+    query.addBindValue(hashes);
+    query.addBindValue(matchIds);
+    if(!query.execBatch())
+    {
+        qDebug() << "could not load changed files:" << query.lastError().text();
+        db.rollback();
+        return 0;
+    }
+
+    //changed files: new stat data, and what was read from the old content has to be read again
+    query.prepare("update replays set size = (select size from scanned_files s where s.filename = replays.filename), "
+                  "modified = (select modified from scanned_files s where s.filename = replays.filename), "
+                  "inode = (select inode from scanned_files s where s.filename = replays.filename), "
+                  "hash = (select hash from scanned_files s where s.filename = replays.filename), "
+                  "info_read = NULL, timeline_read = NULL "
+                  "where root_id = ? and filename in (select filename from scanned_files)");
+    query.addBindValue(root);
+    bool ok = query.exec();
+
+    //what is left is new
+    query.prepare("delete from scanned_files where filename in (select filename from replays where root_id = ?)");
+    query.addBindValue(root);
+    ok = ok && query.exec();
+
+    //named after a match nobody has yet; 'or ignore' leaves the second of two copies with the same name for below
+    query.prepare("insert or ignore into replays (filename, root_id, match_id, size, modified, inode, hash) "
+                  "select filename, ?, match_id, size, modified, inode, hash from scanned_files s "
+                  "where match_id > 0 and not exists (select 1 from replays r where r.match_id = s.match_id)");
+    query.addBindValue(root);
+    ok = ok && query.exec();
+
+    //everything else gets a local id
+    QList<QVariantList> unnamed;
+    query.prepare("select filename, size, modified, inode, hash from scanned_files where filename not in (select filename from replays where root_id = ?)");
+    query.addBindValue(root);
+    ok = ok && query.exec();
+    while(ok && query.next())
+        unnamed.append(QVariantList() << query.value(0) << query.value(1) << query.value(2) << query.value(3) << query.value(4));
+
+    QSqlQuery insert(db);
+    insert.prepare("insert or ignore into replays (filename, root_id, match_id, size, modified, inode, hash) VALUES (?, ?, ?, ?, ?, ?, ?)");
+    foreach(const QVariantList &row, unnamed)
+    {
+        insert.addBindValue(row.at(0));
+        insert.addBindValue(root);
+        insert.addBindValue(freeMatchId(0));
+        for(int i = 1; i < row.size(); i++)
+            insert.addBindValue(row.at(i));
+        ok = ok && insert.exec();
+    }
+
+    int added = 0;
+    query.prepare("select count(*) from scanned_files where filename in (select filename from replays where root_id = ?)");
+    query.addBindValue(root);
+    if(ok && query.exec() && query.next())
+        added = query.value(0).toInt();
+    query.exec("delete from scanned_files");
+
+    if(!ok)
+    {
+        qDebug() << "Could not update replays:" << query.lastError().text() << db.lastError().text();
+        db.rollback();
+        return 0;
+    }
+
+    db.commit();
+    return added;
+}
+
+bool ReplayIndex::setHashes(const QList<ReplayFile> &files)
+{
+    if(!db.transaction())
+        return false;
+
+    //only if the file is still the one that was hashed; if it changed since, the next scan hashes it again
+    QSqlQuery query(db);
+    query.prepare("update replays set hash = ? where filename = ? and root_id = ? and size = ? and modified = ?");
+    foreach(const ReplayFile &file, files)
+    {
+        query.addBindValue(hashValue(file.hash));
+        query.addBindValue(file.fileName);
+        query.addBindValue(root);
+        query.addBindValue(file.size);
+        query.addBindValue(file.modified);
+        query.exec();
+    }
+
+    return db.commit();
+}
+
+/*
+ * info_read = 0 remembers that a replay had no readable file info block, so scans leave it alone.
+ * Like the hash it only holds for the stat data it was read at; if the file changed since, it is left NULL
+ * and the next scan reads it again, and update() clears it once the file changes later on.
+ */
+bool ReplayIndex::setUnreadable(const QList<ReplayFile> &files)
+{
+    if(!db.transaction())
+        return false;
+
+    QSqlQuery query(db);
+    query.prepare("update replays set info_read = 0 where filename = ? and root_id = ? and size = ? and modified = ? and info_read is NULL");
+    foreach(const ReplayFile &file, files)
+    {
+        query.addBindValue(file.fileName);
+        query.addBindValue(root);
+        query.addBindValue(file.size);
+        query.addBindValue(file.modified);
+        query.exec();
+    }
+
+    return db.commit();
+}
+
+bool ReplayIndex::setInfo(const QList<DemoInfo> &infos)
+{
+    if(!db.transaction())
+        return false;
+
+    QSqlQuery clearPlayers(db);
+    QSqlQuery setMatchId(db);
+    QSqlQuery setInfo(db);
+    QSqlQuery addPlayer(db);
+    clearPlayers.prepare("delete from replay_players where match_id = (select match_id from replays where filename = ? and root_id = ?)");
+    //the timeline is tied to the match id and players, which may change below, so it is built again
+    QSqlQuery clearTimeline(db);
+    clearTimeline.prepare("delete from replay_timeline where match_id = (select match_id from replays where filename = ? and root_id = ?)");
+    QSqlQuery clearSeek(db);
+    clearSeek.prepare("delete from replay_seek where match_id = (select match_id from replays where filename = ? and root_id = ?)");
+    //the replay knows its own match id; take it unless another replay already has it
+    setMatchId.prepare("update replays set match_id = ? where filename = ? and root_id = ? and not exists (select 1 from replays where match_id = ?)");
+    setInfo.prepare("update replays set duration = ?, game_mode = ?, winner = ?, end_time = ?, info_read = 1, timeline_read = NULL where filename = ? and root_id = ?");
+    addPlayer.prepare("insert or replace into replay_players (match_id, slot, team, player_name, hero, steam_id) select match_id, ?, ?, ?, ?, ? from replays where filename = ? and root_id = ?");
+
+    bool ok = true;
+    foreach(const DemoInfo &info, infos)
+    {
+        clearPlayers.addBindValue(info.fileName);
+        clearPlayers.addBindValue(root);
+        ok = ok && clearPlayers.exec();
+        clearTimeline.addBindValue(info.fileName);
+        clearTimeline.addBindValue(root);
+        ok = ok && clearTimeline.exec();
+        clearSeek.addBindValue(info.fileName);
+        clearSeek.addBindValue(root);
+        ok = ok && clearSeek.exec();
+
+        if(info.matchID > 0)
+        {
+            setMatchId.addBindValue(qint64(info.matchID));
+            setMatchId.addBindValue(info.fileName);
+            setMatchId.addBindValue(root);
+            setMatchId.addBindValue(qint64(info.matchID));
+            ok = ok && setMatchId.exec();
+        }
+
+        for(int slot = 0; slot < info.players.size(); slot++)
+        {
+            const DemoPlayer &player = info.players.at(slot);
+            addPlayer.addBindValue(slot);
+            addPlayer.addBindValue(player.team);
+            addPlayer.addBindValue(player.playerName);
+            addPlayer.addBindValue(player.heroName);
+            addPlayer.addBindValue(qint64(player.steamID));
+            addPlayer.addBindValue(info.fileName);
+            addPlayer.addBindValue(root);
+            ok = ok && addPlayer.exec();
+        }
+
+        //after the players: setting info_read is what has the search document rebuilt
+        setInfo.addBindValue(info.duration);
+        setInfo.addBindValue(info.gameModeName());
+        setInfo.addBindValue(info.winnerName());
+        setInfo.addBindValue(info.endTime);
+        setInfo.addBindValue(info.fileName);
+        setInfo.addBindValue(root);
+        ok = ok && setInfo.exec();
+    }
+
+    if(!ok)
+    {
+        qDebug() << "Could not store replay info:" << db.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    return db.commit();
+}
+
+bool ReplayIndex::setTimelines(const QList<ReplayTimeline> &timelines)
+{
+    if(!db.transaction())
+        return false;
+
+    QSqlQuery clear(db);
+    QSqlQuery clearSeek(db);
+    QSqlQuery addSeries(db);
+    QSqlQuery addSeekPoint(db);
+    QSqlQuery markRead(db);
+    clear.prepare("delete from replay_timeline where match_id = (select match_id from replays where filename = ? and root_id = ?)");
+    clearSeek.prepare("delete from replay_seek where match_id = (select match_id from replays where filename = ? and root_id = ?)");
+    addSeekPoint.prepare("insert or replace into replay_seek (match_id, tick, file_offset) select match_id, ?, ? from replays where filename = ? and root_id = ?");
+    //the heroes are matched to player slots through what the file info block said
+    addSeries.prepare("insert or replace into replay_timeline (match_id, slot, series, sample_ticks, data) "
+                      "select p.match_id, p.slot, ?, ?, ? from replays r join replay_players p on p.match_id = r.match_id and p.hero = ? where r.filename = ? and r.root_id = ?");
+    markRead.prepare("update replays set timeline_read = ? where filename = ? and root_id = ?");
+
+    bool ok = true;
+    foreach(const ReplayTimeline &timeline, timelines)
+    {
+        clear.addBindValue(timeline.fileName);
+        clear.addBindValue(root);
+        ok = ok && clear.exec();
+        clearSeek.addBindValue(timeline.fileName);
+        clearSeek.addBindValue(root);
+        ok = ok && clearSeek.exec();
+
+        for(int i = 0; ok && i < timeline.seekPoints.size(); i++)
+        {
+            addSeekPoint.addBindValue(timeline.seekPoints.at(i).tick);
+            addSeekPoint.addBindValue(timeline.seekPoints.at(i).offset);
+            addSeekPoint.addBindValue(timeline.fileName);
+            addSeekPoint.addBindValue(root);
+            ok = addSeekPoint.exec();
+        }
+
+        QHash<QString, HeroTimeline>::const_iterator hero;
+        for(hero = timeline.heroes.constBegin(); ok && hero != timeline.heroes.constEnd(); ++hero)
+        {
+            QStringList names;
+            QList<QByteArray> data;
+            names << "gold" << "xp" << "last_hits";
+            data << ReplayTimeline::encode(hero->gold) << ReplayTimeline::encode(hero->xp) << ReplayTimeline::encode(hero->lastHits);
+
+            for(int i = 0; ok && i < names.size(); i++)
+            {
+                addSeries.addBindValue(names.at(i));
+                addSeries.addBindValue(timeline.sampleTicks);
+                addSeries.addBindValue(data.at(i));
+                addSeries.addBindValue(hero.key());
+                addSeries.addBindValue(timeline.fileName);
+                addSeries.addBindValue(root);
+                ok = addSeries.exec();
+            }
+        }
+
+        markRead.addBindValue(int(!timeline.ok ? TimelineFailed : (timeline.complete ? TimelineComplete : TimelineIncomplete)));
+        markRead.addBindValue(timeline.fileName);
+        markRead.addBindValue(root);
+        ok = ok && markRead.exec();
+    }
+
+    if(!ok)
+    {
+        qDebug() << "Could not store replay timelines:" << db.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    return db.commit();
+}
+
+HeroTimeline ReplayIndex::playerTimeline(qint64 matchId, int slot, int *sampleTicks)
+{
+    HeroTimeline timeline;
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("select series, sample_ticks, data from replay_timeline where match_id = ? and slot = ?");
+    query.addBindValue(matchId);
+    query.addBindValue(slot);
+    query.exec();
+    while(query.next())
+    {
+        QString series = query.value(0).toString();
+        if(sampleTicks)
+            *sampleTicks = query.value(1).toInt();
+
+        if(series == "gold")
+            timeline.gold = ReplayTimeline::decode(query.value(2).toByteArray());
+        else if(series == "xp")
+            timeline.xp = ReplayTimeline::decode(query.value(2).toByteArray());
+        else if(series == "last_hits")
+            timeline.lastHits = ReplayTimeline::decode(query.value(2).toByteArray());
+    }
+
+    return timeline;
+}
+
+qint64 ReplayIndex::matchId(const QString &fileName)
+{
+    QSqlQuery query(db);
+    query.prepare("select match_id from replays where filename = ? and root_id = ?");
+    query.addBindValue(fileName);
+    query.addBindValue(root);
+    return query.exec() && query.next() ? query.value(0).toLongLong() : 0;
+}
+
+qint64 ReplayIndex::seekOffset(const QString &fileName, int tick, int *startTick)
+{
+    QSqlQuery query(db);
+    query.prepare("select s.tick, s.file_offset from replay_seek s join replays r on r.match_id = s.match_id where r.filename = ? and r.root_id = ? and s.tick <= ? order by s.tick desc limit 1");
+    query.addBindValue(fileName);
+    query.addBindValue(root);
+    query.addBindValue(tick);
+    if(!query.exec() || !query.next())
+        return -1;
+
+    if(startTick)
+        *startTick = query.value(0).toInt();
+    return query.value(1).toLongLong();
+}
+
+bool ReplayIndex::insert(const QStringList &fileNames)
+{
+    if(!db.transaction())
+        return false;
+
+    QSqlQuery query(db);
+    query.prepare("insert or ignore into replays (filename, root_id, match_id) VALUES (?, ?, ?)");
+    foreach(QString fileName, fileNames)
+    {
+        query.addBindValue(fileName);
+        query.addBindValue(root);
+        query.addBindValue(freeMatchId(matchIdFromFileName(fileName)));
+        query.exec();
+    }
+
+    return db.commit();
+}
+
+bool ReplayIndex::rename(const QString &from, const QString &to)
+{
+    QSqlQuery query(db);
+    query.prepare("update replays set filename = ? where filename = ? and root_id = ? and archived is NULL");
+    query.addBindValue(to);
+    query.addBindValue(from);
+    query.addBindValue(root);
+    return query.exec() && query.numRowsAffected() > 0;
+}
+
+bool ReplayIndex::remove(const QStringList &fileNames)
+{
+    if(!db.transaction())
+        return false;
+
+    QSqlQuery query(db);
+    query.prepare("delete from replays where filename = ? and root_id = ? and archived is NULL");
+    foreach(QString fileName, fileNames)
+    {
+        query.addBindValue(fileName);
+        query.addBindValue(root);
+        query.exec();
+    }
+    query.exec("delete from replay_players where match_id not in (select match_id from replays)");
+    query.exec("delete from replay_timeline where match_id not in (select match_id from replays)");
+    query.exec("delete from replay_seek where match_id not in (select match_id from replays)");
+
+    return db.commit();
+}
+
+/*
+ * The names are loaded into a temporary table and the rest is one set based delete,
+ * instead of a query per file.
+ */
+bool ReplayIndex::removeMissing(const QStringList &fileNames)
+{
+    QVariantList names;
+    names.reserve(fileNames.size());
+    foreach(QString fileName, fileNames)
+        names.append(fileName);
+
+    if(!db.transaction())
+        return false;
+
+    QSqlQuery query(db);
+    query.exec("create temp table if not exists scanned (filename TEXT PRIMARY KEY)");
+    query.exec("delete from scanned");
+
+    query.prepare("insert or ignore into scanned (filename) VALUES (?)");
+    query.addBindValue(names);
+    if(!query.execBatch())
+    {
+        qDebug() << "could not load scanned files:" << query.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    query.prepare("delete from replays where root_id = ? and filename not in (select filename from scanned) and archived is NULL");
+    query.addBindValue(root);
+    query.exec();
+    query.exec("delete from replay_players where match_id not in (select match_id from replays)");
+    query.exec("delete from replay_timeline where match_id not in (select match_id from replays)");
+    query.exec("delete from replay_seek where match_id not in (select match_id from replays)");
+    query.exec("delete from scanned");
+    return db.commit();
+}
+
+QStringList ReplayIndex::archiveCandidates(qint64 modifiedBefore)
+{
+    QStringList fileNames;
+
+    QSqlQuery query(db);
+    query.prepare("select filename from replays where root_id = ? and archived is NULL and modified < ?");
+    query.addBindValue(root);
+    query.addBindValue(modifiedBefore);
+    query.exec();
+    while(query.next())
+        fileNames.append(query.value(0).toString());
+
+    return fileNames;
+}
+
+bool ReplayIndex::setArchived(const QString &fileName, qint64 archivedSize)
+{
+    QSqlQuery query(db);
+    query.prepare("update replays set archived = ?, archived_size = ? where filename = ? and root_id = ?");
+    query.addBindValue(archivedSize < 0 ? QVariant(QVariant::Int) : QVariant(1));
+    query.addBindValue(archivedSize < 0 ? QVariant(QVariant::LongLong) : QVariant(archivedSize));
+    query.addBindValue(fileName);
+    query.addBindValue(root);
+    return query.exec();
+}
+
+/*
+ * The extracted file is a new inode, so without its stat the next scan would take it for a changed replay
+ * and hash and read it all over again.
+ */
+bool ReplayIndex::setRestored(const ReplayFile &file)
+{
+    QSqlQuery query(db);
+    query.prepare("update replays set archived = NULL, archived_size = NULL, size = ?, modified = ?, inode = ? where filename = ? and root_id = ?");
+    query.addBindValue(file.size);
+    query.addBindValue(file.modified);
+    query.addBindValue(file.inode);
+    query.addBindValue(file.fileName);
+    query.addBindValue(root);
+    return query.exec();
+}
+
+bool ReplayIndex::isArchived(const QString &fileName)
+{
+    QSqlQuery query(db);
+    query.prepare("select 1 from replays where filename = ? and root_id = ? and archived is not NULL");
+    query.addBindValue(fileName);
+    query.addBindValue(root);
+    return query.exec() && query.next();
+}
+
+/*
+ * Same hash and size, and not already the same file: a different inode, or no inodes to go by.
+ * Within a group, files already linked to each other are next to each other.
+ */
+QList<QList<ReplayFile> > ReplayIndex::duplicates()
+{
+    QList<QList<ReplayFile> > groups;
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.exec("select filename, size, modified, inode, hash, root_id from replays where archived is NULL and hash in "
+               "(select hash from replays where archived is NULL and hash is not NULL group by hash, size "
+               "having count(*) > 1 and (count(distinct inode) > 1 or max(inode) = 0)) "
+               "order by hash, size, inode, root_id, filename");
+
+    QByteArray lastHash;
+    qint64 lastSize = -1;
+    while(query.next())
+    {
+        ReplayFile file;
+        file.fileName = query.value(0).toString();
+        file.size = query.value(1).toLongLong();
+        file.modified = query.value(2).toLongLong();
+        file.inode = query.value(3).toLongLong();
+        file.hash = query.value(4).toString().toLatin1();
+        file.rootId = query.value(5).toInt();
+
+        if(groups.isEmpty() || file.hash != lastHash || file.size != lastSize)
+            groups.append(QList<ReplayFile>());
+
+        groups.last().append(file);
+        lastHash = file.hash;
+        lastSize = file.size;
+    }
+
+    //a hash shared by files of different sizes leaves singles behind
+    for(int i = groups.size() - 1; i >= 0; i--)
+    {
+        if(groups.at(i).size() < 2)
+            groups.removeAt(i);
+    }
+
+    return groups;
+}
+
+qint64 ReplayIndex::matchIdFromFileName(const QString &fileName)
+{
+    QString name = fileName.mid(fileName.lastIndexOf('/') + 1);
+    if(!name.endsWith(".dem", Qt::CaseInsensitive))
+        return 0;
+
+    QString id = name.left(name.size() - 4);
+    for(int i = 0; i < id.size(); i++)
+    {
+        if(!id.at(i).isDigit())
+            return 0;
+    }
+
+    bool ok;
+    qint64 matchID = id.toLongLong(&ok);
+    return ok ? matchID : 0;
+}
+
+/*
+ * The match id if no other replay has it yet, otherwise (or for replays not named after a match) a negative local id,
+ * so a renamed or oddly named file can never take the key of a real match.
+ */
+qint64 ReplayIndex::freeMatchId(qint64 matchID)
+{
+    QSqlQuery query(db);
+    if(matchID > 0)
+    {
+        query.prepare("select 1 from replays where match_id = ?");
+        query.addBindValue(matchID);
+        if(query.exec() && !query.next())
+            return matchID;
+    }
+
+    if(nextLocalId == 0)
+    {
+        query.exec("select min(0, ifnull(min(match_id), 0)) - 1 from replays");
+        nextLocalId = query.next() ? query.value(0).toLongLong() : -1;
+    }
+
+    return nextLocalId--;
+}
@@ -0,0 +1,96 @@
+#ifndef REPLAYINDEX_H
+#define REPLAYINDEX_H
+
+#include <QByteArray>
+#include <QFileInfo>
+#include <QHash>
+#include <QList>
+#include <QMetaType>
+#include <QSqlDatabase>
+#include <QStringList>
+#include "demoheader.h"
+#include "replaytimeline.h"
+
+//what we know about a replay file on disk, enough to tell if it changed without reading it
+struct ReplayFile
+{
+    ReplayFile() : rootId(0), size(-1), modified(-1), inode(0), infoRead(false), infoUnreadable(false), timelineRead(false) {}
+
+    int rootId;                                                             //which replay folder it is in
+    QString fileName;                                                       //relative to that folder, '/' separated
+    qint64 size;
+    qint64 modified;                                                        //ms since epoch
+    qint64 inode;                                                           //0 where the platform has none
+    QByteArray hash;                                                        //hex xxh64 of the content, empty until hashed
+    bool infoRead;                                                          //the file info block has been stored
+    bool infoUnreadable;                                                    //it couldn't be read at this size and mtime
+    bool timelineRead;                                                      //the packet stream has been gone through, successfully or not
+
+    bool sameFile(const ReplayFile &other) const;                           //size, mtime and inode all match
+    static ReplayFile fromFileInfo(const QFileInfo &info);                  //fileName is just the name, without any folders
+};
+
+Q_DECLARE_METATYPE(ReplayFile)
+
+/*
+ * The replays table in matches.db: one row per replay file, keyed by match id, with the stat data
+ * and content hash from the last time the file was looked at, and what the replay's own file info block says.
+ * Replays can come from several folders, the roots; each row records which one, and its file name is relative to it.
+ * Everything that goes by file name works on the root the index was made for.
+ * The schema is versioned with PRAGMA user_version and older layouts are migrated on open.
+ */
+class ReplayIndex
+{
+public:
+    explicit ReplayIndex(const QSqlDatabase &db, int rootId = 0);
+
+    bool createTables();                                                    //creates or migrates to the current schema
+    int rootId(const QString &path);                                        //adds the folder as a root if it isn't one yet; 0 on error
+    QHash<int, QString> rootPaths();                                        //every folder that has been a root, by id
+    bool removeRootsExcept(const QList<int> &rootIds);                      //drops the replays of folders no longer scanned, archived ones are kept
+
+    QHash<QString, ReplayFile> files();                                     //stored stat data by file name
+    int update(const QList<ReplayFile> &files);                             //adds new files, refreshes stat data of changed ones; returns rows added
+    bool setHashes(const QList<ReplayFile> &files);
+    bool setInfo(const QList<DemoInfo> &infos);                             //what each replay's file info block said
+    bool setUnreadable(const QList<ReplayFile> &files);                     //no file info block at the stat data given
+    bool setTimelines(const QList<ReplayTimeline> &timelines);              //with their seek points
+    HeroTimeline playerTimeline(qint64 matchId, int slot, int *sampleTicks = 0);   //the player's series as stored, empty if there are none
+    qint64 matchId(const QString &fileName);                                //key of the replay's row, 0 if there is none
+    qint64 seekOffset(const QString &fileName, int tick, int *startTick = 0);  //the last full packet at or before tick, -1 if none
+    bool insert(const QStringList &fileNames);                              //names only, stat data is filled in by the next scan
+    bool rename(const QString &from, const QString &to);                    //false if there was no such replay in the folder
+    bool remove(const QStringList &fileNames);                              //archived replays are kept
+    bool removeMissing(const QStringList &fileNames);                       //drop every row not in fileNames, other than archived ones
+
+    QStringList archiveCandidates(qint64 modifiedBefore);                   //replays in the folder last changed before this (ms since epoch)
+    bool setArchived(const QString &fileName, qint64 archivedSize);         //archivedSize < 0 for back in the folder
+    bool setRestored(const ReplayFile &file);                               //back from the archive; takes the extracted file's size, mtime and inode
+    bool isArchived(const QString &fileName);
+
+    QList<QList<ReplayFile> > duplicates();                                 //groups of replays with the same content, across all roots
+
+    static qint64 matchIdFromFileName(const QString &fileName);             //0 if the file isn't named after a match, folders are ignored
+
+private:
+    enum { SchemaVersion = 11 };
+    enum TimelineState { TimelineFailed = 0, TimelineComplete = 1, TimelineIncomplete = 2 };   //values of timeline_read, NULL for not read yet
+
+    bool migrateFromVersion1();
+    bool migrateToVersion3();
+    bool migrateToVersion4();
+    bool migrateToVersion5();
+    bool migrateToVersion6();
+    bool migrateToVersion7();
+    bool migrateToVersion8();
+    bool migrateToVersion9();
+    bool migrateToVersion10();
+    bool migrateToVersion11();
+    qint64 freeMatchId(qint64 matchID);
+
+    QSqlDatabase db;
+    int root;
+    qint64 nextLocalId;                                                     //ids for replays not named after a match count down from -1
+};
+
+#endif // REPLAYINDEX_H
@@ -0,0 +1,337 @@
+#include "replayscanner.h"
+
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QtConcurrent>
+#include "xxhash64.h"
+
+struct ReplayJob
+{
+    enum Kind { ReadInfo, Hash, Timeline };
+
+    ReplayJob() : kind(ReadInfo) {}
+    ReplayJob(const ReplayFile &file, Kind kind) : file(file), kind(kind) {}
+
+    ReplayFile file;
+    Kind kind;
+};
+
+//what a scan still has to do, each kind run over every file before the next
+struct ReplayJobQueue
+{
+    //queues what the index is missing for the file; true if it's new or changed since the index saw it
+    bool add(const ReplayFile &file, const QHash<QString, ReplayFile> &knownFiles);
+
+    QList<ReplayJob> readJobs;
+    QList<ReplayJob> hashJobs;
+    QList<ReplayJob> timelineJobs;
+};
+
+bool ReplayJobQueue::add(const ReplayFile &file, const QHash<QString, ReplayFile> &knownFiles)
+{
+    QHash<QString, ReplayFile>::const_iterator known = knownFiles.constFind(file.fileName);
+    if(known == knownFiles.constEnd() || !known->sameFile(file))
+    {
+        readJobs.append(ReplayJob(file, ReplayJob::ReadInfo));
+        hashJobs.append(ReplayJob(file, ReplayJob::Hash));
+        timelineJobs.append(ReplayJob(file, ReplayJob::Timeline));
+        return true;
+    }
+
+    //unchanged, but some of the work may be missing or was dropped by a schema change
+    if(known->hash.isEmpty())
+        hashJobs.append(ReplayJob(file, ReplayJob::Hash));
+
+    //one that had no file info block at this size and mtime won't have one now, it waits until it changes
+    if(!known->infoRead && !known->infoUnreadable)
+    {
+        readJobs.append(ReplayJob(file, ReplayJob::ReadInfo));
+        timelineJobs.append(ReplayJob(file, ReplayJob::Timeline));
+    }
+    else if(known->infoRead && !known->timelineRead)
+    {
+        timelineJobs.append(ReplayJob(file, ReplayJob::Timeline));
+    }
+    return false;
+}
+
+struct ReplayResult
+{
+    ReplayResult() : infoRead(false), infoUnreadable(false), timelineRead(false) {}
+
+    ReplayFile file;                                                        //with the hash filled in, if it was a hash job
+    DemoInfo info;
+    bool infoRead;
+    bool infoUnreadable;                                                    //read and found wanting, not just stopped
+    ReplayTimeline timeline;
+    bool timelineRead;                                                      //gone through to the end, even if nothing came of it
+};
+
+static QByteArray hashFile(const QString &path, const QAtomicInt *stopRequested)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    //one buffer for the whole file; the hash is far faster than the disk, so this is a plain sequential read
+    XxHash64 hash;
+    QByteArray buffer(1024 * 1024, Qt::Uninitialized);
+    while(!file.atEnd())
+    {
+        if(stopRequested->load())
+            return QByteArray();
+
+        qint64 size = file.read(buffer.data(), buffer.size());
+        if(size <= 0)
+            return QByteArray();
+        hash.addData(buffer.constData(), size);
+    }
+
+    return hash.hexResult();
+}
+
+//runs one job on a pool thread; only reads the file, everything it finds goes back in the result
+struct RunReplayJob
+{
+    typedef ReplayResult result_type;
+
+    RunReplayJob(const QString &directory, const QAtomicInt *stopRequested) :
+        directory(directory), stopRequested(stopRequested) {}
+
+    ReplayResult operator()(const ReplayJob &job) const
+    {
+        ReplayResult result;
+        result.file = job.file;
+        if(stopRequested->load())
+            return result;
+
+        QString path = directory + "/" + job.file.fileName;
+        if(job.kind == ReplayJob::ReadInfo)
+        {
+            result.infoRead = DemoHeader::read(path, &result.info);
+            result.infoUnreadable = !result.infoRead && !stopRequested->load();
+            result.info.fileName = job.file.fileName;
+        }
+        else if(job.kind == ReplayJob::Hash)
+        {
+            result.file.hash = hashFile(path, stopRequested);
+        }
+        else
+        {
+            TimelineReader reader;
+            reader.read(path, &result.timeline, stopRequested);
+            result.timeline.fileName = job.file.fileName;
+            result.timelineRead = !stopRequested->load();                   //a stopped read says nothing about the file
+        }
+
+        return result;
+    }
+
+    QString directory;
+    const QAtomicInt *stopRequested;
+};
+
+ReplayScanner::ReplayScanner(QObject *parent) :
+    QThread(parent), root(0), stopRequested(0)
+{
+    qRegisterMetaType<QList<ReplayFile> >("QList<ReplayFile>");
+    qRegisterMetaType<QList<DemoInfo> >("QList<DemoInfo>");
+    qRegisterMetaType<QList<ReplayTimeline> >("QList<ReplayTimeline>");
+}
+
+void ReplayScanner::setRoot(int rootId, const QString &dir)
+{
+    root = rootId;
+    rootDir = dir;
+}
+
+void ReplayScanner::setKnownFiles(const QHash<QString, ReplayFile> &files)
+{
+    knownFiles = files;
+}
+
+void ReplayScanner::setFileNames(const QStringList &fileNames)
+{
+    onlyFiles = fileNames;
+}
+
+void ReplayScanner::stop()
+{
+    stopRequested.store(1);
+}
+
+int ReplayScanner::rootId() const
+{
+    return root;
+}
+
+QString ReplayScanner::directory() const
+{
+    return rootDir;
+}
+
+void ReplayScanner::run()
+{
+    stopRequested.store(0);
+
+    ReplayJobQueue queue;
+    if(!onlyFiles.isEmpty())
+    {
+        //just the files the folder watcher saw come in; the rest of the root is left alone, so nothing is listed
+        QDir base(rootDir);
+        QList<ReplayFile> changed;
+        foreach(QString fileName, onlyFiles)
+        {
+            QFileInfo info(base.absoluteFilePath(fileName));
+            if(!info.isFile())
+                continue;
+
+            ReplayFile file = ReplayFile::fromFileInfo(info);
+            file.rootId = root;
+            file.fileName = fileName;
+            if(queue.add(file, knownFiles))
+                changed.append(file);
+        }
+        if(!changed.isEmpty())
+            emit filesChanged(changed);
+    }
+    else if(!listFiles(&queue))
+    {
+        emit scanFinished(false);
+        return;
+    }
+
+    //file info blocks first, they are a few KB each so the table fills in long before hashing is done;
+    //timelines last, they go through every packet of the replay
+    int done = 0;
+    int total = queue.readJobs.size() + queue.hashJobs.size() + queue.timelineJobs.size();
+    emit progress(done, total);
+    QSet<QString> unreadable;
+    if(!runJobs(queue.readJobs, &done, total, &unreadable))
+    {
+        emit scanFinished(false);
+        return;
+    }
+
+    //a replay without a file info block is no replay we can go through
+    for(int i = queue.timelineJobs.size() - 1; i >= 0; i--)
+    {
+        if(unreadable.contains(queue.timelineJobs.at(i).file.fileName))
+        {
+            queue.timelineJobs.removeAt(i);
+            total--;
+        }
+    }
+
+    if(!runJobs(queue.hashJobs, &done, total) || !runJobs(queue.timelineJobs, &done, total))
+    {
+        emit scanFinished(false);
+        return;
+    }
+
+    emit scanFinished(true);
+}
+
+//goes over the whole root, queueing work for whatever the index doesn't have yet; false if stopped
+bool ReplayScanner::listFiles(ReplayJobQueue *queue)
+{
+    QStringList batch;
+    QStringList folders(rootDir);
+    QList<ReplayFile> changedBatch;
+    QElapsedTimer sinceLastBatch;
+    sinceLastBatch.start();
+
+    //QDirIterator reads one entry at a time, and the name filter means we never look at anything but replays and folders;
+    //symlinked folders are not followed, so a link back up the tree can't make it go round in circles
+    QDir base(rootDir);
+    QDirIterator it(rootDir, QStringList("*.dem"), QDir::Files | QDir::AllDirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while(it.hasNext())
+    {
+        if(stopRequested.load())
+            return false;
+
+        it.next();
+        if(it.fileInfo().isDir())
+        {
+            folders.append(it.filePath());
+            continue;
+        }
+
+        //only stat data here, the file itself is not opened
+        ReplayFile file = ReplayFile::fromFileInfo(it.fileInfo());
+        file.rootId = root;
+        file.fileName = base.relativeFilePath(it.filePath());
+        batch.append(file.fileName);
+        if(queue->add(file, knownFiles))
+            changedBatch.append(file);
+
+        if(batch.size() >= BatchSize || sinceLastBatch.elapsed() >= BatchInterval)
+        {
+            emit filesFound(batch);
+            if(!changedBatch.isEmpty())
+                emit filesChanged(changedBatch);
+            batch.clear();
+            changedBatch.clear();
+            sinceLastBatch.restart();
+        }
+    }
+
+    if(!batch.isEmpty())
+        emit filesFound(batch);
+    if(!changedBatch.isEmpty())
+        emit filesChanged(changedBatch);
+    emit filesListed(folders);
+    return true;
+}
+
+/*
+ * Runs the jobs on the global thread pool a chunk at a time, so only a few files are open at once,
+ * results go to the database in batches, and a stop is noticed between chunks.
+ */
+bool ReplayScanner::runJobs(const QList<ReplayJob> &jobs, int *done, int total, QSet<QString> *unreadable)
+{
+    const int chunkSize = qMax(ChunkPerThread * QThread::idealThreadCount(), int(ChunkPerThread));
+
+    for(int start = 0; start < jobs.size(); start += chunkSize)
+    {
+        if(stopRequested.load())
+            return false;
+
+        QList<ReplayResult> results = QtConcurrent::blockingMapped<QList<ReplayResult> >(jobs.mid(start, chunkSize), RunReplayJob(rootDir, &stopRequested));
+
+        QList<DemoInfo> infos;
+        QList<ReplayFile> unreadableFiles;
+        QList<ReplayFile> hashed;
+        QList<ReplayTimeline> timelines;
+        foreach(const ReplayResult &result, results)
+        {
+            if(result.infoRead)
+                infos.append(result.info);
+            if(result.infoUnreadable)
+            {
+                unreadableFiles.append(result.file);
+                if(unreadable)
+                    unreadable->insert(result.file.fileName);
+            }
+            if(!result.file.hash.isEmpty())
+                hashed.append(result.file);
+            if(result.timelineRead)
+                timelines.append(result.timeline);
+        }
+
+        if(!infos.isEmpty())
+            emit filesRead(infos);
+        if(!unreadableFiles.isEmpty())
+            emit filesUnreadable(unreadableFiles);
+        if(!hashed.isEmpty())
+            emit filesHashed(hashed);
+        if(!timelines.isEmpty())
+            emit timelinesRead(timelines);
+
+        *done += results.size();
+        emit progress(*done, total);
+    }
+
+    return !stopRequested.load();
+}
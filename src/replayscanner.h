@@ -0,0 +1,66 @@
+#ifndef REPLAYSCANNER_H
+#define REPLAYSCANNER_H
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QThread>
+#include <QDebug>
+#include "replayindex.h"
+
+struct ReplayJob;
+struct ReplayJobQueue;
+
+/*
+ * Lists the .dem files in one replay folder and all of its subfolders on a worker thread.
+ * Each root has its own scanner, so several folders are listed at the same time and can be rescanned on their own.
+ * Entries are streamed off the directory and handed to the GUI in batches as they are found,
+ * so nothing has to wait for the whole folder to be read. File names are relative to the root.
+ * Files whose size, mtime and inode match what the index already has are only listed;
+ * new or changed ones are reported with their stat data, then have their file info block read and are hashed
+ * once the listing is done, spread over the global thread pool. Last, each one whose file info block could be read
+ * has its packet stream gone through for the per player timelines. One that couldn't is left alone until it changes.
+ * A scanner can also be given just a few files, which are looked at the same way without listing the root.
+ */
+class ReplayScanner : public QThread
+{
+    Q_OBJECT
+public:
+    explicit ReplayScanner(QObject *parent = 0);
+
+    void setRoot(int rootId, const QString &dir);                           //only takes effect on the next start()
+    void setKnownFiles(const QHash<QString, ReplayFile> &files);            //what the index has for the root, same as setRoot
+    void setFileNames(const QStringList &fileNames);                        //only look at these, relative to the root; empty for all of it
+    void stop();
+
+    int rootId() const;
+    QString directory() const;
+
+signals:
+    void filesFound(const QStringList &fileNames);                          //every replay, changed or not
+    void filesChanged(const QList<ReplayFile> &files);                      //new or changed since the index saw them, not hashed yet
+    void filesListed(const QStringList &folders);                           //filesFound has had every replay; folders is the root and every folder below it
+    void filesRead(const QList<DemoInfo> &infos);                           //file info blocks of new or changed replays
+    void filesUnreadable(const QList<ReplayFile> &files);                   //no file info block could be read, with the stat data it was read at
+    void filesHashed(const QList<ReplayFile> &files);
+    void timelinesRead(const QList<ReplayTimeline> &timelines);             //including replays nothing could be read from
+    void progress(int done, int total);                                     //files read or hashed after the listing
+    void scanFinished(bool completed);                                      //completed is false if the scan was stopped
+
+private:
+    void run();
+    bool listFiles(ReplayJobQueue *queue);                                  //false if stopped
+    bool runJobs(const QList<ReplayJob> &jobs, int *done, int total, QSet<QString> *unreadable = 0);   //false if stopped; unreadable gets the files with no file info block
+
+    enum { BatchSize = 256, BatchInterval = 100 };                          //emit after this many files or this many ms, whichever comes first
+    enum { ChunkPerThread = 4 };                                            //jobs per pool thread in flight at once
+
+    int root;
+    QString rootDir;
+    QHash<QString, ReplayFile> knownFiles;
+    QStringList onlyFiles;
+    QAtomicInt stopRequested;
+};
+
+#endif // REPLAYSCANNER_H
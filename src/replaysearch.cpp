@@ -0,0 +1,149 @@
+#include "replaysearch.h"
+
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVariant>
+#include <QDebug>
+
+ReplaySearch::ReplaySearch(const QSqlDatabase &db) : db(db)
+{
+}
+
+/*
+ * The triggers are made on every start, since rebuilding the replays table in a schema migration drops them.
+ * If any was missing, documents may have gone stale meanwhile, so they are all written again.
+ */
+bool ReplaySearch::createTables()
+{
+    QSqlQuery query(db);
+    if(!db.tables().contains("replay_search")
+            && !query.exec("create virtual table replay_search using fts5(title, players, heroes, game_mode, prefix = '2 3')"))
+    {
+        qDebug() << "No full text search, using LIKE instead:" << query.lastError().text();
+        return false;
+    }
+
+    QString update = "delete from replay_search where rowid = new.match_id; insert into replay_search (rowid, title, players, heroes, game_mode) " + documentQuery("new.match_id") + ";";
+    QString remove = "delete from replay_search where rowid = old.match_id;";
+
+    //a replay's players and game mode are written together, and info_read = 1 comes last, so that is where its document is rebuilt,
+    //once rather than per player row; the same goes for a match's players and its matches row
+    QStringList triggers;
+    triggers << "replay_search_replay_added after insert on replays begin " + update + " end"
+             << "replay_search_title_changed after update of title, match_id on replays begin " + remove + " " + update + " end"
+             << "replay_search_replay_read after update of info_read on replays when new.info_read = 1 begin " + update + " end"
+             << "replay_search_replay_removed after delete on replays begin " + remove + " end"
+             << "replay_search_match_added after insert on matches begin " + update + " end";
+
+    //per row triggers of older versions
+    QStringList obsolete;
+    obsolete << "replay_search_replay_changed" << "replay_search_player_added" << "replay_search_player_removed" << "replay_search_match_player_added";
+
+    if(!db.transaction())
+        return false;
+
+    foreach(QString trigger, obsolete)
+        query.exec("drop trigger if exists " + trigger);
+
+    query.exec("select count(*) from sqlite_master where type = 'trigger' and name like 'replay_search_%'");
+    bool complete = query.next() && query.value(0).toInt() == triggers.size();
+
+    bool ok = true;
+    foreach(QString trigger, triggers)
+        ok = ok && query.exec("create trigger if not exists " + trigger);
+
+    ok = ok && (complete || rebuild());
+    if(!ok)
+    {
+        qDebug() << "Could not create search triggers:" << query.lastError().text();
+        db.rollback();
+        return false;
+    }
+
+    return db.commit();
+}
+
+bool ReplaySearch::isFullText()
+{
+    return db.tables().contains("replay_search");
+}
+
+int ReplaySearch::search(const QString &text, int limit, const QString &condition, const QVariantList &values)
+{
+    QSqlQuery query(db);
+    query.exec("create temp table if not exists search_hits (position INTEGER PRIMARY KEY, match_id INTEGER)");
+    query.exec("delete from search_hits");
+
+    //positions are handed out in insert order, which is the order of the select
+    if(isFullText())
+    {
+        //bm25 scores every hit before it can pick the best ones; words that common don't rank anything much, so those go newest first
+        QString match = fullTextQuery(text);
+        QString narrowed = condition.isEmpty() ? QString() : " and rowid in (select r.match_id from replays r where " + condition + ")";
+        query.prepare("select count(*) from replay_search where replay_search match ?" + narrowed);
+        query.addBindValue(match);
+        foreach(QVariant value, values)
+            query.addBindValue(value);
+        bool ranked = query.exec() && query.next() && query.value(0).toInt() <= MaxRanked;
+
+        //a hit in the title counts the most, one in the game mode the least
+        query.prepare(QString("insert into search_hits (match_id) select rowid from replay_search where replay_search match ?%1 order by %2 limit ?")
+                      .arg(narrowed, ranked ? "bm25(replay_search, 10.0, 4.0, 4.0, 1.0)" : "rowid desc"));
+        query.addBindValue(match);
+        foreach(QVariant value, values)
+            query.addBindValue(value);
+        query.addBindValue(limit);
+    }
+    else
+    {
+        QString pattern = "%" + QString(text).replace("\\", "\\\\").replace("%", "\\%").replace("_", "\\_") + "%";
+        query.prepare("insert into search_hits (match_id) select r.match_id from replays r where (r.title like ? escape '\\' or r.game_mode like ? escape '\\' "
+                      "or exists (select 1 from replay_players p where p.match_id = r.match_id and (p.player_name like ? escape '\\' or p.hero like ? escape '\\')) "
+                      "or exists (select 1 from match_players m where m.match_id = r.match_id and (m.account_name like ? escape '\\' or m.hero_localized_name like ? escape '\\')))"
+                      + (condition.isEmpty() ? QString() : " and " + condition) + " order by r.end_time desc limit ?");
+        for(int i = 0; i < 6; i++)
+            query.addBindValue(pattern);
+        foreach(QVariant value, values)
+            query.addBindValue(value);
+        query.addBindValue(limit);
+    }
+
+    if(!query.exec())
+    {
+        qDebug() << "Search failed:" << query.lastError().text();
+        return -1;
+    }
+
+    return query.numRowsAffected();
+}
+
+bool ReplaySearch::rebuild()
+{
+    QSqlQuery query(db);
+    return query.exec("delete from replay_search")
+            && query.exec("insert into replay_search (rowid, title, players, heroes, game_mode) " + documentQuery("r.match_id"));
+}
+
+/*
+ * Names are joined into one column per kind; heroes go in both as npc_dota_hero_* from the replay
+ * and by their localized name from the json. The tokenizer splits on '_' and '-', so "anti mage" finds either.
+ */
+QString ReplaySearch::documentQuery(const QString &matchId)
+{
+    return QString("select r.match_id, ifnull(r.title, ''), "
+                   "ifnull((select group_concat(player_name, ' ') from replay_players where match_id = r.match_id), '') || ' ' || "
+                   "ifnull((select group_concat(account_name, ' ') from match_players where match_id = r.match_id), ''), "
+                   "ifnull((select group_concat(replace(hero, 'npc_dota_hero_', ''), ' ') from replay_players where match_id = r.match_id), '') || ' ' || "
+                   "ifnull((select group_concat(hero_localized_name, ' ') from match_players where match_id = r.match_id), ''), "
+                   "ifnull(r.game_mode, '') || ' ' || ifnull((select game_mode from matches where match_id = r.match_id), '') "
+                   "from replays r where r.match_id = %1").arg(matchId);
+}
+
+QString ReplaySearch::fullTextQuery(const QString &text)
+{
+    QStringList terms;
+    foreach(QString word, text.split(' ', QString::SkipEmptyParts))
+        terms.append("\"" + word.replace("\"", "\"\"") + "\"*");
+    return terms.join(" ");
+}
@@ -0,0 +1,38 @@
+#ifndef REPLAYSEARCH_H
+#define REPLAYSEARCH_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QVariant>
+
+/*
+ * Full text search over the replays in matches.db: custom titles, player names, heroes and game mode,
+ * from both the replays' own file info blocks and the match json ingested by MatchStore.
+ * The FTS5 table replay_search has one document per replay, keyed by match id. Triggers on replays and matches
+ * rewrite a replay's document whenever it or its match is written, so it is never rebuilt as a whole
+ * after the first time. Player rows have no triggers of their own: they are written before the row that fires one. Where SQLite was built without FTS5, searches fall back to LIKE over the same columns.
+ *
+ * Results go into the temporary table search_hits (position, match_id), best match first,
+ * where ReplayTableModel pages them in from. The model's filters are applied here, before the limit.
+ */
+class ReplaySearch
+{
+public:
+    explicit ReplaySearch(const QSqlDatabase &db);
+
+    bool createTables();                                                    //after the replay and match tables; false if FTS5 isn't there
+    bool isFullText();
+    int search(const QString &text, int limit,                              //fills search_hits, returns how many there are; -1 on error
+               const QString &condition = QString(), const QVariantList &values = QVariantList());  //only hits whose row in replays r meets it
+
+private:
+    enum { MaxRanked = 20000 };                                             //more hits than this are listed newest first instead
+
+    bool rebuild();
+    static QString documentQuery(const QString &matchId);                   //select of one replay's document
+    static QString fullTextQuery(const QString &text);                      //every word a prefix, all of them have to match
+
+    QSqlDatabase db;
+};
+
+#endif // REPLAYSEARCH_H
@@ -0,0 +1,532 @@
+#include "replaytablemodel.h"
+#include "replaysearch.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QSqlError>
+#include <QVariant>
+#include <QDebug>
+
+static const char *RowColumns = "r.match_id, r.root_id, r.title, r.filename, r.end_time, r.duration, r.game_mode, r.winner, r.archived";
+enum { RowColumnCount = 9 };
+
+ReplayTableModel::ReplayTableModel(const QSqlDatabase &db, QObject *parent) :
+    QAbstractTableModel(parent), db(db), rows(0), rowQuery(db), searchTime(0), sortColumn(-1), sortOrder(Qt::AscendingOrder), sortKey("r.match_id"),
+    pages(MaxPages)
+{
+    rowQuery.setForwardOnly(true);
+    rowQuery.prepare(QString("select %1 from replays r where r.match_id = ?").arg(RowColumns));
+
+    reload();
+}
+
+int ReplayTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows;
+}
+
+int ReplayTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(ColumnCount);
+}
+
+QVariant ReplayTableModel::data(const QModelIndex &index, int role) const
+{
+    if(!index.isValid() || role != Qt::DisplayRole)
+        return QVariant();
+
+    ReplayRow replay = this->replay(index.row());
+    switch(index.column())
+    {
+    case Title:
+        return replay.title;
+    case FileName:
+        return replay.fileName;
+    case Date:
+        return replay.endTime > 0 ? QVariant(QDateTime::fromTime_t(uint(replay.endTime)).toString(Qt::DefaultLocaleShortDate)) : QVariant();
+    case Duration:
+        return replay.duration < 0 ? QVariant() : QVariant(replay.duration);
+    case GameMode:
+        return replay.gameMode;
+    case Winner:
+        return replay.winner;
+    case Archived:
+        return replay.archived ? QVariant(tr("Yes")) : QVariant();
+    }
+
+    return QVariant();
+}
+
+QVariant ReplayTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if(orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    switch(section)
+    {
+    case Title:
+        return tr("Title");
+    case FileName:
+        return tr("File");
+    case Date:
+        return tr("Date");
+    case Duration:
+        return tr("Duration (s)");
+    case GameMode:
+        return tr("Game Mode");
+    case Winner:
+        return tr("Winner");
+    case Archived:
+        return tr("Archived");
+    }
+
+    return QVariant();
+}
+
+ReplayRow ReplayTableModel::replay(int row) const
+{
+    if(row < 0 || row >= rows)
+        return ReplayRow();
+
+    const QList<ReplayRow> *rowsOfPage = page(row / PageSize);
+    if(!rowsOfPage || row % PageSize >= rowsOfPage->size())
+        return ReplayRow();
+
+    return rowsOfPage->at(row % PageSize);
+}
+
+/*
+ * In match id order each cached page is binary searched, otherwise they are gone through;
+ * a row that isn't cached isn't on screen either, and is read fresh when it gets there.
+ */
+int ReplayTableModel::rowOf(qint64 matchID) const
+{
+    bool byMatchId = searchText.isEmpty() && sortKey == "r.match_id" && sortOrder == Qt::AscendingOrder;
+    foreach(int number, pages.keys())
+    {
+        const QList<ReplayRow> *rowsOfPage = pages.object(number);
+
+        if(!byMatchId)
+        {
+            for(int i = 0; i < rowsOfPage->size(); i++)
+            {
+                if(rowsOfPage->at(i).matchID == matchID)
+                    return number * PageSize + i;
+            }
+            continue;
+        }
+
+        if(rowsOfPage->isEmpty() || matchID < rowsOfPage->first().matchID || matchID > rowsOfPage->last().matchID)
+            continue;
+
+        int low = 0;
+        int high = rowsOfPage->size() - 1;
+        while(low <= high)
+        {
+            int middle = (low + high) / 2;
+            qint64 key = rowsOfPage->at(middle).matchID;
+            if(key == matchID)
+                return number * PageSize + middle;
+            if(key < matchID)
+                low = middle + 1;
+            else
+                high = middle - 1;
+        }
+    }
+
+    return -1;
+}
+
+void ReplayTableModel::reload()
+{
+    beginResetModel();
+    clearPages();
+
+    if(searchText.isEmpty())
+    {
+        QSqlQuery query(db);
+        query.prepare("select count(*) from replays r" + (filterConditions.isEmpty() ? QString() : " where " + filterConditions.join(" and ")));
+        foreach(QVariant value, filterValues)
+            query.addBindValue(value);
+        rows = query.exec() && query.next() ? query.value(0).toInt() : 0;
+    }
+    else
+    {
+        QElapsedTimer timer;
+        timer.start();
+        rows = qMax(ReplaySearch(db).search(searchText, MaxHits, filterConditions.join(" and "), filterValues), 0);
+        searchTime = timer.elapsed();
+    }
+    endResetModel();
+}
+
+/*
+ * The same rows in another order, so they aren't counted again; the first page is read from the column's index
+ * once the view asks for it. Replays are named after their match, so the file name column goes by match id.
+ */
+void ReplayTableModel::sort(int column, Qt::SortOrder order)
+{
+    sortColumn = column;
+    sortOrder = order;
+    switch(column)
+    {
+    case Title:
+        sortKey = "r.title";
+        break;
+    case Date:
+        sortKey = "r.end_time";
+        break;
+    case Duration:
+        sortKey = "r.duration";
+        break;
+    case GameMode:
+        sortKey = "r.game_mode";
+        break;
+    case Winner:
+        sortKey = "r.winner";
+        break;
+    case Archived:
+        sortKey = "r.archived";
+        break;
+    default:
+        sortKey = "r.match_id";
+        break;
+    }
+
+    beginResetModel();
+    clearPages();
+    endResetModel();
+}
+
+void ReplayTableModel::setSearchText(const QString &text)
+{
+    searchText = text.trimmed();
+    reload();
+}
+
+int ReplayTableModel::searchMsecs() const
+{
+    return searchTime;
+}
+
+void ReplayTableModel::setFilter(const ReplayFilter &filter)
+{
+    filterConditions.clear();
+    filterValues.clear();
+
+    //end_time is in seconds since epoch, the dates are local days
+    if(filter.from.isValid())
+    {
+        filterConditions << "r.end_time >= ?";
+        filterValues << qint64(QDateTime(filter.from).toTime_t());
+    }
+    if(filter.to.isValid())
+    {
+        filterConditions << "r.end_time < ?";
+        filterValues << qint64(QDateTime(filter.to.addDays(1)).toTime_t());
+    }
+    if(!filter.gameMode.isEmpty())
+    {
+        filterConditions << "r.game_mode = ?";
+        filterValues << filter.gameMode;
+    }
+    if(!filter.hero.isEmpty())
+    {
+        filterConditions << "r.match_id in (select match_id from replay_players where hero = ?)";
+        filterValues << filter.hero;
+    }
+    if(!filter.winner.isEmpty())
+    {
+        filterConditions << "r.winner = ?";
+        filterValues << filter.winner;
+    }
+
+    reload();
+}
+
+//the view keeps its selection and scroll position, unlike with reload()
+void ReplayTableModel::refresh()
+{
+    //what changed may decide which rows get through the filter
+    if(!filterConditions.isEmpty())
+    {
+        reload();
+        return;
+    }
+
+    dropPagesFrom(0);
+    if(rows > 0)
+        emit dataChanged(index(0, 0), index(rows - 1, ColumnCount - 1));
+}
+
+void ReplayTableModel::refreshReplay(qint64 matchID)
+{
+    //a new title or archived state can move it anywhere when sorted by that, onto the screen too
+    if(rowsMayMove())
+    {
+        refresh();
+        return;
+    }
+
+    int row = rowOf(matchID);
+    if(row < 0)
+        return;
+
+    rowQuery.addBindValue(matchID);
+    if(!rowQuery.exec() || !rowQuery.next())
+        return;
+
+    (*pages.object(row / PageSize))[row % PageSize] = readRow(rowQuery);
+    rowQuery.finish();
+    emit dataChanged(index(row, 0), index(row, ColumnCount - 1));
+}
+
+void ReplayTableModel::replayRemoved(int row)
+{
+    if(row < 0 || row >= rows)
+        return;
+
+    //the positions of the hits after it would all move, running the search again is as cheap
+    if(!searchText.isEmpty())
+    {
+        reload();
+        return;
+    }
+
+    beginRemoveRows(QModelIndex(), row, row);
+    rows--;
+    dropPagesFrom(row / PageSize);
+    endRemoveRows();
+}
+
+bool ReplayTableModel::rowsMayMove() const
+{
+    return sortKey != "r.match_id" && (searchText.isEmpty() || sortColumn >= 0);
+}
+
+void ReplayTableModel::clearPages()
+{
+    pages.clear();
+    anchors.clear();
+    anchors.insert(0, Key());
+}
+
+//pages after a removed row start one row later than they did; where the page it was in starts is still right
+void ReplayTableModel::dropPagesFrom(int number)
+{
+    foreach(int cached, pages.keys())
+    {
+        if(cached >= number)
+            pages.remove(cached);
+    }
+
+    QMap<int, Key>::iterator it = anchors.upperBound(number);
+    while(it != anchors.end())
+        it = anchors.erase(it);
+}
+
+ReplayRow ReplayTableModel::readRow(const QSqlQuery &query)
+{
+    ReplayRow replay;
+    replay.matchID = query.value(0).toLongLong();
+    replay.rootId = query.value(1).toInt();
+    replay.title = query.value(2).toString();
+    replay.fileName = query.value(3).toString();
+    replay.endTime = query.value(4).toLongLong();
+    replay.duration = query.value(5).isNull() ? -1 : query.value(5).toInt();
+    replay.gameMode = query.value(6).toString();
+    replay.winner = query.value(7).toString();
+    replay.archived = !query.value(8).isNull();
+    return replay;
+}
+
+const QList<ReplayRow> *ReplayTableModel::page(int number) const
+{
+    QList<ReplayRow> *cached = pages.object(number);
+    if(cached)
+        return cached;
+
+    QList<ReplayRow> *rowsOfPage = new QList<ReplayRow>;
+    rowsOfPage->reserve(PageSize);
+    if(!(searchText.isEmpty() ? readPage(number, rowsOfPage) : readHits(number, rowsOfPage)))
+    {
+        delete rowsOfPage;
+        return 0;
+    }
+
+    pages.insert(number, rowsOfPage);
+    return rowsOfPage;
+}
+
+bool ReplayTableModel::readPage(int number, QList<ReplayRow> *rowsOfPage) const
+{
+    Key after;
+    if(!anchor(number, &after))
+        return false;
+
+    //the sort value of each row comes last, after the row itself
+    QVariant lastValue;
+    foreach(Segment segment, segmentsAfter(after))
+    {
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
+        query.prepare(QString("select %1, %2 from replays r where %3 order by %4 limit %5")
+                      .arg(RowColumns, sortKey, whereClause(segment), orderBy()).arg(PageSize - rowsOfPage->size()));
+        bindValues(&query, segment);
+        if(!query.exec())
+        {
+            qDebug() << "Could not read replays:" << query.lastError().text();
+            return false;
+        }
+
+        while(query.next())
+        {
+            rowsOfPage->append(readRow(query));
+            lastValue = query.value(RowColumnCount);
+        }
+
+        if(rowsOfPage->size() == PageSize)
+            break;
+    }
+
+    //the next page starts right after this one, no need to look that up when scrolling on
+    if(rowsOfPage->size() == PageSize)
+    {
+        Key next;
+        next.top = false;
+        next.value = lastValue;
+        next.matchID = rowsOfPage->last().matchID;
+        anchors.insert(number + 1, next);
+    }
+
+    return true;
+}
+
+//there are at most MaxHits, so they are sorted and skipped through as they are
+bool ReplayTableModel::readHits(int number, QList<ReplayRow> *rowsOfPage) const
+{
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(QString("select %1 from search_hits h join replays r on r.match_id = h.match_id order by %2 limit %3 offset %4")
+                  .arg(RowColumns, sortColumn < 0 ? QString("h.position") : orderBy()).arg(int(PageSize)).arg(number * PageSize));
+    if(!query.exec())
+    {
+        qDebug() << "Could not read search hits:" << query.lastError().text();
+        return false;
+    }
+
+    while(query.next())
+        rowsOfPage->append(readRow(query));
+    return true;
+}
+
+/*
+ * Jumping far down the table starts from the closest page before it whose start is known
+ * and skips the rows in between by counting them on the sort column's index, which never touches the rows themselves.
+ */
+bool ReplayTableModel::anchor(int number, Key *key) const
+{
+    QMap<int, Key>::const_iterator known = anchors.upperBound(number);
+    --known;                                                                //page 0 is always there
+    if(known.key() == number)
+    {
+        *key = known.value();
+        return true;
+    }
+
+    int skip = (number - known.key()) * PageSize - 1;
+    foreach(Segment segment, segmentsAfter(known.value()))
+    {
+        QSqlQuery query(db);
+        query.setForwardOnly(true);
+        query.prepare("select count(*) from replays r where " + whereClause(segment));
+        bindValues(&query, segment);
+        if(!query.exec() || !query.next())
+            return false;
+
+        int count = query.value(0).toInt();
+        if(skip >= count)
+        {
+            skip -= count;
+            continue;
+        }
+
+        query.prepare(QString("select %1, r.match_id from replays r where %2 order by %3 limit 1 offset %4")
+                      .arg(sortKey, whereClause(segment), orderBy()).arg(skip));
+        bindValues(&query, segment);
+        if(!query.exec() || !query.next())
+            return false;
+
+        key->top = false;
+        key->value = query.value(0);
+        key->matchID = query.value(1).toLongLong();
+        anchors.insert(number, *key);
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * SQLite sorts NULL before any value, so ascending the rows without a value come first and descending last.
+ * Each segment is either the rows with the key's value and a later match id, or a range of values,
+ * and each of those is one seek on the (column, match_id) index; together they are everything after the key.
+ */
+QList<ReplayTableModel::Segment> ReplayTableModel::segmentsAfter(const Key &key) const
+{
+    bool descending = sortOrder == Qt::DescendingOrder;
+    QString later = descending ? "<" : ">";
+
+    Segment nulls;
+    nulls.where = sortKey + " is null";
+    Segment values;
+    values.where = sortKey + " is not null";
+
+    QList<Segment> segments;
+    if(key.top)
+    {
+        segments << nulls << values;
+        if(descending)
+            segments.swap(0, 1);
+    }
+    else if(key.value.isNull())
+    {
+        Segment tied;
+        tied.where = QString("%1 is null and r.match_id %2 ?").arg(sortKey, later);
+        tied.values << key.matchID;
+        segments << tied;
+        if(!descending)
+            segments << values;
+    }
+    else
+    {
+        Segment tied;
+        tied.where = QString("%1 = ? and r.match_id %2 ?").arg(sortKey, later);
+        tied.values << key.value << key.matchID;
+        Segment rest;
+        rest.where = QString("%1 %2 ?").arg(sortKey, later);
+        rest.values << key.value;
+        segments << tied << rest;
+        if(descending)
+            segments << nulls;
+    }
+
+    return segments;
+}
+
+QString ReplayTableModel::whereClause(const Segment &segment) const
+{
+    return (QStringList(filterConditions) << segment.where).join(" and ");
+}
+
+//the filter's values go first, in the order of whereClause()
+void ReplayTableModel::bindValues(QSqlQuery *query, const Segment &segment) const
+{
+    foreach(QVariant value, filterValues + segment.values)
+        query->addBindValue(value);
+}
+
+QString ReplayTableModel::orderBy() const
+{
+    return QString("%1 %2, r.match_id %2").arg(sortKey, sortOrder == Qt::DescendingOrder ? "desc" : "asc");
+}
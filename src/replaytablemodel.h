@@ -0,0 +1,121 @@
+#ifndef REPLAYTABLEMODEL_H
+#define REPLAYTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QCache>
+#include <QDate>
+#include <QMap>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QStringList>
+
+//one line of the replay table
+struct ReplayRow
+{
+    ReplayRow() : matchID(0), rootId(0), endTime(0), duration(-1), archived(false) {}
+
+    qint64 matchID;                                                         //key of the row
+    int rootId;
+    QString title;
+    QString fileName;                                                       //relative to its root
+    qint64 endTime;                                                         //seconds since epoch, 0 until the file info block is read
+    int duration;                                                           //seconds, -1 until the file info block is read
+    QString gameMode;
+    QString winner;
+    bool archived;
+};
+
+//what the replay table is narrowed down to; parts left empty don't filter anything
+struct ReplayFilter
+{
+    QDate from;                                                             //played on or after
+    QDate to;                                                               //played on or before
+    QString gameMode;
+    QString hero;                                                           //npc_dota_hero_* as the replay has it
+    QString winner;                                                         //Radiant or Dire
+};
+
+/*
+ * The replays table for the view, read a page at a time as rows are scrolled into sight.
+ * Sorting and filtering happen in SQL: rows are ordered by the sort column and then match id, and a page is
+ * fetched as "the next PageSize rows after this (value, match id)", walking the column's index from there,
+ * so a page deep into the table costs the same as the first one and changing the sort reads nothing but the rows on screen.
+ * Only the last MaxPages pages are kept, plus the key where each page seen so far starts,
+ * so memory stays flat however large the library gets.
+ * Edits and removals of single rows only touch the cached page they are in, the rest is read again when needed.
+ * While searching, the rows are the hits in ReplaySearch's search_hits, in rank order unless sorted otherwise.
+ */
+class ReplayTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    enum Column { Title, FileName, Date, Duration, GameMode, Winner, Archived, ColumnCount };
+
+    explicit ReplayTableModel(const QSqlDatabase &db, QObject *parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);        //column -1 for match id order, or rank while searching
+
+    ReplayRow replay(int row) const;                                        //a default ReplayRow if row is out of range
+    int rowOf(qint64 matchID) const;                                        //-1 unless the row is in a cached page
+
+    void reload();                                                          //after rows were added
+    void refresh();                                                         //rows changed, maybe their keys too; reloads if that could change what is filtered out
+    void refreshReplay(qint64 matchID);                                     //one row changed, its key didn't
+    void replayRemoved(int row);                                            //the row is already gone from the table
+
+    void setSearchText(const QString &text);                                //empty for every replay
+    int searchMsecs() const;                                                //how long the last search took
+    void setFilter(const ReplayFilter &filter);
+
+private:
+    enum { PageSize = 256, MaxPages = 64, MaxHits = 1000 };
+
+    //where a page starts: right after the row with this sort value and match id, or at the top
+    struct Key
+    {
+        Key() : top(true), matchID(0) {}
+
+        bool top;
+        QVariant value;                                                     //NULL sorts before everything else
+        qint64 matchID;
+    };
+
+    //a stretch of the sort order that can be read straight off the sort column's index
+    struct Segment
+    {
+        QString where;
+        QVariantList values;
+    };
+
+    const QList<ReplayRow> *page(int number) const;
+    bool readPage(int number, QList<ReplayRow> *rowsOfPage) const;
+    bool readHits(int number, QList<ReplayRow> *rowsOfPage) const;
+    bool anchor(int number, Key *key) const;                                //key of the last row before the page
+    QList<Segment> segmentsAfter(const Key &key) const;                     //the rest of the table after key, in order
+    QString whereClause(const Segment &segment) const;                      //with the filter
+    void bindValues(QSqlQuery *query, const Segment &segment) const;
+    QString orderBy() const;
+    bool rowsMayMove() const;                                               //whether changing a row can change where it is in the table
+    void clearPages();
+    void dropPagesFrom(int number);
+    static ReplayRow readRow(const QSqlQuery &query);
+
+    QSqlDatabase db;
+    int rows;
+    QSqlQuery rowQuery;
+    QString searchText;
+    int searchTime;
+    int sortColumn;
+    Qt::SortOrder sortOrder;
+    QString sortKey;                                                        //the column ordered by, then by match id
+    QStringList filterConditions;                                           //on replays r
+    QVariantList filterValues;
+    mutable QCache<int, QList<ReplayRow> > pages;
+    mutable QMap<int, Key> anchors;
+};
+
+#endif // REPLAYTABLEMODEL_H
@@ -0,0 +1,613 @@
+#include "replaytimeline.h"
+#include "bitreader.h"
+#include "demoreader.h"
+#include "protoreader.h"
+#include "snappy.h"
+
+#include <QFileInfo>
+
+QByteArray ReplayTimeline::encode(const QVector<qint64> &samples)
+{
+    QByteArray data;
+    data.reserve(samples.size() * 2);
+
+    qint64 previous = 0;
+    foreach(qint64 sample, samples)
+    {
+        qint64 delta = sample - previous;
+        quint64 zigzag = (quint64(delta) << 1) ^ quint64(delta >> 63);
+        previous = sample;
+
+        while(zigzag >= 0x80)
+        {
+            data.append(char(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        data.append(char(zigzag));
+    }
+
+    return data;
+}
+
+QVector<qint64> ReplayTimeline::decode(const QByteArray &data)
+{
+    QVector<qint64> samples;
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+    const uchar *end = p + data.size();
+
+    qint64 previous = 0;
+    quint64 zigzag;
+    while(ProtoReader::readVarint(&p, end, &zigzag))
+    {
+        previous += qint64(zigzag >> 1) ^ -qint64(zigzag & 1);
+        samples.append(previous);
+    }
+
+    return samples;
+}
+
+TimelineReader::TimelineReader(int sampleTicks) :
+    sampleTicks(qMax(sampleTicks, 1)), timeline(0), combatLogNamesTable(-1), nextSampleTick(0), samplesTaken(0)
+{
+}
+
+bool TimelineReader::read(const QString &fileName, ReplayTimeline *timeline, const QAtomicInt *stopRequested)
+{
+    DemoReader demo;
+    if(!demo.open(fileName) || !demo.isSource2())
+        return false;
+
+    reset(timeline);
+
+    QByteArray payload;
+    int messages = 0;
+    while(demo.next())
+    {
+        if(stopRequested && (++messages & 1023) == 0 && stopRequested->load())
+            return false;
+
+        //full packets repeat state we already followed through the regular ones, all we want is where they are
+        if(demo.command() == DemoReader::DEM_FullPacket && demo.tick() >= 0)
+            timeline->seekPoints.append(SeekPoint(demo.tick(), demo.offset()));
+
+        if(demo.command() != DemoReader::DEM_Packet && demo.command() != DemoReader::DEM_SignonPacket)
+            continue;
+
+        if(demo.tick() >= 0)
+            sampleUpTo(demo.tick());
+
+        if(!demo.readPayload(&payload) || !readPacket(payload))
+            return false;
+    }
+
+    if(demo.hasError())
+        return false;
+
+    //what was read up to the cut is kept, but marked as such
+    takeSample();
+    timeline->fileName = QFileInfo(fileName).fileName();
+    timeline->ok = !timeline->heroes.isEmpty();
+    timeline->complete = demo.reachedStop();
+    return timeline->ok;
+}
+
+/*
+ * What was earned between two ticks, sampled from fromTick on, without going through the replay up to there.
+ * The string tables are created by the signon packets at the start, which are read first; then reading
+ * jumps to the full packet at offset, whose snapshot of the tables stands in for every update before it.
+ * Series start at 0 on fromTick. complete is false if the replay ends before toTick.
+ */
+bool TimelineReader::readRange(const QString &fileName, qint64 offset, int fromTick, int toTick, ReplayTimeline *timeline)
+{
+    DemoReader demo;
+    if(!demo.open(fileName) || !demo.isSource2())
+        return false;
+
+    reset(timeline);
+
+    QByteArray payload;
+    while(demo.next() && demo.command() != DemoReader::DEM_Packet && demo.command() != DemoReader::DEM_FullPacket)
+    {
+        if(demo.command() == DemoReader::DEM_SignonPacket && (!demo.readPayload(&payload) || !readPacket(payload)))
+            return false;
+    }
+
+    if(demo.hasError() || !demo.seek(offset) || !demo.next() || demo.command() != DemoReader::DEM_FullPacket
+            || !demo.readPayload(&payload) || !readFullPacket(payload))
+    {
+        return false;
+    }
+
+    //packets between the full packet and fromTick are followed for the names they add, but nothing in them counts
+    bool counting = false;
+    nextSampleTick = fromTick;
+    while(demo.next() && demo.tick() <= toTick)
+    {
+        if(demo.command() != DemoReader::DEM_Packet)
+            continue;
+
+        if(!counting && demo.tick() >= fromTick)
+        {
+            totals.clear();
+            timeline->heroes.clear();
+            counting = true;
+        }
+        if(counting)
+            sampleUpTo(demo.tick());
+
+        if(!demo.readPayload(&payload) || !readPacket(payload))
+            return false;
+    }
+
+    if(demo.hasError())
+        return false;
+
+    if(!counting)
+    {
+        totals.clear();
+        timeline->heroes.clear();
+    }
+    takeSample();
+    timeline->fileName = QFileInfo(fileName).fileName();
+    timeline->ok = !timeline->heroes.isEmpty();
+    timeline->complete = demo.reachedStop() || demo.tick() > toTick;
+    return timeline->ok;
+}
+
+void TimelineReader::reset(ReplayTimeline *timeline)
+{
+    this->timeline = timeline;
+    timeline->sampleTicks = sampleTicks;
+    timeline->heroes.clear();
+    timeline->seekPoints.clear();
+    stringTables.clear();
+    combatLogNamesTable = -1;
+    combatLogNames.clear();
+    totals.clear();
+    nextSampleTick = 0;
+    samplesTaken = 0;
+}
+
+/*
+ * CDemoFullPacket; only its string tables (field 1, a CDemoStringTables) are read.
+ * Each table is a name and its entries in index order, each a key and user data; for CombatLogNames
+ * they replace the names followed so far.
+ */
+bool TimelineReader::readFullPacket(const QByteArray &payload)
+{
+    ProtoReader packet(reinterpret_cast<const uchar *>(payload.constData()), payload.size());
+    while(packet.next())
+    {
+        qint64 size;
+        const uchar *data;
+        if(packet.field() != 1 || !(data = packet.toBytes(&size)))
+        {
+            packet.skip();
+            continue;
+        }
+
+        ProtoReader tables(data, size);
+        while(tables.next())
+        {
+            const uchar *table;
+            if(tables.field() != 1 || !(table = tables.toBytes(&size)))
+            {
+                tables.skip();
+                continue;
+            }
+
+            QByteArray name;
+            QList<QByteArray> keys;
+            ProtoReader fields(table, size);
+            while(fields.next())
+            {
+                const uchar *item;
+                if(fields.field() == 1)
+                {
+                    name = fields.toString().toLatin1();
+                }
+                else if(fields.field() == 2 && (item = fields.toBytes(&size)))
+                {
+                    QByteArray key;
+                    ProtoReader itemFields(item, size);
+                    while(itemFields.next())
+                    {
+                        if(itemFields.field() == 1)
+                            key = itemFields.toString().toLatin1();
+                        else
+                            itemFields.skip();
+                    }
+                    if(itemFields.hasError())
+                        return false;
+                    keys.append(key);
+                }
+                else
+                {
+                    fields.skip();
+                }
+            }
+
+            if(fields.hasError())
+                return false;
+
+            if(name == "CombatLogNames")
+            {
+                combatLogNames.clear();
+                for(int i = 0; i < keys.size(); i++)
+                {
+                    if(!keys.at(i).isEmpty())
+                        combatLogNames.insert(quint32(i), keys.at(i));
+                }
+            }
+        }
+
+        if(tables.hasError())
+            return false;
+    }
+
+    return !packet.hasError();
+}
+
+/*
+ * CDemoPacket, whose data is a bit stream of messages:
+ * a ubitvar type, a varint size and that many bytes, back to back.
+ */
+bool TimelineReader::readPacket(const QByteArray &payload)
+{
+    ProtoReader reader(reinterpret_cast<const uchar *>(payload.constData()), payload.size());
+    while(reader.next())
+    {
+        if(reader.field() != 3)
+        {
+            reader.skip();
+            continue;
+        }
+
+        qint64 size;
+        const uchar *data = reader.toBytes(&size);
+        if(!data)
+            return false;
+
+        BitReader bits(data, size);
+        QByteArray message;
+        while(bits.bitsLeft() >= 8)
+        {
+            int type = int(bits.readUBitVar());
+            quint32 messageSize = bits.readVarUInt32();
+
+            switch(type)
+            {
+            case svc_CreateStringTable:
+            case svc_UpdateStringTable:
+            case DOTA_UM_CombatLogBulkData:
+            case DOTA_UM_CombatLogDataHLTV:
+                if(!bits.readBytes(messageSize, &message) || !readMessage(type, message))
+                    return false;
+                break;
+            default:
+                if(!bits.skipBits(qint64(messageSize) * 8))
+                    return false;
+            }
+        }
+
+        if(bits.hasError())
+            return false;
+    }
+
+    return !reader.hasError();
+}
+
+bool TimelineReader::readMessage(int type, const QByteArray &data)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+
+    switch(type)
+    {
+    case svc_CreateStringTable:
+        return createStringTable(data);
+    case svc_UpdateStringTable:
+        return updateStringTable(data);
+    case DOTA_UM_CombatLogDataHLTV:
+        return readCombatLogEntry(bytes, data.size());
+    default:
+    {
+        //CDOTAUserMsg_CombatLogBulkData, a batch of entries in field 1
+        ProtoReader reader(bytes, data.size());
+        while(reader.next())
+        {
+            if(reader.field() == 1)
+            {
+                qint64 size;
+                const uchar *entry = reader.toBytes(&size);
+                if(!entry || !readCombatLogEntry(entry, size))
+                    return false;
+            }
+            else
+            {
+                reader.skip();
+            }
+        }
+        return !reader.hasError();
+    }
+    }
+}
+
+//CSVCMsg_CreateStringTable; every table is remembered for its id, only CombatLogNames is read
+bool TimelineReader::createStringTable(const QByteArray &data)
+{
+    StringTable table;
+    table.userDataFixedSize = false;
+    table.userDataSizeBits = 0;
+    table.flags = 0;
+    table.varintBitCounts = false;
+
+    int count = 0;
+    bool compressed = false;
+    QByteArray stringData;
+
+    ProtoReader reader(reinterpret_cast<const uchar *>(data.constData()), data.size());
+    while(reader.next())
+    {
+        qint64 size;
+        const uchar *bytes;
+
+        switch(reader.field())
+        {
+        case 1:
+            table.name = reader.toString().toLatin1();
+            break;
+        case 2:
+            count = int(reader.toVarint());
+            break;
+        case 3:
+            table.userDataFixedSize = reader.toVarint() != 0;
+            break;
+        case 5:
+            table.userDataSizeBits = int(reader.toVarint());
+            break;
+        case 6:
+            table.flags = int(reader.toVarint());
+            break;
+        case 7:
+            bytes = reader.toBytes(&size);
+            if(bytes)
+                stringData = QByteArray(reinterpret_cast<const char *>(bytes), int(size));
+            break;
+        case 9:
+            compressed = reader.toVarint() != 0;
+            break;
+        case 10:
+            table.varintBitCounts = reader.toVarint() != 0;
+            break;
+        default:
+            reader.skip();
+        }
+    }
+
+    if(reader.hasError())
+        return false;
+
+    stringTables.append(table);
+    if(table.name != "CombatLogNames")
+        return true;
+
+    combatLogNamesTable = stringTables.size() - 1;
+    if(compressed)
+    {
+        QByteArray uncompressed;
+        if(!Snappy::uncompress(stringData.constData(), stringData.size(), &uncompressed))
+            return false;
+        stringData = uncompressed;
+    }
+
+    return readStringTableEntries(stringData, count, table);
+}
+
+//CSVCMsg_UpdateStringTable
+bool TimelineReader::updateStringTable(const QByteArray &data)
+{
+    int tableId = -1;
+    int count = 0;
+    const uchar *stringData = 0;
+    qint64 size = 0;
+
+    ProtoReader reader(reinterpret_cast<const uchar *>(data.constData()), data.size());
+    while(reader.next())
+    {
+        switch(reader.field())
+        {
+        case 1:
+            tableId = int(reader.toVarint());
+            break;
+        case 2:
+            count = int(reader.toVarint());
+            break;
+        case 3:
+            stringData = reader.toBytes(&size);
+            break;
+        default:
+            reader.skip();
+        }
+    }
+
+    if(reader.hasError())
+        return false;
+
+    if(tableId != combatLogNamesTable || tableId < 0 || !stringData)
+        return true;
+
+    return readStringTableEntries(QByteArray::fromRawData(reinterpret_cast<const char *>(stringData), int(size)), count, stringTables.at(tableId));
+}
+
+/*
+ * Entries are an index (the next one, or a jump), an optional key that may reuse the start of one of
+ * the last 32 keys, and optional user data, which we step over.
+ */
+bool TimelineReader::readStringTableEntries(const QByteArray &data, int count, const StringTable &table)
+{
+    BitReader bits(reinterpret_cast<const uchar *>(data.constData()), data.size());
+    QList<QByteArray> history;
+    int index = -1;
+
+    for(int i = 0; i < count && !bits.hasError(); i++)
+    {
+        if(bits.readBool())
+            index++;
+        else
+            index = int(bits.readVarUInt32()) + 1;
+
+        if(bits.readBool())
+        {
+            QByteArray key;
+            if(bits.readBool())
+            {
+                int position = int(bits.readBits(5));
+                int length = int(bits.readBits(5));
+                if(position < history.size())
+                    key = history.at(position).left(length);
+            }
+            key += bits.readString();
+
+            if(history.size() >= 32)
+                history.removeFirst();
+            history.append(key);
+            combatLogNames.insert(quint32(index), key);
+        }
+
+        if(bits.readBool())
+        {
+            qint64 valueBits;
+            if(table.userDataFixedSize)
+            {
+                valueBits = table.userDataSizeBits;
+            }
+            else
+            {
+                if(table.flags & 1)
+                    bits.readBool();                                        //compressed, which doesn't matter when skipping
+                valueBits = table.varintBitCounts ? qint64(bits.readUBitVar()) * 8 : qint64(bits.readBits(17)) * 8;
+            }
+            bits.skipBits(valueBits);
+        }
+    }
+
+    return !bits.hasError();
+}
+
+TimelineReader::Totals *TimelineReader::hero(quint32 nameIndex)
+{
+    QHash<quint32, QByteArray>::const_iterator name = combatLogNames.constFind(nameIndex);
+    if(name == combatLogNames.constEnd() || !name->startsWith("npc_dota_hero_"))
+        return 0;
+
+    QString heroName = QString::fromLatin1(*name);
+    if(!totals.contains(heroName))
+    {
+        //a hero first seen now had nothing in the samples already taken
+        HeroTimeline &series = timeline->heroes[heroName];
+        series.gold.fill(0, samplesTaken);
+        series.xp.fill(0, samplesTaken);
+        series.lastHits.fill(0, samplesTaken);
+    }
+
+    return &totals[heroName];
+}
+
+//CMsgDOTACombatLogEntry
+bool TimelineReader::readCombatLogEntry(const uchar *data, qint64 size)
+{
+    int type = -1;
+    quint32 targetName = 0, attackerName = 0;
+    bool attackerIllusion = false, targetHero = false;
+    qint32 value = 0;
+    int attackerTeam = -1, targetTeam = -1;
+
+    ProtoReader reader(data, size);
+    while(reader.next())
+    {
+        switch(reader.field())
+        {
+        case 1:
+            type = int(reader.toVarint());
+            break;
+        case 2:
+            targetName = quint32(reader.toVarint());
+            break;
+        case 4:
+            attackerName = quint32(reader.toVarint());
+            break;
+        case 7:
+            attackerIllusion = reader.toVarint() != 0;
+            break;
+        case 10:
+            targetHero = reader.toVarint() != 0;
+            break;
+        case 13:
+            value = qint32(quint32(reader.toVarint()));                     //gold lost to a death comes through negative
+            break;
+        case 28:
+            attackerTeam = int(reader.toVarint());
+            break;
+        case 29:
+            targetTeam = int(reader.toVarint());
+            break;
+        default:
+            reader.skip();
+        }
+    }
+
+    if(reader.hasError())
+        return false;
+
+    Totals *heroTotals;
+    switch(type)
+    {
+    case DOTA_COMBATLOG_GOLD:
+        if((heroTotals = hero(targetName)))
+            heroTotals->gold += value;
+        break;
+    case DOTA_COMBATLOG_XP:
+        if((heroTotals = hero(targetName)))
+            heroTotals->xp += value;
+        break;
+    case DOTA_COMBATLOG_DEATH:
+    {
+        //a hero killing a creep of the other side; same side is a deny
+        if(attackerIllusion || targetHero || (attackerTeam >= 0 && attackerTeam == targetTeam))
+            break;
+
+        QByteArray target = combatLogNames.value(targetName);
+        if(!target.startsWith("npc_dota_creep") && !target.startsWith("npc_dota_neutral") && !target.contains("_siege"))
+            break;
+
+        if((heroTotals = hero(attackerName)))
+            heroTotals->lastHits++;
+        break;
+    }
+    }
+
+    return true;
+}
+
+void TimelineReader::sampleUpTo(int tick)
+{
+    while(tick >= nextSampleTick)
+    {
+        takeSample();
+        nextSampleTick += sampleTicks;
+    }
+}
+
+void TimelineReader::takeSample()
+{
+    QHash<QString, Totals>::const_iterator it;
+    for(it = totals.constBegin(); it != totals.constEnd(); ++it)
+    {
+        HeroTimeline &series = timeline->heroes[it.key()];
+        series.gold.append(it->gold);
+        series.xp.append(it->xp);
+        series.lastHits.append(it->lastHits);
+    }
+
+    samplesTaken++;
+}
@@ -0,0 +1,113 @@
+#ifndef REPLAYTIMELINE_H
+#define REPLAYTIMELINE_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+
+//one hero's running totals, sampled every sampleTicks
+struct HeroTimeline
+{
+    QVector<qint64> gold;                                                   //gold earned less gold lost, so net worth without the starting gold
+    QVector<qint64> xp;
+    QVector<qint64> lastHits;
+};
+
+//where a full packet starts; reading can begin there without anything before it
+struct SeekPoint
+{
+    SeekPoint() : tick(0), offset(0) {}
+    SeekPoint(int tick, qint64 offset) : tick(tick), offset(offset) {}
+
+    int tick;
+    qint64 offset;
+};
+
+struct ReplayTimeline
+{
+    ReplayTimeline() : sampleTicks(0), ok(false), complete(false) {}
+
+    QString fileName;
+    int sampleTicks;
+    bool ok;
+    bool complete;                                                          //read up to DEM_Stop; false for a replay that was cut off
+    QHash<QString, HeroTimeline> heroes;                                    //by npc_dota_hero_* name
+    QVector<SeekPoint> seekPoints;                                          //every full packet, in tick order
+
+    static QByteArray encode(const QVector<qint64> &samples);               //differences as zigzag varints, a few bytes a sample
+    static QVector<qint64> decode(const QByteArray &data);
+};
+
+Q_DECLARE_METATYPE(ReplayTimeline)
+
+/*
+ * Builds per hero gold, xp and last hit curves from a replay's combat log.
+ * The packet stream is read one message at a time with DemoReader; of everything in a packet only
+ * combat log entries and the string table naming their units are decoded, the rest is skipped unread.
+ * The same pass notes where each full packet starts, as a seek index into the file, which readRange() starts from.
+ * Needs a source 2 replay.
+ */
+class TimelineReader
+{
+public:
+    enum { TicksPerSecond = 30, DefaultSampleTicks = 60 * TicksPerSecond };
+
+    explicit TimelineReader(int sampleTicks = DefaultSampleTicks);
+
+    bool read(const QString &fileName, ReplayTimeline *timeline, const QAtomicInt *stopRequested = 0);
+    bool readRange(const QString &fileName, qint64 offset, int fromTick, int toTick, ReplayTimeline *timeline);   //offset of a full packet at or before fromTick, from the seek index
+
+private:
+    enum {
+        svc_CreateStringTable = 44,
+        svc_UpdateStringTable = 45,
+        DOTA_UM_CombatLogBulkData = 553,
+        DOTA_UM_CombatLogDataHLTV = 554
+    };
+    enum { DOTA_COMBATLOG_DEATH = 4, DOTA_COMBATLOG_GOLD = 8, DOTA_COMBATLOG_XP = 10 };
+
+    struct StringTable
+    {
+        QByteArray name;
+        bool userDataFixedSize;
+        int userDataSizeBits;
+        int flags;
+        bool varintBitCounts;
+    };
+
+    struct Totals
+    {
+        Totals() : gold(0), xp(0), lastHits(0) {}
+
+        qint64 gold;
+        qint64 xp;
+        qint64 lastHits;
+    };
+
+    void reset(ReplayTimeline *timeline);
+    bool readFullPacket(const QByteArray &payload);
+    bool readPacket(const QByteArray &payload);
+    bool readMessage(int type, const QByteArray &data);
+    bool createStringTable(const QByteArray &data);
+    bool updateStringTable(const QByteArray &data);
+    bool readStringTableEntries(const QByteArray &data, int count, const StringTable &table);
+    bool readCombatLogEntry(const uchar *data, qint64 size);
+    Totals *hero(quint32 nameIndex);
+    void sampleUpTo(int tick);
+    void takeSample();
+
+    int sampleTicks;
+    ReplayTimeline *timeline;
+    QList<StringTable> stringTables;                                        //the table id is the position
+    int combatLogNamesTable;
+    QHash<quint32, QByteArray> combatLogNames;                              //combat log entries name units by index into this table
+    QHash<QString, Totals> totals;
+    int nextSampleTick;
+    int samplesTaken;
+};
+
+#endif // REPLAYTIMELINE_H
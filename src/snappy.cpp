@@ -0,0 +1,125 @@
+#include "snappy.h"
+
+#include <string.h>
+
+/*
+ * The preamble is the uncompressed length as a varint; returns the bytes it took, 0 if bad.
+ * The best any element does is a 2 byte offset copy, 64 bytes out of 3 in, so a length above that
+ * for what follows can't be right, and is turned down before anything is allocated for it.
+ */
+static int readPreamble(const uchar *data, int size, quint32 maxLength, quint32 *length)
+{
+    quint32 value = 0;
+    for(int i = 0; i < size && i < 5; i++)
+    {
+        value |= quint32(data[i] & 0x7f) << (7 * i);
+        if(!(data[i] & 0x80))
+        {
+            if(value > maxLength || quint64(value) * 3 > quint64(size - i - 1) * 64)
+                return 0;
+
+            *length = value;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+int Snappy::uncompressedLength(const char *data, int size)
+{
+    quint32 length;
+    if(!readPreamble(reinterpret_cast<const uchar *>(data), size, MaxLength, &length))
+        return -1;
+
+    return int(length);
+}
+
+bool Snappy::uncompress(const char *data, int size, QByteArray *out)
+{
+    const uchar *in = reinterpret_cast<const uchar *>(data);
+    const uchar *end = in + size;
+
+    quint32 length;
+    int used = readPreamble(in, size, MaxLength, &length);
+    if(!used)
+        return false;
+    in += used;
+
+    out->resize(int(length));
+    char *dest = out->data();
+    int produced = 0;
+
+    while(in < end)
+    {
+        uchar tag = *in++;
+        int elementLength;
+        int offset = 0;
+
+        if((tag & 3) == 0)
+        {
+            //literal, lengths over 60 are stored in the next 1-4 bytes
+            elementLength = tag >> 2;
+            if(elementLength >= 60)
+            {
+                int bytes = elementLength - 59;
+                if(end - in < bytes)
+                    return false;
+
+                elementLength = 0;
+                for(int i = 0; i < bytes; i++)
+                    elementLength |= int(in[i]) << (8 * i);
+                in += bytes;
+            }
+            elementLength++;
+
+            if(elementLength <= 0 || end - in < elementLength || int(length) - produced < elementLength)
+                return false;
+
+            memcpy(dest + produced, in, elementLength);
+            in += elementLength;
+            produced += elementLength;
+            continue;
+        }
+
+        //copies of earlier output, with a 1, 2 or 4 byte offset
+        if((tag & 3) == 1)
+        {
+            if(end - in < 1)
+                return false;
+            elementLength = ((tag >> 2) & 7) + 4;
+            offset = ((tag >> 5) << 8) | in[0];
+            in += 1;
+        }
+        else if((tag & 3) == 2)
+        {
+            if(end - in < 2)
+                return false;
+            elementLength = (tag >> 2) + 1;
+            offset = in[0] | (in[1] << 8);
+            in += 2;
+        }
+        else
+        {
+            if(end - in < 4)
+                return false;
+            elementLength = (tag >> 2) + 1;
+            quint32 value = in[0] | (in[1] << 8) | (in[2] << 16) | (quint32(in[3]) << 24);
+            if(value > 0x7fffffff)
+                return false;
+            offset = int(value);
+            in += 4;
+        }
+
+        if(offset <= 0 || offset > produced || int(length) - produced < elementLength)
+            return false;
+
+        //the source may overlap what is being written, which repeats the pattern, so go byte by byte
+        const char *source = dest + produced - offset;
+        for(int i = 0; i < elementLength; i++)
+            dest[produced + i] = source[i];
+        produced += elementLength;
+    }
+
+    return produced == int(length);
+}
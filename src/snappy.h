@@ -0,0 +1,20 @@
+#ifndef SNAPPY_H
+#define SNAPPY_H
+
+#include <QByteArray>
+
+/*
+ * Decompressor for raw snappy blocks, which is what replays use for their compressed messages.
+ * Only decoding is needed, so this is a few dozen lines instead of another library.
+ */
+class Snappy
+{
+public:
+    static bool uncompress(const char *data, int size, QByteArray *out);   //false on a malformed or truncated block
+    static int uncompressedLength(const char *data, int size);              //-1 if the preamble is bad or claims more than the block can hold
+
+private:
+    enum { MaxLength = 64 * 1024 * 1024 };                                  //far above any message in a replay
+};
+
+#endif // SNAPPY_H
@@ -0,0 +1,138 @@
+#include "xxhash64.h"
+
+#include <QtEndian>
+
+#include <string.h>
+
+static const quint64 Prime1 = Q_UINT64_C(11400714785074694791);
+static const quint64 Prime2 = Q_UINT64_C(14029467366897019727);
+static const quint64 Prime3 = Q_UINT64_C(1609587929392839161);
+static const quint64 Prime4 = Q_UINT64_C(9650029242287828579);
+static const quint64 Prime5 = Q_UINT64_C(2870177450012600261);
+
+static inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline quint64 xxh64Round(quint64 accumulator, quint64 input)
+{
+    accumulator += input * Prime2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * Prime1;
+}
+
+static inline quint64 mergeRound(quint64 accumulator, quint64 value)
+{
+    accumulator ^= xxh64Round(0, value);
+    return accumulator * Prime1 + Prime4;
+}
+
+static inline quint64 read64(const uchar *p)
+{
+    return qFromLittleEndian<quint64>(p);
+}
+
+static inline quint32 read32(const uchar *p)
+{
+    return qFromLittleEndian<quint32>(p);
+}
+
+XxHash64::XxHash64(quint64 seed) :
+    v1(seed + Prime1 + Prime2), v2(seed + Prime2), v3(seed), v4(seed - Prime1), seed(seed), totalSize(0), buffered(0)
+{
+}
+
+void XxHash64::addData(const char *data, qint64 size)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    const uchar *end = p + size;
+    totalSize += size;
+
+    //top up what was left over from last time first
+    if(buffered + size < 32)
+    {
+        memcpy(buffer + buffered, p, size_t(size));
+        buffered += int(size);
+        return;
+    }
+
+    if(buffered > 0)
+    {
+        int fill = 32 - buffered;
+        memcpy(buffer + buffered, p, fill);
+        v1 = xxh64Round(v1, read64(buffer));
+        v2 = xxh64Round(v2, read64(buffer + 8));
+        v3 = xxh64Round(v3, read64(buffer + 16));
+        v4 = xxh64Round(v4, read64(buffer + 24));
+        p += fill;
+        buffered = 0;
+    }
+
+    //the bulk, 32 bytes at a time in four independent lanes
+    while(end - p >= 32)
+    {
+        v1 = xxh64Round(v1, read64(p));
+        v2 = xxh64Round(v2, read64(p + 8));
+        v3 = xxh64Round(v3, read64(p + 16));
+        v4 = xxh64Round(v4, read64(p + 24));
+        p += 32;
+    }
+
+    buffered = int(end - p);
+    memcpy(buffer, p, buffered);
+}
+
+quint64 XxHash64::result() const
+{
+    quint64 hash;
+    if(totalSize >= 32)
+    {
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = mergeRound(hash, v1);
+        hash = mergeRound(hash, v2);
+        hash = mergeRound(hash, v3);
+        hash = mergeRound(hash, v4);
+    }
+    else
+    {
+        hash = seed + Prime5;
+    }
+
+    hash += totalSize;
+
+    const uchar *p = buffer;
+    const uchar *end = buffer + buffered;
+    while(end - p >= 8)
+    {
+        hash ^= xxh64Round(0, read64(p));
+        hash = rotateLeft(hash, 27) * Prime1 + Prime4;
+        p += 8;
+    }
+
+    if(end - p >= 4)
+    {
+        hash ^= quint64(read32(p)) * Prime1;
+        hash = rotateLeft(hash, 23) * Prime2 + Prime3;
+        p += 4;
+    }
+
+    while(p < end)
+    {
+        hash ^= quint64(*p) * Prime5;
+        hash = rotateLeft(hash, 11) * Prime1;
+        p++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+QByteArray XxHash64::hexResult() const
+{
+    return QByteArray::number(result(), 16).rightJustified(16, '0');
+}
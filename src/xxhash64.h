@@ -0,0 +1,27 @@
+#ifndef XXHASH64_H
+#define XXHASH64_H
+
+#include <QByteArray>
+
+/*
+ * Streaming XXH64: a non-cryptographic 64 bit hash that runs at several GB/s,
+ * so hashing a replay costs about as much as reading it. Good for spotting identical files, not for security.
+ */
+class XxHash64
+{
+public:
+    explicit XxHash64(quint64 seed = 0);
+
+    void addData(const char *data, qint64 size);
+    quint64 result() const;
+    QByteArray hexResult() const;                                           //16 lowercase hex digits
+
+private:
+    quint64 v1, v2, v3, v4;
+    quint64 seed;
+    quint64 totalSize;
+    uchar buffer[32];                                                       //input short of a full 32 byte stripe
+    int buffered;
+};
+
+#endif // XXHASH64_H
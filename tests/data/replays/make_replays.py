@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+# Writes the cut down replays tst_demoheader reads.
+# Each is a demo header, a few filler messages and the CDemoFileInfo the header points to,
+# encoded the way Dota writes them, so the expected values in the test are the ones set below.
+import struct, random, os
+random.seed(15)
+def varint(v):
+    out=bytearray()
+    while True:
+        b=v&0x7f; v>>=7
+        if v: out.append(b|0x80)
+        else: out.append(b); return bytes(out)
+def key(f,wt): return varint((f<<3)|wt)
+def fvar(f,v): return key(f,0)+varint(v)
+def fbytes(f,b):
+    if isinstance(b,str): b=b.encode()
+    return key(f,2)+varint(len(b))+b
+def ffloat(f,x): return key(f,5)+struct.pack('<f',x)
+
+def snappy(data):
+    out=bytearray(varint(len(data)))
+    i=0; lit_start=0; table={}
+    def emit_lit(a,b):
+        while a<b:
+            n=min(b-a,60)
+            out.append((n-1)<<2); out.extend(data[a:a+n]); a+=n
+    while i+4<=len(data):
+        k=data[i:i+4]; cand=table.get(k); table[k]=i
+        if cand is not None and i-cand<65536:
+            m=4
+            while i+m<len(data) and data[cand+m]==data[i+m] and m<64: m+=1
+            emit_lit(lit_start,i)
+            off=i-cand
+            if m<=11 and off<2048 and m>=4:
+                out.append(1|((m-4)<<2)|((off>>8)<<5)); out.append(off&0xff)
+            else:
+                out.append(2|((m-1)<<2)); out.extend(struct.pack('<H',off))
+            i+=m; lit_start=i
+        else: i+=1
+    emit_lit(lit_start,len(data))
+    return bytes(out)
+
+def message(cmd,tick,payload,compress=False):
+    if compress:
+        payload=snappy(payload); cmd|=64
+    return varint(cmd)+varint(tick)+varint(len(payload))+payload
+
+players=[("npc_dota_hero_antimage","Puppey",76561197960287930,2),("npc_dota_hero_crystal_maiden","KuroKy",76561197960287931,2),
+("npc_dota_hero_pudge","Dendi",76561197960287932,2),("npc_dota_hero_invoker","XBOCT",76561197960287933,2),("npc_dota_hero_earthshaker","Funn1k",76561197960287934,2),
+("npc_dota_hero_lion","s4",76561197960287935,3),("npc_dota_hero_juggernaut","Loda",76561197960287936,3),("npc_dota_hero_nevermore","AdmiralBulldog",76561197960287937,3),
+("npc_dota_hero_tidehunter","EGM",76561197960287938,3),("npc_dota_hero_rubick","Akke",76561197960287939,3)]
+def fileinfo(match,mode,winner,end,playback):
+    dota=fvar(1,match)+fvar(2,mode)+fvar(3,winner)
+    for h,n,s,t in players:
+        dota+=fbytes(4,fbytes(1,h)+fbytes(2,n)+fbytes(3,"")+fvar(4,s)+fvar(5,t))
+    dota+=fvar(5,65000)+fvar(11,end)
+    game=fbytes(4,dota)
+    return ffloat(1,playback)+fvar(2,72000)+fvar(3,1000)+fbytes(4,game)
+
+def filler(n):
+    words=[b"dota",b"npc_",b"hero",b"tick",b"\x00\x01",b"CDOTA_Unit"]
+    return b"".join(random.choice(words) for _ in range(n))
+
+def demo(magic,info,compress,source2=True):
+    header_len=16 if source2 else 12
+    body=message(1,0,fbytes(1,"PBDEMS2" if source2 else "PBUFDEM")+fbytes(2,"dota")+filler(120),compress)
+    body+=message(4,0,filler(300),compress)
+    for t in range(4):
+        body+=message(7,t*30,filler(150),compress)
+    body+=message(0,120,b"")
+    off=header_len+len(body)
+    body+=message(2,120,info,compress)
+    hdr=magic+struct.pack('<i',off)+(struct.pack('<i',0) if source2 else b"")
+    return hdr+body
+
+d=os.path.dirname(os.path.abspath(__file__))+"/"
+a=demo(b"PBDEMS2\0",fileinfo(3200000001,22,2,1500000000,2400.5),True)
+open(d+"source2.dem","wb").write(a)
+open(d+"source2_uncompressed.dem","wb").write(demo(b"PBDEMS2\0",fileinfo(3200000002,2,3,1500003600,3120.0),False))
+open(d+"source1.dem","wb").write(demo(b"PBUFDEM\0",fileinfo(1234567890,1,2,1390073525,2832.0),False,False))
+#still being written: the offset isn't filled in yet
+open(d+"in_progress.dem","wb").write(b"PBDEMS2\0"+struct.pack('<ii',0,0)+a[16:2048])
+#cut off before the file info block it points to
+open(d+"truncated.dem","wb").write(a[:len(a)-200])
+
+def unsnappy(b):
+    i=0; n=0; s=0
+    while True:
+        c=b[i]; i+=1; n|=(c&0x7f)<<s; s+=7
+        if not c&0x80: break
+    out=bytearray()
+    while i<len(b):
+        t=b[i]; i+=1
+        if t&3==0:
+            l=(t>>2)+1; out+=b[i:i+l]; i+=l
+        elif t&3==1:
+            l=((t>>2)&7)+4; off=((t>>5)<<8)|b[i]; i+=1
+            for _ in range(l): out.append(out[-off])
+        else:
+            l=(t>>2)+1; off=struct.unpack('<H',b[i:i+2])[0]; i+=2
+            for _ in range(l): out.append(out[-off])
+    assert len(out)==n; return bytes(out)
+#the compressor is only checked against this reference decoder, so make sure they agree
+for x in [fileinfo(1,2,3,4,5.0), filler(500)]:
+    assert unsnappy(snappy(x))==x
+
+# timeline.dem, for tst_replaytimeline: a string table naming the units, then combat log entries
+# spread over a few packets, so the gold, xp and last hit totals below are known exactly.
+class Bits:
+    def __init__(self): self.bits=[]
+    def write(self,v,n):
+        for i in range(n): self.bits.append((v>>i)&1)
+    def bool(self,b): self.write(1 if b else 0,1)
+    def ubitvar(self,v):
+        if v<16: self.write(v,6)
+        elif v<256: self.write((v&15)|16,6); self.write(v>>4,4)
+        elif v<4096: self.write((v&15)|32,6); self.write(v>>4,8)
+        else: self.write((v&15)|48,6); self.write(v>>4,28)
+    def varuint(self,v):
+        for b in varint(v): self.write(b,8)
+    def raw(self,data):
+        for b in data: self.write(b,8)
+    def string(self,s): self.raw(s.encode()+b"\0")
+    def data(self):
+        bits=self.bits+[0]*(-len(self.bits)%8)
+        return bytes(sum(bits[i+j]<<j for j in range(8)) for i in range(0,len(bits),8))
+
+def fsigned(f,v): return fvar(f,v&0xffffffff)
+
+# (index, key, history (position, length) or None, user data bytes or None)
+def string_entries(entries,fixed_bits=None,flags=0,varint_counts=False):
+    b=Bits(); index=-1
+    for i,k,hist,user in entries:
+        if i==index+1: b.bool(True)
+        else: b.bool(False); b.varuint(i-1)
+        index=i
+        b.bool(k is not None)
+        if k is not None:
+            b.bool(hist is not None)
+            if hist is not None:
+                b.write(hist[0],5); b.write(hist[1],5); k=k[hist[1]:]
+            b.string(k)
+        b.bool(user is not None)
+        if user is not None:
+            if fixed_bits is not None: b.write(user,fixed_bits)
+            else:
+                if flags&1: b.bool(False)
+                if varint_counts: b.ubitvar(len(user))
+                else: b.write(len(user),17)
+                b.raw(user)
+    return b.data()
+
+def create_table(name,entries,compress=False,fixed_bits=None,flags=0,varint_counts=False):
+    data=string_entries(entries,fixed_bits,flags,varint_counts)
+    size=len(data)
+    if compress: data=snappy(data)
+    m=fbytes(1,name)+fvar(2,len(entries))+fvar(3,1 if fixed_bits is not None else 0)+fvar(4,0)
+    m+=fvar(5,fixed_bits or 0)+fvar(6,flags)+fbytes(7,data)+fvar(8,size)+fvar(9,1 if compress else 0)+fvar(10,1 if varint_counts else 0)
+    return m
+
+def update_table(table,entries,**kw):
+    return fvar(1,table)+fvar(2,len(entries))+fbytes(3,string_entries(entries,**kw))
+
+DEATH,GOLD,XP=4,8,10
+def entry(kind,target=0,attacker=0,value=None,illusion=False,target_hero=False,attacker_team=None,target_team=None):
+    m=fvar(1,kind)+fvar(2,target)+fvar(3,0)+fvar(4,attacker)
+    if illusion: m+=fvar(7,1)
+    if target_hero: m+=fvar(10,1)
+    if value is not None: m+=fsigned(13,value)
+    if attacker_team is not None: m+=fvar(28,attacker_team)
+    if target_team is not None: m+=fvar(29,target_team)
+    return m
+
+def packet(*messages):
+    b=Bits()
+    for kind,data in messages:
+        b.ubitvar(kind); b.varuint(len(data)); b.raw(data)
+    return fvar(1,0)+fbytes(3,b.data())
+
+noise=(4,fvar(1,12345)+fvar(2,7))                      # net_Tick, skipped
+AXE,LINA,CREEP,NEUTRAL,ALLY,SIEGE,PUDGE=0,1,2,3,4,5,10
+names=[(AXE,"npc_dota_hero_axe",None,None),(LINA,"npc_dota_hero_lina",(0,14),b"\x01\x02"),
+       (CREEP,"npc_dota_creep_badguys_melee",None,None),(NEUTRAL,"npc_dota_neutral_kobold",(0,9),b"\x03"),
+       (ALLY,"npc_dota_creep_goodguys_ranged",(2,14),None),(SIEGE,"npc_dota_badguys_siege",None,b"\x04\x05\x06")]
+body=message(1,0,fbytes(1,"PBDEMS2")+fbytes(2,"dota"))
+body+=message(8,0,packet(noise,(44,create_table("ActiveModifiers",[(0,"modifier",None,1)],fixed_bits=2)),
+                         (44,create_table("CombatLogNames",names,compress=True,flags=1,varint_counts=True))))
+def full_packets(data):
+    i=0; found=[]
+    while i<len(data):
+        start=i; vals=[]
+        for _ in range(3):
+            v=0; sh=0
+            while True:
+                c=data[i]; i+=1; v|=(c&0x7f)<<sh; sh+=7
+                if not c&0x80: break
+            vals.append(v)
+        if vals[0]&~64==13: found.append((vals[1],start))
+        i+=vals[2]
+    return found
+
+# full packets: a snapshot of every string table, entries in index order, and the seek index points at these
+def full_packet(names):
+    tables=fbytes(1,fbytes(1,"ActiveModifiers")+fbytes(2,fbytes(1,"modifier")+fbytes(2,b"\x01")))
+    items=[b""]*(max(i for i,_ in names)+1)
+    for i,k in names: items[i]=k.encode()
+    tables+=fbytes(1,fbytes(1,"CombatLogNames")+b"".join(fbytes(2,fbytes(1,k)+(fbytes(2,b"\x07") if i%2 else b"")) for i,k in enumerate(items)))
+    return fbytes(1,tables)+fbytes(2,packet(noise))
+snapshot=[(i,k) for i,k,_,_ in names]
+body+=message(13,0,full_packet(snapshot))
+body+=message(7,100,packet(noise,(554,entry(GOLD,AXE,value=100)),(554,entry(XP,AXE,value=50)),(554,entry(GOLD,LINA,value=200))))
+body+=message(7,250,packet((554,entry(DEATH,CREEP,AXE,attacker_team=2,target_team=3))),True)
+body+=message(7,400,packet((554,entry(DEATH,NEUTRAL,LINA,attacker_team=3,target_team=4)),
+                           (554,entry(DEATH,ALLY,AXE,attacker_team=2,target_team=2)),                  # a deny
+                           (554,entry(DEATH,CREEP,AXE,illusion=True,attacker_team=2,target_team=3)),
+                           (554,entry(DEATH,AXE,LINA,target_hero=True,attacker_team=3,target_team=2)),
+                           noise))
+body+=message(13,600,full_packet(snapshot),True)
+body+=message(7,700,packet((554,entry(GOLD,AXE,value=-80)),(553,fbytes(1,entry(XP,LINA,value=120))+fbytes(1,entry(GOLD,AXE,value=30)))))
+body+=message(7,900,packet((45,update_table(0,[(1,"modifier_other",None,None)],fixed_bits=2)),
+                           (45,update_table(1,[(PUDGE,"npc_dota_hero_pudge",None,None)],flags=1,varint_counts=True)),
+                           (554,entry(GOLD,PUDGE,value=500))))
+body+=message(7,950,packet((554,entry(DEATH,SIEGE,PUDGE,attacker_team=2,target_team=3))))
+body+=message(0,1000,b"")
+open(d+"timeline.dem","wb").write(b"PBDEMS2\0"+struct.pack('<ii',0,0)+body)
+# where the full packets start, for the test
+for t,o in full_packets(body): print("full packet at tick %d, offset %d" % (t,16+o))
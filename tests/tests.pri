@@ -0,0 +1,25 @@
+#shared by every test project, each one lists the sources it needs from ../src
+
+QT       += core testlib
+QT       -= gui
+
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+SRCDIR = $$PWD/../src
+INCLUDEPATH += $$SRCDIR
+DEPENDPATH += $$SRCDIR
+
+#checked in sample files, found by the tests at runtime
+DEFINES += TESTDATA_DIR=\\\"$$PWD/data\\\"
+
+#the replay readers, which the index and the scanner are built on
+REPLAY_SOURCES = $$SRCDIR/replayindex.cpp \
+    $$SRCDIR/demoheader.cpp \
+    $$SRCDIR/demoreader.cpp \
+    $$SRCDIR/replaytimeline.cpp \
+    $$SRCDIR/bitreader.cpp \
+    $$SRCDIR/protoreader.cpp \
+    $$SRCDIR/snappy.cpp
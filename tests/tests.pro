@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# Unit tests and benchmarks, built against the sources in ../src
+#
+# qmake -r && make check
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += tst_http \
+    tst_matchinfo \
+    tst_matchstore \
+    tst_replayindex \
+    tst_demoheader \
+    tst_demoreader \
+    tst_replayarchive \
+    tst_replaysearch \
+    tst_replaydedup \
+    tst_replaytimeline \
+    tst_replaytablemodel
@@ -0,0 +1,139 @@
+#include <QtTest>
+
+#include "demoheader.h"
+#include "snappy.h"
+
+/*
+ * The replays under data/replays are cut down to their first few KB: the header, a handful of filler messages,
+ * and the file info block the header points to. They cover Source 2 with snappy compressed and plain messages,
+ * Source 1, a replay that is still being written and one that was cut off.
+ */
+class tst_DemoHeader : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void read_data();
+    void read();
+    void players();
+    void snappyRejectsTruncated();
+    void snappyRejectsHugeLength();
+};
+
+void tst_DemoHeader::read_data()
+{
+    QTest::addColumn<QString>("fileName");
+    QTest::addColumn<bool>("ok");
+    QTest::addColumn<quint64>("matchID");
+    QTest::addColumn<QString>("gameMode");
+    QTest::addColumn<QString>("winner");
+    QTest::addColumn<quint32>("endTime");
+    QTest::addColumn<int>("duration");
+    QTest::addColumn<int>("playerCount");
+
+    QTest::newRow("source 2, compressed") << QString("source2.dem") << true << Q_UINT64_C(3200000001) << QString("All Draft") << QString("Radiant") << quint32(1500000000) << 2400 << 10;
+    QTest::newRow("source 2, plain") << QString("source2_uncompressed.dem") << true << Q_UINT64_C(3200000002) << QString("Captains Mode") << QString("Dire") << quint32(1500003600) << 3120 << 10;
+    QTest::newRow("source 1") << QString("source1.dem") << true << Q_UINT64_C(1234567890) << QString("All Pick") << QString("Radiant") << quint32(1390073525) << 2832 << 10;
+    QTest::newRow("still being written") << QString("in_progress.dem") << false << Q_UINT64_C(0) << QString("") << QString("") << quint32(0) << 0 << 0;
+    QTest::newRow("cut off") << QString("truncated.dem") << false << Q_UINT64_C(0) << QString("") << QString("") << quint32(0) << 0 << 0;
+}
+
+void tst_DemoHeader::read()
+{
+    QFETCH(QString, fileName);
+    QFETCH(bool, ok);
+
+    DemoInfo info;
+    QCOMPARE(DemoHeader::read(QString(TESTDATA_DIR) + "/replays/" + fileName, &info), ok);
+    if(!ok)
+        return;
+
+    QFETCH(quint64, matchID);
+    QFETCH(QString, gameMode);
+    QFETCH(QString, winner);
+    QFETCH(quint32, endTime);
+    QFETCH(int, duration);
+    QFETCH(int, playerCount);
+
+    QCOMPARE(info.fileName, fileName);
+    QCOMPARE(info.matchID, matchID);
+    QCOMPARE(info.gameModeName(), gameMode);
+    QCOMPARE(info.winnerName(), winner);
+    QCOMPARE(info.endTime, endTime);
+    QCOMPARE(info.duration, duration);
+    QCOMPARE(info.players.size(), playerCount);
+}
+
+void tst_DemoHeader::players()
+{
+    DemoInfo info;
+    QVERIFY(DemoHeader::read(QString(TESTDATA_DIR) + "/replays/source2.dem", &info));
+    QCOMPARE(info.players.size(), 10);
+
+    const DemoPlayer &first = info.players.first();
+    QCOMPARE(first.playerName, QString("Puppey"));
+    QCOMPARE(first.heroName, QString("npc_dota_hero_antimage"));
+    QCOMPARE(first.steamID, Q_UINT64_C(76561197960287930));
+    QCOMPARE(first.team, 2);
+
+    const DemoPlayer &last = info.players.last();
+    QCOMPARE(last.playerName, QString("Akke"));
+    QCOMPARE(last.heroName, QString("npc_dota_hero_rubick"));
+    QCOMPARE(last.steamID, Q_UINT64_C(76561197960287939));
+    QCOMPARE(last.team, 3);
+}
+
+void tst_DemoHeader::snappyRejectsTruncated()
+{
+    //preamble says 10 bytes, the literal only has 4
+    const char block[] = { 10, (9 << 2), 'a', 'b', 'c', 'd' };
+    QByteArray out;
+    QVERIFY(!Snappy::uncompress(block, sizeof(block), &out));
+
+    //a copy reaching back before the start of the output
+    const char copy[] = { 8, (3 << 2), 'a', 'b', 'c', 'd', 1 | (0 << 2), 8 };
+    QVERIFY(!Snappy::uncompress(copy, sizeof(copy), &out));
+
+    const char good[] = { 8, (3 << 2), 'a', 'b', 'c', 'd', 1 | (0 << 2), 4 };
+    QVERIFY(Snappy::uncompress(good, sizeof(good), &out));
+    QCOMPARE(out, QByteArray("abcdabcd"));
+}
+
+/*
+ * A preamble is read before anything else and sizes the output; one that claims more than the rest
+ * of the block could ever expand to is turned down before that much memory is asked for.
+ */
+void tst_DemoHeader::snappyRejectsHugeLength()
+{
+    //2 GB - 1 out of a 2 byte literal
+    const char huge[] = { char(0xff), char(0xff), char(0xff), char(0xff), 0x07, (1 << 2), 'a', 'b' };
+    QByteArray out;
+    QVERIFY(!Snappy::uncompress(huge, sizeof(huge), &out));
+    QCOMPARE(Snappy::uncompressedLength(huge, sizeof(huge)), -1);
+    QVERIFY(out.size() < 1024);
+
+    //a length that doesn't fit in 32 bits
+    const char overflow[] = { char(0xff), char(0xff), char(0xff), char(0xff), 0x7f, 0 };
+    QCOMPARE(Snappy::uncompressedLength(overflow, sizeof(overflow)), -1);
+
+    //64 bytes out of a 3 byte copy is as far as a block goes; one byte more is too much
+    const char repeated[] = { 68, (3 << 2), 'a', 'b', 'c', 'd', char(2 | (63 << 2)), 4, 0 };
+    QCOMPARE(Snappy::uncompressedLength(repeated, sizeof(repeated)), 68);
+    QVERIFY(Snappy::uncompress(repeated, sizeof(repeated), &out));
+    QCOMPARE(out, QByteArray("abcd").repeated(17));
+
+    const char tooLong[] = { 65, char(2 | (63 << 2)), 4, 0 };
+    QCOMPARE(Snappy::uncompressedLength(tooLong, sizeof(tooLong)), -1);
+
+    //more than the cap, even with input enough to back it
+    QByteArray big(8 * 1024 * 1024, 0);
+    quint32 length = 128 * 1024 * 1024;
+    for(int i = 0; i < 4; i++)
+        big[i] = char((length >> (7 * i)) & 0x7f) | (i < 3 ? char(0x80) : char(0));
+    QCOMPARE(Snappy::uncompressedLength(big.constData(), big.size()), -1);
+    QVERIFY(!Snappy::uncompress(big.constData(), big.size(), &out));
+}
+
+QTEST_MAIN(tst_DemoHeader)
+
+#include "tst_demoheader.moc"
@@ -0,0 +1,8 @@
+include(../tests.pri)
+
+TARGET = tst_demoheader
+
+SOURCES += tst_demoheader.cpp \
+    $$SRCDIR/demoheader.cpp \
+    $$SRCDIR/protoreader.cpp \
+    $$SRCDIR/snappy.cpp
@@ -0,0 +1,117 @@
+#include <QtTest>
+
+#include "demoreader.h"
+
+class tst_DemoReader : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void walkToStop();
+    void cutOff_data();
+    void cutOff();
+    void seek();
+
+private:
+    QTemporaryDir dir;
+};
+
+/*
+ * A whole replay: every payload reads and the walk ends on DEM_Stop.
+ */
+void tst_DemoReader::walkToStop()
+{
+    DemoReader demo;
+    QVERIFY(demo.open(QString(TESTDATA_DIR) + "/replays/source2.dem"));
+    QVERIFY(demo.isSource2());
+
+    QList<int> commands;
+    QByteArray payload;
+    while(demo.next())
+    {
+        commands.append(demo.command());
+        QVERIFY(demo.readPayload(&payload));
+    }
+
+    QVERIFY(!demo.hasError());
+    QVERIFY(demo.reachedStop());
+    QCOMPARE(commands.first(), int(DemoReader::DEM_FileHeader));
+    QCOMPARE(commands.count(int(DemoReader::DEM_Packet)), 4);
+}
+
+void tst_DemoReader::cutOff_data()
+{
+    QTest::addColumn<int>("cut");
+
+    //source2.dem is 2179 bytes and its DEM_Stop starts at 1814
+    QTest::newRow("between messages") << 1814;
+    QTest::newRow("in a message header") << 1815;
+    QTest::newRow("in a payload") << 1000;
+}
+
+/*
+ * A replay that ends early runs out of messages without an error, but never reaches DEM_Stop.
+ */
+void tst_DemoReader::cutOff()
+{
+    QFETCH(int, cut);
+
+    QFile whole(QString(TESTDATA_DIR) + "/replays/source2.dem");
+    QVERIFY(whole.open(QIODevice::ReadOnly));
+    QString fileName = dir.path() + QString("/cut%1.dem").arg(cut);
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(whole.read(cut));
+    file.close();
+
+    DemoReader demo;
+    QVERIFY(demo.open(fileName));
+    int messages = 0;
+    while(demo.next())
+        messages++;
+
+    QVERIFY(messages > 0);
+    QVERIFY(!demo.hasError());
+    QVERIFY(!demo.reachedStop());
+}
+
+/*
+ * Every message start offset() gives can be gone back to, and reading carries on from there
+ * as if it had got there on its own.
+ */
+void tst_DemoReader::seek()
+{
+    DemoReader demo;
+    QVERIFY(demo.open(QString(TESTDATA_DIR) + "/replays/timeline.dem"));
+
+    QList<qint64> offsets;
+    QList<int> ticks;
+    while(demo.next())
+    {
+        offsets.append(demo.offset());
+        ticks.append(demo.tick());
+    }
+    QVERIFY(demo.reachedStop());
+    QCOMPARE(offsets.first(), qint64(16));
+
+    //backwards, so every seek goes against the way the file was read
+    QByteArray payload;
+    for(int i = offsets.size() - 1; i >= 0; i--)
+    {
+        QVERIFY(demo.seek(offsets.at(i)));
+        QVERIFY(demo.next());
+        QCOMPARE(demo.offset(), offsets.at(i));
+        QCOMPARE(demo.tick(), ticks.at(i));
+        QVERIFY(demo.readPayload(&payload));
+
+        int following = 0;
+        while(demo.next())
+            following++;
+        QCOMPARE(following, offsets.size() - i - 1);
+        QVERIFY(demo.reachedStop());
+    }
+}
+
+QTEST_MAIN(tst_DemoReader)
+
+#include "tst_demoreader.moc"
@@ -0,0 +1,7 @@
+include(../tests.pri)
+
+TARGET = tst_demoreader
+
+SOURCES += tst_demoreader.cpp \
+    $$SRCDIR/demoreader.cpp \
+    $$SRCDIR/snappy.cpp
@@ -0,0 +1,443 @@
+#include <QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "http.h"
+
+/*
+ * Minimal http server on the loopback interface.
+ * Every response is held back for a fixed latency, like a round trip to a real server would be,
+ * so the time a batch takes shows how many transfers were on the wire at once.
+ */
+class SlowServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    SlowServer(int latency, int bodySize, QObject *parent = 0) : QTcpServer(parent), latency(latency), body(bodySize, 'x'), active(0), peak(0), requests(0)
+    {
+        connect(this, SIGNAL(newConnection()), SLOT(accept()));
+    }
+
+    int peakConnections() const { return peak; }
+    int requestCount() const { return requests; }
+
+private slots:
+    void accept()
+    {
+        while(QTcpSocket *socket = nextPendingConnection())
+        {
+            connect(socket, SIGNAL(readyRead()), SLOT(request()));
+            connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        }
+    }
+
+    void request()
+    {
+        QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+        //wait until the whole request header is in
+        QByteArray header = socket->property("header").toByteArray() + socket->readAll();
+        socket->setProperty("header", header);
+        if(!header.contains("\r\n\r\n"))
+            return;
+
+        peak = qMax(peak, ++active);
+        ++requests;
+        socket->disconnect(this);
+
+        QTimer *timer = new QTimer(socket);
+        timer->setSingleShot(true);
+        connect(timer, SIGNAL(timeout()), SLOT(respond()));
+        timer->start(latency);
+    }
+
+    void respond()
+    {
+        QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender()->parent());
+        --active;
+        socket->write("HTTP/1.1 200 OK\r\nContent-Length: " + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n");
+        socket->write(body);
+        socket->disconnectFromHost();
+    }
+
+private:
+    int latency;
+    QByteArray body;
+    int active;
+    int peak;
+    int requests;
+};
+
+/*
+ * Serves a few files with validators, and answers conditional and range requests the way a cdn does.
+ * Keeps the headers of every request and counts the body bytes it sends.
+ */
+class CacheServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    struct Resource
+    {
+        Resource() : cutAfter(-1) {}
+
+        QByteArray body;
+        QByteArray etag;
+        QByteArray lastModified;
+        qint64 cutAfter;                                                    //close the connection after this many body bytes, -1 to send it all
+    };
+
+    explicit CacheServer(QObject *parent = 0) : QTcpServer(parent), bodyBytes(0)
+    {
+        connect(this, SIGNAL(newConnection()), SLOT(accept()));
+    }
+
+    void setResource(const QString &path, const Resource &resource) { resources.insert(path, resource); }
+    QString url(const QString &path) const { return QString("http://127.0.0.1:%1%2").arg(serverPort()).arg(path); }
+
+    QList<QHash<QByteArray, QByteArray> > requests;                         //header names in lower case, plus "path"
+    qint64 bodyBytes;                                                       //sent in every response so far
+
+private slots:
+    void accept()
+    {
+        while(QTcpSocket *socket = nextPendingConnection())
+        {
+            connect(socket, SIGNAL(readyRead()), SLOT(request()));
+            connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        }
+    }
+
+    void request()
+    {
+        QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+        QByteArray header = socket->property("header").toByteArray() + socket->readAll();
+        socket->setProperty("header", header);
+        if(!header.contains("\r\n\r\n"))
+            return;
+        socket->disconnect(this);
+
+        QList<QByteArray> lines = header.left(header.indexOf("\r\n\r\n")).split('\n');
+        QHash<QByteArray, QByteArray> headers;
+        headers.insert("path", lines.first().split(' ').value(1));
+        for(int i = 1; i < lines.size(); i++)
+        {
+            int colon = lines.at(i).indexOf(':');
+            if(colon > 0)
+                headers.insert(lines.at(i).left(colon).trimmed().toLower(), lines.at(i).mid(colon + 1).trimmed());
+        }
+        requests.append(headers);
+
+        Resource resource = resources.value(QString::fromLatin1(headers.value("path")));
+        QByteArray validators = "ETag: " + resource.etag + "\r\nLast-Modified: " + resource.lastModified + "\r\n";
+
+        if((headers.contains("if-none-match") && headers.value("if-none-match") == resource.etag)
+                || (!headers.contains("if-none-match") && headers.contains("if-modified-since") && headers.value("if-modified-since") == resource.lastModified))
+        {
+            socket->write("HTTP/1.1 304 Not Modified\r\n" + validators + "Connection: close\r\n\r\n");
+        }
+        else
+        {
+            //only continue from an offset if the client's copy is of the same version
+            qint64 offset = 0;
+            QByteArray validator = resource.etag.isEmpty() ? resource.lastModified : resource.etag;
+            if(headers.value("range").startsWith("bytes=") && headers.value("if-range") == validator)
+                offset = qBound(qint64(0), headers.value("range").mid(6).split('-').first().toLongLong(), qint64(resource.body.size()));
+
+            QByteArray part = resource.body.mid(offset);
+            if(offset > 0)
+                socket->write("HTTP/1.1 206 Partial Content\r\n" + validators + "Content-Range: bytes " + QByteArray::number(offset) + "-"
+                              + QByteArray::number(resource.body.size() - 1) + "/" + QByteArray::number(resource.body.size()) + "\r\n");
+            else
+                socket->write("HTTP/1.1 200 OK\r\n" + validators);
+            socket->write("Content-Length: " + QByteArray::number(part.size()) + "\r\nConnection: close\r\n\r\n");
+
+            if(resource.cutAfter >= 0)
+                part = part.left(resource.cutAfter);
+            socket->write(part);
+            bodyBytes += part.size();
+        }
+        socket->disconnectFromHost();
+    }
+
+private:
+    QHash<QString, Resource> resources;
+};
+
+class tst_Http : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void finishedOnce();
+    void concurrentThroughput();
+    void cancelQueued();
+    void revalidate();
+    void resume();
+    void coalesce();
+
+private:
+    QStringList urls(const QString &batch, int count);
+    qint64 download(Http &http, const QStringList &urlList, int *finishedCount = 0);
+
+    QByteArray readDownload(const QString &fileName);
+
+    SlowServer *server;
+    CacheServer *cacheServer;
+    QString downloads;
+};
+
+void tst_Http::initTestCase()
+{
+    //keep the test's downloads and cache index away from the real ones, and start without any from a previous run
+    QStandardPaths::setTestModeEnabled(true);
+    downloads = QStandardPaths::standardLocations(QStandardPaths::DataLocation).at(0) + "/downloads";
+    QDir(downloads).removeRecursively();
+    QDir().mkpath(downloads);
+
+    server = new SlowServer(100, 64 * 1024, this);
+    QVERIFY(server->listen(QHostAddress::LocalHost));
+    cacheServer = new CacheServer(this);
+    QVERIFY(cacheServer->listen(QHostAddress::LocalHost));
+}
+
+QByteArray tst_Http::readDownload(const QString &fileName)
+{
+    QFile file(downloads + "/" + fileName);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+QStringList tst_Http::urls(const QString &batch, int count)
+{
+    QStringList urlList;
+    for(int i = 0; i < count; i++)
+        urlList << QString("http://127.0.0.1:%1/%2/file%3.bin").arg(server->serverPort()).arg(batch).arg(i);
+
+    return urlList;
+}
+
+/*
+ * Appends urlList and waits for the queue to drain, returns how long it took in ms.
+ */
+qint64 tst_Http::download(Http &http, const QStringList &urlList, int *finishedCount)
+{
+    QSignalSpy finished(&http, SIGNAL(finished()));
+    QSignalSpy downloaded(&http, SIGNAL(downloaded(QUrl,QString,bool)));
+
+    QElapsedTimer timer;
+    timer.start();
+    http.append(urlList);
+    while(downloaded.count() < urlList.size() && timer.elapsed() < 30000)
+        QTest::qWait(10);
+    qint64 elapsed = timer.elapsed();
+
+    //give a duplicate finished() a chance to show up
+    QTest::qWait(100);
+
+    foreach(const QList<QVariant> &args, downloaded)
+        if(!args.at(2).toBool())
+            qWarning("%s failed", qPrintable(args.at(0).toUrl().toString()));
+
+    if(finishedCount)
+        *finishedCount = finished.count();
+    return downloaded.count() == urlList.size() ? elapsed : -1;
+}
+
+void tst_Http::finishedOnce()
+{
+    Http http;
+    int finishedCount = 0;
+    QVERIFY(download(http, urls("once", 8), &finishedCount) >= 0);
+    QCOMPARE(finishedCount, 1);
+
+    //a second batch on the same object gets its own finished()
+    QVERIFY(download(http, urls("again", 3), &finishedCount) >= 0);
+    QCOMPARE(finishedCount, 1);
+}
+
+/*
+ * The same batch over one connection and over the default limits.
+ * With every response held back by the server, running them side by side should cut the wall time by several times.
+ */
+void tst_Http::concurrentThroughput()
+{
+    const int count = 24;
+
+    Http serial;
+    serial.setMaxConnections(1);
+    qint64 serialTime = download(serial, urls("serial", count));
+    QVERIFY(serialTime > 0);
+
+    Http concurrent;
+    qint64 concurrentTime = download(concurrent, urls("concurrent", count));
+    QVERIFY(concurrentTime > 0);
+
+    qDebug("%d files: %lld ms on one connection, %lld ms concurrent (%.1fx), peak %d connections",
+           count, serialTime, concurrentTime, double(serialTime) / concurrentTime, server->peakConnections());
+    QVERIFY(server->peakConnections() > 1);
+    QVERIFY(concurrentTime * 2 < serialTime);
+}
+
+/*
+ * Cancelling a token must not put any of its queued urls on the wire, even though aborting the running ones frees connections.
+ */
+void tst_Http::cancelQueued()
+{
+    Http http;
+    http.setMaxConnections(2);
+    QSignalSpy downloaded(&http, SIGNAL(downloaded(QUrl,QString,bool)));
+    QStringList urlList = urls("cancel", 10);
+
+    int token = http.createToken();
+    foreach(QString url, urlList)
+        http.append(QUrl(url), Http::Interactive, token);
+
+    int before = server->requestCount();
+    QTRY_COMPARE(server->requestCount() - before, 2);
+
+    http.cancel(token);
+    QVERIFY(http.isFinished(token));
+    QTest::qWait(300);
+
+    QCOMPARE(server->requestCount() - before, 2);
+    QCOMPARE(downloaded.count(), urlList.size());
+    foreach(const QList<QVariant> &args, downloaded)
+        QVERIFY(!args.at(2).toBool());
+}
+
+/*
+ * A second request for a cached file is a conditional one; the 304 costs a round trip, no body, and the copy on disk stays.
+ */
+void tst_Http::revalidate()
+{
+    CacheServer::Resource resource;
+    resource.body = QByteArray(200 * 1024, 'h');
+    resource.etag = "\"v1\"";
+    resource.lastModified = "Sat, 18 Jan 2014 19:32:05 GMT";
+    cacheServer->setResource("/revalidate/hero_sb.png", resource);
+    QString url = cacheServer->url("/revalidate/hero_sb.png");
+
+    Http http;
+    QSignalSpy downloaded(&http, SIGNAL(downloaded(QUrl,QString,bool)));
+    http.append(QUrl(url));
+    QTRY_COMPARE(downloaded.count(), 1);
+    QVERIFY(downloaded.at(0).at(2).toBool());
+    QCOMPARE(readDownload("hero_sb.png"), resource.body);
+    QCOMPARE(cacheServer->bodyBytes, qint64(resource.body.size()));
+    QVERIFY(!cacheServer->requests.last().contains("if-none-match"));
+
+    int before = cacheServer->requests.size();
+    http.append(QUrl(url));
+    QTRY_COMPARE(downloaded.count(), 2);
+    QVERIFY(downloaded.at(1).at(2).toBool());
+    QCOMPARE(downloaded.at(1).at(1).toString(), downloads + "/hero_sb.png");
+
+    QCOMPARE(cacheServer->requests.size(), before + 1);
+    QCOMPARE(cacheServer->requests.last().value("if-none-match"), resource.etag);
+    QCOMPARE(cacheServer->requests.last().value("if-modified-since"), resource.lastModified);
+    QCOMPARE(cacheServer->bodyBytes, qint64(resource.body.size()));
+    QCOMPARE(readDownload("hero_sb.png"), resource.body);
+    QVERIFY(!QFile::exists(downloads + "/hero_sb.png.part"));
+}
+
+/*
+ * A transfer cut off halfway leaves a .part file and never the real one. The next attempt asks for the rest
+ * with Range/If-Range and moves the completed file into place; if the server's copy changed meanwhile it starts over.
+ */
+void tst_Http::resume()
+{
+    CacheServer::Resource resource;
+    for(int i = 0; i < 300 * 1024; i++)
+        resource.body.append(char(i * 7));
+    resource.etag = "\"replay-v1\"";
+    resource.lastModified = "Sat, 18 Jan 2014 19:32:05 GMT";
+    resource.cutAfter = resource.body.size() / 2;
+    cacheServer->setResource("/resume/replay.dem", resource);
+    cacheServer->setResource("/resume/changed.dem", resource);
+
+    Http http;
+    QSignalSpy downloaded(&http, SIGNAL(downloaded(QUrl,QString,bool)));
+    http.append(QStringList() << cacheServer->url("/resume/replay.dem") << cacheServer->url("/resume/changed.dem"));
+    QTRY_COMPARE(downloaded.count(), 2);
+    foreach(const QList<QVariant> &args, downloaded)
+        QVERIFY(!args.at(2).toBool());
+
+    QFileInfo part(downloads + "/replay.dem.part");
+    QVERIFY(part.exists());
+    QVERIFY(part.size() > 0 && part.size() <= resource.cutAfter);
+    QVERIFY(!QFile::exists(downloads + "/replay.dem"));
+    QVERIFY(!QFile::exists(downloads + "/changed.dem"));
+
+    //the same file: only the rest comes over the wire
+    qint64 partSize = part.size();
+    qint64 before = cacheServer->bodyBytes;
+    resource.cutAfter = -1;
+    cacheServer->setResource("/resume/replay.dem", resource);
+    http.append(QUrl(cacheServer->url("/resume/replay.dem")));
+    QTRY_COMPARE(downloaded.count(), 3);
+    QVERIFY(downloaded.at(2).at(2).toBool());
+    QCOMPARE(cacheServer->requests.last().value("range"), "bytes=" + QByteArray::number(partSize) + "-");
+    QCOMPARE(cacheServer->requests.last().value("if-range"), resource.etag);
+    QCOMPARE(cacheServer->bodyBytes - before, resource.body.size() - partSize);
+    QVERIFY(readDownload("replay.dem") == resource.body);
+    QVERIFY(!QFile::exists(downloads + "/replay.dem.part"));
+
+    //a new version on the server: the range is ignored and the whole new body replaces the stale bytes
+    CacheServer::Resource changed;
+    changed.body = QByteArray(250 * 1024, 'n');
+    changed.etag = "\"replay-v2\"";
+    changed.lastModified = "Sun, 19 Jan 2014 08:00:00 GMT";
+    cacheServer->setResource("/resume/changed.dem", changed);
+    before = cacheServer->bodyBytes;
+    http.append(QUrl(cacheServer->url("/resume/changed.dem")));
+    QTRY_COMPARE(downloaded.count(), 4);
+    QVERIFY(downloaded.at(3).at(2).toBool());
+    QCOMPARE(cacheServer->requests.last().value("if-range"), resource.etag);
+    QCOMPARE(cacheServer->bodyBytes - before, qint64(changed.body.size()));
+    QVERIFY(readDownload("changed.dem") == changed.body);
+    QVERIFY(!QFile::exists(downloads + "/changed.dem.part"));
+}
+
+/*
+ * Several appends of one url while it is queued share a single transfer, and everyone who asked hears back.
+ */
+void tst_Http::coalesce()
+{
+    CacheServer::Resource resource;
+    resource.body = QByteArray(32 * 1024, 'c');
+    resource.etag = "\"icon\"";
+    cacheServer->setResource("/coalesce/item_lg.png", resource);
+    QUrl url(cacheServer->url("/coalesce/item_lg.png"));
+
+    Http http;
+    QSignalSpy downloaded(&http, SIGNAL(downloaded(QUrl,QString,bool)));
+    QSignalSpy tokenFinished(&http, SIGNAL(tokenFinished(int)));
+    QSignalSpy finished(&http, SIGNAL(finished()));
+    int first = http.createToken();
+    int second = http.createToken();
+
+    int before = cacheServer->requests.size();
+    http.append(url, Http::Background, first);
+    http.append(url);
+    http.append(url, Http::Visible, second);
+    http.append(url, Http::Interactive, first);
+    QCOMPARE(http.coalescedCount(), 3);
+    QCOMPARE(http.requestCount(), 4);
+
+    QTRY_COMPARE(downloaded.count(), 1);
+    QTRY_COMPARE(finished.count(), 1);
+    QVERIFY(downloaded.at(0).at(2).toBool());
+    QCOMPARE(cacheServer->requests.size() - before, 1);
+    QVERIFY(readDownload("item_lg.png") == resource.body);
+
+    //each token once, however many of its appends were folded in
+    QList<int> tokens;
+    foreach(const QList<QVariant> &args, tokenFinished)
+        tokens.append(args.at(0).toInt());
+    qSort(tokens);
+    QCOMPARE(tokens, QList<int>() << first << second);
+    QVERIFY(http.isFinished(first) && http.isFinished(second));
+}
+
+QTEST_MAIN(tst_Http)
+
+#include "tst_http.moc"
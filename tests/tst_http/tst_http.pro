@@ -0,0 +1,12 @@
+include(../tests.pri)
+
+QT       += gui widgets network
+
+TARGET = tst_http
+
+SOURCES += tst_http.cpp \
+    $$SRCDIR/http.cpp \
+    $$SRCDIR/httpcache.cpp
+
+HEADERS += $$SRCDIR/http.h \
+    $$SRCDIR/httpcache.h
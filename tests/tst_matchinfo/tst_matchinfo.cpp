@@ -0,0 +1,414 @@
+#include <QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "matchinfo.h"
+#include "matchcache.h"
+
+#include <new>
+#include <stdlib.h>
+
+#ifdef Q_OS_WIN
+#include <sys/types.h>
+#include <sys/utime.h>
+#define utimbuf _utimbuf
+#define utime _utime
+#else
+#include <utime.h>
+#endif
+
+/*
+ * Counts heap allocations while a test has counting switched on.
+ * With glibc malloc itself is replaced, which also catches what Qt's containers and strings allocate;
+ * elsewhere only operator new is, which misses those.
+ */
+static bool countAllocations = false;
+static int allocationCount = 0;
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void __libc_free(void *pointer);
+
+void *malloc(size_t size) __THROW
+{
+    if(countAllocations)
+        ++allocationCount;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) __THROW
+{
+    if(countAllocations)
+        ++allocationCount;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) __THROW
+{
+    if(countAllocations)
+        ++allocationCount;
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer) __THROW
+{
+    __libc_free(pointer);
+}
+}
+#else
+void *operator new(size_t size)
+{
+    if(countAllocations)
+        ++allocationCount;
+    void *pointer = malloc(size ? size : 1);
+    if(!pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) Q_DECL_NOTHROW
+{
+    free(pointer);
+}
+
+void operator delete[](void *pointer) Q_DECL_NOTHROW
+{
+    free(pointer);
+}
+#endif
+
+class tst_MatchInfo : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void readMatch();
+    void benchmarkQJsonDocument();
+    void benchmarkReadMatch();
+    void allocations();
+    void cacheRoundTrip();
+    void cacheRejectsStale();
+    void benchmarkCacheLoad();
+
+private:
+    static bool readMatchQJson(const QString &filename, MatchRecord *match);
+    QString copyJson(const QString &name);
+
+    QString jsonFile;
+    QTemporaryDir dir;
+};
+
+void tst_MatchInfo::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    jsonFile = QString(TESTDATA_DIR) + "/match.json";
+    QVERIFY(QFile::exists(jsonFile));
+}
+
+/*
+ * How matches were read before MatchRecord: the whole file goes through QJsonDocument,
+ * and every field is looked up from the root down.
+ */
+bool tst_MatchInfo::readMatchQJson(const QString &filename, MatchRecord *match)
+{
+    QFile file(filename);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QJsonDocument json = QJsonDocument::fromJson(file.readAll());
+
+    match->matchID = json.object().value("match_id").toString().toLongLong();
+    match->gameMode = json.object().value("game_mode").toString();
+    match->startTime = matchInfo::parseStartTime(json.object().value("start_time").toString());
+    match->lobbyType = json.object().value("lobby_type").toString();
+    match->duration = matchInfo::parseDuration(json.object().value("duration").toString());
+    match->firstBloodTime = matchInfo::parseDuration(json.object().value("first_blood_time").toString());
+    match->radiantWin = json.object().value("radiant_win").toString().compare("1") == 0;
+
+    if(match->gameMode.compare("Captains Mode") == 0)
+    {
+        for(int i=0; i < 2; i++)
+        {
+            QString team = (i == 0) ? "radiant" : "dire";
+            for(int j=0; j < 5; j++)
+            {
+                match->bans[i][j] = json.object().value("picks_bans").toObject().value(team).toObject().value("bans").toArray().at(j).toObject().value("name").toString();
+                match->picks[i][j] = json.object().value("picks_bans").toObject().value(team).toObject().value("picks").toArray().at(j).toObject().value("name").toString();
+            }
+        }
+    }
+
+    for(int i=0; i<2; i++)
+        for(int j=0; j<5; j++)
+        {
+            QString team = (i == 0) ? "radiant" : "dire";
+            PlayerSlot &slot = match->players[i][j];
+            slot.accountName = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("account_name").toString();
+            slot.level = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("level").toString().toInt();
+            slot.heroName = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("hero").toObject().value("name").toString();
+            slot.heroLocalizedName = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("hero").toObject().value("localized_name").toString();
+            slot.kills = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("kills").toString().toInt();
+            slot.deaths = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("deaths").toString().toInt();
+            slot.assists = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("assists").toString().toInt();
+            slot.goldSpent = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("gold_spent").toString().toInt();
+            slot.lastHits = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("last_hits").toString().toInt();
+            slot.denies = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("denies").toString().toInt();
+            slot.gpm = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("gold_per_min").toString().toInt();
+            slot.xpm = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("xp_per_min").toString().toInt();
+
+            for(int k=0; k<6; k++)
+                slot.items[k] = json.object().value("slots").toObject().value(team).toArray().at(j).toObject().value("item_" + QString::number(k)).toString();
+        }
+
+    return !json.isNull();
+}
+
+void tst_MatchInfo::readMatch()
+{
+    MatchRecord match;
+    QVERIFY(matchInfo::readMatch(jsonFile, &match));
+
+    QCOMPARE(match.matchID, Q_INT64_C(1234567890));
+    QCOMPARE(match.gameMode, QString("Captains Mode"));
+    QCOMPARE(match.startTime, QDateTime(QDate(2014, 1, 18), QTime(19, 32, 5), Qt::UTC).toMSecsSinceEpoch() / 1000);
+    QCOMPARE(match.lobbyType, QString("Tournament"));
+    QCOMPARE(match.duration, 47 * 60 + 12);
+    QCOMPARE(match.firstBloodTime, 2 * 60 + 41);
+    QCOMPARE(matchInfo::startTimeText(match.startTime), QString("2014-01-18 19:32:05"));
+    QCOMPARE(matchInfo::durationText(match.duration), QString("47:12"));
+    QCOMPARE(matchInfo::durationText(match.firstBloodTime), QString("2:41"));
+    QVERIFY(match.radiantWin);
+
+    QCOMPARE(match.bans[0][0], QString("npc_dota_hero_io"));
+    QCOMPARE(match.picks[1][4], QString("npc_dota_hero_rubick"));
+
+    const PlayerSlot &first = match.players[0][0];
+    QCOMPARE(first.accountName, QString("Puppey"));
+    QCOMPARE(first.heroName, QString("npc_dota_hero_antimage"));
+    QCOMPARE(first.heroLocalizedName, QString("Anti-Mage"));
+    QCOMPARE(first.items[5], QString("black_king_bar"));
+
+    const PlayerSlot &last = match.players[1][4];
+    QCOMPARE(last.accountName, QString("Akke"));
+    QCOMPARE(last.level, 21);
+    QCOMPARE(last.kills, 4);
+    QCOMPARE(last.deaths, 9);
+    QCOMPARE(last.assists, 19);
+    QCOMPARE(last.goldSpent, 23978);
+    QCOMPARE(last.lastHits, 356);
+    QCOMPARE(last.denies, 29);
+    QCOMPARE(last.gpm, 429);
+    QCOMPARE(last.xpm, 379);
+
+    //the one pass reader has to agree with the old path on every field
+    MatchRecord old;
+    QVERIFY(readMatchQJson(jsonFile, &old));
+    QCOMPARE(match.matchID, old.matchID);
+    QCOMPARE(match.radiantWin, old.radiantWin);
+    for(int i=0; i<2; i++)
+        for(int j=0; j<5; j++)
+        {
+            QCOMPARE(match.picks[i][j], old.picks[i][j]);
+            QCOMPARE(match.bans[i][j], old.bans[i][j]);
+            QCOMPARE(match.players[i][j].accountName, old.players[i][j].accountName);
+            QCOMPARE(match.players[i][j].heroName, old.players[i][j].heroName);
+            QCOMPARE(match.players[i][j].gpm, old.players[i][j].gpm);
+            for(int k=0; k<6; k++)
+                QCOMPARE(match.players[i][j].items[k], old.players[i][j].items[k]);
+        }
+}
+
+void tst_MatchInfo::benchmarkQJsonDocument()
+{
+    QBENCHMARK
+    {
+        MatchRecord match;
+        readMatchQJson(jsonFile, &match);
+    }
+}
+
+void tst_MatchInfo::benchmarkReadMatch()
+{
+    QBENCHMARK
+    {
+        MatchRecord match;
+        matchInfo::readMatch(jsonFile, &match);
+    }
+}
+
+/*
+ * Heap allocations for one match, the old path against readMatch.
+ * Each runs once before it is counted, so one time setup (codecs, file engines) is not charged to it.
+ */
+void tst_MatchInfo::allocations()
+{
+    MatchRecord warmUp;
+    QVERIFY(readMatchQJson(jsonFile, &warmUp));
+    QVERIFY(matchInfo::readMatch(jsonFile, &warmUp));
+
+    MatchRecord old;
+    allocationCount = 0;
+    countAllocations = true;
+    readMatchQJson(jsonFile, &old);
+    countAllocations = false;
+    int qjsonCount = allocationCount;
+
+    MatchRecord match;
+    allocationCount = 0;
+    countAllocations = true;
+    matchInfo::readMatch(jsonFile, &match);
+    countAllocations = false;
+    int readMatchCount = allocationCount;
+
+    qDebug("allocations per match: %d through QJsonDocument, %d through readMatch", qjsonCount, readMatchCount);
+    QVERIFY(qjsonCount > 0);
+    QVERIFY(readMatchCount < qjsonCount);
+}
+
+//a json of our own, so its .bin lands in the temporary dir
+QString tst_MatchInfo::copyJson(const QString &name)
+{
+    QString copy = dir.path() + "/" + name;
+    QFile::remove(copy);
+    QFile::remove(MatchCache::cacheFileName(copy));
+    return QFile::copy(jsonFile, copy) ? copy : QString();
+}
+
+/*
+ * What comes back from the .bin is what readMatch got out of the json.
+ */
+void tst_MatchInfo::cacheRoundTrip()
+{
+    QString json = copyJson("1234567890.json");
+    QVERIFY(!json.isEmpty());
+
+    MatchRecord match;
+    QVERIFY(!MatchCache::load(json, &match));
+    QVERIFY(matchInfo::readMatch(json, &match));
+    QVERIFY(MatchCache::save(json, match));
+    QVERIFY(QFile::exists(dir.path() + "/1234567890.bin"));
+
+    MatchRecord cached;
+    QVERIFY(MatchCache::load(json, &cached));
+    QCOMPARE(cached.matchID, match.matchID);
+    QCOMPARE(cached.gameMode, match.gameMode);
+    QCOMPARE(cached.startTime, match.startTime);
+    QCOMPARE(cached.lobbyType, match.lobbyType);
+    QCOMPARE(cached.duration, match.duration);
+    QCOMPARE(cached.firstBloodTime, match.firstBloodTime);
+    QCOMPARE(cached.radiantWin, match.radiantWin);
+    for(int i=0; i<2; i++)
+        for(int j=0; j<5; j++)
+        {
+            QCOMPARE(cached.picks[i][j], match.picks[i][j]);
+            QCOMPARE(cached.bans[i][j], match.bans[i][j]);
+
+            const PlayerSlot &a = cached.players[i][j];
+            const PlayerSlot &b = match.players[i][j];
+            QCOMPARE(a.accountName, b.accountName);
+            QCOMPARE(a.heroName, b.heroName);
+            QCOMPARE(a.heroLocalizedName, b.heroLocalizedName);
+            QCOMPARE(a.level, b.level);
+            QCOMPARE(a.kills, b.kills);
+            QCOMPARE(a.deaths, b.deaths);
+            QCOMPARE(a.assists, b.assists);
+            QCOMPARE(a.goldSpent, b.goldSpent);
+            QCOMPARE(a.lastHits, b.lastHits);
+            QCOMPARE(a.denies, b.denies);
+            QCOMPARE(a.gpm, b.gpm);
+            QCOMPARE(a.xpm, b.xpm);
+            for(int k=0; k<6; k++)
+                QCOMPARE(a.items[k], b.items[k]);
+        }
+}
+
+/*
+ * A .bin from another version of the layout, or made from a json that has since changed, is not used.
+ */
+void tst_MatchInfo::cacheRejectsStale()
+{
+    QString json = copyJson("stale.json");
+    MatchRecord match;
+    QVERIFY(matchInfo::readMatch(json, &match));
+    QVERIFY(MatchCache::save(json, match));
+    QVERIFY(MatchCache::load(json, &match));
+
+    //the version follows the four byte magic
+    QFile bin(MatchCache::cacheFileName(json));
+    QVERIFY(bin.open(QIODevice::ReadWrite));
+    QByteArray good = bin.readAll();
+    quint32 version;
+    memcpy(&version, good.constData() + 4, sizeof(version));
+    version++;
+    QVERIFY(bin.seek(4));
+    QCOMPARE(bin.write((const char*)&version, sizeof(version)), qint64(sizeof(version)));
+    bin.close();
+    QVERIFY(!MatchCache::load(json, &match));
+
+    //the json touched but not changed in size
+    QVERIFY(MatchCache::save(json, match));
+    QVERIFY(MatchCache::load(json, &match));
+    struct utimbuf times;
+    times.actime = times.modtime = QFileInfo(json).lastModified().toTime_t() - 60;
+    QCOMPARE(utime(QFile::encodeName(json).constData(), &times), 0);
+    QVERIFY(!MatchCache::load(json, &match));
+
+    //the json downloaded again with other content
+    QVERIFY(MatchCache::save(json, match));
+    QVERIFY(MatchCache::load(json, &match));
+    QFile file(json);
+    QVERIFY(file.open(QIODevice::Append));
+    file.write("\n");
+    file.close();
+    QVERIFY(!MatchCache::load(json, &match));
+
+    //and a .bin cut short
+    QVERIFY(MatchCache::save(json, match));
+    QVERIFY(bin.open(QIODevice::ReadWrite));
+    QVERIFY(bin.resize(64));
+    bin.close();
+    QVERIFY(!MatchCache::load(json, &match));
+}
+
+/*
+ * Reopening a match that has been viewed before; well under a millisecond, so it is not worth a thread.
+ */
+void tst_MatchInfo::benchmarkCacheLoad()
+{
+    QString json = copyJson("benchmark.json");
+    MatchRecord match;
+    QVERIFY(matchInfo::readMatch(json, &match));
+    QVERIFY(MatchCache::save(json, match));
+
+    const int loads = 1000;
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < loads; i++)
+    {
+        MatchRecord cached;
+        QVERIFY(MatchCache::load(json, &cached));
+    }
+    qint64 nsecs = timer.nsecsElapsed() / loads;
+    qDebug("MatchCache::load: %lld us per match", nsecs / 1000);
+    QVERIFY(nsecs < 1000000);
+
+    QBENCHMARK
+    {
+        MatchRecord cached;
+        MatchCache::load(json, &cached);
+    }
+}
+
+QTEST_MAIN(tst_MatchInfo)
+
+#include "tst_matchinfo.moc"
@@ -0,0 +1,18 @@
+include(../tests.pri)
+
+QT       += gui widgets network
+
+TARGET = tst_matchinfo
+
+SOURCES += tst_matchinfo.cpp \
+    $$SRCDIR/matchinfo.cpp \
+    $$SRCDIR/matchcache.cpp \
+    $$SRCDIR/jsonreader.cpp \
+    $$SRCDIR/http.cpp \
+    $$SRCDIR/httpcache.cpp
+
+HEADERS += $$SRCDIR/matchinfo.h \
+    $$SRCDIR/matchcache.h \
+    $$SRCDIR/jsonreader.h \
+    $$SRCDIR/http.h \
+    $$SRCDIR/httpcache.h
@@ -0,0 +1,185 @@
+#include <QtTest>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+#include "matchstore.h"
+
+class tst_MatchStore : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+    void ingestDirectory();
+    void backfillStops();
+    void timesAsIntegers();
+    void benchmarkIngest();
+
+private:
+    int count(const QString &table);
+    void writeFile(const QString &name, const QByteArray &data);
+
+    QTemporaryDir dir;
+    QDir downloads;
+    QSqlDatabase db;
+    QByteArray sample;
+};
+
+void tst_MatchStore::initTestCase()
+{
+    QVERIFY(dir.isValid());
+
+    QFile file(QString(TESTDATA_DIR) + "/match.json");
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    sample = file.readAll();
+}
+
+//every test starts from an empty database and downloads dir
+void tst_MatchStore::init()
+{
+    downloads = QDir(dir.path() + "/" + QTest::currentTestFunction());
+    QVERIFY(downloads.mkpath(downloads.path()));
+
+    db = QSqlDatabase::addDatabase("QSQLITE");
+    db.setDatabaseName(downloads.path() + ".db");
+    QVERIFY(db.open());
+    QVERIFY(MatchStore(db).createTables());
+}
+
+void tst_MatchStore::cleanup()
+{
+    db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+int tst_MatchStore::count(const QString &table)
+{
+    QSqlQuery query("select count(*) from " + table, db);
+    return query.next() ? query.value(0).toInt() : -1;
+}
+
+void tst_MatchStore::writeFile(const QString &name, const QByteArray &data)
+{
+    QFile file(downloads.path() + "/" + name);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(data);
+}
+
+/*
+ * Good json is stored, json that can't be read is remembered and not read again until it changes.
+ */
+void tst_MatchStore::ingestDirectory()
+{
+    writeFile("1234567890.json", sample);
+    writeFile("42.json", "{\"error\": \"Match ID not found\"}");
+    writeFile("43.json", sample.left(sample.size() / 2));
+    writeFile("index.json", "{}");
+
+    MatchStore store(db);
+    QCOMPARE(store.ingestDirectory(downloads), 1);
+    QCOMPARE(count("matches"), 1);
+    QCOMPARE(count("match_players"), 10);
+    QCOMPARE(count("match_items"), 60);
+    QCOMPARE(count("picks_bans"), 20);
+    QCOMPARE(count("match_ingest_failures"), 2);
+
+    //nothing new, nothing changed
+    QCOMPARE(store.ingestDirectory(downloads), 0);
+    QCOMPARE(count("match_ingest_failures"), 2);
+
+    //downloaded again, this time with a match in it
+    QByteArray match = sample;
+    match.replace("\"match_id\": \"1234567890\"", "\"match_id\": \"42\"");
+    writeFile("42.json", match);
+    QCOMPARE(store.ingestDirectory(downloads), 1);
+    QCOMPARE(count("matches"), 2);
+}
+
+/*
+ * Times are numbers, so they sort and average as numbers; a matches table from before that is converted in place.
+ */
+void tst_MatchStore::timesAsIntegers()
+{
+    writeFile("1234567890.json", sample);
+    MatchStore store(db);
+    QCOMPARE(store.ingestDirectory(downloads), 1);
+
+    QSqlQuery query("select typeof(start_time), start_time, duration, first_blood_time from matches", db);
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toString(), QString("integer"));
+    QCOMPARE(query.value(1).toLongLong(), QDateTime(QDate(2014, 1, 18), QTime(19, 32, 5), Qt::UTC).toMSecsSinceEpoch() / 1000);
+    QCOMPARE(query.value(2).toInt(), 47 * 60 + 12);
+    QCOMPARE(query.value(3).toInt(), 2 * 60 + 41);
+
+    //the old layout, with the api's display strings
+    QVERIFY(query.exec("drop table matches"));
+    QVERIFY(query.exec("create table matches (match_id INTEGER PRIMARY KEY, game_mode TEXT, lobby_type TEXT, start_time TEXT, duration TEXT, first_blood_time TEXT, radiant_win INTEGER)"));
+    QVERIFY(query.exec("insert into matches values (1, 'All Pick', 'Public', '2014-01-18 19:32:05', '9:58', '0:45', 1)"));
+    QVERIFY(query.exec("insert into matches values (2, 'All Pick', 'Public', '2014-01-19 20:00:00', '47:12', '2:41', 0)"));
+    QVERIFY(query.exec("insert into matches values (3, 'All Pick', 'Public', '2014-01-20 21:00:00', '1:02:03', '10:00', 1)"));
+    QVERIFY(store.createTables());
+
+    QVERIFY(query.exec("select match_id, duration from matches order by duration"));
+    QList<qint64> order;
+    while(query.next())
+        order.append(query.value(0).toLongLong());
+    QCOMPARE(order, QList<qint64>() << 1 << 2 << 3);
+
+    QVERIFY(query.exec("select sum(duration), max(first_blood_time), min(start_time) from matches"));
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), (9 * 60 + 58) + (47 * 60 + 12) + 3723);
+    QCOMPARE(query.value(1).toInt(), 600);
+    QCOMPARE(query.value(2).toLongLong(), QDateTime(QDate(2014, 1, 18), QTime(19, 32, 5), Qt::UTC).toMSecsSinceEpoch() / 1000);
+
+    //and only once
+    QVERIFY(store.createTables());
+    QCOMPARE(count("matches"), 3);
+}
+
+void tst_MatchStore::backfillStops()
+{
+    writeFile("1234567890.json", sample);
+
+    QAtomicInt stop(1);
+    QVERIFY(!MatchStore::backfill(db.databaseName(), downloads.path(), &stop));
+    QCOMPARE(count("matches"), 0);
+
+    stop.store(0);
+    QVERIFY(MatchStore::backfill(db.databaseName(), downloads.path(), &stop));
+    QCOMPARE(count("matches"), 1);
+}
+
+/*
+ * 10k matches in one call, the way a first backfill of a large downloads dir stores them.
+ */
+void tst_MatchStore::benchmarkIngest()
+{
+    const int matchCount = 10000;
+
+    MatchRecord match;
+    writeFile("1234567890.json", sample);
+    QVERIFY(matchInfo::readMatch(downloads.path() + "/1234567890.json", &match));
+
+    QList<MatchRecord> matches;
+    for(int i = 0; i < matchCount; i++)
+    {
+        match.matchID = i + 1;
+        matches.append(match);
+    }
+
+    MatchStore store(db);
+    QBENCHMARK_ONCE
+    {
+        QVERIFY(store.ingest(matches));
+    }
+
+    QCOMPARE(count("matches"), matchCount);
+    QCOMPARE(count("match_players"), matchCount * 10);
+}
+
+QTEST_MAIN(tst_MatchStore)
+
+#include "tst_matchstore.moc"
@@ -0,0 +1,20 @@
+include(../tests.pri)
+
+QT       += gui widgets network sql
+
+TARGET = tst_matchstore
+
+SOURCES += tst_matchstore.cpp \
+    $$SRCDIR/matchstore.cpp \
+    $$SRCDIR/matchinfo.cpp \
+    $$SRCDIR/matchcache.cpp \
+    $$SRCDIR/jsonreader.cpp \
+    $$SRCDIR/http.cpp \
+    $$SRCDIR/httpcache.cpp
+
+HEADERS += $$SRCDIR/matchstore.h \
+    $$SRCDIR/matchinfo.h \
+    $$SRCDIR/matchcache.h \
+    $$SRCDIR/jsonreader.h \
+    $$SRCDIR/http.h \
+    $$SRCDIR/httpcache.h
@@ -0,0 +1,220 @@
+#include <QtTest>
+#include <QtEndian>
+
+#include "replayarchive.h"
+#include "xxhash64.h"
+
+#ifdef Q_OS_WIN
+#include <sys/types.h>
+#include <sys/utime.h>
+#define utimbuf _utimbuf
+#define utime _utime
+#else
+#include <utime.h>
+#endif
+
+class tst_ReplayArchive : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void roundTrip();
+    void keepsModified();
+    void verifyRejectsDamage();
+    void readsVersion1();
+    void benchmarkCompress();
+    void benchmarkExtract();
+
+private:
+    enum { ReplaySize = 32 * 1024 * 1024 };
+
+    static quint64 hashOf(const QByteArray &data);
+    static QByteArray readAll(const QString &fileName);
+    static bool writeAll(const QString &fileName, const QByteArray &data);
+
+    QTemporaryDir dir;
+    QString replay;                 //synthetic replay, compressible about as well as a real one
+    QByteArray contents;
+    qint64 modified;                //its mtime, well in the past like an archive candidate's
+};
+
+quint64 tst_ReplayArchive::hashOf(const QByteArray &data)
+{
+    XxHash64 hash;
+    hash.addData(data.constData(), data.size());
+    return hash.result();
+}
+
+QByteArray tst_ReplayArchive::readAll(const QString &fileName)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+bool tst_ReplayArchive::writeAll(const QString &fileName, const QByteArray &data)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+/*
+ * Runs of repeated entity updates with noise in between, and a size that is not a whole number of chunks.
+ */
+void tst_ReplayArchive::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    replay = dir.path() + "/1234567890.dem";
+
+    qsrand(1);
+    contents.reserve(ReplaySize + 12345);
+    while(contents.size() < ReplaySize + 12345)
+    {
+        QByteArray run(16 + qrand() % 240, char(qrand()));
+        for(int i = 0; i < run.size(); i += 8)
+            run[i] = char(qrand());
+        contents.append(run);
+    }
+    contents.resize(ReplaySize + 12345);
+    QVERIFY(writeAll(replay, contents));
+
+    modified = QDateTime(QDate(2014, 1, 18), QTime(19, 32, 5)).toMSecsSinceEpoch();
+    struct utimbuf times;
+    times.actime = times.modtime = modified / 1000;
+    QCOMPARE(utime(QFile::encodeName(replay).constData(), &times), 0);
+    QCOMPARE(QFileInfo(replay).lastModified().toMSecsSinceEpoch(), modified);
+}
+
+void tst_ReplayArchive::roundTrip()
+{
+    QString archive = dir.path() + "/roundTrip.d2ra";
+    QString restored = dir.path() + "/roundTrip.dem";
+
+    quint64 hash = 0;
+    QVERIFY(ReplayArchive::compress(replay, archive, 0, &hash));
+    QCOMPARE(hash, hashOf(contents));
+    QVERIFY(QFileInfo(archive).size() < contents.size());
+    QVERIFY(ReplayArchive::verify(archive, hash));
+
+    QVERIFY(ReplayArchive::extract(archive, restored));
+    QVERIFY(readAll(restored) == contents);
+}
+
+/*
+ * A restored replay looks the way it did before it was archived, so the index has no reason to read it again.
+ */
+void tst_ReplayArchive::keepsModified()
+{
+    QString archive = dir.path() + "/keepsModified.d2ra";
+    QString restored = dir.path() + "/keepsModified.dem";
+
+    QVERIFY(ReplayArchive::compress(replay, archive));
+    QVERIFY(ReplayArchive::extract(archive, restored));
+    QCOMPARE(QFileInfo(restored).lastModified().toMSecsSinceEpoch() / 1000, modified / 1000);
+}
+
+void tst_ReplayArchive::verifyRejectsDamage()
+{
+    QString archive = dir.path() + "/verify.d2ra";
+    quint64 hash = 0;
+    QVERIFY(ReplayArchive::compress(replay, archive, 0, &hash));
+    QByteArray good = readAll(archive);
+
+    //some other file's hash
+    QVERIFY(!ReplayArchive::verify(archive, hash + 1));
+
+    //cut short, at the end and in the middle of the chunk table
+    QVERIFY(writeAll(archive, good.left(good.size() - 1)));
+    QVERIFY(!ReplayArchive::verify(archive, hash));
+    QVERIFY(writeAll(archive, good.left(good.size() / 2)));
+    QVERIFY(!ReplayArchive::verify(archive, hash));
+
+    //a flipped bit in the compressed data
+    QByteArray damaged = good;
+    damaged[damaged.size() / 2] = damaged.at(damaged.size() / 2) ^ 0x10;
+    QVERIFY(writeAll(archive, damaged));
+    QVERIFY(!ReplayArchive::verify(archive, hash));
+
+    //the header claiming a different size
+    damaged = good;
+    qToLittleEndian<qint64>(contents.size() + 1, reinterpret_cast<uchar *>(damaged.data()) + 8);
+    QVERIFY(writeAll(archive, damaged));
+    QVERIFY(!ReplayArchive::verify(archive, hash));
+}
+
+/*
+ * Archives made before the header had the mtime in it still extract.
+ */
+void tst_ReplayArchive::readsVersion1()
+{
+    const int chunkSize = 4 * 1024 * 1024;
+    QByteArray archive(20, '\0');
+    uchar *header = reinterpret_cast<uchar *>(archive.data());
+    memcpy(header, "D2RA", 4);
+    qToLittleEndian<quint32>(1, header + 4);
+    qToLittleEndian<qint64>(contents.size(), header + 8);
+    qToLittleEndian<quint32>(chunkSize, header + 16);
+    for(int offset = 0; offset < contents.size(); offset += chunkSize)
+    {
+        QByteArray chunk = qCompress(contents.mid(offset, chunkSize));
+        uchar length[4];
+        qToLittleEndian<quint32>(quint32(chunk.size()), length);
+        archive.append(reinterpret_cast<const char *>(length), 4);
+        archive.append(chunk);
+    }
+
+    QString fileName = dir.path() + "/version1.d2ra";
+    QString restored = dir.path() + "/version1.dem";
+    QVERIFY(writeAll(fileName, archive));
+    QVERIFY(ReplayArchive::verify(fileName, hashOf(contents)));
+    QVERIFY(ReplayArchive::extract(fileName, restored));
+    QVERIFY(readAll(restored) == contents);
+}
+
+/*
+ * Archiving as ReplayArchiver does it: compress, then read the archive back before the original may go.
+ */
+void tst_ReplayArchive::benchmarkCompress()
+{
+    QString archive = dir.path() + "/benchmark.d2ra";
+    QElapsedTimer timer;
+    qint64 compressTime = 0;
+    qint64 verifyTime = 0;
+    QBENCHMARK_ONCE
+    {
+        quint64 hash = 0;
+        timer.start();
+        QVERIFY(ReplayArchive::compress(replay, archive, 0, &hash));
+        compressTime = timer.restart();
+        QVERIFY(ReplayArchive::verify(archive, hash));
+        verifyTime = timer.elapsed();
+    }
+
+    const double megabytes = contents.size() / (1024.0 * 1024.0);
+    qDebug("%.0f MB to %.1f MB: compress %lld ms (%.0f MB/s), verify %lld ms (%.0f MB/s)",
+           megabytes, QFileInfo(archive).size() / (1024.0 * 1024.0),
+           compressTime, megabytes / qMax(compressTime, qint64(1)) * 1000,
+           verifyTime, megabytes / qMax(verifyTime, qint64(1)) * 1000);
+}
+
+void tst_ReplayArchive::benchmarkExtract()
+{
+    QString archive = dir.path() + "/benchmark.d2ra";
+    QString restored = dir.path() + "/benchmark.dem";
+    QVERIFY(ReplayArchive::compress(replay, archive));
+
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK_ONCE
+    {
+        QVERIFY(ReplayArchive::extract(archive, restored));
+    }
+    qint64 elapsed = timer.elapsed();
+
+    qDebug("extract %lld ms (%.0f MB/s)", elapsed, contents.size() / (1024.0 * 1024.0) / qMax(elapsed, qint64(1)) * 1000);
+    QCOMPARE(QFileInfo(restored).size(), qint64(contents.size()));
+}
+
+QTEST_MAIN(tst_ReplayArchive)
+
+#include "tst_replayarchive.moc"
@@ -0,0 +1,12 @@
+include(../tests.pri)
+
+QT       += concurrent
+
+TARGET = tst_replayarchive
+
+SOURCES += tst_replayarchive.cpp \
+    $$SRCDIR/replayarchive.cpp \
+    $$SRCDIR/xxhash64.cpp
+
+HEADERS += $$SRCDIR/replayarchive.h \
+    $$SRCDIR/xxhash64.h
@@ -0,0 +1,299 @@
+#include <QtTest>
+#include <QtConcurrent>
+
+#include "replaydedup.h"
+#include "xxhash64.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+class tst_ReplayDedup : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void knownAnswers_data();
+    void knownAnswers();
+    void pieces_data();
+    void pieces();
+    void linkCopy();
+    void linkCopyRefusesMismatch();
+    void linkCopyMapped();
+    void benchmarkRead();
+    void benchmarkHash();
+
+private:
+    enum { ReplaySize = 64 * 1024 * 1024, ChunkSize = 1024 * 1024 };
+
+    static QByteArray pattern();
+    static QByteArray readAll(const QString &fileName);
+    static bool writeAll(const QString &fileName, const QByteArray &data);
+
+    QTemporaryDir dir;
+    QString replay;                 //large enough to read at disk speed rather than out of a cache line
+};
+
+//1000 bytes that are not a whole number of 32 byte stripes
+QByteArray tst_ReplayDedup::pattern()
+{
+    QByteArray data(1000, 0);
+    for(int i = 0; i < data.size(); i++)
+        data[i] = char((i * 7 + (i >> 8)) & 0xff);
+    return data;
+}
+
+QByteArray tst_ReplayDedup::readAll(const QString &fileName)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+bool tst_ReplayDedup::writeAll(const QString &fileName, const QByteArray &data)
+{
+    QFile file(fileName);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+void tst_ReplayDedup::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    replay = dir.path() + "/benchmark.dem";
+
+    QFile file(replay);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QByteArray chunk(ChunkSize, Qt::Uninitialized);
+    qsrand(1);
+    for(int written = 0; written < ReplaySize; written += chunk.size())
+    {
+        for(int i = 0; i < chunk.size(); i++)
+            chunk[i] = char(qrand());
+        QCOMPARE(file.write(chunk), qint64(chunk.size()));
+    }
+}
+
+/*
+ * The reference implementation's answers, as xxhsum and the python xxhash package give them.
+ * Short inputs only go through the tail; from 32 bytes on the four lanes are used.
+ */
+void tst_ReplayDedup::knownAnswers_data()
+{
+    QTest::addColumn<QByteArray>("input");
+    QTest::addColumn<quint64>("seed");
+    QTest::addColumn<QByteArray>("hash");
+
+    QTest::newRow("empty") << QByteArray() << Q_UINT64_C(0) << QByteArray("ef46db3751d8e999");
+    QTest::newRow("a") << QByteArray("a") << Q_UINT64_C(0) << QByteArray("d24ec4f1a98c6e5b");
+    QTest::newRow("abc") << QByteArray("abc") << Q_UINT64_C(0) << QByteArray("44bc2cf5ad770999");
+    QTest::newRow("14 bytes") << QByteArray("message digest") << Q_UINT64_C(0) << QByteArray("066ed728fceeb3be");
+    QTest::newRow("26 bytes") << QByteArray("abcdefghijklmnopqrstuvwxyz") << Q_UINT64_C(0) << QByteArray("cfe1f278fa89835c");
+    QTest::newRow("39 bytes") << QByteArray("Nobody inspects the spammish repetition") << Q_UINT64_C(0) << QByteArray("fbcea83c8a378bf1");
+    QTest::newRow("62 bytes") << QByteArray("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789") << Q_UINT64_C(0) << QByteArray("fd5e2ce9520872dd");
+    QTest::newRow("1000 bytes") << pattern() << Q_UINT64_C(0) << QByteArray("698399d62f9c1695");
+    QTest::newRow("seeded, short") << QByteArray("abc") << Q_UINT64_C(1) << QByteArray("bea9ca8199328908");
+    QTest::newRow("seeded, long") << pattern() << Q_UINT64_C(2654435761) << QByteArray("54bf4105274d8346");
+}
+
+void tst_ReplayDedup::knownAnswers()
+{
+    QFETCH(QByteArray, input);
+    QFETCH(quint64, seed);
+    QFETCH(QByteArray, hash);
+
+    XxHash64 hasher(seed);
+    hasher.addData(input.constData(), input.size());
+    QCOMPARE(hasher.hexResult(), hash);
+    QCOMPARE(hasher.result(), hash.toULongLong(0, 16));
+}
+
+/*
+ * Replays are hashed a buffer at a time, so the same bytes fed in pieces that straddle the 32 byte stripes
+ * and the leftover buffer have to give the same answer as all at once.
+ */
+void tst_ReplayDedup::pieces_data()
+{
+    QTest::addColumn<int>("piece");
+
+    QList<int> sizes;
+    sizes << 1 << 3 << 7 << 8 << 31 << 32 << 33 << 63 << 64 << 65 << 999;
+    foreach(int size, sizes)
+        QTest::newRow(qPrintable(QString("%1 bytes").arg(size))) << size;
+}
+
+void tst_ReplayDedup::pieces()
+{
+    QFETCH(int, piece);
+
+    QByteArray data = pattern();
+    XxHash64 hasher;
+    for(int start = 0; start < data.size(); start += piece)
+        hasher.addData(data.constData() + start, qMin(piece, data.size() - start));
+    QCOMPARE(hasher.hexResult(), QByteArray("698399d62f9c1695"));
+
+    //split once at every point, with an empty piece on the way
+    for(int split = 0; split <= 100; split++)
+    {
+        XxHash64 whole;
+        whole.addData(data.constData(), 100);
+        XxHash64 fed;
+        fed.addData(data.constData(), split);
+        fed.addData(data.constData() + split, 0);
+        fed.addData(data.constData() + split, 100 - split);
+        QCOMPARE(fed.result(), whole.result());
+    }
+}
+
+/*
+ * Two copies of a replay become one: the duplicate keeps its name and content, but now points at the original's data.
+ */
+void tst_ReplayDedup::linkCopy()
+{
+    QString original = dir.path() + "/123.dem";
+    QString duplicate = dir.path() + "/copy/123.dem";
+    QVERIFY(QDir().mkpath(dir.path() + "/copy"));
+    QByteArray data = pattern().repeated(100);
+    QVERIFY(writeAll(original, data));
+    QVERIFY(writeAll(duplicate, data));
+
+    QVERIFY(ReplayDedup::linkCopy(qMakePair(original, duplicate)));
+    QCOMPARE(readAll(duplicate), data);
+    QCOMPARE(readAll(original), data);
+    QVERIFY(!QFile::exists(duplicate + ".link"));
+
+#ifdef Q_OS_UNIX
+    //a hard link shares the inode; a reflink is a file of its own that shares extents, so only the link count tells them apart
+    struct stat originalStat, duplicateStat;
+    QCOMPARE(::stat(QFile::encodeName(original).constData(), &originalStat), 0);
+    QCOMPARE(::stat(QFile::encodeName(duplicate).constData(), &duplicateStat), 0);
+    if(originalStat.st_ino == duplicateStat.st_ino)
+        QCOMPARE(int(originalStat.st_nlink), 2);
+    else
+        QCOMPARE(int(originalStat.st_nlink), 1);
+#endif
+
+    //linking the two again changes nothing
+    QVERIFY(ReplayDedup::linkCopy(qMakePair(original, duplicate)));
+    QCOMPARE(readAll(duplicate), data);
+}
+
+//a matching hash is not enough; anything that differs leaves both files as they were
+void tst_ReplayDedup::linkCopyRefusesMismatch()
+{
+    QString original = dir.path() + "/456.dem";
+    QString duplicate = dir.path() + "/456_copy.dem";
+    QByteArray data = pattern().repeated(2000);
+    QVERIFY(writeAll(original, data));
+
+    //same size, the last byte differs; well past the first buffer
+    QByteArray other = data;
+    other[other.size() - 1] = char(other.at(other.size() - 1) + 1);
+    QVERIFY(writeAll(duplicate, other));
+    QVERIFY(!ReplayDedup::linkCopy(qMakePair(original, duplicate)));
+    QCOMPARE(readAll(duplicate), other);
+    QCOMPARE(readAll(original), data);
+    QVERIFY(!QFile::exists(duplicate + ".link"));
+
+    //one byte shorter
+    QVERIFY(writeAll(duplicate, data.left(data.size() - 1)));
+    QVERIFY(!ReplayDedup::linkCopy(qMakePair(original, duplicate)));
+    QCOMPARE(readAll(duplicate).size(), data.size() - 1);
+
+    //gone, or never there
+    QVERIFY(QFile::remove(duplicate));
+    QVERIFY(!ReplayDedup::linkCopy(qMakePair(original, duplicate)));
+    QVERIFY(!QFile::exists(duplicate));
+    QVERIFY(!ReplayDedup::linkCopy(qMakePair(dir.path() + "/missing.dem", original)));
+    QCOMPARE(readAll(original), data);
+}
+
+//the way the main window runs it: one result per copy, in order
+void tst_ReplayDedup::linkCopyMapped()
+{
+    QByteArray data = pattern().repeated(50);
+    QString original = dir.path() + "/789.dem";
+    QVERIFY(writeAll(original, data));
+
+    QList<QPair<QString, QString> > copies;
+    QList<bool> expected;
+    for(int i = 0; i < 8; i++)
+    {
+        QString copy = dir.path() + QString("/789_%1.dem").arg(i);
+        QVERIFY(writeAll(copy, i % 3 == 2 ? pattern() : data));
+        copies.append(qMakePair(original, copy));
+        expected.append(i % 3 != 2);
+    }
+
+    QFuture<bool> linked = QtConcurrent::mapped(copies, &ReplayDedup::linkCopy);
+    linked.waitForFinished();
+    QCOMPARE(linked.results(), expected);
+    for(int i = 0; i < copies.size(); i++)
+        QCOMPARE(readAll(copies.at(i).second), expected.at(i) ? data : pattern());
+}
+
+/*
+ * Hashing is meant to be no slower than reading the file; these two read the same file the same way,
+ * one of them hashing as it goes. It was only just written, so both get it from the page cache.
+ */
+void tst_ReplayDedup::benchmarkRead()
+{
+    QByteArray buffer(ChunkSize, Qt::Uninitialized);
+    QElapsedTimer timer;
+    timer.start();
+    qint64 total = 0;
+    QBENCHMARK
+    {
+        QFile file(replay);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        qint64 size;
+        while((size = file.read(buffer.data(), buffer.size())) > 0)
+            total += size;
+    }
+    qint64 elapsed = timer.elapsed();
+
+    qDebug("read %.0f MB/s", total / (1024.0 * 1024.0) / qMax(elapsed, qint64(1)) * 1000);
+}
+
+void tst_ReplayDedup::benchmarkHash()
+{
+    QByteArray buffer(ChunkSize, Qt::Uninitialized);
+    QElapsedTimer timer;
+    timer.start();
+    qint64 total = 0;
+    QBENCHMARK
+    {
+        QFile file(replay);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        XxHash64 hash;
+        qint64 size;
+        while((size = file.read(buffer.data(), buffer.size())) > 0)
+        {
+            hash.addData(buffer.constData(), size);
+            total += size;
+        }
+        QVERIFY(hash.result() != 0);
+    }
+    qint64 elapsed = timer.elapsed();
+    qDebug("read and hash %.0f MB/s", total / (1024.0 * 1024.0) / qMax(elapsed, qint64(1)) * 1000);
+
+    //the hash on its own, out of memory, is what has to stay well ahead of the disk
+    QFile file(replay);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QByteArray data = file.read(ChunkSize * 16);
+    timer.restart();
+    const int rounds = 16;
+    quint64 result = 0;
+    for(int i = 0; i < rounds; i++)
+    {
+        XxHash64 hash;
+        hash.addData(data.constData(), data.size());
+        result ^= hash.result();
+    }
+    elapsed = timer.elapsed();
+    QVERIFY(result != 0);
+    qDebug("hash alone %.0f MB/s", double(data.size()) * rounds / (1024.0 * 1024.0) / qMax(elapsed, qint64(1)) * 1000);
+}
+
+QTEST_MAIN(tst_ReplayDedup)
+
+#include "tst_replaydedup.moc"
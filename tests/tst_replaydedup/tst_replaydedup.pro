@@ -0,0 +1,12 @@
+include(../tests.pri)
+
+QT       += concurrent
+
+TARGET = tst_replaydedup
+
+SOURCES += tst_replaydedup.cpp \
+    $$SRCDIR/replaydedup.cpp \
+    $$SRCDIR/xxhash64.cpp
+
+HEADERS += $$SRCDIR/replaydedup.h \
+    $$SRCDIR/xxhash64.h
@@ -0,0 +1,401 @@
+#include <QtTest>
+#include <QDirIterator>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+#include "replayindex.h"
+
+class tst_ReplayIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+    void update();
+    void removeMissing();
+    void setUnreadable();
+    void migrateFromVersion1();
+    void migrateFromVersion7();
+    void benchmarkFirstScan();
+    void benchmarkRescanChanged();
+
+private:
+    enum { ReplayCount = 10000 };
+
+    QList<ReplayFile> listFiles(const QString &path);
+    qint64 matchIdOf(const QString &fileName);
+    int count(const QString &where = QString());
+    QSqlDatabase openLegacy(const QString &name);
+
+    QTemporaryDir dir;
+    QString replays;                //synthetic replay folder, one empty .dem per match
+    QSqlDatabase db;
+    int root;
+};
+
+void tst_ReplayIndex::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    replays = dir.path() + "/replays";
+    QVERIFY(QDir().mkpath(replays + "/sub"));
+
+    for(int i = 0; i < ReplayCount; i++)
+    {
+        QFile file(QString("%1/%2.dem").arg(replays).arg(1000000 + i));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+    }
+}
+
+//every test starts from an empty database
+void tst_ReplayIndex::init()
+{
+    db = QSqlDatabase::addDatabase("QSQLITE");
+    db.setDatabaseName(dir.path() + "/" + QTest::currentTestFunction() + ".db");
+    QVERIFY(db.open());
+    QVERIFY(ReplayIndex(db).createTables());
+    root = ReplayIndex(db).rootId(replays);
+    QVERIFY(root > 0);
+}
+
+void tst_ReplayIndex::cleanup()
+{
+    db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+//what a scan of path reports, names relative to it
+QList<ReplayFile> tst_ReplayIndex::listFiles(const QString &path)
+{
+    QList<ReplayFile> files;
+    QDir base(path);
+    QDirIterator it(path, QStringList("*.dem"), QDir::Files, QDirIterator::Subdirectories);
+    while(it.hasNext())
+    {
+        it.next();
+        ReplayFile file = ReplayFile::fromFileInfo(it.fileInfo());
+        file.rootId = root;
+        file.fileName = base.relativeFilePath(it.filePath());
+        files.append(file);
+    }
+
+    return files;
+}
+
+qint64 tst_ReplayIndex::matchIdOf(const QString &fileName)
+{
+    return ReplayIndex(db, root).matchId(fileName);
+}
+
+int tst_ReplayIndex::count(const QString &where)
+{
+    QSqlQuery query("select count(*) from replays" + (where.isEmpty() ? QString() : " where " + where), db);
+    return query.next() ? query.value(0).toInt() : -1;
+}
+
+//a database left behind by an older version, next to the one init() made
+QSqlDatabase tst_ReplayIndex::openLegacy(const QString &name)
+{
+    QSqlDatabase legacy = QSqlDatabase::addDatabase("QSQLITE", name);
+    legacy.setDatabaseName(dir.path() + "/" + name + ".db");
+    legacy.open();
+    return legacy;
+}
+
+void tst_ReplayIndex::update()
+{
+    QList<ReplayFile> files;
+    ReplayFile file;
+    file.rootId = root;
+    file.size = 100;
+    file.modified = 1000;
+
+    file.fileName = "123.dem";
+    files << file;
+    file.fileName = "sub/123.dem";          //same match in another folder, can't have its id
+    files << file;
+    file.fileName = "highlights.dem";       //not named after a match
+    files << file;
+    file.fileName = "456.dem";
+    files << file;
+
+    ReplayIndex index(db, root);
+    QCOMPARE(index.update(files), 4);
+    QCOMPARE(count(), 4);
+    QCOMPARE(matchIdOf("123.dem"), Q_INT64_C(123));
+    QCOMPARE(matchIdOf("456.dem"), Q_INT64_C(456));
+    QVERIFY(matchIdOf("sub/123.dem") < 0);
+    QVERIFY(matchIdOf("highlights.dem") < 0);
+    QVERIFY(matchIdOf("sub/123.dem") != matchIdOf("highlights.dem"));
+
+    //changed files keep their row and id but have to be read again
+    QSqlQuery("update replays set info_read = 1, timeline_read = 1", db);
+    files[0].size = 200;
+    files[3].size = 300;
+    QCOMPARE(index.update(files.mid(0, 1) + files.mid(3, 1)), 0);
+    QCOMPARE(count(), 4);
+    QCOMPARE(count("size = 200 and match_id = 123 and info_read is NULL and timeline_read is NULL"), 1);
+    QCOMPARE(count("size = 300 and match_id = 456"), 1);
+    QCOMPARE(count("size = 100 and info_read = 1"), 2);
+
+    //a new file among changed ones
+    file.fileName = "789.dem";
+    QCOMPARE(index.update(QList<ReplayFile>() << files.at(0) << file), 1);
+    QCOMPARE(matchIdOf("789.dem"), Q_INT64_C(789));
+}
+
+void tst_ReplayIndex::removeMissing()
+{
+    QList<ReplayFile> files = listFiles(replays);
+    ReplayIndex index(db, root);
+    QCOMPARE(index.update(files), int(ReplayCount));
+
+    QStringList present;
+    for(int i = 0; i < files.size(); i += 2)
+        present.append(files.at(i).fileName);
+    QVERIFY(index.removeMissing(present));
+    QCOMPARE(count(), present.size());
+}
+
+//a replay with no file info block is remembered as such until the file changes
+void tst_ReplayIndex::setUnreadable()
+{
+    ReplayFile file;
+    file.rootId = root;
+    file.fileName = "123.dem";
+    file.size = 100;
+    file.modified = 1000;
+    ReplayFile other = file;
+    other.fileName = "456.dem";
+
+    ReplayIndex index(db, root);
+    QCOMPARE(index.update(QList<ReplayFile>() << file << other), 2);
+    QVERIFY(!index.files().value("123.dem").infoUnreadable);
+
+    //read at another size than the index has, so it says nothing about this file
+    ReplayFile stale = other;
+    stale.size = 50;
+    QVERIFY(index.setUnreadable(QList<ReplayFile>() << file << stale));
+    QHash<QString, ReplayFile> files = index.files();
+    QVERIFY(files.value("123.dem").infoUnreadable);
+    QVERIFY(!files.value("123.dem").infoRead);
+    QVERIFY(!files.value("456.dem").infoUnreadable);
+    QCOMPARE(count("info_read = 0"), 1);
+
+    //a file that was read fine stays that way
+    QSqlQuery("update replays set info_read = 1 where filename = '456.dem'", db);
+    QVERIFY(index.setUnreadable(QList<ReplayFile>() << other));
+    QVERIFY(index.files().value("456.dem").infoRead);
+
+    //once it changes it's read again
+    file.size = 200;
+    QCOMPARE(index.update(QList<ReplayFile>() << file), 0);
+    files = index.files();
+    QVERIFY(!files.value("123.dem").infoUnreadable);
+    QVERIFY(!files.value("123.dem").infoRead);
+}
+
+/*
+ * The table the first versions had, with titles the user typed in.
+ * Goes through every migration, including the rebuild of version 8, and comes out with the same rows and titles.
+ */
+void tst_ReplayIndex::migrateFromVersion1()
+{
+    {
+        QSqlDatabase legacy = openLegacy("version1");
+        QVERIFY(legacy.isOpen());
+
+        QSqlQuery query(legacy);
+        QVERIFY(query.exec("create table if not exists replays (title TEXT, filename TEXT PRIMARY KEY, fileExists BLOB)"));
+        QVERIFY(query.exec("insert into replays (title, filename, fileExists) VALUES ('Grand final', '123.dem', 1)"));
+        QVERIFY(query.exec("insert into replays (title, filename, fileExists) VALUES (NULL, '456.dem', 1)"));
+        QVERIFY(query.exec("insert into replays (title, filename, fileExists) VALUES ('Rampage', 'highlights.dem', 1)"));
+        QVERIFY(query.exec("insert into replays (title, filename, fileExists) VALUES ('Gone', '789.dem', 0)"));
+
+        QVERIFY(ReplayIndex(legacy).createTables());
+
+        QVERIFY(query.exec("PRAGMA user_version"));
+        QVERIFY(query.next());
+        int version = query.value(0).toInt();
+        QVERIFY(version >= 10);
+
+        //same rows with the same titles, ids from the file names where there is one
+        QVERIFY(query.exec("select filename, title, match_id, root_id, size, hash, info_read, timeline_read, archived from replays order by filename"));
+        QStringList fileNames;
+        while(query.next())
+        {
+            QString fileName = query.value(0).toString();
+            fileNames.append(fileName);
+            if(fileName == "123.dem")
+                QCOMPARE(query.value(1).toString(), QString("Grand final"));
+            else if(fileName == "456.dem")
+                QVERIFY(query.value(1).isNull());
+            else if(fileName == "highlights.dem")
+                QCOMPARE(query.value(1).toString(), QString("Rampage"));
+            else
+                QCOMPARE(query.value(1).toString(), QString("Gone"));
+
+            qint64 matchId = query.value(2).toLongLong();
+            if(fileName == "highlights.dem")
+                QVERIFY(matchId < 0);
+            else
+                QCOMPARE(QString::number(matchId) + ".dem", fileName);
+
+            //in the one folder there was, and nothing known about the file so the next scan looks at it
+            QCOMPARE(query.value(3).toInt(), 1);
+            QVERIFY(query.value(4).isNull());
+            QVERIFY(query.value(5).isNull());
+            QVERIFY(query.value(6).isNull());
+            QVERIFY(query.value(7).isNull());
+            QVERIFY(query.value(8).isNull());
+        }
+        QCOMPARE(fileNames, QStringList() << "123.dem" << "456.dem" << "789.dem" << "highlights.dem");
+
+        //the copies made on the way are gone, the indexes of the later versions are there
+        QStringList tables = legacy.tables();
+        QVERIFY(!tables.contains("replays_v1"));
+        QVERIFY(!tables.contains("replays_v7"));
+        QVERIFY(tables.contains("roots"));
+        QVERIFY(tables.contains("replay_players"));
+        QVERIFY(tables.contains("replay_timeline"));
+        QStringList indexes;
+        QVERIFY(query.exec("select name from sqlite_master where type = 'index' and tbl_name = 'replays'"));
+        while(query.next())
+            indexes.append(query.value(0).toString());
+        QVERIFY(indexes.contains("replays_by_hash"));
+        QVERIFY(indexes.contains("replays_by_title"));
+        QVERIFY(indexes.contains("replays_by_end_time"));
+
+        //the first folder asked for takes over the old rows, and a second one may reuse their names
+        ReplayIndex index(legacy);
+        QCOMPARE(index.rootId(replays), 1);
+        QHash<QString, ReplayFile> files = ReplayIndex(legacy, 1).files();
+        QCOMPARE(files.size(), 4);
+        QVERIFY(!files.value("123.dem").infoRead);
+        QVERIFY(files.value("123.dem").hash.isEmpty());
+        int other = index.rootId(dir.path() + "/other");
+        QVERIFY(other > 1);
+        QVERIFY(ReplayIndex(legacy, other).insert(QStringList("123.dem")));
+        QVERIFY(query.exec("select count(*) from replays where filename = '123.dem'"));
+        QVERIFY(query.next());
+        QCOMPARE(query.value(0).toInt(), 2);
+
+        //opening it again changes nothing
+        QVERIFY(ReplayIndex(legacy).createTables());
+        QVERIFY(query.exec("select title from replays where filename = '123.dem' and root_id = 1"));
+        QVERIFY(query.next());
+        QCOMPARE(query.value(0).toString(), QString("Grand final"));
+        QVERIFY(query.exec("PRAGMA user_version"));
+        QVERIFY(query.next());
+        QCOMPARE(query.value(0).toInt(), version);
+    }
+    QSqlDatabase::removeDatabase("version1");
+}
+
+/*
+ * Version 8 rebuilds the table to add the root; every column a version 7 row had has to come through the copy,
+ * and only the hash is dropped, by version 7 itself.
+ */
+void tst_ReplayIndex::migrateFromVersion7()
+{
+    {
+        QSqlDatabase legacy = openLegacy("version7");
+        QVERIFY(legacy.isOpen());
+
+        QSqlQuery query(legacy);
+        QVERIFY(query.exec("create table replays (title TEXT, filename TEXT NOT NULL UNIQUE, match_id INTEGER PRIMARY KEY, size INTEGER, modified INTEGER, inode INTEGER, hash TEXT, "
+                           "duration INTEGER, game_mode TEXT, winner TEXT, end_time INTEGER, info_read INTEGER, timeline_read INTEGER, archived INTEGER, archived_size INTEGER)"));
+        QVERIFY(query.exec("create table replay_players (match_id INTEGER, slot INTEGER, team INTEGER, player_name TEXT, hero TEXT, steam_id INTEGER, PRIMARY KEY (match_id, slot))"));
+        QVERIFY(query.exec("create table replay_timeline (match_id INTEGER, slot INTEGER, series TEXT, sample_ticks INTEGER, data BLOB, PRIMARY KEY (match_id, slot, series))"));
+        QVERIFY(query.exec("create index replays_by_hash on replays (hash, size)"));
+        QVERIFY(query.exec("insert into replays VALUES ('Comeback', '123.dem', 123, 1000, 2000, 3000, 'abcdef', 2832, 'Captains Mode', 'radiant', 1390073525, 1, 1, NULL, NULL)"));
+        QVERIFY(query.exec("insert into replays VALUES (NULL, '456.dem', 456, 500, 600, 700, NULL, NULL, NULL, NULL, NULL, 0, NULL, 1390000000000, 250)"));
+        QVERIFY(query.exec("insert into replay_players VALUES (123, 0, 2, 'player', 'npc_dota_hero_axe', 76561197960265728)"));
+        QVERIFY(query.exec("PRAGMA user_version = 7"));
+
+        QVERIFY(ReplayIndex(legacy).createTables());
+
+        QVERIFY(query.exec("select title, filename, size, modified, inode, hash, duration, game_mode, winner, end_time, info_read, timeline_read, archived, archived_size, root_id "
+                           "from replays where match_id = 123"));
+        QVERIFY(query.next());
+        QCOMPARE(query.value(0).toString(), QString("Comeback"));
+        QCOMPARE(query.value(1).toString(), QString("123.dem"));
+        QCOMPARE(query.value(2).toLongLong(), Q_INT64_C(1000));
+        QCOMPARE(query.value(3).toLongLong(), Q_INT64_C(2000));
+        QCOMPARE(query.value(4).toLongLong(), Q_INT64_C(3000));
+        QCOMPARE(query.value(5).toString(), QString("abcdef"));
+        QCOMPARE(query.value(6).toInt(), 2832);
+        QCOMPARE(query.value(7).toString(), QString("Captains Mode"));
+        QCOMPARE(query.value(8).toString(), QString("radiant"));
+        QCOMPARE(query.value(9).toLongLong(), Q_INT64_C(1390073525));
+        QCOMPARE(query.value(10).toInt(), 1);
+        QVERIFY(query.value(11).isNull());                                  //gone through again for the seek index
+        QVERIFY(query.value(12).isNull());
+        QVERIFY(query.value(13).isNull());
+        QCOMPARE(query.value(14).toInt(), 1);
+
+        QVERIFY(query.exec("select title, archived, archived_size, info_read from replays where match_id = 456"));
+        QVERIFY(query.next());
+        QVERIFY(query.value(0).isNull());
+        QCOMPARE(query.value(1).toLongLong(), Q_INT64_C(1390000000000));
+        QCOMPARE(query.value(2).toLongLong(), Q_INT64_C(250));
+        QCOMPARE(query.value(3).toInt(), 0);
+
+        QVERIFY(query.exec("select count(*) from replay_players where match_id = 123"));
+        QVERIFY(query.next());
+        QCOMPARE(query.value(0).toInt(), 1);
+        QVERIFY(!legacy.tables().contains("replays_v7"));
+    }
+    QSqlDatabase::removeDatabase("version7");
+}
+
+/*
+ * A folder the index has never seen: every file is new.
+ */
+void tst_ReplayIndex::benchmarkFirstScan()
+{
+    ReplayIndex index(db, root);
+    int added = 0;
+    QBENCHMARK_ONCE
+    {
+        QList<ReplayFile> files = listFiles(replays);
+        QStringList names;
+        foreach(const ReplayFile &file, files)
+            names.append(file.fileName);
+
+        added = index.update(files);
+        index.removeMissing(names);
+    }
+
+    QCOMPARE(added, int(ReplayCount));
+    QCOMPARE(count(), int(ReplayCount));
+}
+
+/*
+ * Every file changed since the last scan, e.g. the folder was restored from a backup.
+ */
+void tst_ReplayIndex::benchmarkRescanChanged()
+{
+    ReplayIndex index(db, root);
+    QList<ReplayFile> files = listFiles(replays);
+    QCOMPARE(index.update(files), int(ReplayCount));
+
+    QSqlQuery("update replays set info_read = 1, timeline_read = 1", db);
+    for(int i = 0; i < files.size(); i++)
+        files[i].modified++;
+
+    int added = -1;
+    QBENCHMARK_ONCE
+    {
+        added = index.update(files);
+    }
+
+    QCOMPARE(added, 0);
+    QCOMPARE(count("info_read is NULL"), int(ReplayCount));
+}
+
+QTEST_MAIN(tst_ReplayIndex)
+
+#include "tst_replayindex.moc"
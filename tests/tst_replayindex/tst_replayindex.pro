@@ -0,0 +1,8 @@
+include(../tests.pri)
+
+QT       += sql
+
+TARGET = tst_replayindex
+
+SOURCES += tst_replayindex.cpp \
+    $$REPLAY_SOURCES
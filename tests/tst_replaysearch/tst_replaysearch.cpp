@@ -0,0 +1,212 @@
+#include <QtTest>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+#include "replayindex.h"
+#include "replaysearch.h"
+#include "matchstore.h"
+
+class tst_ReplaySearch : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void documents();
+    void benchmarkSetInfo();
+    void benchmarkSearch_data();
+    void benchmarkSearch();
+
+private:
+    enum { ReplayCount = 10000, PlayerNames = 2000, Limit = 500 };
+
+    QList<DemoInfo> addReplays(int root, qint64 firstMatchId, int count, int seed);
+    int search(const QString &text);
+    bool found(const QString &text, qint64 matchId);
+
+    QTemporaryDir dir;
+    QSqlDatabase db;
+};
+
+void tst_ReplaySearch::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    db = QSqlDatabase::addDatabase("QSQLITE");
+    db.setDatabaseName(dir.path() + "/matches.db");
+    QVERIFY(db.open());
+
+    //in the order MainWindow makes them
+    QVERIFY(ReplayIndex(db).createTables());
+    QVERIFY(MatchStore(db).createTables());
+    if(!ReplaySearch(db).createTables())
+        QSKIP("SQLite has no FTS5");
+}
+
+void tst_ReplaySearch::cleanupTestCase()
+{
+    db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+/*
+ * Indexes count replays named after their match ids, with file info blocks of ten players each
+ * drawn from a pool of names and heroes, the way a scan would.
+ */
+QList<DemoInfo> tst_ReplaySearch::addReplays(int root, qint64 firstMatchId, int count, int seed)
+{
+    static const char *const heroes[] = {
+        "antimage", "axe", "crystal_maiden", "earthshaker", "juggernaut", "mirana", "morphling", "nevermore",
+        "phantom_lancer", "puck", "pudge", "razor", "sand_king", "storm_spirit", "sven", "tiny", "vengefulspirit",
+        "windrunner", "zuus", "kunkka", "lina", "lion", "shadow_shaman", "slardar", "tidehunter", "witch_doctor"
+    };
+    const int heroCount = int(sizeof(heroes) / sizeof(heroes[0]));
+
+    QList<ReplayFile> files;
+    QList<DemoInfo> infos;
+    qsrand(seed);
+    for(int i = 0; i < count; i++)
+    {
+        ReplayFile file;
+        file.rootId = root;
+        file.fileName = QString("%1.dem").arg(firstMatchId + i);
+        file.size = 40 * 1024 * 1024;
+        file.modified = 1390000000000LL + i;
+        files.append(file);
+
+        DemoInfo info;
+        info.fileName = file.fileName;
+        info.matchID = quint64(firstMatchId + i);
+        info.gameMode = 1 + qrand() % 3;
+        info.winner = 2 + qrand() % 2;
+        info.endTime = 1390000000 + i * 3600;
+        info.duration = 1800 + qrand() % 1800;
+        for(int slot = 0; slot < 10; slot++)
+        {
+            DemoPlayer player;
+            player.playerName = QString("player%1").arg(qrand() % PlayerNames, 4, 10, QChar('0'));
+            player.heroName = QString("npc_dota_hero_") + heroes[qrand() % heroCount];
+            player.steamID = Q_UINT64_C(76561197960265728) + qrand();
+            player.team = slot < 5 ? 2 : 3;
+            info.players.append(player);
+        }
+        infos.append(info);
+    }
+
+    ReplayIndex(db, root).update(files);
+    return infos;
+}
+
+int tst_ReplaySearch::search(const QString &text)
+{
+    return ReplaySearch(db).search(text, Limit);
+}
+
+bool tst_ReplaySearch::found(const QString &text, qint64 matchId)
+{
+    if(search(text) <= 0)
+        return false;
+
+    QSqlQuery query(db);
+    query.prepare("select 1 from search_hits where match_id = ?");
+    query.addBindValue(matchId);
+    return query.exec() && query.next();
+}
+
+/*
+ * A replay's document follows its players and its match, even though neither has a trigger of its own any more.
+ */
+void tst_ReplaySearch::documents()
+{
+    int root = ReplayIndex(db).rootId(dir.path() + "/documents");
+    QList<DemoInfo> infos = addReplays(root, 1, 100, 1);
+    QVERIFY(ReplayIndex(db, root).setInfo(infos));
+
+    QSqlQuery query("select count(*) from replay_search", db);
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), 100);
+
+    DemoInfo &info = infos[41];
+    QVERIFY(found(info.players.at(3).playerName, 42));
+    QVERIFY(found(info.gameModeName(), 42));
+
+    //read again with other players: the old names are gone from the document
+    QString oldName = info.players.at(3).playerName;
+    for(int slot = 0; slot < info.players.size(); slot++)
+        info.players[slot].playerName = QString("renamed%1").arg(slot);
+    QVERIFY(ReplayIndex(db, root).setInfo(infos.mid(41, 1)));
+    QVERIFY(found("renamed3", 42));
+    QVERIFY(!found(oldName + " renamed3", 42));
+
+    //the match json adds account names and localized heroes
+    MatchRecord match;
+    match.matchID = 42;
+    match.gameMode = "Captains Mode";
+    match.players[1][2].accountName = "Akke";
+    match.players[1][2].heroLocalizedName = "Shadow Shaman";
+    QVERIFY(MatchStore(db).ingest(QList<MatchRecord>() << match));
+    QVERIFY(found("akke", 42));
+    QVERIFY(found("shadow shaman", 42));
+    QVERIFY(found("renamed3", 42));
+
+    //a custom title
+    query.prepare("update replays set title = ? where match_id = ?");
+    query.addBindValue("grand final game 3");
+    query.addBindValue(42);
+    QVERIFY(query.exec());
+    QVERIFY(found("grand fin", 42));
+}
+
+/*
+ * Storing the file info of a folder's worth of replays, search documents included.
+ */
+void tst_ReplaySearch::benchmarkSetInfo()
+{
+    int root = ReplayIndex(db).rootId(dir.path() + "/replays");
+    QList<DemoInfo> infos = addReplays(root, 1000000, ReplayCount, 2);
+
+    bool ok = false;
+    QBENCHMARK_ONCE
+    {
+        ok = ReplayIndex(db, root).setInfo(infos);
+    }
+    QVERIFY(ok);
+
+    QSqlQuery query("select count(*) from replay_search where rowid >= 1000000", db);
+    QVERIFY(query.next());
+    QCOMPARE(query.value(0).toInt(), int(ReplayCount));
+}
+
+void tst_ReplaySearch::benchmarkSearch_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<bool>("hits");
+
+    QTest::newRow("one player") << QString("player0042") << true;
+    QTest::newRow("common hero") << QString("pudge") << true;
+    QTest::newRow("two words") << QString("player01 storm") << true;
+    QTest::newRow("every replay") << QString("pla") << true;
+    QTest::newRow("nothing") << QString("zzzz") << false;
+}
+
+/*
+ * What typing in the search box costs once the user pauses, over the replays of benchmarkSetInfo.
+ */
+void tst_ReplaySearch::benchmarkSearch()
+{
+    QFETCH(QString, text);
+    QFETCH(bool, hits);
+
+    int count = -1;
+    QBENCHMARK
+    {
+        count = search(text);
+    }
+    QVERIFY(count >= 0);
+    QCOMPARE(count > 0, hits);
+}
+
+QTEST_MAIN(tst_ReplaySearch)
+
+#include "tst_replaysearch.moc"
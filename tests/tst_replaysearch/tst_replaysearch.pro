@@ -0,0 +1,22 @@
+include(../tests.pri)
+
+QT       += gui widgets network sql
+
+TARGET = tst_replaysearch
+
+SOURCES += tst_replaysearch.cpp \
+    $$REPLAY_SOURCES \
+    $$SRCDIR/replaysearch.cpp \
+    $$SRCDIR/matchstore.cpp \
+    $$SRCDIR/matchinfo.cpp \
+    $$SRCDIR/matchcache.cpp \
+    $$SRCDIR/jsonreader.cpp \
+    $$SRCDIR/http.cpp \
+    $$SRCDIR/httpcache.cpp
+
+HEADERS += $$SRCDIR/matchstore.h \
+    $$SRCDIR/matchinfo.h \
+    $$SRCDIR/matchcache.h \
+    $$SRCDIR/jsonreader.h \
+    $$SRCDIR/http.h \
+    $$SRCDIR/httpcache.h
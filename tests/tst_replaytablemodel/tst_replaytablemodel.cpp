@@ -0,0 +1,672 @@
+#include <QtTest>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+
+#include "replayindex.h"
+#include "replaysearch.h"
+#include "replaytablemodel.h"
+#include "matchstore.h"
+
+class tst_ReplayTableModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void paging_data();
+    void paging();
+    void filtered_data();
+    void filtered();
+    void searchHits_data();
+    void searchHits();
+    void removed_data();
+    void removed();
+    void edited_data();
+    void edited();
+    void deleted_data();
+    void deleted();
+    void benchmarkSort_data();
+    void benchmarkSort();
+    void benchmarkJump_data();
+    void benchmarkJump();
+
+private:
+    enum { PageSize = 256,                                                  //the model's
+           ReplayCount = 10 * PageSize, FirstMatchId = 7000000, FirstEndTime = 1390000000,
+           LargeCount = 1000000 };
+
+    QList<qint64> shown(const ReplayTableModel &model, bool jump);
+    QList<qint64> expected(const QString &from, const QString &orderBy, const QStringList &where = QStringList(), const QVariantList &values = QVariantList());
+    QSqlDatabase largeDatabase();
+
+    QTemporaryDir dir;
+    QSqlDatabase db;
+};
+
+static const char *const GameModes[] = { "All Pick", "Captains Mode", "Random Draft" };
+
+//what ReplayTableModel orders a column by, before the match id
+static QString sortKey(int column)
+{
+    switch(column)
+    {
+    case ReplayTableModel::Title:
+        return "r.title";
+    case ReplayTableModel::Date:
+        return "r.end_time";
+    case ReplayTableModel::Duration:
+        return "r.duration";
+    case ReplayTableModel::GameMode:
+        return "r.game_mode";
+    case ReplayTableModel::Winner:
+        return "r.winner";
+    case ReplayTableModel::Archived:
+        return "r.archived";
+    }
+    return "r.match_id";
+}
+
+static QString orderBy(int column, int order)
+{
+    return QString("%1 %2, r.match_id %2").arg(sortKey(column), order == Qt::DescendingOrder ? "desc" : "asc");
+}
+
+static QString sortName(int column, int order)
+{
+    static const char *const names[] = { "title", "file", "date", "duration", "game mode", "winner", "archived" };
+    return QString("%1 %2").arg(column < 0 ? "match id" : names[column], order == Qt::DescendingOrder ? "desc" : "asc");
+}
+
+/*
+ * Ten pages of replays whose match ids aren't in the order they were added, with values repeating many times over
+ * so ties run across page boundaries. Titles are missing from every fourth row, a page boundary falls inside them;
+ * every fifth has no file info block read yet, exactly two pages of rows with NULL in the date, duration, game mode and winner.
+ */
+void tst_ReplayTableModel::initTestCase()
+{
+    QVERIFY(dir.isValid());
+    db = QSqlDatabase::addDatabase("QSQLITE");
+    db.setDatabaseName(dir.path() + "/matches.db");
+    QVERIFY(db.open());
+
+    //in the order MainWindow makes them; searches go through LIKE where SQLite has no FTS5
+    QVERIFY(ReplayIndex(db).createTables());
+    QVERIFY(MatchStore(db).createTables());
+    ReplaySearch(db).createTables();
+    int root = ReplayIndex(db).rootId(dir.path() + "/replays");
+    QVERIFY(root > 0);
+
+    static const char *const heroes[] = { "axe", "lina", "lion", "puck", "pudge", "sven", "tiny" };
+
+    QVERIFY(db.transaction());
+    QSqlQuery player(db);
+    player.prepare("insert into replay_players (match_id, slot, team, player_name, hero, steam_id) values (?, ?, ?, ?, ?, ?)");
+    QSqlQuery replay(db);
+    replay.prepare("insert into replays (title, filename, match_id, root_id, size, modified, duration, game_mode, winner, end_time, info_read, archived) "
+                   "values (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+    for(int i = 0; i < ReplayCount; i++)
+    {
+        qint64 matchId = FirstMatchId + (qint64(i) * 7919) % ReplayCount;
+        bool infoRead = i % 5 != 0;
+
+        //players first, the row in replays writes the search document
+        for(int slot = 0; infoRead && slot < 2; slot++)
+        {
+            player.addBindValue(matchId);
+            player.addBindValue(slot);
+            player.addBindValue(slot == 0 ? 2 : 3);
+            player.addBindValue(QString("player%1").arg((i + slot) % 100));
+            player.addBindValue(QString("npc_dota_hero_") + heroes[(slot == 0 ? i : i / 7) % 7]);
+            player.addBindValue(qint64(76561197960265728LL + i));
+            QVERIFY(player.exec());
+        }
+
+        replay.addBindValue(i % 4 == 0 ? QVariant(QVariant::String) : QVariant(QString("game %1").arg(i % 50)));
+        replay.addBindValue(QString("%1.dem").arg(matchId));
+        replay.addBindValue(matchId);
+        replay.addBindValue(root);
+        replay.addBindValue(40 * 1024 * 1024);
+        replay.addBindValue(1390000000000LL + i);
+        replay.addBindValue(infoRead ? QVariant(1800 + i % 97) : QVariant(QVariant::Int));
+        replay.addBindValue(infoRead ? QVariant(GameModes[(i / 2) % 3]) : QVariant(QVariant::String));
+        replay.addBindValue(infoRead ? QVariant(i % 2 ? "Radiant" : "Dire") : QVariant(QVariant::String));
+        replay.addBindValue(infoRead ? QVariant(qint64(FirstEndTime) + (i % 400) * 21600) : QVariant(QVariant::LongLong));
+        replay.addBindValue(infoRead ? QVariant(1) : QVariant(QVariant::Int));
+        replay.addBindValue(i % 9 == 0 ? QVariant(1) : QVariant(QVariant::Int));
+        QVERIFY(replay.exec());
+    }
+    QVERIFY(db.commit());
+}
+
+void tst_ReplayTableModel::cleanupTestCase()
+{
+    db.close();
+    db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+
+    if(QSqlDatabase::contains("large"))
+    {
+        QSqlDatabase::database("large", false).close();
+        QSqlDatabase::removeDatabase("large");
+    }
+}
+
+/*
+ * The match ids of every row of the model, from the top. Jumping, the bottom and the middle of the table are asked for first,
+ * so their pages start from keys found by counting rather than from the end of the page before.
+ */
+QList<qint64> tst_ReplayTableModel::shown(const ReplayTableModel &model, bool jump)
+{
+    int rows = model.rowCount();
+    if(jump && rows > 0)
+    {
+        model.replay(rows - 1);
+        model.replay(rows / 2);
+    }
+
+    QList<qint64> matchIds;
+    for(int row = 0; row < rows; row++)
+        matchIds.append(model.replay(row).matchID);
+    return matchIds;
+}
+
+//the same rows through one plain query, which the pages have to add up to
+QList<qint64> tst_ReplayTableModel::expected(const QString &from, const QString &orderBy, const QStringList &where, const QVariantList &values)
+{
+    QSqlQuery query(db);
+    query.prepare(QString("select r.match_id from %1%2 order by %3")
+                  .arg(from, where.isEmpty() ? QString() : " where " + where.join(" and "), orderBy));
+    foreach(QVariant value, values)
+        query.addBindValue(value);
+
+    QList<qint64> matchIds;
+    if(!query.exec())
+        return matchIds;
+
+    while(query.next())
+        matchIds.append(query.value(0).toLongLong());
+    return matchIds;
+}
+
+void tst_ReplayTableModel::paging_data()
+{
+    QTest::addColumn<int>("column");
+    QTest::addColumn<int>("order");
+    QTest::addColumn<bool>("jump");
+
+    for(int column = -1; column < ReplayTableModel::ColumnCount; column++)
+    {
+        for(int order = Qt::AscendingOrder; order <= Qt::DescendingOrder; order++)
+        {
+            QTest::newRow(qPrintable(sortName(column, order))) << column << order << false;
+            QTest::newRow(qPrintable(sortName(column, order) + ", jumping")) << column << order << true;
+        }
+    }
+}
+
+/*
+ * Every sort, NULLs and ties included, gives the rows of ORDER BY column, match id, whichever order the pages are read in.
+ */
+void tst_ReplayTableModel::paging()
+{
+    QFETCH(int, column);
+    QFETCH(int, order);
+    QFETCH(bool, jump);
+
+    ReplayTableModel model(db);
+    model.sort(column, Qt::SortOrder(order));
+    QCOMPARE(model.rowCount(), int(ReplayCount));
+
+    QList<qint64> rows = expected("replays r", orderBy(column, order));
+    QCOMPARE(rows.size(), int(ReplayCount));
+    QCOMPARE(shown(model, jump), rows);
+}
+
+void tst_ReplayTableModel::filtered_data()
+{
+    QTest::addColumn<int>("column");
+    QTest::addColumn<int>("order");
+    QTest::addColumn<QString>("gameMode");
+    QTest::addColumn<QString>("hero");
+    QTest::addColumn<QString>("winner");
+    QTest::addColumn<int>("fromDay");                                       //after the first replay's, -1 for no limit
+    QTest::addColumn<int>("toDay");
+
+    QTest::newRow("game mode, by date") << int(ReplayTableModel::Date) << int(Qt::AscendingOrder) << QString("Captains Mode") << QString() << QString() << -1 << -1;
+    QTest::newRow("hero, by title desc") << int(ReplayTableModel::Title) << int(Qt::DescendingOrder) << QString() << QString("npc_dota_hero_pudge") << QString() << -1 << -1;
+    QTest::newRow("winner, by archived") << int(ReplayTableModel::Archived) << int(Qt::AscendingOrder) << QString() << QString() << QString("Dire") << -1 << -1;
+    QTest::newRow("winner, by archived desc") << int(ReplayTableModel::Archived) << int(Qt::DescendingOrder) << QString() << QString() << QString("Dire") << -1 << -1;
+    QTest::newRow("dates, by duration desc") << int(ReplayTableModel::Duration) << int(Qt::DescendingOrder) << QString() << QString() << QString() << 20 << 60;
+    QTest::newRow("everything, by match id") << -1 << int(Qt::AscendingOrder) << QString("All Pick") << QString("npc_dota_hero_axe") << QString("Radiant") << 10 << 90;
+    QTest::newRow("nothing gets through") << int(ReplayTableModel::Title) << int(Qt::AscendingOrder) << QString("Ability Draft") << QString() << QString() << -1 << -1;
+}
+
+/*
+ * The filter's conditions go in front of every segment's, and the pages still add up to one plain query.
+ */
+void tst_ReplayTableModel::filtered()
+{
+    QFETCH(int, column);
+    QFETCH(int, order);
+    QFETCH(QString, gameMode);
+    QFETCH(QString, hero);
+    QFETCH(QString, winner);
+    QFETCH(int, fromDay);
+    QFETCH(int, toDay);
+
+    QDate firstDay = QDateTime::fromTime_t(uint(FirstEndTime)).date();
+    ReplayFilter filter;
+    QStringList where;
+    QVariantList values;
+    if(fromDay >= 0)
+    {
+        filter.from = firstDay.addDays(fromDay);
+        where << "r.end_time >= ?";
+        values << qint64(QDateTime(filter.from).toTime_t());
+    }
+    if(toDay >= 0)
+    {
+        filter.to = firstDay.addDays(toDay);
+        where << "r.end_time < ?";
+        values << qint64(QDateTime(filter.to.addDays(1)).toTime_t());
+    }
+    filter.gameMode = gameMode;
+    if(!gameMode.isEmpty())
+    {
+        where << "r.game_mode = ?";
+        values << gameMode;
+    }
+    filter.hero = hero;
+    if(!hero.isEmpty())
+    {
+        where << "r.match_id in (select match_id from replay_players where hero = ?)";
+        values << hero;
+    }
+    filter.winner = winner;
+    if(!winner.isEmpty())
+    {
+        where << "r.winner = ?";
+        values << winner;
+    }
+
+    QList<qint64> rows = expected("replays r", orderBy(column, order), where, values);
+    for(int jump = 0; jump < 2; jump++)
+    {
+        ReplayTableModel model(db);
+        model.sort(column, Qt::SortOrder(order));
+        model.setFilter(filter);
+        QCOMPARE(model.rowCount(), rows.size());
+        QCOMPARE(shown(model, jump), rows);
+    }
+}
+
+void tst_ReplayTableModel::searchHits_data()
+{
+    QTest::addColumn<int>("column");
+    QTest::addColumn<int>("order");
+    QTest::addColumn<QString>("gameMode");
+
+    QTest::newRow("by rank") << -1 << int(Qt::AscendingOrder) << QString();
+    QTest::newRow("by title desc") << int(ReplayTableModel::Title) << int(Qt::DescendingOrder) << QString();
+    QTest::newRow("by date") << int(ReplayTableModel::Date) << int(Qt::AscendingOrder) << QString();
+    QTest::newRow("by archived, game mode") << int(ReplayTableModel::Archived) << int(Qt::AscendingOrder) << QString("Random Draft");
+    QTest::newRow("by rank, game mode") << -1 << int(Qt::AscendingOrder) << QString("Random Draft");
+}
+
+/*
+ * More replays have a title than the model lists hits, so the hits fill several pages; they come in rank order,
+ * or sorted like the table, and only the filtered ones are there.
+ */
+void tst_ReplayTableModel::searchHits()
+{
+    QFETCH(int, column);
+    QFETCH(int, order);
+    QFETCH(QString, gameMode);
+
+    ReplayFilter filter;
+    filter.gameMode = gameMode;
+
+    for(int jump = 0; jump < 2; jump++)
+    {
+        ReplayTableModel model(db);
+        model.sort(column, Qt::SortOrder(order));
+        model.setFilter(filter);
+        model.setSearchText("game");
+        QVERIFY(model.rowCount() > PageSize);
+
+        //the search fills search_hits on the model's connection, which is this one
+        QList<qint64> rows = expected("search_hits h join replays r on r.match_id = h.match_id", column < 0 ? QString("h.position") : orderBy(column, order));
+        QCOMPARE(rows.size(), model.rowCount());
+        QCOMPARE(shown(model, jump), rows);
+
+        if(gameMode.isEmpty())
+            continue;
+
+        QSqlQuery query(db);
+        query.prepare("select count(*) from search_hits h join replays r on r.match_id = h.match_id where r.game_mode is not ?");
+        query.addBindValue(gameMode);
+        QVERIFY(query.exec() && query.next());
+        QCOMPARE(query.value(0).toInt(), 0);
+    }
+}
+
+void tst_ReplayTableModel::removed_data()
+{
+    QTest::addColumn<int>("column");
+    QTest::addColumn<int>("order");
+    QTest::addColumn<int>("page");
+    QTest::addColumn<int>("position");                                      //in the page, -1 for its last row
+
+    QTest::newRow("duration desc, middle of a page") << int(ReplayTableModel::Duration) << int(Qt::DescendingOrder) << 3 << 100;
+    QTest::newRow("duration desc, end of a page") << int(ReplayTableModel::Duration) << int(Qt::DescendingOrder) << 5 << -1;
+    QTest::newRow("duration desc, end of a page of NULLs") << int(ReplayTableModel::Duration) << int(Qt::DescendingOrder) << 8 << -1;
+    QTest::newRow("duration desc, among the NULLs") << int(ReplayTableModel::Duration) << int(Qt::DescendingOrder) << 9 << 10;
+    QTest::newRow("date, among the NULLs") << int(ReplayTableModel::Date) << int(Qt::AscendingOrder) << 1 << 200;
+    QTest::newRow("archived, first row") << int(ReplayTableModel::Archived) << int(Qt::AscendingOrder) << 0 << 0;
+    QTest::newRow("match id, end of a page") << -1 << int(Qt::AscendingOrder) << 2 << -1;
+}
+
+/*
+ * The rows removed stay gone for the tests after this one, which compare against the table as it is.
+ * Once a row is gone from the table and replayRemoved() is told, the pages after it start a row later;
+ * the keys where pages start that are still known, and the ones counted again, have to agree with the table as it is now.
+ */
+void tst_ReplayTableModel::removed()
+{
+    QFETCH(int, column);
+    QFETCH(int, order);
+    QFETCH(int, page);
+    QFETCH(int, position);
+
+    ReplayTableModel model(db);
+    model.sort(column, Qt::SortOrder(order));
+    QCOMPARE(shown(model, false), expected("replays r", orderBy(column, order)));
+
+    //every page has been read, so every page's start is known
+    int rows = model.rowCount();
+    int row = page * PageSize + (position < 0 ? PageSize - 1 : position);
+    QVERIFY(row < rows);
+    qint64 matchId = model.replay(row).matchID;
+
+    QSqlQuery query(db);
+    query.prepare("delete from replays where match_id = ?");
+    query.addBindValue(matchId);
+    QVERIFY(query.exec());
+    model.replayRemoved(row);
+    QCOMPARE(model.rowCount(), rows - 1);
+
+    QList<qint64> left = expected("replays r", orderBy(column, order));
+    QVERIFY(!left.contains(matchId));
+    QCOMPARE(shown(model, true), left);
+}
+
+void tst_ReplayTableModel::edited_data()
+{
+    QTest::addColumn<int>("column");
+    QTest::addColumn<int>("order");
+    QTest::addColumn<QString>("field");
+    QTest::addColumn<QString>("value");
+
+    QTest::newRow("title, match id") << -1 << int(Qt::AscendingOrder) << QString("title") << QString("zzz grand final");
+    QTest::newRow("title, by title") << int(ReplayTableModel::Title) << int(Qt::AscendingOrder) << QString("title") << QString("zzz grand final");
+    QTest::newRow("rename, match id") << -1 << int(Qt::AscendingOrder) << QString("filename") << QString("renamed/final.dem");
+    QTest::newRow("rename, by duration desc") << int(ReplayTableModel::Duration) << int(Qt::DescendingOrder) << QString("filename") << QString("renamed/semi final.dem");
+}
+
+/*
+ * A new title or file name for one replay. In match id order it stays where it is: one row is changed
+ * and every cached page stays. Sorted by anything else it may move, so every row is changed and read again.
+ */
+void tst_ReplayTableModel::edited()
+{
+    QFETCH(int, column);
+    QFETCH(int, order);
+    QFETCH(QString, field);
+    QFETCH(QString, value);
+
+    ReplayTableModel model(db);
+    model.sort(column, Qt::SortOrder(order));
+    shown(model, false);
+
+    int rows = model.rowCount();
+    int row = 3 * PageSize + 17;
+    qint64 matchId = model.replay(row).matchID;
+    qint64 first = model.replay(0).matchID;
+    qint64 last = model.replay(rows - 1).matchID;
+
+    QSqlQuery query(db);
+    query.prepare(QString("update replays set %1 = ? where match_id = ?").arg(field));
+    query.addBindValue(value);
+    query.addBindValue(matchId);
+    QVERIFY(query.exec());
+
+    QSignalSpy changed(&model, SIGNAL(dataChanged(QModelIndex,QModelIndex)));
+    QSignalSpy reset(&model, SIGNAL(modelReset()));
+    model.refreshReplay(matchId);
+    QCOMPARE(reset.count(), 0);
+    QCOMPARE(changed.count(), 1);
+
+    QModelIndex topLeft = changed.at(0).at(0).value<QModelIndex>();
+    QModelIndex bottomRight = changed.at(0).at(1).value<QModelIndex>();
+    QCOMPARE(topLeft.column(), 0);
+    QCOMPARE(bottomRight.column(), int(ReplayTableModel::ColumnCount) - 1);
+    if(column < 0)
+    {
+        QCOMPARE(topLeft.row(), row);
+        QCOMPARE(bottomRight.row(), row);
+        QCOMPARE(model.rowOf(matchId), row);
+        QCOMPARE(model.rowOf(first), 0);
+        QCOMPARE(model.rowOf(last), rows - 1);
+    }
+    else
+    {
+        QCOMPARE(topLeft.row(), 0);
+        QCOMPARE(bottomRight.row(), rows - 1);
+        QCOMPARE(model.rowOf(matchId), -1);
+        QCOMPARE(model.rowOf(first), -1);
+    }
+
+    QList<qint64> now = expected("replays r", orderBy(column, order));
+    QCOMPARE(shown(model, false), now);
+    ReplayRow replay = model.replay(now.indexOf(matchId));
+    QCOMPARE(replay.matchID, matchId);
+    QCOMPARE(field == "title" ? replay.title : replay.fileName, value);
+
+    //a row that isn't in a cached page isn't on screen, there is nothing to tell the view
+    ReplayTableModel fresh(db);
+    fresh.sort(column, Qt::SortOrder(order));
+    fresh.replay(0);
+    QSignalSpy freshChanged(&fresh, SIGNAL(dataChanged(QModelIndex,QModelIndex)));
+    fresh.refreshReplay(now.at(rows - 1));
+    QCOMPARE(freshChanged.count(), column < 0 ? 0 : 1);
+}
+
+void tst_ReplayTableModel::deleted_data()
+{
+    QTest::addColumn<int>("column");
+    QTest::addColumn<int>("order");
+
+    QTest::newRow("match id") << -1 << int(Qt::AscendingOrder);
+    QTest::newRow("date desc") << int(ReplayTableModel::Date) << int(Qt::DescendingOrder);
+}
+
+/*
+ * Deleting a replay removes just its row; the cached pages before it stay, the rest are read again, a row up.
+ */
+void tst_ReplayTableModel::deleted()
+{
+    QFETCH(int, column);
+    QFETCH(int, order);
+
+    ReplayTableModel model(db);
+    model.sort(column, Qt::SortOrder(order));
+    shown(model, false);
+
+    int rows = model.rowCount();
+    int row = 4 * PageSize + 5;
+    qint64 matchId = model.replay(row).matchID;
+    qint64 first = model.replay(0).matchID;
+    qint64 pageBefore = model.replay(row - PageSize).matchID;
+    qint64 samePage = model.replay(4 * PageSize).matchID;
+    qint64 pageAfter = model.replay(row + PageSize).matchID;
+
+    QSqlQuery query(db);
+    query.prepare("delete from replays where match_id = ?");
+    query.addBindValue(matchId);
+    QVERIFY(query.exec());
+
+    QSignalSpy removing(&model, SIGNAL(rowsAboutToBeRemoved(QModelIndex,int,int)));
+    QSignalSpy removed(&model, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+    QSignalSpy changed(&model, SIGNAL(dataChanged(QModelIndex,QModelIndex)));
+    QSignalSpy reset(&model, SIGNAL(modelReset()));
+    model.replayRemoved(row);
+    QCOMPARE(reset.count(), 0);
+    QCOMPARE(changed.count(), 0);
+    QCOMPARE(removing.count(), 1);
+    QCOMPARE(removed.count(), 1);
+    QCOMPARE(removed.at(0).at(1).toInt(), row);
+    QCOMPARE(removed.at(0).at(2).toInt(), row);
+    QCOMPARE(model.rowCount(), rows - 1);
+
+    QCOMPARE(model.rowOf(first), 0);
+    QCOMPARE(model.rowOf(pageBefore), row - PageSize);
+    QCOMPARE(model.rowOf(samePage), -1);
+    QCOMPARE(model.rowOf(pageAfter), -1);
+
+    QCOMPARE(shown(model, false), expected("replays r", orderBy(column, order)));
+    QCOMPARE(model.rowOf(samePage), 4 * PageSize);
+    QCOMPARE(model.rowOf(pageAfter), row + PageSize - 1);
+}
+
+/*
+ * Ten rows out of every eleven with a title, no file info block read on one in twenty, one in fifty archived.
+ */
+QSqlDatabase tst_ReplayTableModel::largeDatabase()
+{
+    if(QSqlDatabase::contains("large"))
+        return QSqlDatabase::database("large");
+
+    QSqlDatabase large = QSqlDatabase::addDatabase("QSQLITE", "large");
+    large.setDatabaseName(dir.path() + "/large.db");
+    if(!large.open() || !ReplayIndex(large).createTables())
+        return QSqlDatabase();
+    int root = ReplayIndex(large).rootId(dir.path() + "/large");
+
+    large.transaction();
+    QSqlQuery query(large);
+    query.prepare("insert into replays (title, filename, match_id, root_id, size, modified, duration, game_mode, winner, end_time, info_read, archived) "
+                  "values (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+    for(int i = 0; i < LargeCount; i++)
+    {
+        bool infoRead = i % 20 != 0;
+        query.addBindValue(i % 11 == 0 ? QVariant(QVariant::String) : QVariant(QString("game %1").arg(i % 5000)));
+        query.addBindValue(QString("%1.dem").arg(100000000 + i));
+        query.addBindValue(qint64(100000000 + i));
+        query.addBindValue(root);
+        query.addBindValue(40 * 1024 * 1024);
+        query.addBindValue(1390000000000LL + i);
+        query.addBindValue(infoRead ? QVariant(1200 + (i * 7919) % 3000) : QVariant(QVariant::Int));
+        query.addBindValue(infoRead ? QVariant(GameModes[(i / 3) % 3]) : QVariant(QVariant::String));
+        query.addBindValue(infoRead ? QVariant(i % 2 ? "Radiant" : "Dire") : QVariant(QVariant::String));
+        query.addBindValue(infoRead ? QVariant(qint64(FirstEndTime) + qint64(i) * 60) : QVariant(QVariant::LongLong));
+        query.addBindValue(infoRead ? QVariant(1) : QVariant(QVariant::Int));
+        query.addBindValue(i % 50 == 0 ? QVariant(1) : QVariant(QVariant::Int));
+        if(!query.exec())
+        {
+            large.rollback();
+            return QSqlDatabase();
+        }
+    }
+    large.commit();
+
+    return large;
+}
+
+void tst_ReplayTableModel::benchmarkSort_data()
+{
+    QTest::addColumn<int>("column");
+    QTest::addColumn<int>("order");
+
+    QTest::newRow("match id") << -1 << int(Qt::AscendingOrder);
+    QTest::newRow("title") << int(ReplayTableModel::Title) << int(Qt::AscendingOrder);
+    QTest::newRow("date desc") << int(ReplayTableModel::Date) << int(Qt::DescendingOrder);
+    QTest::newRow("duration") << int(ReplayTableModel::Duration) << int(Qt::AscendingOrder);
+    QTest::newRow("game mode desc") << int(ReplayTableModel::GameMode) << int(Qt::DescendingOrder);
+    QTest::newRow("archived desc") << int(ReplayTableModel::Archived) << int(Qt::DescendingOrder);
+}
+
+/*
+ * Clicking a column header over a million replays: the new sort and the first page of it, which is what the view asks for.
+ */
+void tst_ReplayTableModel::benchmarkSort()
+{
+    QFETCH(int, column);
+    QFETCH(int, order);
+
+    QSqlDatabase large = largeDatabase();
+    QVERIFY(large.isOpen());
+    ReplayTableModel model(large);
+    QCOMPARE(model.rowCount(), int(LargeCount));
+
+    QList<qint64> firstPage;
+    QBENCHMARK
+    {
+        model.sort(column, Qt::SortOrder(order));
+        firstPage.clear();
+        for(int row = 0; row < PageSize; row++)
+            firstPage.append(model.replay(row).matchID);
+    }
+
+    QSqlQuery query(large);
+    query.prepare(QString("select r.match_id from replays r order by %1 limit %2").arg(orderBy(column, order)).arg(int(PageSize)));
+    QVERIFY(query.exec());
+    for(int row = 0; query.next(); row++)
+        QCOMPARE(firstPage.at(row), query.value(0).toLongLong());
+}
+
+void tst_ReplayTableModel::benchmarkJump_data()
+{
+    QTest::addColumn<int>("column");
+    QTest::addColumn<int>("order");
+    QTest::addColumn<int>("row");
+
+    QTest::newRow("match id, middle") << -1 << int(Qt::AscendingOrder) << int(LargeCount / 2);
+    QTest::newRow("match id, bottom") << -1 << int(Qt::AscendingOrder) << int(LargeCount - 1);
+    QTest::newRow("title, middle") << int(ReplayTableModel::Title) << int(Qt::AscendingOrder) << int(LargeCount / 2);
+    QTest::newRow("title, bottom") << int(ReplayTableModel::Title) << int(Qt::AscendingOrder) << int(LargeCount - 1);
+    QTest::newRow("date desc, bottom") << int(ReplayTableModel::Date) << int(Qt::DescendingOrder) << int(LargeCount - 1);
+    QTest::newRow("duration desc, middle") << int(ReplayTableModel::Duration) << int(Qt::DescendingOrder) << int(LargeCount / 2);
+    QTest::newRow("archived, bottom") << int(ReplayTableModel::Archived) << int(Qt::AscendingOrder) << int(LargeCount - 1);
+}
+
+/*
+ * Dragging the scroll bar far down right after a sort, when no page but the first has a known start:
+ * the rows before it are counted on the column's index and then skipped, which grows with how far down the row is.
+ */
+void tst_ReplayTableModel::benchmarkJump()
+{
+    QFETCH(int, column);
+    QFETCH(int, order);
+    QFETCH(int, row);
+
+    QSqlDatabase large = largeDatabase();
+    QVERIFY(large.isOpen());
+    ReplayTableModel model(large);
+
+    qint64 matchId = 0;
+    QBENCHMARK
+    {
+        model.sort(column, Qt::SortOrder(order));
+        matchId = model.replay(row).matchID;
+    }
+
+    QSqlQuery query(large);
+    query.prepare(QString("select r.match_id from replays r order by %1 limit 1 offset %2").arg(orderBy(column, order)).arg(row));
+    QVERIFY(query.exec() && query.next());
+    QCOMPARE(matchId, query.value(0).toLongLong());
+}
+
+QTEST_MAIN(tst_ReplayTableModel)
+
+#include "tst_replaytablemodel.moc"
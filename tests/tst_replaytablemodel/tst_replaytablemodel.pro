@@ -0,0 +1,24 @@
+include(../tests.pri)
+
+QT       += gui widgets network sql
+
+TARGET = tst_replaytablemodel
+
+SOURCES += tst_replaytablemodel.cpp \
+    $$REPLAY_SOURCES \
+    $$SRCDIR/replaytablemodel.cpp \
+    $$SRCDIR/replaysearch.cpp \
+    $$SRCDIR/matchstore.cpp \
+    $$SRCDIR/matchinfo.cpp \
+    $$SRCDIR/matchcache.cpp \
+    $$SRCDIR/jsonreader.cpp \
+    $$SRCDIR/http.cpp \
+    $$SRCDIR/httpcache.cpp
+
+HEADERS += $$SRCDIR/replaytablemodel.h \
+    $$SRCDIR/matchstore.h \
+    $$SRCDIR/matchinfo.h \
+    $$SRCDIR/matchcache.h \
+    $$SRCDIR/jsonreader.h \
+    $$SRCDIR/http.h \
+    $$SRCDIR/httpcache.h
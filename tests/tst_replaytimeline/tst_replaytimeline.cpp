@@ -0,0 +1,304 @@
+#include <QtTest>
+#include <QSqlDatabase>
+
+#include "replayindex.h"
+#include "replaytimeline.h"
+
+typedef QVector<qint64> Series;                                            //a metatype already, as Qt declares every QVector
+
+/*
+ * data/replays/timeline.dem is a Source 2 replay of a few packets, written by make_replays.py:
+ * a CombatLogNames string table (snappy compressed, with key history and user data to step over),
+ * an update adding a hero later on, and combat log entries both on their own and in a bulk message,
+ * among messages the reader has to skip. The totals each hero should end up with are set there.
+ * Full packets at tick 0 and 600 carry a snapshot of the string tables, for the seek index.
+ */
+class tst_ReplayTimeline : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void encode();
+    void roundTrip_data();
+    void roundTrip();
+    void read();
+    void readRange();
+    void defaultSampling();
+    void cutOff();
+    void notSource2();
+    void stored();
+
+private:
+    enum { SampleTicks = 300 };
+    enum { FirstFullPacket = 255, SecondFullPacket = 665 };                  //offsets make_replays.py prints, at tick 0 and 600
+
+    static Series series(const QList<qint64> &values);
+    static QString fixture(const QString &fileName);
+
+    QTemporaryDir dir;
+};
+
+Series tst_ReplayTimeline::series(const QList<qint64> &values)
+{
+    return values.toVector();
+}
+
+QString tst_ReplayTimeline::fixture(const QString &fileName)
+{
+    return QString(TESTDATA_DIR) + "/replays/" + fileName;
+}
+
+//differences from the sample before, zigzagged so small drops are as short as small gains
+void tst_ReplayTimeline::encode()
+{
+    QCOMPARE(ReplayTimeline::encode(Series()), QByteArray());
+    QCOMPARE(ReplayTimeline::encode(series(QList<qint64>() << 1 << 3 << 2)), QByteArray("\x02\x04\x01", 3));
+    QCOMPARE(ReplayTimeline::encode(series(QList<qint64>() << 100 << 164)), QByteArray("\xc8\x01\x80\x01", 4));
+    QCOMPARE(ReplayTimeline::encode(series(QList<qint64>() << 0 << 0 << -64)), QByteArray("\x00\x00\x7f", 3));
+}
+
+void tst_ReplayTimeline::roundTrip_data()
+{
+    QTest::addColumn<Series>("samples");
+
+    QTest::newRow("empty") << Series();
+    QTest::newRow("flat") << series(QList<qint64>() << 0 << 0 << 0 << 0);
+    QTest::newRow("rising") << series(QList<qint64>() << 0 << 150 << 420 << 980 << 2200 << 4100);
+    QTest::newRow("gold lost") << series(QList<qint64>() << 600 << 320 << -40 << 1200 << 1199);
+    QTest::newRow("large") << series(QList<qint64>() << (Q_INT64_C(1) << 40) << -(Q_INT64_C(1) << 40) << 0 << Q_INT64_C(123456789012));
+
+    //the sort of curve a whole game makes, 90 minutes at one sample a minute
+    Series game;
+    qint64 gold = 0;
+    for(int i = 0; i < 90; i++)
+    {
+        gold += 300 + (i * 37) % 250 - (i % 7 == 0 ? 500 : 0);
+        game.append(gold);
+    }
+    QTest::newRow("game") << game;
+}
+
+void tst_ReplayTimeline::roundTrip()
+{
+    QFETCH(Series, samples);
+
+    QByteArray data = ReplayTimeline::encode(samples);
+    QCOMPARE(ReplayTimeline::decode(data), samples);
+
+    //a few bytes a sample is what makes storing every hero's curves cheap
+    if(samples.size() > 10)
+        QVERIFY(data.size() <= samples.size() * 3);
+}
+
+/*
+ * Sampled every 10 seconds: at the packets of tick 0, 400, 700 and 900, each before that packet is read,
+ * and once more at the end. Creeps never get a series, and of the deaths only the ones a hero
+ * got on the other side count: no denies, illusions or hero kills.
+ */
+void tst_ReplayTimeline::read()
+{
+    ReplayTimeline timeline;
+    QVERIFY(TimelineReader(SampleTicks).read(fixture("timeline.dem"), &timeline));
+    QVERIFY(timeline.ok);
+    QVERIFY(timeline.complete);
+    QCOMPARE(timeline.fileName, QString("timeline.dem"));
+    QCOMPARE(timeline.sampleTicks, int(SampleTicks));
+
+    QStringList heroes = timeline.heroes.keys();
+    heroes.sort();
+    QCOMPARE(heroes, QStringList() << "npc_dota_hero_axe" << "npc_dota_hero_lina" << "npc_dota_hero_pudge");
+
+    //gold lost to a death comes through as a negative value
+    HeroTimeline axe = timeline.heroes.value("npc_dota_hero_axe");
+    QCOMPARE(axe.gold, series(QList<qint64>() << 0 << 100 << 100 << 50 << 50));
+    QCOMPARE(axe.xp, series(QList<qint64>() << 0 << 50 << 50 << 50 << 50));
+    QCOMPARE(axe.lastHits, series(QList<qint64>() << 0 << 1 << 1 << 1 << 1));
+
+    //the neutral counts; the xp came in a bulk message
+    HeroTimeline lina = timeline.heroes.value("npc_dota_hero_lina");
+    QCOMPARE(lina.gold, series(QList<qint64>() << 0 << 200 << 200 << 200 << 200));
+    QCOMPARE(lina.xp, series(QList<qint64>() << 0 << 0 << 0 << 120 << 120));
+    QCOMPARE(lina.lastHits, series(QList<qint64>() << 0 << 0 << 1 << 1 << 1));
+
+    //named by the string table update at tick 900, so the samples before are zeros; siege creeps count
+    HeroTimeline pudge = timeline.heroes.value("npc_dota_hero_pudge");
+    QCOMPARE(pudge.gold, series(QList<qint64>() << 0 << 0 << 0 << 0 << 500));
+    QCOMPARE(pudge.xp, series(QList<qint64>() << 0 << 0 << 0 << 0 << 0));
+    QCOMPARE(pudge.lastHits, series(QList<qint64>() << 0 << 0 << 0 << 0 << 1));
+
+    //the seek index comes out of the same pass
+    QCOMPARE(timeline.seekPoints.size(), 2);
+    QCOMPARE(timeline.seekPoints.at(0).tick, 0);
+    QCOMPARE(timeline.seekPoints.at(0).offset, qint64(FirstFullPacket));
+    QCOMPARE(timeline.seekPoints.at(1).tick, 600);
+    QCOMPARE(timeline.seekPoints.at(1).offset, qint64(SecondFullPacket));
+}
+
+/*
+ * Starting at a full packet instead of the top: the names come from its snapshot and the signon packets,
+ * and only what happened from fromTick on counts.
+ */
+void tst_ReplayTimeline::readRange()
+{
+    //from tick 600 on: sampled at 600 and 900, then at the end
+    ReplayTimeline timeline;
+    TimelineReader reader(SampleTicks);
+    QVERIFY(reader.readRange(fixture("timeline.dem"), SecondFullPacket, 600, 1000, &timeline));
+    QVERIFY(timeline.complete);
+    QCOMPARE(timeline.heroes.value("npc_dota_hero_axe").gold, series(QList<qint64>() << 0 << -50 << -50));
+    QCOMPARE(timeline.heroes.value("npc_dota_hero_axe").lastHits, series(QList<qint64>() << 0 << 0 << 0));
+    QCOMPARE(timeline.heroes.value("npc_dota_hero_lina").xp, series(QList<qint64>() << 0 << 120 << 120));
+    //named by an update after the full packet, to a table only the signon packets describe
+    QCOMPARE(timeline.heroes.value("npc_dota_hero_pudge").gold, series(QList<qint64>() << 0 << 0 << 500));
+    QCOMPARE(timeline.heroes.value("npc_dota_hero_pudge").lastHits, series(QList<qint64>() << 0 << 0 << 1));
+
+    //stops at the first packet past toTick
+    QVERIFY(reader.readRange(fixture("timeline.dem"), SecondFullPacket, 600, 800, &timeline));
+    QVERIFY(timeline.complete);
+    QCOMPARE(timeline.heroes.size(), 2);
+    QCOMPARE(timeline.heroes.value("npc_dota_hero_axe").gold, series(QList<qint64>() << 0 << -50));
+
+    //from the first full packet, but what came before tick 300 isn't counted
+    QVERIFY(reader.readRange(fixture("timeline.dem"), FirstFullPacket, 300, 1000, &timeline));
+    QCOMPARE(timeline.heroes.value("npc_dota_hero_axe").gold, series(QList<qint64>() << 0 << 0 << -50 << -50));
+    QCOMPARE(timeline.heroes.value("npc_dota_hero_lina").lastHits, series(QList<qint64>() << 0 << 1 << 1 << 1));
+
+    //all of it is the same as reading from the top
+    ReplayTimeline whole;
+    QVERIFY(reader.read(fixture("timeline.dem"), &whole));
+    QVERIFY(reader.readRange(fixture("timeline.dem"), FirstFullPacket, 0, 1000, &timeline));
+    QCOMPARE(timeline.heroes.keys().toSet(), whole.heroes.keys().toSet());
+    foreach(QString hero, whole.heroes.keys())
+    {
+        QCOMPARE(timeline.heroes.value(hero).gold, whole.heroes.value(hero).gold);
+        QCOMPARE(timeline.heroes.value(hero).xp, whole.heroes.value(hero).xp);
+        QCOMPARE(timeline.heroes.value(hero).lastHits, whole.heroes.value(hero).lastHits);
+    }
+
+    //an offset that isn't a full packet
+    QVERIFY(!reader.readRange(fixture("timeline.dem"), SecondFullPacket + 1, 600, 1000, &timeline));
+    QVERIFY(!reader.readRange(fixture("timeline.dem"), 16, 600, 1000, &timeline));
+}
+
+//the whole replay is shorter than a minute: the sample at the start and the one at the end
+void tst_ReplayTimeline::defaultSampling()
+{
+    ReplayTimeline timeline;
+    QVERIFY(TimelineReader().read(fixture("timeline.dem"), &timeline));
+    QCOMPARE(timeline.sampleTicks, int(TimelineReader::DefaultSampleTicks));
+    QCOMPARE(timeline.heroes.value("npc_dota_hero_axe").gold, series(QList<qint64>() << 0 << 50));
+    QCOMPARE(timeline.heroes.value("npc_dota_hero_lina").xp, series(QList<qint64>() << 0 << 120));
+    QCOMPARE(timeline.heroes.value("npc_dota_hero_pudge").lastHits, series(QList<qint64>() << 0 << 1));
+}
+
+//cut off right before DEM_Stop: every packet was read, but the replay isn't whole
+void tst_ReplayTimeline::cutOff()
+{
+    QFile whole(fixture("timeline.dem"));
+    QVERIFY(whole.open(QIODevice::ReadOnly));
+    QByteArray data = whole.readAll();
+    QVERIFY(data.endsWith(QByteArray("\x00\xe8\x07\x00", 4)));              //DEM_Stop at tick 1000, no payload
+
+    QString fileName = dir.path() + "/timeline.dem";
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(data.left(data.size() - 4));
+    file.close();
+
+    ReplayTimeline timeline;
+    QVERIFY(TimelineReader(SampleTicks).read(fileName, &timeline));
+    QVERIFY(timeline.ok);
+    QVERIFY(!timeline.complete);
+    QCOMPARE(timeline.heroes.value("npc_dota_hero_pudge").lastHits, series(QList<qint64>() << 0 << 0 << 0 << 0 << 1));
+}
+
+void tst_ReplayTimeline::notSource2()
+{
+    ReplayTimeline timeline;
+    QVERIFY(!TimelineReader().read(fixture("source1.dem"), &timeline));
+    QVERIFY(!timeline.ok);
+
+    //a Source 2 replay without a combat log has nothing to show
+    QVERIFY(!TimelineReader().read(fixture("source2.dem"), &timeline));
+    QVERIFY(timeline.heroes.isEmpty());
+}
+
+/*
+ * Through the index: stored per player slot, by the hero the file info block gave that slot,
+ * and decoded back to the same samples.
+ */
+void tst_ReplayTimeline::stored()
+{
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
+        db.setDatabaseName(dir.path() + "/timeline.db");
+        QVERIFY(db.open());
+        QVERIFY(ReplayIndex(db).createTables());
+        int root = ReplayIndex(db).rootId(QString(TESTDATA_DIR) + "/replays");
+        ReplayIndex index(db, root);
+
+        ReplayFile file = ReplayFile::fromFileInfo(QFileInfo(fixture("timeline.dem")));
+        file.rootId = root;
+        QCOMPARE(index.update(QList<ReplayFile>() << file), 1);
+
+        DemoInfo info;
+        info.fileName = file.fileName;
+        QStringList heroes;
+        heroes << "npc_dota_hero_axe" << "npc_dota_hero_lina" << "npc_dota_hero_pudge" << "npc_dota_hero_zuus";
+        foreach(QString hero, heroes)
+        {
+            DemoPlayer player;
+            player.heroName = hero;
+            player.team = info.players.size() < 2 ? 2 : 3;
+            info.players.append(player);
+        }
+        QVERIFY(index.setInfo(QList<DemoInfo>() << info));
+
+        ReplayTimeline timeline;
+        QVERIFY(TimelineReader(SampleTicks).read(fixture("timeline.dem"), &timeline));
+        QVERIFY(index.setTimelines(QList<ReplayTimeline>() << timeline));
+
+        qint64 matchId = index.matchId(file.fileName);
+        for(int slot = 0; slot < 3; slot++)
+        {
+            int sampleTicks = 0;
+            HeroTimeline stored = index.playerTimeline(matchId, slot, &sampleTicks);
+            HeroTimeline read = timeline.heroes.value(heroes.at(slot));
+            QCOMPARE(sampleTicks, int(SampleTicks));
+            QCOMPARE(stored.gold, read.gold);
+            QCOMPARE(stored.xp, read.xp);
+            QCOMPARE(stored.lastHits, read.lastHits);
+        }
+
+        //the last full packet at or before a tick, to start a range read from
+        int startTick = -1;
+        QCOMPARE(index.seekOffset(file.fileName, 650, &startTick), qint64(SecondFullPacket));
+        QCOMPARE(startTick, 600);
+        QCOMPARE(index.seekOffset(file.fileName, 599, &startTick), qint64(FirstFullPacket));
+        QCOMPARE(startTick, 0);
+        ReplayTimeline range;
+        QVERIFY(TimelineReader(SampleTicks).readRange(fixture("timeline.dem"), index.seekOffset(file.fileName, 650), 650, 1000, &range));
+        QCOMPARE(range.heroes.value("npc_dota_hero_pudge").gold.last(), Q_INT64_C(500));
+
+        //gone through once, which scans go by; the file changing is what has it gone through again
+        QVERIFY(index.files().value(file.fileName).timelineRead);
+        ReplayFile changed = file;
+        changed.modified += 1000;
+        QCOMPARE(index.update(QList<ReplayFile>() << changed), 0);
+        QVERIFY(!index.files().value(file.fileName).timelineRead);
+
+        //a hero the replay had nothing on
+        int sampleTicks = -1;
+        HeroTimeline missing = index.playerTimeline(matchId, 3, &sampleTicks);
+        QVERIFY(missing.gold.isEmpty());
+        QVERIFY(missing.lastHits.isEmpty());
+        QCOMPARE(sampleTicks, -1);
+
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+QTEST_MAIN(tst_ReplayTimeline)
+
+#include "tst_replaytimeline.moc"
@@ -0,0 +1,8 @@
+include(../tests.pri)
+
+QT       += sql
+
+TARGET = tst_replaytimeline
+
+SOURCES += tst_replaytimeline.cpp \
+    $$REPLAY_SOURCES